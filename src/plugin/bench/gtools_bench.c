@@ -0,0 +1,681 @@
+/*
+ * Standalone benchmark and regression harness
+ * -------------------------------------------
+ *
+ * Links gtools.c against the in-memory Stata stub (gtools_stub.c) and
+ * times stata_call on synthetic data for a fixed table of scenarios
+ * (hash, sort, collapse, quantiles, hashsort), writing one CSV row per
+ * scenario to stdout. Each row also has the number of groups the plugin
+ * found and a checksum of the data after the call (the plugin writes its
+ * results back to the data), so diffing the rc, J, and checksum columns
+ * of two builds run with the same options catches changes in results.
+ * Before the scenarios it checks that the one-pass accumulators give the
+ * same stats as the functions applied to the buffered group, that the
+ * one-pass sd is within its error bound of the two-pass sd, and that
+ * work stealing runs every item exactly once.
+ *
+ * Build and run with `make bench`; see gtools_bench -h for options.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include "gtools_stub.h"
+#include "common/gttypes.h"
+#include "collapse/gtools_accum.h"
+#include "collapse/gtools_math.h"
+#include "parallel/gtools_threads.h"
+
+STDLL stata_call (int argc, char *argv[]);
+
+#define GTOOLS_BENCH_MAXREPS 64
+#define GTOOLS_BENCH_STRLEN  32
+#define GTOOLS_BENCH_WIDE    244
+#define GTOOLS_BENCH_URLLEN  64
+#define GTOOLS_BENCH_PANEL   20
+
+struct GtoolsBenchScenario {
+    const char *name;
+    const char *command;  // hash, sort, collapse, quantiles, hashsort
+    const char *keys;     // one char per key: i int, I big int, d double, s string, w wide string, u URL, p sorted panel id
+    ST_double  groups;    // <= 1: fraction of N; > 1: number of groups (quantiles: nq)
+    ST_double  skew;      // 0 is uniform; larger concentrates obs in fewer groups
+    ST_double  missing;   // fraction of missing keys and sources
+};
+
+static struct GtoolsBenchScenario GtoolsBenchScenarios[] = {
+    {"hash_int",          "hash",      "i",   0.1,  0, 0},
+    {"hash_bigint",       "hash",      "I",   0.1,  0, 0},
+    {"hash_double",       "hash",      "d",   0.1,  0, 0},
+    {"hash_string",       "hash",      "s",   0.1,  0, 0},
+    {"hash_mixed",        "hash",      "isd", 0.01, 0, 0},
+    {"hash_wide",         "hash",      "w",   0.1,  0, 0},
+    {"hash_strint",       "hash",      "si",  0.01, 0, 0},
+    {"hash_skewed",       "hash",      "I",   0.1,  4, 0},
+    {"hash_missing",      "hash",      "Id",  0.1,  0, 0.2},
+    {"sort_bigint",       "sort",      "I",   0.1,  0, 0},
+    {"sort_double",       "sort",      "d",   0.1,  0, 0},
+    {"sort_doubles",      "sort",      "dId", 0.1,  0, 0},
+    {"sort_string",       "sort",      "s",   0.1,  0, 0},
+    {"sort_url",          "sort",      "u",   0.1,  0, 0},
+    {"sort_mixed",        "sort",      "isd", 0.01, 0, 0},
+    {"sort_strint",       "sort",      "si",  0.01, 0, 0},
+    {"collapse_few",      "collapse",  "i",   100,  0, 0},
+    {"collapse_many",     "collapse",  "I",   0.1,  0, 0},
+    {"collapse_string",   "collapse",  "s",   0.01, 0, 0},
+    {"collapse_skewed",   "collapse",  "I",   0.01, 4, 0},
+    {"collapse_missing",  "collapse",  "Is",  0.01, 0, 0.2},
+    {"collapse_prefix",   "collapse",  "pd",  10,   0, 0},
+    {"collapse_prefix_s", "collapse",  "ps",  10,   0, 0},
+    {"collapse_wide",     "collapse",  "wi",  0.01, 0, 0},
+    {"quantiles_nq10",    "quantiles", "",    10,   0, 0.1},
+    {"quantiles_nq1000",  "quantiles", "",    1000, 0, 0.1},
+    {"hashsort_bigint",   "hashsort",  "I",   0.1,  0, 0},
+    {"hashsort_string",   "hashsort",  "s",   0.1,  0, 0},
+    {"hashsort_url",      "hashsort",  "u",   0.1,  0, 0},
+    {"hashsort_mixed",    "hashsort",  "isd", 0.01, 0, 0},
+    {"sort_prefix",       "sort",      "pId", 0.01, 0, 0},
+    {NULL, NULL, NULL, 0, 0, 0}
+};
+
+// Values of __gtools_hash_method, by name (-m)
+static const char *GtoolsBenchHashMethods[] = {
+    "default", "biject", "spooky", "column", "fast64", NULL
+};
+
+// sum mean sd min max median p90 count nunique
+static ST_double GtoolsBenchStats[] = {-1, -2, -3, -5, -4, 50, 90, -6, -18};
+#define GTOOLS_BENCH_NSTATS (sizeof(GtoolsBenchStats) / sizeof(ST_double))
+
+static uint64_t gb_state;
+
+static ST_double gb_wall_time (void)
+{
+#if defined(_WIN64) || defined(_WIN32)
+    return ((ST_double) clock() / CLOCKS_PER_SEC);
+#else
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ((ST_double) ts.tv_sec + (ST_double) ts.tv_nsec / 1e9);
+#endif
+}
+
+static uint64_t gb_rand (void)
+{
+    gb_state ^= gb_state << 13;
+    gb_state ^= gb_state >> 7;
+    gb_state ^= gb_state << 17;
+    return (gb_state);
+}
+
+static ST_double gb_unif (void)
+{
+    return ((gb_rand() >> 11) * (1.0 / 9007199254740992.0));
+}
+
+/**
+ * @brief Missing value: ., .a, ..., .z about equally often
+ */
+static ST_double gb_missing (void)
+{
+    ST_double z;
+    uint64_t bits = 0x7fe0000000000000ULL + (gb_rand() % 27) * 0x0000010000000000ULL;
+    memcpy(&z, &bits, sizeof z);
+    return (z);
+}
+
+/**
+ * @brief Draw a group in [0, G); with skew > 0 low groups are more likely
+ */
+static uint64_t gb_group (uint64_t G, ST_double skew)
+{
+    uint64_t g;
+    if ( skew <= 0 ) return (gb_rand() % G);
+    g = (uint64_t) floor(G * pow(gb_unif(), 1 + skew));
+    return (g < G? g: G - 1);
+}
+
+/**
+ * @brief Set the scalars and matrices the plugin always reads
+ *
+ * Mirrors what _gtools_internal.ado sets up before calling the plugin,
+ * with every option off.
+ */
+static void gb_defaults (ST_double threads, ST_double method, ST_boolean verbose)
+{
+    ST_int i;
+    char name[GTOOLS_STUB_NAMELEN];
+    ST_double zeros[4]  = {0, 0, 0, 0};
+    ST_double missval   = GTOOLS_STUB_MISSING;
+    const char *scalars[] = {
+        "debug", "verbose", "benchmark", "any_if", "init_targ", "invertix",
+        "skipcheck", "cache", "hash_method", "threads", "weight_code", "weight_pos",
+        "nunique", "seecount", "countonly", "unsorted", "keepmiss", "missing",
+        "nomiss", "replace", "countmiss", "numfmt_max", "numfmt_len",
+        "cleanstr", "colsep_len", "sep_len", "top_groupmiss", "top_miss",
+        "top_other", "top_lmiss", "top_lother", "xtile_xvars", "xtile_nq",
+        "xtile_nq2", "xtile_cutvars", "xtile_ncuts", "xtile_qvars",
+        "xtile_gen", "xtile_pctile", "xtile_genpct", "xtile_pctpct",
+        "xtile_altdef", "xtile_missing", "xtile_strict", "xtile_min",
+        "xtile_method", "xtile_bincount", "xtile__pctile", "xtile_dedup",
+        "xtile_cutifin", "xtile_cutby", "encode", "group_data", "group_fill",
+        "k_stats", "k_vars", "k_targets", "k_group", "group_val", "top_freq",
+        "top_ntop", "top_pct", "kvars", "kvars_int", "kvars_num", "kvars_str",
+        NULL
+    };
+
+    for (i = 0; scalars[i] != NULL; i++) {
+        sprintf(name, "__gtools_%s", scalars[i]);
+        gs_scal_set(name, 0);
+    }
+
+    gs_scal_set("__gtools_threads",    threads);
+    gs_scal_set("__gtools_hash_method", method);
+    gs_scal_set("__gtools_verbose",    verbose);
+    gs_scal_set("__gtools_benchmark",  verbose? 2: 0);
+    gs_scal_set("__gtools_verify",     2);
+    gs_scal_set("__gtools_approx_eps", 0.01);
+
+    gs_mat_set("__gtools_contract_which",  1, 4, zeros);
+    gs_mat_set("__gtools_invert",          1, 1, zeros);
+    gs_mat_set("__gtools_xtile_quantiles", 1, 1, &missval);
+    gs_mat_set("__gtools_xtile_cutoffs",   1, 1, &missval);
+    gs_mat_set("__gtools_group_targets",   1, 3, zeros);
+    gs_mat_set("__gtools_group_init",      1, 3, zeros);
+    gs_mat_set("__gtools_strpos",          1, 1, zeros);
+    gs_mat_set("__gtools_numpos",          1, 1, zeros);
+    gs_mat_set("__gtools_stats",           1, 1, zeros);
+    gs_mat_set("__gtools_pos_targets",     1, 1, zeros);
+    gs_mat_set("__gtools_bylens",          1, 1, zeros);
+    gs_mat_set("__gtools_timings",         9, 4, NULL);
+    gs_macro_set("_r_strategy", "");
+}
+
+/**
+ * @brief Generate the by variables for @keys
+ *
+ * All keys are a function of a single group draw per observation, so
+ * the number of groups is the same regardless of the number of keys.
+ * Strings vary in length (4 to 23 characters) across groups; w is a
+ * string with the same values declared str244; u is the same values
+ * behind a long common prefix, like a URL or a file path (so strings
+ * mostly differ past their 30th byte). The exception is p, a
+ * panel id the data is sorted by (one panel per GTOOLS_BENCH_PANEL
+ * observations).
+ */
+static void gb_gen_keys (const char *keys, ST_int N, uint64_t G, ST_double skew, ST_double missing)
+{
+    ST_int i, k, var, K = strlen(keys), nnum = 0, nstr = 0;
+    ST_double *bylens = calloc(K + 1, sizeof(ST_double));
+    ST_double *numpos = calloc(K + 1, sizeof(ST_double));
+    ST_double *strpos = calloc(K + 1, sizeof(ST_double));
+    uint64_t  *groups = calloc(N + 1, sizeof(uint64_t));
+    char str[GTOOLS_BENCH_URLLEN];
+    ST_double *x;
+    uint64_t g, len;
+
+    if ( (bylens == NULL) || (numpos == NULL) || (strpos == NULL) || (groups == NULL) ) {
+        fprintf(stderr, "gtools_bench: out of memory\n");
+        exit(1702);
+    }
+
+    for (i = 0; i < N; i++)
+        groups[i] = gb_group(G, skew);
+
+    for (k = 0; k < K; k++) {
+        if ( (keys[k] == 's') || (keys[k] == 'w') || (keys[k] == 'u') ) {
+            var = gs_add_str();
+            bylens[k] = (keys[k] == 'w')? GTOOLS_BENCH_WIDE:
+                        (keys[k] == 'u')? GTOOLS_BENCH_URLLEN - 1: GTOOLS_BENCH_STRLEN - 1;
+            strpos[nstr++] = k + 1;
+            for (i = 0; i < N; i++) {
+                if ( gb_unif() < missing ) continue;
+                g   = groups[i] * (k + 1);
+                len = 4 + (g * 2654435761ULL) % 20;
+                sprintf(str, "%s%0*llu", (keys[k] == 'u')? "https://example.org/data/files/": "",
+                        (int) len, (unsigned long long) g);
+                gs_set_str(var, i + 1, str);
+            }
+        }
+        else {
+            var = gs_add_num();
+            x   = gs_num(var);
+            numpos[nnum++] = k + 1;
+            for (i = 0; i < N; i++) {
+                g = groups[i];
+                if ( gb_unif() < missing ) {
+                    x[i] = gb_missing();
+                }
+                else if ( keys[k] == 'i' ) {
+                    x[i] = (ST_double) g;
+                }
+                else if ( keys[k] == 'p' ) {
+                    x[i] = (ST_double) (i / GTOOLS_BENCH_PANEL);
+                }
+                else if ( keys[k] == 'I' ) {
+                    x[i] = (ST_double) g * 1000003 - 5e8;
+                }
+                else {
+                    x[i] = (ST_double) g / 7 - 1e3;
+                }
+            }
+        }
+    }
+
+    gs_scal_set("__gtools_kvars",     K);
+    gs_scal_set("__gtools_kvars_num", nnum);
+    gs_scal_set("__gtools_kvars_str", nstr);
+    gs_scal_set("__gtools_missing",   missing > 0);
+
+    gs_mat_set("__gtools_bylens", 1, K, bylens);
+    gs_mat_set("__gtools_invert", 1, K, NULL);
+    if ( nnum ) gs_mat_set("__gtools_numpos", 1, nnum, numpos);
+    if ( nstr ) gs_mat_set("__gtools_strpos", 1, nstr, strpos);
+
+    free(bylens);
+    free(numpos);
+    free(strpos);
+    free(groups);
+}
+
+/**
+ * @brief Add a numeric source variable with a share @missing of missing values
+ */
+static void gb_gen_source (ST_int N, ST_double missing)
+{
+    ST_int i;
+    ST_double *x = gs_num(gs_add_num());
+    for (i = 0; i < N; i++)
+        x[i] = gb_unif() < missing? gb_missing(): gb_unif() * gb_unif() * 1000 - 100;
+}
+
+/**
+ * @brief Set up the data and info for @sc and run it once
+ *
+ * @return plugin return code; @seconds is the time spent in stata_call
+ */
+static ST_retcode gb_run (
+    struct GtoolsBenchScenario *sc,
+    ST_int N,
+    ST_double threads,
+    ST_double method,
+    ST_boolean verbose,
+    uint64_t seed,
+    const char *tmpfile,
+    ST_double *seconds)
+{
+    ST_int s;
+    ST_retcode rc;
+    ST_double start, targets[GTOOLS_BENCH_NSTATS];
+    uint64_t G = sc->groups > 1? (uint64_t) sc->groups: (uint64_t) ceil(sc->groups * N);
+    char *argv[3];
+
+    gb_state = seed;
+    gs_data_reset(N);
+    gb_defaults(threads, method, verbose);
+
+    if ( strcmp(sc->command, "quantiles") == 0 ) {
+        gs_add_num();  // xtile
+        gs_add_num();  // pctile
+        gb_gen_source(N, sc->missing);
+        gs_scal_set("__gtools_xtile_xvars",  1);
+        gs_scal_set("__gtools_xtile_nq",     (ST_double) G);
+        gs_scal_set("__gtools_xtile_gen",    1);
+        gs_scal_set("__gtools_xtile_pctile", 1);
+        gs_scal_set("__gtools_xtile_min",    1);
+        argv[0] = "quantiles";
+    }
+    else {
+        gb_gen_keys(sc->keys, N, G > 0? G: 1, sc->skew, sc->missing);
+        if ( strcmp(sc->command, "hashsort") == 0 ) {
+            gs_add_num();  // _sortindex
+            argv[0] = "hashsort";
+        }
+        else if ( strcmp(sc->command, "collapse") == 0 ) {
+            gb_gen_source(N, sc->missing);
+            for (s = 0; s < (ST_int) GTOOLS_BENCH_NSTATS; s++) {
+                gs_add_num();
+                targets[s] = 0;
+            }
+            gs_scal_set("__gtools_k_vars",    1);
+            gs_scal_set("__gtools_k_targets", GTOOLS_BENCH_NSTATS);
+            gs_scal_set("__gtools_k_stats",   GTOOLS_BENCH_NSTATS);
+            gs_scal_set("__gtools_nunique",   1);
+            gs_mat_set("__gtools_stats",       1, GTOOLS_BENCH_NSTATS, GtoolsBenchStats);
+            gs_mat_set("__gtools_pos_targets", 1, GTOOLS_BENCH_NSTATS, targets);
+            argv[0] = "collapse";
+            argv[1] = "memory";
+            argv[2] = (char *) tmpfile;
+        }
+        else {
+            gb_gen_source(N, sc->missing);
+            gs_scal_set("__gtools_unsorted", strcmp(sc->command, "hash") == 0);
+            argv[0] = "hash";
+        }
+    }
+
+    start    = gb_wall_time();
+    rc       = stata_call(strcmp(sc->command, "collapse") == 0? 3: 1, argv);
+    *seconds = gb_wall_time() - start;
+
+    remove(tmpfile);
+    return (rc);
+}
+
+// Stats with both a one-pass accumulator (gf_accum_stat) and a
+// function of the buffered non-missing values (gf_switch_fun_code)
+static ST_double GtoolsBenchAccumStats[] = {
+    -1, -2, -3, -4, -5, -15, -16, -17
+};
+#define GTOOLS_BENCH_NACCUM (sizeof(GtoolsBenchAccumStats) / sizeof(ST_double))
+
+/**
+ * @brief Check the one-pass accumulators against the buffered stats
+ *
+ * For runs of general values, of 0/1 values, and of non-negative
+ * values (each with some missing values), accumulates the run with
+ * gf_accum_update and compares every stat to the one sf_egen_bulk
+ * computes from the buffered non-missing values. Sums are added in a
+ * different order and the sd is computed in one pass instead of two,
+ * so the stats may differ by a relative 1e-10; the count and the first
+ * and last non-missing values must match exactly.
+ *
+ * @return Number of mismatches (each is printed to stderr)
+ */
+static int gb_check_accum (uint64_t seed)
+{
+    int failed = 0;
+    GT_size n = 1000, nnm, i, t, k;
+    ST_double x[1000], buf[1000], y, z, tol;
+    struct GtoolsAccum accum;
+
+    gb_state = seed;
+    for (t = 0; t < 3; t++) {
+        memset(&accum, '\0', sizeof accum);
+        for (i = nnm = 0; i < n; i++) {
+            if ( gb_unif() < 0.1 ) x[i] = gb_missing();
+            else if ( t == 1 ) x[i] = gb_unif() < 0.5;
+            else if ( t == 2 ) x[i] = floor(gb_unif() * 20);
+            else x[i] = gb_unif() * 1000 - 100;
+            if ( !SF_is_missing(x[i]) ) buf[nnm++] = x[i];
+            gf_accum_update(&accum, x[i], i == 0, i == n - 1);
+        }
+
+        if ( (accum.nonmiss != nnm) || (accum.firstnm != buf[0]) || (accum.lastnm != buf[nnm - 1]) ) {
+            fprintf(stderr, "gtools_bench: gf_accum_update (data %d) counts "GT_size_cfmt
+                            " non-missing values from %.17g to %.17g instead of "
+                            GT_size_cfmt" from %.17g to %.17g\n",
+                    (int) t, accum.nonmiss, accum.firstnm, accum.lastnm, nnm, buf[0], buf[nnm - 1]);
+            failed++;
+        }
+
+        for (k = 0; k < GTOOLS_BENCH_NACCUM; k++) {
+            y   = gf_switch_fun_code(GtoolsBenchAccumStats[k], buf, 0, nnm);
+            z   = gf_accum_stat(&accum, GtoolsBenchAccumStats[k], n, n, 0);
+            tol = 1e-10 * (fabs(y) > 1? fabs(y): 1);
+            if ( SF_is_missing(y) && SF_is_missing(z) && (y == z) ) continue;
+            if ( !SF_is_missing(y) && !SF_is_missing(z) && (fabs(y - z) <= tol) ) continue;
+            fprintf(stderr, "gtools_bench: gf_accum_stat (data %d) gives %.17g"
+                            " for stat %g instead of %.17g\n",
+                    (int) t, z, GtoolsBenchAccumStats[k], y);
+            failed++;
+        }
+    }
+
+    return (failed);
+}
+
+/**
+ * @brief Count the calls for each item (gb_check_steal)
+ */
+static ST_retcode gb_steal_count (void *context, GT_size worker, GT_size item)
+{
+    ((GT_size *) context)[item]++;
+    return (0);
+}
+
+/**
+ * @brief Check that gf_pool_steal runs every item exactly once
+ *
+ * Items have very uneven costs (one item costs as much as all the rest,
+ * some cost nothing) so that workers run out of work and steal.
+ *
+ * @return Number of failures (each is printed to stderr)
+ */
+static int gb_check_steal (uint64_t seed, ST_double threads)
+{
+    int failed = 0;
+    GT_size n = 100000, i, w, total, nworkers[] = {1, 2, 3, 8};
+    GT_size *cost  = calloc(n, sizeof *cost);
+    GT_size *count = calloc(n, sizeof *count);
+
+    if ( (cost == NULL) || (count == NULL) || gf_pool_init((GT_size) threads) ) {
+        fprintf(stderr, "gtools_bench: out of memory\n");
+        free (cost);
+        free (count);
+        return (1);
+    }
+
+    gb_state = seed;
+    for (i = total = 0; i < n; i++) {
+        cost[i] = gb_unif() < 0.1? 0: (GT_size) (gb_unif() * 100);
+        total  += cost[i];
+    }
+    cost[n / 3] = total;
+
+    for (w = 0; w < sizeof(nworkers) / sizeof(GT_size); w++) {
+        memset(count, '\0', n * sizeof *count);
+        if ( gf_pool_steal(gb_steal_count, count, cost, n, nworkers[w]) ) failed++;
+        for (i = 0; i < n; i++) {
+            if ( count[i] == 1 ) continue;
+            fprintf(stderr, "gtools_bench: gf_pool_steal with "GT_size_cfmt" workers"
+                            " ran item "GT_size_cfmt" "GT_size_cfmt" times\n",
+                    nworkers[w], i, count[i]);
+            failed++;
+            break;
+        }
+    }
+
+    free (cost);
+    free (count);
+    return (failed);
+}
+
+/**
+ * @brief Check the one-pass sd against the two-pass sd
+ *
+ * For several sizes and kinds of data (including a large offset and a
+ * first value far from the rest), the relative difference must be
+ * within 4 * n * DBL_EPSILON * (1 + r^2), r = (mean - v[0]) / sd; see
+ * gtools_simd.h for the derivation.
+ *
+ * @return Number of failures (each is printed to stderr)
+ */
+static int gb_check_sd (uint64_t seed)
+{
+    int failed = 0;
+    GT_size n, i, s, t, sizes[] = {2, 3, 17, 1000, 1000000};
+    ST_double *x, mean, ss, sd2, sd1, r, bound;
+
+    if ( (x = malloc(1000000 * sizeof *x)) == NULL ) {
+        fprintf(stderr, "gtools_bench: out of memory\n");
+        return (1);
+    }
+
+    gb_state = seed;
+    for (t = 0; t < 3; t++) {
+        for (s = 0; s < sizeof(sizes) / sizeof(GT_size); s++) {
+            n = sizes[s];
+            for (i = 0; i < n; i++) {
+                if ( t == 0 ) x[i] = gb_unif() * 1000 - 100;
+                else if ( t == 1 ) x[i] = 1e6 + gb_unif();
+                else x[i] = gb_unif();
+            }
+            if ( t == 2 ) x[0] = 1e4;
+
+            mean = 0;
+            for (i = 0; i < n; i++)
+                mean += x[i];
+            mean /= n;
+
+            ss = 0;
+            for (i = 0; i < n; i++)
+                ss += (x[i] - mean) * (x[i] - mean);
+            sd2 = sqrt(ss / (n - 1));
+
+            sd1   = gf_array_dsd_range(x, 0, n);
+            r     = (mean - x[0]) / sd2;
+            bound = 4 * n * DBL_EPSILON * (1 + r * r);
+            if ( fabs(sd1 - sd2) > bound * sd2 ) {
+                fprintf(stderr, "gtools_bench: one-pass sd (data %d, n = %d) is %.17g instead of"
+                                " %.17g (relative error %.3g > bound %.3g)\n",
+                        (int) t, (int) n, sd1, sd2, fabs(sd1 - sd2) / sd2, bound);
+                failed++;
+            }
+        }
+    }
+
+    free(x);
+    return (failed);
+}
+
+static int gb_cmp_double (const void *a, const void *b)
+{
+    ST_double x = *(const ST_double *) a, y = *(const ST_double *) b;
+    return ((x > y) - (x < y));
+}
+
+static void gb_usage (void)
+{
+    fprintf(stderr,
+        "usage: gtools_bench [-n N] [-r reps] [-t threads] [-m method] [-s seed] [-d dir] [-f filter] [-l] [-v]\n"
+        "\n"
+        "    -n N        observations per scenario (default 1000000)\n"
+        "    -r reps     timed runs per scenario (default 3, max %d)\n"
+        "    -t threads  value of __gtools_threads (default 1)\n"
+        "    -m method   hash method: default, biject, spooky, column, or fast64\n"
+        "    -s seed     seed for the synthetic data (default 1)\n"
+        "    -d dir      directory for temporary files (default .)\n"
+        "    -f filter   only run scenarios whose name contains filter\n"
+        "    -l          list scenarios and exit\n"
+        "    -v          print the plugin's verbose output and step timers to stderr\n"
+        "\n"
+        "Writes one CSV row per scenario to stdout. rc, J, and checksum only\n"
+        "depend on the options and the results of the plugin, so they can be\n"
+        "diffed across builds to check for regressions. Exits with a non-zero\n"
+        "code if a scenario fails, if the accumulated stats do not match the\n"
+        "stats computed from the buffered data, if the one-pass sd is outside\n"
+        "its error bound, or if work stealing skips or repeats an item.\n",
+        GTOOLS_BENCH_MAXREPS
+    );
+}
+
+int main (int argc, char *argv[])
+{
+    int a, r, m, failed = 0;
+    ST_boolean verbose = 0;
+    ST_int N = 1000000, reps = 3;
+    ST_double J, threads = 1, method = 0, seconds[GTOOLS_BENCH_MAXREPS];
+    ST_retcode rc;
+    uint64_t seed = 1, checksum;
+    const char *dir = ".", *filter = NULL;
+    char *tmpfile;
+    struct GtoolsBenchScenario *sc;
+
+    for (a = 1; a < argc; a++) {
+        if ( strcmp(argv[a], "-l") == 0 ) {
+            for (sc = GtoolsBenchScenarios; sc->name != NULL; sc++)
+                printf("%s\n", sc->name);
+            return (0);
+        }
+        else if ( strcmp(argv[a], "-v") == 0 ) {
+            verbose = 1;
+        }
+        else if ( (strcmp(argv[a], "-h") == 0) || (a + 1 >= argc) ) {
+            gb_usage();
+            return (strcmp(argv[a], "-h") == 0? 0: 198);
+        }
+        else if ( strcmp(argv[a], "-n") == 0 ) N       = atoi(argv[++a]);
+        else if ( strcmp(argv[a], "-r") == 0 ) reps    = atoi(argv[++a]);
+        else if ( strcmp(argv[a], "-t") == 0 ) threads = atof(argv[++a]);
+        else if ( strcmp(argv[a], "-m") == 0 ) {
+            for (m = 0; GtoolsBenchHashMethods[m] != NULL; m++) {
+                if ( strcmp(argv[a + 1], GtoolsBenchHashMethods[m]) == 0 ) break;
+            }
+            if ( GtoolsBenchHashMethods[m] == NULL ) {
+                gb_usage();
+                return (198);
+            }
+            method = m;
+            a++;
+        }
+        else if ( strcmp(argv[a], "-s") == 0 ) seed    = strtoull(argv[++a], NULL, 10);
+        else if ( strcmp(argv[a], "-d") == 0 ) dir     = argv[++a];
+        else if ( strcmp(argv[a], "-f") == 0 ) filter  = argv[++a];
+        else {
+            gb_usage();
+            return (198);
+        }
+    }
+
+    if ( (N < 1) || (reps < 1) || (reps > GTOOLS_BENCH_MAXREPS) ) {
+        gb_usage();
+        return (198);
+    }
+
+    // xorshift gets stuck at 0
+    if ( seed == 0 ) seed = 1;
+
+    if ( (tmpfile = malloc(strlen(dir) + 32)) == NULL ) {
+        fprintf(stderr, "gtools_bench: out of memory\n");
+        return (1702);
+    }
+    sprintf(tmpfile, "%s/__gtools_bench_collapse.tmp", dir);
+
+    gs_stub_init();
+    gs_stub_quiet(!verbose);
+    if ( gb_check_accum(seed) )          failed = 1;
+    if ( gb_check_sd(seed) )             failed = 1;
+    if ( gb_check_steal(seed, threads) ) failed = 1;
+
+    printf("scenario,command,keys,N,groups,skew,missing,threads,reps,"
+           "rc,J,min_seconds,median_seconds,checksum,strategy\n");
+
+    for (sc = GtoolsBenchScenarios; sc->name != NULL; sc++) {
+        if ( (filter != NULL) && (strstr(sc->name, filter) == NULL) ) continue;
+
+        rc = 0;
+        for (r = 0; (r < reps) && (rc == 0); r++)
+            rc = gb_run(sc, N, threads, method, verbose, seed, tmpfile, seconds + r);
+
+        checksum = gs_data_checksum();
+        J = rc == 0? atof(gs_macro_get("_r_J")): 0;
+        qsort(seconds, r, sizeof(ST_double), gb_cmp_double);
+        printf("%s,%s,%s,%d,%g,%g,%g,%g,%d,%d,%.0f,%.6f,%.6f,%016llx,%s\n",
+               sc->name,
+               sc->command,
+               sc->keys,
+               N,
+               sc->groups,
+               sc->skew,
+               sc->missing,
+               threads,
+               r,
+               rc,
+               J,
+               seconds[0],
+               seconds[r / 2],
+               (unsigned long long) checksum,
+               gs_macro_get("_r_strategy"));
+        fflush(stdout);
+
+        if ( rc ) failed = 1;
+    }
+
+    gs_stub_free();
+    free(tmpfile);
+    return (failed);
+}
@@ -0,0 +1,511 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gtools_stub.h"
+
+static ST_plugin GtoolsStub;
+
+static struct GtoolsStubVar    *gs_vars    = NULL;
+static struct GtoolsStubScalar *gs_scalars = NULL;
+static struct GtoolsStubMatrix *gs_mats    = NULL;
+static struct GtoolsStubMacro  *gs_macros  = NULL;
+
+static ST_int gs_nobs    = 0;
+static ST_int gs_nvars   = 0;
+static ST_int gs_nscalar = 0;
+static ST_int gs_nmat    = 0;
+static ST_int gs_nmacro  = 0;
+static ST_int gs_in1     = 1;
+static ST_int gs_in2     = 0;
+
+static ST_ubyte   *gs_ifmask = NULL;
+static ST_boolean gs_quiet   = 1;
+
+static void *gs_grow (void *ptr, ST_int n, size_t size)
+{
+    void *grown = realloc(ptr, (n + 1) * size);
+    if ( grown == NULL ) {
+        fprintf(stderr, "gtools stub: out of memory\n");
+        exit(1702);
+    }
+    return (grown);
+}
+
+static struct GtoolsStubScalar *gs_find_scalar (const char *name)
+{
+    ST_int i;
+    for (i = 0; i < gs_nscalar; i++) {
+        if ( strcmp(gs_scalars[i].name, name) == 0 ) return (gs_scalars + i);
+    }
+    return (NULL);
+}
+
+static struct GtoolsStubMatrix *gs_find_mat (const char *name)
+{
+    ST_int i;
+    for (i = 0; i < gs_nmat; i++) {
+        if ( strcmp(gs_mats[i].name, name) == 0 ) return (gs_mats + i);
+    }
+    return (NULL);
+}
+
+static struct GtoolsStubMacro *gs_find_macro (const char *name)
+{
+    ST_int i;
+    for (i = 0; i < gs_nmacro; i++) {
+        if ( strcmp(gs_macros[i].name, name) == 0 ) return (gs_macros + i);
+    }
+    return (NULL);
+}
+
+static ST_boolean gs_bad_obs (ST_int var, ST_int obs, ST_boolean isstr)
+{
+    return ((var < 1) || (var > gs_nvars) || (obs < 1) || (obs > gs_nobs)
+            || (gs_vars[var - 1].isstr != isstr));
+}
+
+/*********************************************************************
+ *                        Plugin entry points                        *
+ *********************************************************************/
+
+static ST_int gs_display (char *str)
+{
+    if ( !gs_quiet ) fputs(str, stderr);
+    return (0);
+}
+
+static ST_int gs_error (char *str)
+{
+    fputs(str, stderr);
+    return (0);
+}
+
+static ST_int gs_macro_save (char *macro, char *value)
+{
+    return (gs_macro_set(macro, value));
+}
+
+static ST_int gs_macro_use (char *macro, char *contents, ST_int maxlen)
+{
+    struct GtoolsStubMacro *m = gs_find_macro(macro);
+    if ( maxlen < 1 ) return (198);
+    strncpy(contents, m == NULL? "": m->value, maxlen - 1);
+    contents[maxlen - 1] = '\0';
+    return (0);
+}
+
+static ST_int gs_scal_use (char *scal, ST_double *value)
+{
+    struct GtoolsStubScalar *s = gs_find_scalar(scal);
+    if ( s == NULL ) return (111);
+    *value = s->value;
+    return (0);
+}
+
+static ST_int gs_scal_save (char *scal, ST_double value)
+{
+    return (gs_scal_set(scal, value));
+}
+
+static ST_int gs_scal_savep (char *scal, ST_double *value)
+{
+    return (gs_scal_set(scal, *value));
+}
+
+static ST_int gs_mat_el (char *mat, ST_int row, ST_int col, ST_double *value)
+{
+    struct GtoolsStubMatrix *m = gs_find_mat(mat);
+    if ( m == NULL ) return (111);
+    if ( (row < 1) || (col < 1) || (row > m->rows) || (col > m->cols) ) return (503);
+    *value = m->values[(row - 1) * m->cols + (col - 1)];
+    return (0);
+}
+
+static ST_int gs_mat_store (char *mat, ST_int row, ST_int col, ST_double value)
+{
+    struct GtoolsStubMatrix *m = gs_find_mat(mat);
+    if ( m == NULL ) return (111);
+    if ( (row < 1) || (col < 1) || (row > m->rows) || (col > m->cols) ) return (503);
+    m->values[(row - 1) * m->cols + (col - 1)] = value;
+    return (0);
+}
+
+static ST_int gs_colsof (char *mat)
+{
+    struct GtoolsStubMatrix *m = gs_find_mat(mat);
+    return (m == NULL? 0: m->cols);
+}
+
+static ST_int gs_rowsof (char *mat)
+{
+    struct GtoolsStubMatrix *m = gs_find_mat(mat);
+    return (m == NULL? 0: m->rows);
+}
+
+static ST_int gs_vdata (ST_int var, ST_int obs, ST_double *value)
+{
+    if ( gs_bad_obs(var, obs, 0) ) return (198);
+    *value = gs_vars[var - 1].num[obs - 1];
+    return (0);
+}
+
+static ST_int gs_vstore (ST_int var, ST_int obs, ST_double value)
+{
+    if ( gs_bad_obs(var, obs, 0) ) return (198);
+    gs_vars[var - 1].num[obs - 1] = value;
+    return (0);
+}
+
+static ST_int gs_sdata (ST_int var, ST_int obs, char *value)
+{
+    if ( gs_bad_obs(var, obs, 1) ) return (198);
+    strcpy(value, gs_vars[var - 1].str[obs - 1]);
+    return (0);
+}
+
+static ST_int gs_sstore (ST_int var, ST_int obs, char *value)
+{
+    return (gs_set_str(var, obs, value));
+}
+
+static ST_boolean gs_selobs (ST_int obs)
+{
+    return (gs_ifmask == NULL? 1: gs_ifmask[obs - 1]);
+}
+
+static ST_int gs_nobs1 (void)
+{
+    return (gs_in1);
+}
+
+static ST_int gs_nobs2 (void)
+{
+    return (gs_in2);
+}
+
+static ST_int gs_nobs_fcn (void)
+{
+    return (gs_nobs);
+}
+
+static ST_int gs_nvar_fcn (void)
+{
+    return (gs_nvars);
+}
+
+static ST_boolean gs_ismissing (ST_double z)
+{
+    return (z >= GTOOLS_STUB_MISSING);
+}
+
+/*********************************************************************
+ *                             Stub setup                            *
+ *********************************************************************/
+
+/**
+ * @brief Point the plugin interface at the in-memory stub
+ */
+void gs_stub_init (void)
+{
+    memset(&GtoolsStub, 0, sizeof GtoolsStub);
+
+    GtoolsStub.spoutsml     = gs_display;
+    GtoolsStub.spoutnosml   = gs_display;
+    GtoolsStub.spouterr     = gs_error;
+    GtoolsStub.macresave    = gs_macro_save;
+    GtoolsStub.macuse       = gs_macro_use;
+    GtoolsStub.scalaruse    = gs_scal_use;
+    GtoolsStub.scalarsave   = gs_scal_savep;
+    GtoolsStub.scalsave     = gs_scal_save;
+    GtoolsStub.matel        = gs_mat_el;
+    GtoolsStub.safematel    = gs_mat_el;
+    GtoolsStub.matstore     = gs_mat_store;
+    GtoolsStub.safematstore = gs_mat_store;
+    GtoolsStub.colsof       = gs_colsof;
+    GtoolsStub.rowsof       = gs_rowsof;
+    GtoolsStub.vdata        = gs_vdata;
+    GtoolsStub.safevdata    = gs_vdata;
+    GtoolsStub.store        = gs_vstore;
+    GtoolsStub.safestore    = gs_vstore;
+    GtoolsStub.sdata        = gs_sdata;
+    GtoolsStub.sstore       = gs_sstore;
+    GtoolsStub.selobs       = gs_selobs;
+    GtoolsStub.nobs1        = gs_nobs1;
+    GtoolsStub.nobs2        = gs_nobs2;
+    GtoolsStub.nobs         = gs_nobs_fcn;
+    GtoolsStub.nvar         = gs_nvar_fcn;
+    GtoolsStub.nvars        = gs_nvar_fcn;
+    GtoolsStub.missval      = GTOOLS_STUB_MISSING;
+    GtoolsStub.ismissing    = gs_ismissing;
+
+    pginit(&GtoolsStub);
+}
+
+/**
+ * @brief Free the data, scalars, matrices, and macros in the stub
+ */
+void gs_stub_free (void)
+{
+    ST_int i;
+
+    gs_data_reset(0);
+
+    for (i = 0; i < gs_nmat; i++)
+        free(gs_mats[i].values);
+
+    for (i = 0; i < gs_nmacro; i++)
+        free(gs_macros[i].value);
+
+    free(gs_scalars);
+    free(gs_mats);
+    free(gs_macros);
+
+    gs_scalars = NULL;
+    gs_mats    = NULL;
+    gs_macros  = NULL;
+    gs_nscalar = gs_nmat = gs_nmacro = 0;
+}
+
+/**
+ * @brief Whether to discard the plugin's printed (non-error) output
+ *
+ * Printed output goes to stderr, same as errors, so it does not get
+ * mixed in with whatever the caller writes to stdout.
+ */
+void gs_stub_quiet (ST_boolean quiet)
+{
+    gs_quiet = quiet;
+}
+
+/**
+ * @brief Drop all variables and the if mask and set the number of obs
+ *
+ * @param nobs Number of observations; in range is 1 to @nobs
+ */
+void gs_data_reset (ST_int nobs)
+{
+    ST_int k, i;
+    for (k = 0; k < gs_nvars; k++) {
+        if ( gs_vars[k].isstr ) {
+            for (i = 0; i < gs_nobs; i++)
+                free(gs_vars[k].str[i]);
+            free(gs_vars[k].str);
+        }
+        else {
+            free(gs_vars[k].num);
+        }
+    }
+
+    free(gs_vars);
+    free(gs_ifmask);
+
+    gs_vars   = NULL;
+    gs_ifmask = NULL;
+    gs_nvars  = 0;
+    gs_nobs   = nobs;
+    gs_in1    = 1;
+    gs_in2    = nobs;
+}
+
+/*********************************************************************
+ *                           Data and info                           *
+ *********************************************************************/
+
+/**
+ * @brief Add a numeric variable, initialized to 0
+ *
+ * @return Index of the new variable
+ */
+ST_int gs_add_num (void)
+{
+    gs_vars = gs_grow(gs_vars, gs_nvars, sizeof *gs_vars);
+    gs_vars[gs_nvars].isstr = 0;
+    gs_vars[gs_nvars].str   = NULL;
+    gs_vars[gs_nvars].num   = calloc(gs_nobs > 0? gs_nobs: 1, sizeof(ST_double));
+    if ( gs_vars[gs_nvars].num == NULL ) {
+        fprintf(stderr, "gtools stub: out of memory\n");
+        exit(1702);
+    }
+    return (++gs_nvars);
+}
+
+/**
+ * @brief Add a string variable, initialized to ""
+ *
+ * @return Index of the new variable
+ */
+ST_int gs_add_str (void)
+{
+    ST_int i;
+    gs_vars = gs_grow(gs_vars, gs_nvars, sizeof *gs_vars);
+    gs_vars[gs_nvars].isstr = 1;
+    gs_vars[gs_nvars].num   = NULL;
+    gs_vars[gs_nvars].str   = calloc(gs_nobs > 0? gs_nobs: 1, sizeof(char *));
+    if ( gs_vars[gs_nvars].str == NULL ) {
+        fprintf(stderr, "gtools stub: out of memory\n");
+        exit(1702);
+    }
+    for (i = 0; i < gs_nobs; i++) {
+        if ( (gs_vars[gs_nvars].str[i] = calloc(1, sizeof(char))) == NULL ) {
+            fprintf(stderr, "gtools stub: out of memory\n");
+            exit(1702);
+        }
+    }
+    return (++gs_nvars);
+}
+
+/**
+ * @brief Column array backing numeric variable @var
+ */
+ST_double *gs_num (ST_int var)
+{
+    if ( (var < 1) || (var > gs_nvars) || gs_vars[var - 1].isstr ) return (NULL);
+    return (gs_vars[var - 1].num);
+}
+
+/**
+ * @brief Store @value in string variable @var, observation @obs
+ */
+ST_int gs_set_str (ST_int var, ST_int obs, const char *value)
+{
+    char *copy;
+    if ( gs_bad_obs(var, obs, 1) ) return (198);
+    if ( (copy = malloc(strlen(value) + 1)) == NULL ) return (1702);
+    strcpy(copy, value);
+    free(gs_vars[var - 1].str[obs - 1]);
+    gs_vars[var - 1].str[obs - 1] = copy;
+    return (0);
+}
+
+/**
+ * @brief Set the if condition; NULL selects every observation
+ *
+ * @param mask Array of length nobs; observation i is selected if mask[i - 1]
+ */
+ST_int gs_set_if (const ST_ubyte *mask)
+{
+    free(gs_ifmask);
+    gs_ifmask = NULL;
+    if ( mask == NULL ) return (0);
+    if ( (gs_ifmask = malloc(gs_nobs > 0? gs_nobs: 1)) == NULL ) return (1702);
+    memcpy(gs_ifmask, mask, gs_nobs);
+    return (0);
+}
+
+ST_int gs_scal_set (const char *name, ST_double value)
+{
+    struct GtoolsStubScalar *s = gs_find_scalar(name);
+    if ( strlen(name) >= GTOOLS_STUB_NAMELEN ) return (198);
+    if ( s == NULL ) {
+        gs_scalars = gs_grow(gs_scalars, gs_nscalar, sizeof *gs_scalars);
+        s = gs_scalars + gs_nscalar++;
+        strcpy(s->name, name);
+    }
+    s->value = value;
+    return (0);
+}
+
+/**
+ * @brief Value of scalar @name; missing if it does not exist
+ */
+ST_double gs_scal_get (const char *name)
+{
+    struct GtoolsStubScalar *s = gs_find_scalar(name);
+    return (s == NULL? GTOOLS_STUB_MISSING: s->value);
+}
+
+/**
+ * @brief Create or replace matrix @name
+ *
+ * @param values Row-major @rows x @cols array; NULL fills with 0
+ */
+ST_int gs_mat_set (const char *name, ST_int rows, ST_int cols, const ST_double *values)
+{
+    ST_double *copy;
+    struct GtoolsStubMatrix *m = gs_find_mat(name);
+    size_t nel = (size_t) rows * cols;
+
+    if ( strlen(name) >= GTOOLS_STUB_NAMELEN ) return (198);
+    if ( (rows < 1) || (cols < 1) ) return (503);
+    if ( (copy = calloc(nel, sizeof(ST_double))) == NULL ) return (1702);
+    if ( values != NULL ) memcpy(copy, values, nel * sizeof(ST_double));
+
+    if ( m == NULL ) {
+        gs_mats = gs_grow(gs_mats, gs_nmat, sizeof *gs_mats);
+        m = gs_mats + gs_nmat++;
+        strcpy(m->name, name);
+    }
+    else {
+        free(m->values);
+    }
+
+    m->rows   = rows;
+    m->cols   = cols;
+    m->values = copy;
+    return (0);
+}
+
+ST_int gs_macro_set (const char *name, const char *value)
+{
+    char *copy;
+    struct GtoolsStubMacro *m = gs_find_macro(name);
+
+    if ( strlen(name) >= GTOOLS_STUB_NAMELEN ) return (198);
+    if ( (copy = malloc(strlen(value) + 1)) == NULL ) return (1702);
+    strcpy(copy, value);
+
+    if ( m == NULL ) {
+        gs_macros = gs_grow(gs_macros, gs_nmacro, sizeof *gs_macros);
+        m = gs_macros + gs_nmacro++;
+        strcpy(m->name, name);
+    }
+    else {
+        free(m->value);
+    }
+
+    m->value = copy;
+    return (0);
+}
+
+/**
+ * @brief Contents of local macro @name; "" if it does not exist
+ */
+const char *gs_macro_get (const char *name)
+{
+    struct GtoolsStubMacro *m = gs_find_macro(name);
+    return (m == NULL? "": m->value);
+}
+
+/**
+ * @brief 64-bit FNV-1a hash of every variable in the data
+ *
+ * Used to check that results are unchanged across builds: the plugin
+ * writes its output back to the data, so two builds that compute the
+ * same thing give the same checksum.
+ */
+uint64_t gs_data_checksum (void)
+{
+    ST_int k, i;
+    size_t b, len;
+    const unsigned char *bytes;
+    uint64_t h = 14695981039346656037ULL;
+
+    for (k = 0; k < gs_nvars; k++) {
+        for (i = 0; i < gs_nobs; i++) {
+            if ( gs_vars[k].isstr ) {
+                bytes = (const unsigned char *) gs_vars[k].str[i];
+                len   = strlen(gs_vars[k].str[i]) + 1;
+            }
+            else {
+                bytes = (const unsigned char *) (gs_vars[k].num + i);
+                len   = sizeof(ST_double);
+            }
+            for (b = 0; b < len; b++) {
+                h ^= bytes[b];
+                h *= 1099511628211ULL;
+            }
+        }
+    }
+
+    return (h);
+}
@@ -0,0 +1,68 @@
+#ifndef GTOOLS_STUB
+#define GTOOLS_STUB
+
+/*
+ * In-memory Stata stub (benchmark and regression harness)
+ * -------------------------------------------------------
+ *
+ * Implements the parts of the Stata Plugin Interface the plugin uses
+ * (SF_vdata, SF_sdata, SF_vstore, SF_sstore, SF_scal_use, SF_mat_el,
+ * SF_ifobs, SF_macro_use, ...) on top of column arrays, so that gtools.c
+ * can be linked into a standalone executable and stata_call run on
+ * synthetic data without Stata. Variables, scalars, matrices, and local
+ * macros are set up by the caller the way the ado files would set them
+ * up before calling the plugin.
+ *
+ * Everything is 1-indexed, as in Stata: variable k is column k - 1 and
+ * observation i is row i - 1.
+ */
+
+#include <stdint.h>
+#include "spi/stplugin.h"
+
+#define GTOOLS_STUB_MISSING 8.988465674311579e+307
+#define GTOOLS_STUB_NAMELEN 64
+
+struct GtoolsStubVar {
+    ST_boolean isstr;
+    ST_double  *num;
+    char       **str;
+};
+
+struct GtoolsStubScalar {
+    char      name[GTOOLS_STUB_NAMELEN];
+    ST_double value;
+};
+
+struct GtoolsStubMatrix {
+    char      name[GTOOLS_STUB_NAMELEN];
+    ST_int    rows;
+    ST_int    cols;
+    ST_double *values;
+};
+
+struct GtoolsStubMacro {
+    char name[GTOOLS_STUB_NAMELEN];
+    char *value;
+};
+
+void gs_stub_init   (void);
+void gs_stub_free   (void);
+void gs_stub_quiet  (ST_boolean quiet);
+void gs_data_reset  (ST_int nobs);
+
+ST_int     gs_add_num (void);
+ST_int     gs_add_str (void);
+ST_double *gs_num     (ST_int var);
+ST_int     gs_set_str (ST_int var, ST_int obs, const char *value);
+ST_int     gs_set_if  (const ST_ubyte *mask);
+
+ST_int    gs_scal_set  (const char *name, ST_double value);
+ST_double gs_scal_get  (const char *name);
+ST_int    gs_mat_set   (const char *name, ST_int rows, ST_int cols, const ST_double *values);
+ST_int    gs_macro_set (const char *name, const char *value);
+const char *gs_macro_get (const char *name);
+
+uint64_t gs_data_checksum (void);
+
+#endif
@@ -1,5 +1,8 @@
+#include "gegen.h"
+
 ST_retcode sf_egen_multiple_sources (struct StataInfo *st_info, int level);
 ST_retcode sf_egen_bulk             (struct StataInfo *st_info, int level);
+ST_retcode sf_egen_bulk_accum       (struct StataInfo *st_info, int level);
 ST_retcode sf_write_output          (struct StataInfo *st_info, int level, GT_size wtargets, char *fname);
 ST_retcode sf_write_collapsed       (struct StataInfo *st_info, int level, GT_size wtargets, char *fname);
 ST_retcode sf_write_byvars          (struct StataInfo *st_info, int level);
@@ -38,6 +41,33 @@ ST_retcode sf_egen_bulk (struct StataInfo *st_info, int level)
         return (sf_egen_multiple_sources (st_info, level));
     }
 
+    // If no stat needs the entire group at once, accumulate the stats as
+    // the sources are read instead of buffering all N x ksources values,
+    // so long as the J x ksources accumulators take up less memory.
+    // Approximate quantiles also need a sketch for each group and source,
+    // which never holds more values than the group has observations, and
+    // approx_nunique needs 2^p registers for each group and source. If the
+    // sketches would not save memory we buffer the data and compute the
+    // exact stats instead (see below).
+
+    GT_size accum_bytes  = st_info->J * st_info->kvars_sources * sizeof(struct GtoolsAccum);
+    GT_size buffer_bytes = st_info->N * st_info->kvars_sources * sizeof(ST_double)
+                         + st_info->J * st_info->kvars_sources * (2 * sizeof(GT_bool) + 2 * sizeof(GT_size));
+
+    if ( gf_sketch_any(st_info->statcode, st_info->kvars_stats) ) {
+        accum_bytes += st_info->J * st_info->kvars_sources * sizeof(struct GtoolsSketch)
+                     + GTOOLS_PWMIN(st_info->N, st_info->J * gf_sketch_items(gf_sketch_k(st_info->approx_eps)))
+                     * st_info->kvars_sources * sizeof(ST_double);
+    }
+
+    if ( gf_hll_any(st_info->statcode, st_info->kvars_stats) ) {
+        accum_bytes += st_info->J * st_info->kvars_sources * (((GT_size) 1) << gf_hll_precision(st_info->approx_eps));
+    }
+
+    if ( gf_accum_streamable(st_info->statcode, st_info->kvars_stats) & (accum_bytes <= buffer_bytes) ) {
+        return (sf_egen_bulk_accum (st_info, level));
+    }
+
     /*********************************************************************
      *                           Step 1: Setup                           *
      *********************************************************************/
@@ -46,9 +76,8 @@ ST_retcode sf_egen_bulk (struct StataInfo *st_info, int level)
     ST_double z;
 
     GT_size i, j, k, l;
-    GT_size nj, nj_max, start, end, sel;
-    GT_size offset_output,
-           offset_source,
+    GT_size nj, nj_max, start, end, nworkers;
+    GT_size offset_source,
            offset_buffer;
 
     clock_t  timer = clock();
@@ -66,23 +95,47 @@ ST_retcode sf_egen_bulk (struct StataInfo *st_info, int level)
      *                     Step 2: Memory allocation                     *
      *********************************************************************/
 
-    GT_size *pos_sources = calloc(ksources, sizeof *pos_sources);
-    ST_double *statcode  = calloc(ktargets, sizeof *statcode);
+    // Everything is freed on exit, so it is all declared before the
+    // first allocation that can fail (the scratch space is malloc'd).
 
-    if ( pos_sources == NULL ) return(sf_oom_error("sf_egen_bulk", "pos_sources"));
+    struct eScratch *scratch  = NULL;
+    ST_double *all_buffer     = NULL;
+    GT_bool   *all_firstmiss  = NULL;
+    GT_bool   *all_lastmiss   = NULL;
+    GT_size   *all_nonmiss    = NULL;
+    GT_size   *all_yesmiss    = NULL;
+    GT_size   *offsets_buffer = NULL;
+    GT_size   *nj_buffer      = NULL;
+    GT_size   *nmfreq         = NULL;
+    GT_size   *index_st       = NULL;
+
+    nworkers = 0;
+
+    GT_size *pos_sources = gf_arena_calloc(st_info->arena, ksources, sizeof *pos_sources);
+    ST_double *statcode  = gf_arena_calloc(st_info->arena, ktargets, sizeof *statcode);
+
+    if ( pos_sources == NULL ) { rc = sf_oom_error("sf_egen_bulk", "pos_sources"); goto exit; }
+    if ( statcode    == NULL ) { rc = sf_oom_error("sf_egen_bulk", "statcode");    goto exit; }
 
     for (k = 0; k < ksources; k++)
         pos_sources[k] = start_sources + k;
 
+    // The whole group is in memory, so approximate stats are exact
     for (k = 0; k < st_info->kvars_stats; k++)
-        statcode[k] = st_info->statcode[k];
+        statcode[k] = gf_sketch_exact(st_info->statcode[k]);
 
-    st_info->output = calloc(J * ktargets, sizeof st_info->output);
-    if ( st_info->output == NULL ) return(sf_oom_error("sf_egen_bulk", "st_info->output"));
+    if ( st_info->verbose ) {
+        if ( gf_sketch_any(st_info->statcode, st_info->kvars_stats)
+          || gf_hll_any(st_info->statcode, st_info->kvars_stats) ) {
+            sf_printf("approx stats: the data are buffered, so they are computed exactly\n");
+        }
+    }
+
+    st_info->output = gf_arena_calloc(st_info->arena, J * ktargets, sizeof st_info->output);
+    if ( st_info->output == NULL ) { rc = sf_oom_error("sf_egen_bulk", "st_info->output"); goto exit; }
 
     GTOOLS_GC_ALLOCATED("st_info->output")
     ST_double *output = st_info->output;
-    st_info->free = 9;
 
     nj_max = st_info->info[1] - st_info->info[0];
     for (j = 1; j < st_info->J; j++) {
@@ -90,53 +143,36 @@ ST_retcode sf_egen_bulk (struct StataInfo *st_info, int level)
             nj_max = (st_info->info[j + 1] - st_info->info[j]);
     }
 
-    GT_size   *nuniq_ix    = calloc(st_info->nunique? nj_max: 1, sizeof *nuniq_ix);
-    uint64_t  *nuniq_h1    = calloc(st_info->nunique? nj_max: 1, sizeof *nuniq_h1);
-    uint64_t  *nuniq_h2    = calloc(st_info->nunique? nj_max: 1, sizeof *nuniq_h2);
-    uint64_t  *nuniq_h3    = calloc(st_info->nunique? nj_max: 1, sizeof *nuniq_h3);
-    uint64_t  *nuniq_xcopy = calloc(st_info->nunique? nj_max: 1, sizeof *nuniq_xcopy);
-
-    if ( nuniq_ix    == NULL ) return(sf_oom_error("sf_egen_bulk_w", "nuniq_ix"));
-    if ( nuniq_h1    == NULL ) return(sf_oom_error("sf_egen_bulk_w", "nuniq_h1"));
-    if ( nuniq_h2    == NULL ) return(sf_oom_error("sf_egen_bulk_w", "nuniq_h2"));
-    if ( nuniq_h3    == NULL ) return(sf_oom_error("sf_egen_bulk_w", "nuniq_h3"));
-    if ( nuniq_xcopy == NULL ) return(sf_oom_error("sf_egen_bulk_w", "nuniq_xcopy"));
-
-    ST_double *all_buffer     = calloc(N * ksources, sizeof *all_buffer);
-    GT_bool   *all_firstmiss  = calloc(J * ksources, sizeof *all_firstmiss);
-    GT_bool   *all_lastmiss   = calloc(J * ksources, sizeof *all_lastmiss);
-    GT_size   *all_nonmiss    = calloc(J * ksources, sizeof *all_nonmiss);
-    GT_size   *all_yesmiss    = calloc(J * ksources, sizeof *all_yesmiss);
-    GT_size   *offsets_buffer = calloc(J, sizeof *offsets_buffer);
-    GT_size   *nj_buffer      = calloc(J, sizeof *nj_buffer);
-
-    if ( all_buffer     == NULL ) return(sf_oom_error("sf_egen_bulk", "output"));
-    if ( all_firstmiss  == NULL ) return(sf_oom_error("sf_egen_bulk", "all_firstmiss"));
-    if ( all_lastmiss   == NULL ) return(sf_oom_error("sf_egen_bulk", "all_lastmiss"));
-    if ( all_nonmiss    == NULL ) return(sf_oom_error("sf_egen_bulk", "all_nonmiss"));
-    if ( all_yesmiss    == NULL ) return(sf_oom_error("sf_egen_bulk", "all_yesmiss"));
-    if ( offsets_buffer == NULL ) return(sf_oom_error("sf_egen_bulk", "offsets_buffer"));
-    if ( nj_buffer      == NULL ) return(sf_oom_error("sf_egen_bulk", "nj_buffer"));
+    // Each worker computing group stats in Step 4 has its own scratch space
+    nworkers = gf_pool_steal_workers(J, N);
+    scratch  = gf_egen_scratch_alloc(nworkers, ksources, ktargets, nj_max, st_info->nunique, 0);
+    if ( scratch == NULL ) { rc = sf_oom_error("sf_egen_bulk", "scratch"); goto exit; }
+
+    all_buffer     = gf_arena_calloc(st_info->arena, N * ksources, sizeof *all_buffer);
+    all_firstmiss  = gf_arena_calloc(st_info->arena, J * ksources, sizeof *all_firstmiss);
+    all_lastmiss   = gf_arena_calloc(st_info->arena, J * ksources, sizeof *all_lastmiss);
+    all_nonmiss    = gf_arena_calloc(st_info->arena, J * ksources, sizeof *all_nonmiss);
+    all_yesmiss    = gf_arena_calloc(st_info->arena, J * ksources, sizeof *all_yesmiss);
+    offsets_buffer = gf_arena_calloc(st_info->arena, J, sizeof *offsets_buffer);
+    nj_buffer      = gf_arena_calloc(st_info->arena, J, sizeof *nj_buffer);
+
+    if ( all_buffer     == NULL ) { rc = sf_oom_error("sf_egen_bulk", "all_buffer");     goto exit; }
+    if ( all_firstmiss  == NULL ) { rc = sf_oom_error("sf_egen_bulk", "all_firstmiss");  goto exit; }
+    if ( all_lastmiss   == NULL ) { rc = sf_oom_error("sf_egen_bulk", "all_lastmiss");   goto exit; }
+    if ( all_nonmiss    == NULL ) { rc = sf_oom_error("sf_egen_bulk", "all_nonmiss");    goto exit; }
+    if ( all_yesmiss    == NULL ) { rc = sf_oom_error("sf_egen_bulk", "all_yesmiss");    goto exit; }
+    if ( offsets_buffer == NULL ) { rc = sf_oom_error("sf_egen_bulk", "offsets_buffer"); goto exit; }
+    if ( nj_buffer      == NULL ) { rc = sf_oom_error("sf_egen_bulk", "nj_buffer");      goto exit; }
 
     for (j = 0; j < J * ksources; j++)
         all_firstmiss[j] = all_lastmiss[j] = all_nonmiss[j] = all_yesmiss[j] = 0;
 
-    GT_size *nmfreq = calloc(ksources, sizeof *nmfreq);
-    if ( nmfreq == NULL ) return(sf_oom_error("sf_egen_bulk", "nmfreq"));
+    nmfreq = gf_arena_calloc(st_info->arena, ksources, sizeof *nmfreq);
+    if ( nmfreq == NULL ) { rc = sf_oom_error("sf_egen_bulk", "nmfreq"); goto exit; }
 
     for (k = 0; k < ksources; k++)
         nmfreq[k] = 0;
 
-    ST_double *firstmiss = calloc(ksources, sizeof *firstmiss);
-    ST_double *lastmiss  = calloc(ksources, sizeof *lastmiss);
-    ST_double *firstnm   = calloc(ksources, sizeof *firstnm);
-    ST_double *lastnm    = calloc(ksources, sizeof *lastnm);
-
-    if ( firstmiss == NULL ) return(sf_oom_error("sf_egen_bulk", "firstmiss"));
-    if ( lastmiss  == NULL ) return(sf_oom_error("sf_egen_bulk", "lastmiss"));
-    if ( firstnm   == NULL ) return(sf_oom_error("sf_egen_bulk", "firstnm"));
-    if ( lastnm    == NULL ) return(sf_oom_error("sf_egen_bulk", "lastnm"));
-
     /*********************************************************************
      *               Step 3: Read in variables from Stata                *
      *********************************************************************/
@@ -149,8 +185,8 @@ ST_retcode sf_egen_bulk (struct StataInfo *st_info, int level)
      * observations from Stata in order; this is only sometimes faster,
      */
 
-    GT_size *index_st = calloc(st_info->Nread, sizeof *index_st);
-    if ( index_st == NULL ) return(sf_oom_error("sf_egen_bulk", "index_st"));
+    index_st = gf_arena_calloc(st_info->arena, st_info->Nread, sizeof *index_st);
+    if ( index_st == NULL ) { rc = sf_oom_error("sf_egen_bulk", "index_st"); goto exit; }
 
     for (i = 0; i < st_info->Nread; i++) {
         index_st[i] = 0;
@@ -194,6 +230,7 @@ ST_retcode sf_egen_bulk (struct StataInfo *st_info, int level)
         }
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_READ);
     if ( st_info->benchmark > 2 )
         sf_running_timer (&stimer, "\t\tPlugin step 5.1: Read source variables sequentially");
 
@@ -207,157 +244,562 @@ ST_retcode sf_egen_bulk (struct StataInfo *st_info, int level)
         for (k = 0; k < ksources; k++)
             nmfreq[k] += all_nonmiss[j * ksources + k];
 
-    {
-        for (j = 0; j < J; j++) {
+    // Groups are independent, but their sizes can be very uneven, so
+    // they are handed out to the workers with work stealing.
+
+    struct eInfo einfo = {0};
+    einfo.st_info        = st_info;
+    einfo.scratch        = scratch;
+    einfo.output         = output;
+    einfo.statcode       = statcode;
+    einfo.all_buffer     = all_buffer;
+    einfo.offsets_buffer = offsets_buffer;
+    einfo.nj_buffer      = nj_buffer;
+    einfo.all_firstmiss  = all_firstmiss;
+    einfo.all_lastmiss   = all_lastmiss;
+    einfo.all_nonmiss    = all_nonmiss;
+    einfo.nmfreq         = nmfreq;
+
+    if ( (rc = gf_pool_steal (gf_egen_group, &einfo, nj_buffer, J, nworkers)) ) goto exit;
+
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_STATS);
+    if ( st_info->benchmark > 2 )
+        sf_running_timer (&stimer, "\t\tPlugin step 5.2: Computed summary stats");
 
-            // Remember we read things in group sort order but info and index
-            // are in hash sort order, so the jth output corresponds to the
-            // st_info->ix[j]th source
-            offset_output = j * ktargets;
-            offset_source = st_info->ix[j] * ksources;
-            offset_buffer = offsets_buffer[j];
-            nj            = nj_buffer[j];
+    if ( st_info->benchmark > 1 )
+        sf_running_timer (&timer, "\tPlugin step 5: Generated output array");
 
-            // Get the position of the first and last obs of each source
-            // variable (in case they are modified by calling qselect)
-            for (k = 0; k < ksources; k++) {
-                sel   = offset_source + k;
-                start = offset_buffer + nj * k;
-                end   = all_nonmiss[sel];
-                if ( end == 0 ) { // all are missing; invert first/last bc missings were read in reverse
-                    firstmiss[k] = firstnm[k] = all_buffer[start + nj - 1];
-                    lastmiss[k]  = lastnm[k]  = all_buffer[start];
-                }
-                else if ( end < nj ) { // some are missing; invert first/last bc missings were read in reverse
-                    firstnm[k]   = all_buffer[start];
-                    lastnm[k]    = all_buffer[start + end - 1];
-                    firstmiss[k] = all_buffer[start + nj - 1];
-                    lastmiss[k]  = all_buffer[start + end];
-                }
-                else { // none are missing; first/last are same
-                    firstmiss[k] = firstnm[k] = all_buffer[start];
-                    lastmiss[k]  = lastnm[k]  = all_buffer[start + end - 1];
-                }
+exit:
+
+    gf_arena_free (st_info->arena, pos_sources);
+    gf_arena_free (st_info->arena, statcode);
+
+    gf_arena_free (st_info->arena, index_st);
+
+    gf_egen_scratch_free (scratch, nworkers);
+
+    gf_arena_free (st_info->arena, all_buffer);
+    gf_arena_free (st_info->arena, all_firstmiss);
+    gf_arena_free (st_info->arena, all_lastmiss);
+    gf_arena_free (st_info->arena, all_nonmiss);
+    gf_arena_free (st_info->arena, all_yesmiss);
+    gf_arena_free (st_info->arena, offsets_buffer);
+    gf_arena_free (st_info->arena, nj_buffer);
+
+    gf_arena_free (st_info->arena, nmfreq);
+
+    return (rc);
+}
+
+/**
+ * @brief Summary stats for the jth group (Step 4 of sf_egen_bulk)
+ *
+ * @param context Pointer to struct eInfo with the data for all groups
+ * @param worker Worker running this group; indexes its scratch space
+ * @param j Group to summarize
+ * @return Stores the stats for group @j in output
+ */
+ST_retcode gf_egen_group (void *context, GT_size worker, GT_size j)
+{
+    struct eInfo *einfo = ((struct eInfo *) context);
+    struct StataInfo *st_info = einfo->st_info;
+    struct eScratch  *scratch = einfo->scratch + worker;
+
+    ST_retcode rc = 0;
+    GT_size k, l, nq, nj, start, end, sel;
+    GT_size offset_output,
+            offset_source,
+            offset_buffer;
+
+    GT_size ksources = st_info->kvars_sources;
+    GT_size ktargets = st_info->kvars_targets;
+
+    ST_double *output         = einfo->output;
+    ST_double *statcode       = einfo->statcode;
+    ST_double *all_buffer     = einfo->all_buffer;
+    GT_size   *offsets_buffer = einfo->offsets_buffer;
+    GT_size   *nj_buffer      = einfo->nj_buffer;
+    GT_bool   *all_firstmiss  = einfo->all_firstmiss;
+    GT_bool   *all_lastmiss   = einfo->all_lastmiss;
+    GT_size   *all_nonmiss    = einfo->all_nonmiss;
+    GT_size   *nmfreq         = einfo->nmfreq;
+
+    ST_double *firstmiss   = scratch->firstmiss;
+    ST_double *lastmiss    = scratch->lastmiss;
+    ST_double *firstnm     = scratch->firstnm;
+    ST_double *lastnm      = scratch->lastnm;
+    uint64_t  *nuniq_h1    = scratch->nuniq_h1;
+    uint64_t  *nuniq_xcopy = scratch->nuniq_xcopy;
+    struct GtoolsHashSet *nuniq_set = &(scratch->nuniq_set);
+    ST_double *quantiles   = scratch->quantiles;
+    ST_double *qoutput     = scratch->qoutput;
+
+    // Remember we read things in group sort order but info and index
+    // are in hash sort order, so the jth output corresponds to the
+    // st_info->ix[j]th source
+    offset_output = j * ktargets;
+    offset_source = st_info->ix[j] * ksources;
+    offset_buffer = offsets_buffer[j];
+    nj            = nj_buffer[j];
+
+    // Get the position of the first and last obs of each source
+    // variable (in case they are modified by calling qselect)
+    for (k = 0; k < ksources; k++) {
+        sel   = offset_source + k;
+        start = offset_buffer + nj * k;
+        end   = all_nonmiss[sel];
+        if ( end == 0 ) { // all are missing; invert first/last bc missings were read in reverse
+            firstmiss[k] = firstnm[k] = all_buffer[start + nj - 1];
+            lastmiss[k]  = lastnm[k]  = all_buffer[start];
+        }
+        else if ( end < nj ) { // some are missing; invert first/last bc missings were read in reverse
+            firstnm[k]   = all_buffer[start];
+            lastnm[k]    = all_buffer[start + end - 1];
+            firstmiss[k] = all_buffer[start + nj - 1];
+            lastmiss[k]  = all_buffer[start + end];
+        }
+        else { // none are missing; first/last are same
+            firstmiss[k] = firstnm[k] = all_buffer[start];
+            lastmiss[k]  = lastnm[k]  = all_buffer[start + end - 1];
+        }
+    }
+
+    for (k = 0; k < ktargets; k++) {
+        // For each target, grab start and end position of source variable
+        sel   = offset_source + st_info->pos_targets[k];
+        start = offset_buffer + nj * st_info->pos_targets[k];
+        end   = all_nonmiss[sel];
+
+        // If there is at least one non-missing observation, we store
+        // the result in output. If all observations are missing then
+        // we store Stata's special SV_missval
+        if ( statcode[k] == -6 ) { // count
+            // If count, you just need to know how many non-missing obs there are
+            output[offset_output + k] = end;
+        }
+        else if ( statcode[k] == -14 ) { // freq
+            output[offset_output + k] = nj;
+        }
+        else if ( statcode[k] == -7  ) { // percent
+            // Percent outputs the % of all non-missing values of
+            // that variable in that group relative to the number
+            // of non-missing values of that variable in the entire
+            // data. This latter count is stored in nmfreq; we divide
+            // by this when writing to Stata.
+            output[offset_output + k] = 100 * ((ST_double) end / nmfreq[st_info->pos_targets[k]]);
+        }
+        else if ( statcode[k] == -10 ) { // first
+            // If first obs is missing, get first missing value that
+            // appeared; otherwise get first non-missing value
+            output[offset_output + k] = all_firstmiss[sel]? firstmiss[st_info->pos_targets[k]]: firstnm[st_info->pos_targets[k]];
+        }
+        else if ( statcode[k] == -11 ) { // firstnm
+            // First non-missing is the first entry in the inputs buffer;
+            // this is only missing if all are missing.
+            output[offset_output + k] = firstnm[st_info->pos_targets[k]];
+        }
+        else if (statcode[k] == -12 ) { // last
+            // If last obs is missing, get last missing value that
+            // appeared; otherwise get last non-missing value
+            output[offset_output + k] = all_lastmiss[sel]? lastmiss[st_info->pos_targets[k]]: lastnm[st_info->pos_targets[k]];
+        }
+        else if ( statcode[k] == -13 ) { // lastnm
+            // Last non-missing is the last entry in the inputs buffer;
+            // this is only missing is all are missing.
+            output[offset_output + k] = lastnm[st_info->pos_targets[k]];
+        }
+        else if ( statcode[k] == -18 ) { // nunique
+            if ( (rc = gf_array_nunique_range (
+                    output + offset_output + k,
+                    all_buffer + start,
+                    nj,
+                    (end == 0),
+                    nuniq_h1,
+                    nuniq_xcopy,
+                    nuniq_set
+                )
+            ) ) return (rc);
+        }
+        else if ( end == 0 ) { // no obs
+            // If everything is missing, write a missing value, Except
+            // for sums, which go to 0 for some reason (this is the
+            // behavior of collapse), and min/max (which pick out the
+            // min/max missing value).
+            if ( (statcode[k] == -1) & (st_info->keepmiss == 0) ) { // sum
+                output[offset_output + k] = 0;
+            }
+            else if ( (statcode[k] == -4) || (statcode[k] == -5) ) { // min/max
+                // min/max handle missings b/c they only do comparisons
+                output[offset_output + k] = gf_switch_fun_code (statcode[k], all_buffer, start, start + nj);
+            }
+            else {
+                output[offset_output + k] = SV_missval;
             }
+        }
+        else if ( (statcode[k] == -3) &  (end < 2) ) { // sd
+            // Standard deviation requires at least 2 observations
+            output[offset_output + k] = SV_missval;
+        }
+        else if ( (statcode[k] > 0) | (statcode[k] == -9) ) { // quantiles
+            // Selected together for each source below
+            continue;
+        }
+        else { // etc
+            // Otherwise compute the requested summary stat
+            output[offset_output + k] = gf_switch_fun_code (statcode[k], all_buffer, start, start + end);
+        }
+    }
 
-            for (k = 0; k < ktargets; k++) {
-                // For each target, grab start and end position of source variable
-                sel   = offset_source + st_info->pos_targets[k];
-                start = offset_buffer + nj * st_info->pos_targets[k];
-                end   = all_nonmiss[sel];
+    // All the quantiles (including the median and iqr) of a source are
+    // selected at once, so the group is partitioned once per source
+    // instead of once or twice per quantile.
+    for (l = 0; l < ksources; l++) {
+        sel   = offset_source + l;
+        start = offset_buffer + nj * l;
+        end   = all_nonmiss[sel];
+        if ( end == 0 ) continue;
+
+        nq = 0;
+        for (k = 0; k < ktargets; k++) {
+            if ( st_info->pos_targets[k] != l ) continue;
+            if ( statcode[k] > 0 ) {
+                quantiles[nq++] = statcode[k];
+            }
+            else if ( statcode[k] == -9 ) {
+                quantiles[nq++] = 75;
+                quantiles[nq++] = 25;
+            }
+        }
+        if ( nq == 0 ) continue;
+
+        gf_array_dquantiles_range (
+            all_buffer,
+            start,
+            start + end,
+            quantiles,
+            nq,
+            qoutput,
+            scratch->qranks,
+            scratch->qvalues
+        );
+
+        nq = 0;
+        for (k = 0; k < ktargets; k++) {
+            if ( st_info->pos_targets[k] != l ) continue;
+            if ( statcode[k] > 0 ) {
+                output[offset_output + k] = qoutput[nq++];
+            }
+            else if ( statcode[k] == -9 ) {
+                output[offset_output + k] = qoutput[nq] - qoutput[nq + 1];
+                nq += 2;
+            }
+        }
+    }
 
-                // If there is at least one non-missing observation, we store
-                // the result in output. If all observations are missing then
-                // we store Stata's special SV_missval
-                if ( statcode[k] == -6 ) { // count
-                    // If count, you just need to know how many non-missing obs there are
-                    output[offset_output + k] = end;
-                }
-                else if ( statcode[k] == -14 ) { // freq
-                    output[offset_output + k] = nj;
-                }
-                else if ( statcode[k] == -7  ) { // percent
-                    // Percent outputs the % of all non-missing values of
-                    // that variable in that group relative to the number
-                    // of non-missing values of that variable in the entire
-                    // data. This latter count is stored in nmfreq; we divide
-                    // by this when writing to Stata.
-                    output[offset_output + k] = 100 * ((ST_double) end / nmfreq[st_info->pos_targets[k]]);
-                }
-                else if ( statcode[k] == -10 ) { // first
-                    // If first obs is missing, get first missing value that
-                    // appeared; otherwise get first non-missing value
-                    output[offset_output + k] = all_firstmiss[sel]? firstmiss[st_info->pos_targets[k]]: firstnm[st_info->pos_targets[k]];
-                }
-                else if ( statcode[k] == -11 ) { // firstnm
-                    // First non-missing is the first entry in the inputs buffer;
-                    // this is only missing if all are missing.
-                    output[offset_output + k] = firstnm[st_info->pos_targets[k]];
-                }
-                else if (statcode[k] == -12 ) { // last
-                    // If last obs is missing, get last missing value that
-                    // appeared; otherwise get last non-missing value
-                    output[offset_output + k] = all_lastmiss[sel]? lastmiss[st_info->pos_targets[k]]: lastnm[st_info->pos_targets[k]];
-                }
-                else if ( statcode[k] == -13 ) { // lastnm
-                    // Last non-missing is the last entry in the inputs buffer;
-                    // this is only missing is all are missing.
-                    output[offset_output + k] = lastnm[st_info->pos_targets[k]];
-                }
-                else if ( statcode[k] == -18 ) { // nunique
-                    if ( (rc = gf_array_nunique_range (
-                            output + offset_output + k,
-                            all_buffer + start,
-                            nj,
-                            (end == 0),
-                            nuniq_h1,
-                            nuniq_h2,
-                            nuniq_h3,
-                            nuniq_ix,
-                            nuniq_xcopy
-                        )
-                    ) ) return (rc);
-                }
-                else if ( end == 0 ) { // no obs
-                    // If everything is missing, write a missing value, Except
-                    // for sums, which go to 0 for some reason (this is the
-                    // behavior of collapse), and min/max (which pick out the
-                    // min/max missing value).
-                    if ( (statcode[k] == -1) & (st_info->keepmiss == 0) ) { // sum
-                        output[offset_output + k] = 0;
-                    }
-                    else if ( (statcode[k] == -4) || (statcode[k] == -5) ) { // min/max
-                        // min/max handle missings b/c they only do comparisons
-                        output[offset_output + k] = gf_switch_fun_code (statcode[k], all_buffer, start, start + nj);
-                    }
-                    else {
-                        output[offset_output + k] = SV_missval;
-                    }
-                }
-                else if ( (statcode[k] == -3) &  (end < 2) ) { // sd
-                    // Standard deviation requires at least 2 observations
-                    output[offset_output + k] = SV_missval;
-                }
-                else { // etc
-                    // Otherwise compute the requested summary stat
-                    output[offset_output + k] = gf_switch_fun_code (statcode[k], all_buffer, start, start + end);
-                }
+    return (rc);
+}
+
+/**
+ * @brief Scratch space for each worker computing group stats
+ *
+ * @param nworkers Number of workers
+ * @param ksources Number of source variables
+ * @param ktargets Number of targets (sizes the quantile buffers)
+ * @param nj_max Size of the largest group
+ * @param nunique Whether nunique was requested (needs group-sized buffers)
+ * @param weights Whether weights were used (needs a buffer for quantiles)
+ * @return Array of nworkers scratch structs; NULL if out of memory
+ */
+struct eScratch *gf_egen_scratch_alloc (
+    GT_size nworkers,
+    GT_size ksources,
+    GT_size ktargets,
+    GT_size nj_max,
+    GT_bool nunique,
+    GT_bool weights)
+{
+    GT_size w;
+    GT_size nuniq = nunique? nj_max: 1;
+    GT_size npbuf = weights? 2 * nj_max: 1;
+
+    struct eScratch *scratch = calloc(nworkers, sizeof *scratch);
+    if ( scratch == NULL ) return (NULL);
+
+    for (w = 0; w < nworkers; w++) {
+        scratch[w].firstmiss   = calloc(ksources, sizeof *scratch[w].firstmiss);
+        scratch[w].lastmiss    = calloc(ksources, sizeof *scratch[w].lastmiss);
+        scratch[w].firstnm     = calloc(ksources, sizeof *scratch[w].firstnm);
+        scratch[w].lastnm      = calloc(ksources, sizeof *scratch[w].lastnm);
+        scratch[w].p_buffer    = calloc(npbuf,    sizeof *scratch[w].p_buffer);
+        scratch[w].nuniq_h1    = calloc(nuniq,    sizeof *scratch[w].nuniq_h1);
+        scratch[w].nuniq_xcopy = calloc(nuniq,    sizeof *scratch[w].nuniq_xcopy);
+        gf_hashset_alloc (&(scratch[w].nuniq_set), nuniq);
+        scratch[w].quantiles   = calloc(2 * ktargets, sizeof *scratch[w].quantiles);
+        scratch[w].qoutput     = calloc(2 * ktargets, sizeof *scratch[w].qoutput);
+        scratch[w].qvalues     = calloc(4 * ktargets, sizeof *scratch[w].qvalues);
+        scratch[w].qranks      = calloc(8 * ktargets, sizeof *scratch[w].qranks);
+
+        if ( (scratch[w].firstmiss   == NULL) ||
+             (scratch[w].lastmiss    == NULL) ||
+             (scratch[w].firstnm     == NULL) ||
+             (scratch[w].lastnm      == NULL) ||
+             (scratch[w].p_buffer    == NULL) ||
+             (scratch[w].nuniq_h1    == NULL) ||
+             (scratch[w].nuniq_xcopy == NULL) ||
+             (scratch[w].nuniq_set.keys  == NULL) ||
+             (scratch[w].nuniq_set.stamp == NULL) ||
+             (scratch[w].quantiles   == NULL) ||
+             (scratch[w].qoutput     == NULL) ||
+             (scratch[w].qvalues     == NULL) ||
+             (scratch[w].qranks      == NULL) ) {
+            gf_egen_scratch_free (scratch, w + 1);
+            return (NULL);
+        }
+    }
+
+    return (scratch);
+}
+
+void gf_egen_scratch_free (struct eScratch *scratch, GT_size nworkers)
+{
+    GT_size w;
+    if ( scratch == NULL ) return;
+    for (w = 0; w < nworkers; w++) {
+        free (scratch[w].firstmiss);
+        free (scratch[w].lastmiss);
+        free (scratch[w].firstnm);
+        free (scratch[w].lastnm);
+        free (scratch[w].p_buffer);
+        free (scratch[w].nuniq_h1);
+        free (scratch[w].nuniq_xcopy);
+        gf_hashset_free (&(scratch[w].nuniq_set));
+        free (scratch[w].quantiles);
+        free (scratch[w].qoutput);
+        free (scratch[w].qvalues);
+        free (scratch[w].qranks);
+    }
+    free (scratch);
+}
+
+/**
+ * @brief egen stata variables in bulk using one-pass accumulators
+ *
+ * Same output as sf_egen_bulk, but each observation is added to the
+ * running stats of its group as it is read (see gtools_accum.c), so we
+ * need J x ksources accumulators instead of an N x ksources buffer. Only
+ * used if none of the requested stats need the entire group. Approximate
+ * quantiles and approx_nunique add a sketch for each group and source
+ * (see gtools_sketch.h).
+ *
+ * @param st_info Pointer to container structure for Stata info
+ * @return Stores egen data in Stata
+ */
+ST_retcode sf_egen_bulk_accum (struct StataInfo *st_info, int level)
+{
+
+    /*********************************************************************
+     *                           Step 1: Setup                           *
+     *********************************************************************/
+
+    ST_retcode rc = 0;
+    ST_double z;
+
+    GT_size i, j, k, l;
+    GT_size start, end;
+    GT_size offset_output,
+            offset_source,
+            offset_hll;
+
+    clock_t  timer = clock();
+    clock_t stimer = clock();
+
+    GT_size J = st_info->J;
+
+    GT_size kvars         = st_info->kvars_by;
+    GT_size ksources      = st_info->kvars_sources;
+    GT_size ktargets      = st_info->kvars_targets;
+    GT_size start_sources = kvars + st_info->kvars_group + 1;
+
+    /*********************************************************************
+     *                     Step 2: Memory allocation                     *
+     *********************************************************************/
+
+    GT_size *pos_sources = gf_arena_calloc(st_info->arena, ksources, sizeof *pos_sources);
+    ST_double *statcode  = gf_arena_calloc(st_info->arena, ktargets, sizeof *statcode);
+
+    if ( pos_sources == NULL ) return(sf_oom_error("sf_egen_bulk_accum", "pos_sources"));
+    if ( statcode    == NULL ) return(sf_oom_error("sf_egen_bulk_accum", "statcode"));
+
+    for (k = 0; k < ksources; k++)
+        pos_sources[k] = start_sources + k;
+
+    for (k = 0; k < st_info->kvars_stats; k++)
+        statcode[k] = st_info->statcode[k];
+
+    st_info->output = gf_arena_calloc(st_info->arena, J * ktargets, sizeof st_info->output);
+    if ( st_info->output == NULL ) return(sf_oom_error("sf_egen_bulk_accum", "st_info->output"));
+
+    GTOOLS_GC_ALLOCATED("st_info->output")
+    ST_double *output = st_info->output;
+
+    struct GtoolsAccum *accum = gf_arena_calloc(st_info->arena, J * ksources, sizeof *accum);
+    GT_size *nmfreq   = gf_arena_calloc(st_info->arena, ksources, sizeof *nmfreq);
+    GT_size *index_st = gf_arena_calloc(st_info->arena, st_info->Nread, sizeof *index_st);
+
+    if ( accum    == NULL ) return(sf_oom_error("sf_egen_bulk_accum", "accum"));
+    if ( nmfreq   == NULL ) return(sf_oom_error("sf_egen_bulk_accum", "nmfreq"));
+    if ( index_st == NULL ) return(sf_oom_error("sf_egen_bulk_accum", "index_st"));
+
+    // HyperLogLog registers are only kept for sources with approx_nunique;
+    // hll_slot[k] is the source's position among those, plus one.
+    uint32_t hll_p   = gf_hll_precision(st_info->approx_eps);
+    GT_size  hll_m   = ((GT_size) 1) << hll_p;
+    GT_size  hll_k   = 0;
+    GT_size *hll_slot = gf_arena_calloc(st_info->arena, ksources, sizeof *hll_slot);
+    uint8_t *hll      = NULL;
+
+    if ( hll_slot == NULL ) return(sf_oom_error("sf_egen_bulk_accum", "hll_slot"));
+
+    for (k = 0; k < ktargets; k++) {
+        l = st_info->pos_targets[k];
+        if ( (statcode[k] == GTOOLS_HLL_CODE) & (hll_slot[l] == 0) ) hll_slot[l] = ++hll_k;
+    }
+
+    if ( hll_k ) {
+        hll = gf_arena_calloc(st_info->arena, J * hll_k * hll_m, sizeof *hll);
+        if ( hll == NULL ) return(sf_oom_error("sf_egen_bulk_accum", "hll"));
+        if ( st_info->verbose ) {
+            sf_printf("approx_nunique: HyperLogLog with 2^%u registers"
+                      " (relative standard error %.2f%%)\n",
+                      hll_p, 104 / sqrt(hll_m));
+        }
+    }
+
+    // Sketches are only updated for sources with an approximate quantile.
+    // They are allocated last: their items come from malloc and are freed
+    // on exit, so nothing may return early once they are initialized.
+    GT_bool *sketch_source = gf_arena_calloc(st_info->arena, ksources, sizeof *sketch_source);
+    struct GtoolsSketch *sketch = NULL;
+
+    if ( sketch_source == NULL ) return(sf_oom_error("sf_egen_bulk_accum", "sketch_source"));
+
+    for (k = 0; k < ktargets; k++) {
+        if ( statcode[k] < GTOOLS_SKETCH_CODE ) sketch_source[st_info->pos_targets[k]] = 1;
+    }
+
+    if ( gf_sketch_any(statcode, ktargets) ) {
+        sketch = gf_arena_calloc(st_info->arena, J * ksources, sizeof *sketch);
+        if ( sketch == NULL ) return(sf_oom_error("sf_egen_bulk_accum", "sketch"));
+        for (i = 0; i < J * ksources; i++)
+            gf_sketch_init (sketch + i, gf_sketch_k(st_info->approx_eps));
+    }
+
+    /*********************************************************************
+     *          Step 3: Read in variables and accumulate stats           *
+     *********************************************************************/
+
+    // Map each Stata observation to its group so we can read Stata in
+    // order; each value goes straight into its group's accumulator.
+
+    for (j = 0; j < J; j++) {
+        start = st_info->info[j];
+        end   = st_info->info[j + 1];
+        for (i = start; i < end; i++)
+            index_st[st_info->index[i]] = j + 1;
+    }
+
+    for (i = 0; i < st_info->Nread; i++) {
+        if ( index_st[i] == 0 ) continue;
+        j     = index_st[i] - 1;
+        start = st_info->info[j];
+        end   = st_info->info[j + 1];
+
+        offset_source = j * ksources;
+        offset_hll    = j * hll_k;
+        for (k = 0; k < ksources; k++) {
+            if ( (rc = SF_vdata(pos_sources[k], i + st_info->in1, &z)) ) goto exit;
+            gf_accum_update (
+                accum + offset_source + k,
+                z,
+                i == st_info->index[start],
+                i == st_info->index[end - 1]
+            );
+            if ( sketch_source[k] & !SF_is_missing(z) ) {
+                if ( (rc = gf_sketch_update(sketch + offset_source + k, z)) ) goto exit;
+            }
+            if ( hll_slot[k] ) {
+                gf_hll_update(hll + (offset_hll + hll_slot[k] - 1) * hll_m, hll_p, z);
             }
         }
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_READ);
     if ( st_info->benchmark > 2 )
-        sf_running_timer (&stimer, "\t\tPlugin step 5.2: Computed summary stats");
+        sf_running_timer (&stimer, "\t\tPlugin step 5.1: Read and accumulated source variables");
 
-    if ( st_info->benchmark > 1 )
-        sf_running_timer (&timer, "\tPlugin step 5: Generated output array");
+    /*********************************************************************
+     *                Step 4: Collapse variables by group                *
+     *********************************************************************/
 
-exit:
+    for (j = 0; j < J; j++)
+        for (k = 0; k < ksources; k++)
+            nmfreq[k] += accum[j * ksources + k].nonmiss;
 
-    free (pos_sources);
-    free (statcode);
+    for (j = 0; j < J; j++) {
 
-    free (index_st);
+        // The jth output corresponds to the st_info->ix[j]th group
+        l = st_info->ix[j];
+        offset_output = j * ktargets;
+        offset_source = l * ksources;
+
+        for (k = 0; k < ktargets; k++) {
+            if ( statcode[k] < GTOOLS_SKETCH_CODE ) {
+                output[offset_output + k] = gf_sketch_quantile (
+                    sketch + offset_source + st_info->pos_targets[k],
+                    gf_sketch_exact(statcode[k])
+                );
+                continue;
+            }
+            if ( statcode[k] == GTOOLS_HLL_CODE ) {
+                output[offset_output + k] = gf_hll_count (
+                    hll + (l * hll_k + hll_slot[st_info->pos_targets[k]] - 1) * hll_m,
+                    hll_p
+                );
+                continue;
+            }
+            output[offset_output + k] = gf_accum_stat (
+                accum + offset_source + st_info->pos_targets[k],
+                statcode[k],
+                st_info->info[l + 1] - st_info->info[l],
+                nmfreq[st_info->pos_targets[k]],
+                st_info->keepmiss
+            );
+        }
+    }
 
-    free (nuniq_h1);
-    free (nuniq_h2);
-    free (nuniq_h3);
-    free (nuniq_ix);
-    free (nuniq_xcopy);
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_STATS);
+    if ( st_info->benchmark > 2 )
+        sf_running_timer (&stimer, "\t\tPlugin step 5.2: Computed summary stats");
 
-    free (all_buffer);
-    free (all_firstmiss);
-    free (all_lastmiss);
-    free (all_nonmiss);
-    free (all_yesmiss);
-    free (offsets_buffer);
-    free (nj_buffer);
+    if ( st_info->benchmark > 1 )
+        sf_running_timer (&timer, "\tPlugin step 5: Generated output array");
 
-    free (nmfreq);
-    free (firstmiss);
-    free (lastmiss);
-    free (firstnm);
-    free (lastnm);
+exit:
+
+    gf_arena_free (st_info->arena, pos_sources);
+    gf_arena_free (st_info->arena, statcode);
+    gf_arena_free (st_info->arena, accum);
+    gf_arena_free (st_info->arena, nmfreq);
+    gf_arena_free (st_info->arena, index_st);
+    gf_arena_free (st_info->arena, sketch_source);
+    gf_arena_free (st_info->arena, hll_slot);
+    gf_arena_free (st_info->arena, hll);
+
+    if ( sketch != NULL ) {
+        for (i = 0; i < J * ksources; i++)
+            gf_sketch_free (sketch + i);
+        gf_arena_free (st_info->arena, sketch);
+    }
 
     return (rc);
 }
@@ -408,15 +850,15 @@ ST_retcode sf_egen_multiple_sources (struct StataInfo *st_info, int level)
     for (k = 0; k < ksources; k++)
         pos_sources[k] = start_sources + k;
 
+    // The whole group is in memory, so approximate stats are exact
     for (k = 0; k < st_info->kvars_stats; k++)
-        statcode[k] = st_info->statcode[k];
+        statcode[k] = gf_sketch_exact(st_info->statcode[k]);
 
-    st_info->output = calloc(J * ktargets, sizeof st_info->output);
+    st_info->output = gf_arena_calloc(st_info->arena, J * ktargets, sizeof st_info->output);
     if ( st_info->output == NULL ) return(sf_oom_error("sf_egen_bulk", "st_info->output"));
 
     GTOOLS_GC_ALLOCATED("st_info->output")
     ST_double *output = st_info->output;
-    st_info->free = 9;
 
     nj_max = st_info->info[1] - st_info->info[0];
     for (j = 1; j < st_info->J; j++) {
@@ -424,17 +866,16 @@ ST_retcode sf_egen_multiple_sources (struct StataInfo *st_info, int level)
             nj_max = (st_info->info[j + 1] - st_info->info[j]);
     }
 
-    GT_size   *nuniq_ix    = calloc(st_info->nunique? nj_max * ksources: 1, sizeof *nuniq_ix);
     uint64_t  *nuniq_h1    = calloc(st_info->nunique? nj_max * ksources: 1, sizeof *nuniq_h1);
-    uint64_t  *nuniq_h2    = calloc(st_info->nunique? nj_max * ksources: 1, sizeof *nuniq_h2);
-    uint64_t  *nuniq_h3    = calloc(st_info->nunique? nj_max * ksources: 1, sizeof *nuniq_h3);
     uint64_t  *nuniq_xcopy = calloc(st_info->nunique? nj_max * ksources: 1, sizeof *nuniq_xcopy);
 
-    if ( nuniq_ix    == NULL ) return(sf_oom_error("sf_egen_multiple_sources", "nuniq_ix"));
-    if ( nuniq_h1    == NULL ) return(sf_oom_error("sf_egen_multiple_sources", "nuniq_h1"));
-    if ( nuniq_h2    == NULL ) return(sf_oom_error("sf_egen_multiple_sources", "nuniq_h2"));
-    if ( nuniq_h3    == NULL ) return(sf_oom_error("sf_egen_multiple_sources", "nuniq_h3"));
-    if ( nuniq_xcopy == NULL ) return(sf_oom_error("sf_egen_multiple_sources", "nuniq_xcopy"));
+    struct GtoolsHashSet nuniq_set[1];
+    gf_hashset_alloc (nuniq_set, st_info->nunique? nj_max * ksources: 1);
+
+    if ( nuniq_h1         == NULL ) return(sf_oom_error("sf_egen_multiple_sources", "nuniq_h1"));
+    if ( nuniq_xcopy      == NULL ) return(sf_oom_error("sf_egen_multiple_sources", "nuniq_xcopy"));
+    if ( nuniq_set->keys  == NULL ) return(sf_oom_error("sf_egen_multiple_sources", "nuniq_set->keys"));
+    if ( nuniq_set->stamp == NULL ) return(sf_oom_error("sf_egen_multiple_sources", "nuniq_set->stamp"));
 
     ST_double *all_buffer     = calloc(N * ksources, sizeof *all_buffer);
     GT_bool   *all_firstmiss  = calloc(J, sizeof *all_firstmiss);
@@ -523,6 +964,7 @@ ST_retcode sf_egen_multiple_sources (struct StataInfo *st_info, int level)
         }
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_READ);
     if ( st_info->benchmark > 2 )
         sf_running_timer (&stimer, "\t\tPlugin step 5.1: Read source variables sequentially");
 
@@ -608,10 +1050,8 @@ ST_retcode sf_egen_multiple_sources (struct StataInfo *st_info, int level)
                             nj * ksources,
                             (end == 0),
                             nuniq_h1,
-                            nuniq_h2,
-                            nuniq_h3,
-                            nuniq_ix,
-                            nuniq_xcopy
+                            nuniq_xcopy,
+                            nuniq_set
                         )
                     ) ) return (rc);
                 }
@@ -643,6 +1083,7 @@ ST_retcode sf_egen_multiple_sources (struct StataInfo *st_info, int level)
         }
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_STATS);
     if ( st_info->benchmark > 2 )
         sf_running_timer (&stimer, "\t\tPlugin step 5.2: Computed summary stats");
 
@@ -657,10 +1098,8 @@ exit:
     free (index_st);
 
     free (nuniq_h1);
-    free (nuniq_h2);
-    free (nuniq_h3);
-    free (nuniq_ix);
     free (nuniq_xcopy);
+    gf_hashset_free (nuniq_set);
 
     free (all_buffer);
     free (all_firstmiss);
@@ -741,20 +1180,14 @@ ST_retcode sf_write_output (struct StataInfo *st_info, int level, GT_size wtarge
         }
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_WRITE);
     if ( st_info->benchmark > 1 )
         sf_running_timer (&timer, "\tPlugin step 6: Copied summary stats to stata");
 
     if ( (wtargets < ktargets) & (level == 2) & (within == 0) ) {
-        GT_size kextra = ktargets - wtargets;
-        FILE *fhandle = fopen(fname, "wb");
-
-        for (j = 0; j < st_info->J; j++) {
-            fwrite (st_info->output + j * ktargets + wtargets,
-                    sizeof(st_info->output), kextra, fhandle);
-        }
-
-        fclose (fhandle);
+        if ( (rc = gf_write_collapsed (fname, st_info->output, wtargets, ktargets, st_info->J)) ) goto exit;
 
+        gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_WRITE);
         if ( st_info->benchmark > 1 )
             sf_running_timer (&timer, "\tPlugin step 7: Copied some targets to disk");
     }
@@ -808,7 +1241,7 @@ ST_retcode sf_write_collapsed (struct StataInfo *st_info, int level, GT_size wta
                 for (k = 0; k < kvars; k++) {
                     sel = j * rowbytes + st_info->positions[k];
                     if ( st_info->byvars_lens[k] > 0 ) {
-                        if ( (rc = SF_sstore(k + 1, j + 1, st_info->st_by_charx + sel)) ) goto exit;
+                        if ( (rc = SF_sstore(k + 1, j + 1, GTOOLS_STRREF_STR(st_info->st_by_strx, st_info->st_by_charx + sel))) ) goto exit;
                     }
                     else {
                         z = *((ST_double *) (st_info->st_by_charx + sel));
@@ -842,6 +1275,7 @@ ST_retcode sf_write_collapsed (struct StataInfo *st_info, int level, GT_size wta
         }
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_WRITE);
     if ( st_info->benchmark > 1 )
         sf_running_timer (&timer, "\tPlugin step 6: Copied collapsed data to stata");
 
@@ -850,16 +1284,9 @@ ST_retcode sf_write_collapsed (struct StataInfo *st_info, int level, GT_size wta
      *********************************************************************/
 
     if ( (wtargets < ktargets) & (level == 2) ) {
-        GT_size kextra = ktargets - wtargets;
-        FILE *fhandle = fopen(fname, "wb");
-
-        for (j = 0; j < st_info->J; j++) {
-            fwrite (st_info->output + j * ktargets + wtargets,
-                    sizeof(st_info->output), kextra, fhandle);
-        }
-
-        fclose (fhandle);
+        if ( (rc = gf_write_collapsed (fname, st_info->output, wtargets, ktargets, st_info->J)) ) goto exit;
 
+        gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_WRITE);
         if ( st_info->benchmark > 1 )
             sf_running_timer (&timer, "\tPlugin step 7: Copied some targets to disk");
     }
@@ -899,7 +1326,7 @@ ST_retcode sf_write_byvars (struct StataInfo *st_info, int level)
             for (k = 0; k < kvars; k++) {
                 sel = j * rowbytes + st_info->positions[k];
                 if ( st_info->byvars_lens[k] > 0 ) {
-                    if ( (rc = SF_sstore(k + 1, j + 1, st_info->st_by_charx + sel)) ) goto exit;
+                    if ( (rc = SF_sstore(k + 1, j + 1, GTOOLS_STRREF_STR(st_info->st_by_strx, st_info->st_by_charx + sel))) ) goto exit;
                 }
                 else {
                     z = *((ST_double *) (st_info->st_by_charx + sel));
@@ -918,6 +1345,7 @@ ST_retcode sf_write_byvars (struct StataInfo *st_info, int level)
         }
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_WRITE);
     if ( st_info->benchmark > 1 )
         sf_running_timer (&timer, "\tPlugin step 6: Copied by variables back to stata");
 
@@ -933,19 +1361,22 @@ ST_retcode sf_read_collapsed (GT_size J, GT_size kextra, char *fname)
 
     GT_size j, k;
     ST_retcode rc = 0;
+    struct GtoolsSpill spill;
 
-    ST_double *output = calloc(J * kextra, sizeof *output);
-    if ( output == NULL ) return(sf_oom_error("sf_read_collapsed", "output"));
-
-    gf_read_collapsed (fname, output, kextra, J);
+    // The entries are stored in Stata straight from the mapped file
+    if ( (rc = gf_spill_open (fname, &spill)) ) goto exit;
+    if ( (spill.J != J) || (spill.k != kextra) ) {
+        sf_errprintf ("Spill file %s does not have the expected dimensions.\n", fname);
+        rc = 610; goto exit;
+    }
 
     for (j = 0; j < J; j++) {
         for (k = 0; k < kextra; k++) {
-            if ( (rc = SF_vstore(k + 1, j + 1, output[j * kextra + k])) ) goto exit;
+            if ( (rc = SF_vstore(k + 1, j + 1, spill.data[j * kextra + k])) ) goto exit;
         }
     }
 
 exit:
-    free (output);
+    gf_spill_close (&spill);
     return (rc);
 }
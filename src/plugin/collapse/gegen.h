@@ -0,0 +1,63 @@
+#ifndef GTOOLS_GEGEN
+#define GTOOLS_GEGEN
+
+/*
+ * Per-group summary stats (Step 4 of sf_egen_bulk, Step 5 of
+ * sf_egen_bulk_w) run one group at a time on the thread pool via
+ * gf_pool_steal. Groups only read their own segment of all_buffer and
+ * only write their own row of output; everything else a group needs
+ * that gets modified lives in the worker's scratch space.
+ */
+
+struct eScratch {
+    ST_double *firstmiss;
+    ST_double *lastmiss;
+    ST_double *firstnm;
+    ST_double *lastnm;
+    ST_double *p_buffer;
+    uint64_t  *nuniq_h1;
+    uint64_t  *nuniq_xcopy;
+    struct GtoolsHashSet nuniq_set;
+    ST_double *quantiles;
+    ST_double *qoutput;
+    ST_double *qvalues;
+    GT_size   *qranks;
+};
+
+struct eInfo {
+    struct StataInfo *st_info;
+    struct eScratch  *scratch;
+    ST_double *output;
+    ST_double *statcode;
+    ST_double *all_buffer;
+    GT_size   *offsets_buffer;
+    GT_size   *nj_buffer;
+    // unweighted
+    GT_bool   *all_firstmiss;
+    GT_bool   *all_lastmiss;
+    GT_size   *all_nonmiss;
+    GT_size   *nmfreq;
+    // weighted
+    GT_bool   aweights;
+    ST_double *weights;
+    ST_double *all_wsum;
+    ST_double *all_xwsum;
+    GT_size   *all_xcount;
+    ST_double *nmfreq_w;
+};
+
+struct eScratch *gf_egen_scratch_alloc (
+    GT_size nworkers,
+    GT_size ksources,
+    GT_size ktargets,
+    GT_size nj_max,
+    GT_bool nunique,
+    GT_bool weights
+);
+
+void gf_egen_scratch_free (struct eScratch *scratch, GT_size nworkers);
+
+ST_retcode gf_egen_group   (void *context, GT_size worker, GT_size j);
+ST_retcode gf_egen_group_w (void *context, GT_size worker, GT_size j);
+
+#endif
@@ -1,3 +1,5 @@
+#include "gegen.h"
+
 ST_retcode sf_egen_bulk_w (struct StataInfo *st_info, int level);
 
 /**
@@ -31,10 +33,9 @@ ST_retcode sf_egen_bulk_w (struct StataInfo *st_info, int level)
 
     GT_bool aweights = (st_info->wcode == 1);
     GT_size i, j, k, l;
-    GT_size nj, nj_max, start, startw, end;
-    ST_double endw, endwraw;
-    GT_size offset_output,
-           offset_source,
+    GT_size nj, nj_max, start, end, nworkers;
+    ST_double endwraw;
+    GT_size offset_source,
            offset_buffer,
            offset_weight;
 
@@ -54,23 +55,48 @@ ST_retcode sf_egen_bulk_w (struct StataInfo *st_info, int level)
      *                     Step 2: Memory allocation                     *
      *********************************************************************/
 
+    // Everything is freed on exit, so it is all declared before the
+    // first allocation that can fail.
+
+    struct eScratch *scratch  = NULL;
+    ST_double *weights        = NULL;
+    GT_size   *nbuffer        = NULL;
+    ST_double *all_buffer     = NULL;
+    ST_double *all_wsum       = NULL;
+    ST_double *all_xwsum      = NULL;
+    GT_size   *all_xcount     = NULL;
+    GT_size   *offsets_buffer = NULL;
+    GT_size   *nj_buffer      = NULL;
+    ST_double *nmfreq         = NULL;
+    GT_size   *index_st       = NULL;
+
+    nworkers = 0;
+
     GT_size *pos_sources = calloc(ksources, sizeof *pos_sources);
     ST_double *statcode  = calloc(ktargets, sizeof *statcode);
 
-    if ( pos_sources == NULL ) return(sf_oom_error("sf_egen_bulk_w", "pos_sources"));
+    if ( pos_sources == NULL ) { rc = sf_oom_error("sf_egen_bulk_w", "pos_sources"); goto exit; }
+    if ( statcode    == NULL ) { rc = sf_oom_error("sf_egen_bulk_w", "statcode");    goto exit; }
 
     for (k = 0; k < ksources; k++)
         pos_sources[k] = start_sources + k;
 
+    // The whole group is in memory, so approximate stats are exact
     for (k = 0; k < st_info->kvars_stats; k++)
-        statcode[k] = st_info->statcode[k];
+        statcode[k] = gf_sketch_exact(st_info->statcode[k]);
+
+    if ( st_info->verbose ) {
+        if ( gf_sketch_any(st_info->statcode, st_info->kvars_stats)
+          || gf_hll_any(st_info->statcode, st_info->kvars_stats) ) {
+            sf_printf("approx stats: the data are buffered, so they are computed exactly\n");
+        }
+    }
 
-    st_info->output = calloc(J * ktargets, sizeof st_info->output);
-    if ( st_info->output == NULL ) return(sf_oom_error("sf_egen_bulk_w", "st_info->output"));
+    st_info->output = gf_arena_calloc(st_info->arena, J * ktargets, sizeof st_info->output);
+    if ( st_info->output == NULL ) { rc = sf_oom_error("sf_egen_bulk_w", "st_info->output"); goto exit; }
 
     GTOOLS_GC_ALLOCATED("st_info->output")
     ST_double *output = st_info->output;
-    st_info->free = 9;
 
     nj_max = st_info->info[1] - st_info->info[0];
     for (j = 1; j < st_info->J; j++) {
@@ -78,60 +104,40 @@ ST_retcode sf_egen_bulk_w (struct StataInfo *st_info, int level)
             nj_max = (st_info->info[j + 1] - st_info->info[j]);
     }
 
-    GT_size   *nuniq_ix    = calloc(st_info->nunique? nj_max: 1, sizeof *nuniq_ix);
-    uint64_t  *nuniq_h1    = calloc(st_info->nunique? nj_max: 1, sizeof *nuniq_h1);
-    uint64_t  *nuniq_h2    = calloc(st_info->nunique? nj_max: 1, sizeof *nuniq_h2);
-    uint64_t  *nuniq_h3    = calloc(st_info->nunique? nj_max: 1, sizeof *nuniq_h3);
-    uint64_t  *nuniq_xcopy = calloc(st_info->nunique? nj_max: 1, sizeof *nuniq_xcopy);
-
-    if ( nuniq_ix    == NULL ) return(sf_oom_error("sf_egen_bulk_w", "nuniq_ix"));
-    if ( nuniq_h1    == NULL ) return(sf_oom_error("sf_egen_bulk_w", "nuniq_h1"));
-    if ( nuniq_h2    == NULL ) return(sf_oom_error("sf_egen_bulk_w", "nuniq_h2"));
-    if ( nuniq_h3    == NULL ) return(sf_oom_error("sf_egen_bulk_w", "nuniq_h3"));
-    if ( nuniq_xcopy == NULL ) return(sf_oom_error("sf_egen_bulk_w", "nuniq_xcopy"));
-
-    ST_double *p_buffer = calloc(2 * nj_max, sizeof *p_buffer);
-    ST_double *weights  = calloc(N, sizeof *weights);
-    GT_size   *nbuffer  = calloc(J, sizeof *nbuffer);
-
-    if ( p_buffer == NULL ) return(sf_oom_error("sf_egen_bulk_w", "p_buffer"));
-    if ( weights  == NULL ) return(sf_oom_error("sf_egen_bulk_w", "weights"));
-    if ( nbuffer  == NULL ) return(sf_oom_error("sf_egen_bulk_w", "nbuffer"));
-
-    ST_double *all_buffer     = calloc(N * ksources, sizeof *all_buffer);
-    ST_double *all_wsum       = calloc(J * ksources, sizeof *all_wsum);
-    ST_double *all_xwsum      = calloc(J * ksources, sizeof *all_xwsum);
-    GT_size   *all_xcount     = calloc(J * ksources, sizeof *all_xcount);
-    GT_size   *offsets_buffer = calloc(J, sizeof *offsets_buffer);
-    GT_size   *nj_buffer      = calloc(J, sizeof *nj_buffer);
-
-    if ( all_buffer     == NULL ) return(sf_oom_error("sf_egen_bulk_w", "all_buffer"));
-    if ( all_wsum       == NULL ) return(sf_oom_error("sf_egen_bulk_w", "all_wsum"));
-    if ( all_xwsum      == NULL ) return(sf_oom_error("sf_egen_bulk_w", "all_xwsum"));
-    if ( all_xcount     == NULL ) return(sf_oom_error("sf_egen_bulk_w", "all_xcount"));
-    if ( offsets_buffer == NULL ) return(sf_oom_error("sf_egen_bulk_w", "offsets_buffer"));
-    if ( nj_buffer      == NULL ) return(sf_oom_error("sf_egen_bulk_w", "nj_buffer"));
+    // Each worker computing group stats in Step 5 has its own scratch space
+    nworkers = gf_pool_steal_workers(J, N);
+    scratch  = gf_egen_scratch_alloc(nworkers, ksources, ktargets, nj_max, st_info->nunique, 1);
+    if ( scratch == NULL ) { rc = sf_oom_error("sf_egen_bulk_w", "scratch"); goto exit; }
+
+    weights  = calloc(N, sizeof *weights);
+    nbuffer  = calloc(J, sizeof *nbuffer);
+
+    if ( weights  == NULL ) { rc = sf_oom_error("sf_egen_bulk_w", "weights"); goto exit; }
+    if ( nbuffer  == NULL ) { rc = sf_oom_error("sf_egen_bulk_w", "nbuffer"); goto exit; }
+
+    all_buffer     = calloc(N * ksources, sizeof *all_buffer);
+    all_wsum       = calloc(J * ksources, sizeof *all_wsum);
+    all_xwsum      = calloc(J * ksources, sizeof *all_xwsum);
+    all_xcount     = calloc(J * ksources, sizeof *all_xcount);
+    offsets_buffer = calloc(J, sizeof *offsets_buffer);
+    nj_buffer      = calloc(J, sizeof *nj_buffer);
+
+    if ( all_buffer     == NULL ) { rc = sf_oom_error("sf_egen_bulk_w", "all_buffer");     goto exit; }
+    if ( all_wsum       == NULL ) { rc = sf_oom_error("sf_egen_bulk_w", "all_wsum");       goto exit; }
+    if ( all_xwsum      == NULL ) { rc = sf_oom_error("sf_egen_bulk_w", "all_xwsum");      goto exit; }
+    if ( all_xcount     == NULL ) { rc = sf_oom_error("sf_egen_bulk_w", "all_xcount");     goto exit; }
+    if ( offsets_buffer == NULL ) { rc = sf_oom_error("sf_egen_bulk_w", "offsets_buffer"); goto exit; }
+    if ( nj_buffer      == NULL ) { rc = sf_oom_error("sf_egen_bulk_w", "nj_buffer");      goto exit; }
 
     for (j = 0; j < J; j++)
         nbuffer[j] = 0;
 
-    ST_double *nmfreq = calloc(ksources, sizeof *nmfreq);
-    if ( nmfreq == NULL ) return(sf_oom_error("sf_egen_bulk_w", "nmfreq"));
+    nmfreq = calloc(ksources, sizeof *nmfreq);
+    if ( nmfreq == NULL ) { rc = sf_oom_error("sf_egen_bulk_w", "nmfreq"); goto exit; }
 
     for (k = 0; k < ksources; k++)
         nmfreq[k] = 0;
 
-    ST_double *firstmiss = calloc(ksources, sizeof *firstmiss);
-    ST_double *lastmiss  = calloc(ksources, sizeof *lastmiss);
-    ST_double *firstnm   = calloc(ksources, sizeof *firstnm);
-    ST_double *lastnm    = calloc(ksources, sizeof *lastnm);
-
-    if ( firstmiss == NULL ) return(sf_oom_error("sf_egen_bulk", "firstmiss"));
-    if ( lastmiss  == NULL ) return(sf_oom_error("sf_egen_bulk", "lastmiss"));
-    if ( firstnm   == NULL ) return(sf_oom_error("sf_egen_bulk", "firstnm"));
-    if ( lastnm    == NULL ) return(sf_oom_error("sf_egen_bulk", "lastnm"));
-
-
     /*********************************************************************
      *               Step 3: Read in variables from Stata                *
      *********************************************************************/
@@ -144,8 +150,8 @@ ST_retcode sf_egen_bulk_w (struct StataInfo *st_info, int level)
      * observations from Stata in order; this is only sometimes faster,
      */
 
-    GT_size *index_st = calloc(st_info->Nread, sizeof *index_st);
-    if ( index_st == NULL ) return(sf_oom_error("sf_egen_bulk", "index_st"));
+    index_st = calloc(st_info->Nread, sizeof *index_st);
+    if ( index_st == NULL ) { rc = sf_oom_error("sf_egen_bulk_w", "index_st"); goto exit; }
 
     for (i = 0; i < st_info->Nread; i++) {
         index_st[i] = 0;
@@ -183,6 +189,7 @@ ST_retcode sf_egen_bulk_w (struct StataInfo *st_info, int level)
         nbuffer[j]++;
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_READ);
     if ( st_info->benchmark > 2 )
         sf_running_timer (&stimer, "\t\tPlugin step 5.1: Read source variables sequentially");
 
@@ -213,6 +220,7 @@ ST_retcode sf_egen_bulk_w (struct StataInfo *st_info, int level)
         }
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_STATS);
     if ( st_info->benchmark > 2 )
         sf_running_timer (&stimer, "\t\tPlugin step 5.2: Pre-computed weighted sums");
 
@@ -220,122 +228,27 @@ ST_retcode sf_egen_bulk_w (struct StataInfo *st_info, int level)
      *                Step 5: Collapse variables by gorup                *
      *********************************************************************/
 
-    {
-        for (j = 0; j < J; j++) {
-
-            // Remember we read things in group sort order but info and index
-            // are in hash sort order, so the jth output corresponds to the
-            // st_info->ix[j]th source
-            offset_output = j * ktargets;
-            offset_source = st_info->ix[j] * ksources;
-            offset_buffer = offsets_buffer[j];
-            offset_weight = st_info->info[st_info->ix[j]];
-            nj            = nj_buffer[j];
-
-            // Get the position of the first and last obs of each source
-            // variable (in case they are modified by calling qselect)
-            for (k = 0; k < ksources; k++) {
-                start        = offset_buffer + nj * k;
-                firstmiss[k] = all_buffer[start];
-                lastmiss[k]  = all_buffer[start + nj - 1];
-                firstnm[k]   = gf_array_dfirstnm(all_buffer + offset_buffer + nj * k, nj);
-                lastnm[k]    = gf_array_dlastnm (all_buffer + offset_buffer + nj * k, nj);
-            }
-
-            for (k = 0; k < ktargets; k++) {
-
-                // For each target, grab start and end position of source variable
-                start    = offset_buffer + nj * st_info->pos_targets[k];
-                startw   = j * ksources + st_info->pos_targets[k];
-                endwraw  = all_wsum[startw];
-                endw     = endwraw == SV_missval? 0: endwraw;
-
-                // If there is at least one non-missing observation, we store
-                // the result in output. If all observations are missing then
-                // we store Stata's special SV_missval
-                if ( statcode[k] == -6 ) { // count
-                    // If count, you just need to know how many non-missing obs there are
-                    output[offset_output + k] = aweights? all_xcount[startw]: endw;
-                }
-                else if ( statcode[k] == -14 ) { // freq
-                    output[offset_output + k] = nj;
-                }
-                else if ( statcode[k] == -7  ) { // percent
-                    // Percent outputs the % of all non-missing values of
-                    // that variable in that group relative to the number
-                    // of non-missing values of that variable in the entire
-                    // data. This latter count is stored in nmfreq; we divide
-                    // by this when writing to Stata.
-                    output[offset_output + k] = 100 * (endw / nmfreq[st_info->pos_targets[k]]);
-                }
-                else if ( statcode[k] == -10 ) { // first
-                    output[offset_output + k] = firstmiss[st_info->pos_targets[k]];
-                }
-                else if ( statcode[k] == -11 ) { // firstnm
-                    // First non-missing is the first entry in the inputs buffer;
-                    // this is only missing if all are missing.
-                    output[offset_output + k] = firstnm[st_info->pos_targets[k]];
-                }
-                else if (statcode[k] == -12 ) { // last
-                    output[offset_output + k] = lastmiss[st_info->pos_targets[k]];
-                }
-                else if ( statcode[k] == -13 ) { // lastnm
-                    // Last non-missing is the last entry in the inputs buffer;
-                    // this is only missing is all are missing.
-                    output[offset_output + k] = lastnm[st_info->pos_targets[k]];
-                }
-                else if ( statcode[k] == -18 ) { // nunique
-                    if ( (rc = gf_array_nunique_range (
-                            output + offset_output + k,
-                            all_buffer + start,
-                            nj,
-                            (endwraw == SV_missval),
-                            nuniq_h1,
-                            nuniq_h2,
-                            nuniq_h3,
-                            nuniq_ix,
-                            nuniq_xcopy
-                        )
-                    ) ) return (rc);
-                }
-                else if ( endwraw == SV_missval ) { // all missing values
-                    // If everything is missing, write a missing value, Except
-                    // for sums, which go to 0 for some reason (this is the
-                    // behavior of collapse), and min/max (which pick out the
-                    // min/max missing value).
-                    if ( (statcode[k] == -1) & (st_info->keepmiss == 0) ) { // sum
-                        output[offset_output + k] = 0;
-                    }
-                    else if ( statcode[k] == -4 ) { // max
-                        // min/max handle missings b/c they only do comparisons
-                        output[offset_output + k] = gf_array_dmax_range (all_buffer + start, 0, nj);
-                    }
-                    else if ( statcode[k] == -5 ) { // min
-                        // min/max handle missings b/c they only do comparisons
-                        output[offset_output + k] = gf_array_dmin_range (all_buffer + start, 0, nj);
-                    }
-                    else {
-                        output[offset_output + k] = SV_missval;
-                    }
-                }
-                else {
-                    // Otherwise compute the requested summary stat
-                    output[offset_output + k] = gf_switch_fun_code_w (
-                        statcode[k],
-                        all_buffer + start,
-                        nj,
-                        weights + offset_weight,
-                        all_xwsum[startw],
-                        all_wsum[startw],
-                        all_xcount[startw],
-                        aweights,
-                        p_buffer
-                    );
-                }
-            }
-        }
-    }
-
+    // Groups are independent, but their sizes can be very uneven, so
+    // they are handed out to the workers with work stealing.
+
+    struct eInfo einfo = {0};
+    einfo.st_info        = st_info;
+    einfo.scratch        = scratch;
+    einfo.output         = output;
+    einfo.statcode       = statcode;
+    einfo.all_buffer     = all_buffer;
+    einfo.offsets_buffer = offsets_buffer;
+    einfo.nj_buffer      = nj_buffer;
+    einfo.aweights       = aweights;
+    einfo.weights        = weights;
+    einfo.all_wsum       = all_wsum;
+    einfo.all_xwsum      = all_xwsum;
+    einfo.all_xcount     = all_xcount;
+    einfo.nmfreq_w       = nmfreq;
+
+    if ( (rc = gf_pool_steal (gf_egen_group_w, &einfo, nj_buffer, J, nworkers)) ) goto exit;
+
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_STATS);
     if ( st_info->benchmark > 2 )
         sf_running_timer (&stimer, "\t\tPlugin step 5.3: Computed summary stats");
 
@@ -349,13 +262,8 @@ exit:
 
     free (index_st);
 
-    free (nuniq_h1);
-    free (nuniq_h2);
-    free (nuniq_h3);
-    free (nuniq_ix);
-    free (nuniq_xcopy);
+    gf_egen_scratch_free (scratch, nworkers);
 
-    free (p_buffer);
     free (weights);
     free (nbuffer);
 
@@ -367,10 +275,162 @@ exit:
     free (nj_buffer);
 
     free (nmfreq);
-    free (firstmiss);
-    free (lastmiss);
-    free (firstnm);
-    free (lastnm);
+
+    return (rc);
+}
+
+/**
+ * @brief Weighted summary stats for the jth group (Step 5 of sf_egen_bulk_w)
+ *
+ * @param context Pointer to struct eInfo with the data for all groups
+ * @param worker Worker running this group; indexes its scratch space
+ * @param j Group to summarize
+ * @return Stores the stats for group @j in output
+ */
+ST_retcode gf_egen_group_w (void *context, GT_size worker, GT_size j)
+{
+    struct eInfo *einfo = ((struct eInfo *) context);
+    struct StataInfo *st_info = einfo->st_info;
+    struct eScratch  *scratch = einfo->scratch + worker;
+
+    ST_retcode rc = 0;
+    GT_size k, nj, start, startw;
+    ST_double endw, endwraw;
+    GT_size offset_output,
+            offset_buffer,
+            offset_weight;
+
+    GT_size ksources = st_info->kvars_sources;
+    GT_size ktargets = st_info->kvars_targets;
+
+    GT_bool   aweights        = einfo->aweights;
+    ST_double *output         = einfo->output;
+    ST_double *statcode       = einfo->statcode;
+    ST_double *all_buffer     = einfo->all_buffer;
+    GT_size   *offsets_buffer = einfo->offsets_buffer;
+    GT_size   *nj_buffer      = einfo->nj_buffer;
+    ST_double *weights        = einfo->weights;
+    ST_double *all_wsum       = einfo->all_wsum;
+    ST_double *all_xwsum      = einfo->all_xwsum;
+    GT_size   *all_xcount     = einfo->all_xcount;
+    ST_double *nmfreq         = einfo->nmfreq_w;
+
+    ST_double *firstmiss   = scratch->firstmiss;
+    ST_double *lastmiss    = scratch->lastmiss;
+    ST_double *firstnm     = scratch->firstnm;
+    ST_double *lastnm      = scratch->lastnm;
+    ST_double *p_buffer    = scratch->p_buffer;
+    uint64_t  *nuniq_h1    = scratch->nuniq_h1;
+    uint64_t  *nuniq_xcopy = scratch->nuniq_xcopy;
+    struct GtoolsHashSet *nuniq_set = &(scratch->nuniq_set);
+
+    // Remember we read things in group sort order but info and index
+    // are in hash sort order, so the jth output corresponds to the
+    // st_info->ix[j]th source
+    offset_output = j * ktargets;
+    offset_buffer = offsets_buffer[j];
+    offset_weight = st_info->info[st_info->ix[j]];
+    nj            = nj_buffer[j];
+
+    // Get the position of the first and last obs of each source
+    // variable (in case they are modified by calling qselect)
+    for (k = 0; k < ksources; k++) {
+        start        = offset_buffer + nj * k;
+        firstmiss[k] = all_buffer[start];
+        lastmiss[k]  = all_buffer[start + nj - 1];
+        firstnm[k]   = gf_array_dfirstnm(all_buffer + offset_buffer + nj * k, nj);
+        lastnm[k]    = gf_array_dlastnm (all_buffer + offset_buffer + nj * k, nj);
+    }
+
+    for (k = 0; k < ktargets; k++) {
+
+        // For each target, grab start and end position of source variable
+        start    = offset_buffer + nj * st_info->pos_targets[k];
+        startw   = j * ksources + st_info->pos_targets[k];
+        endwraw  = all_wsum[startw];
+        endw     = endwraw == SV_missval? 0: endwraw;
+
+        // If there is at least one non-missing observation, we store
+        // the result in output. If all observations are missing then
+        // we store Stata's special SV_missval
+        if ( statcode[k] == -6 ) { // count
+            // If count, you just need to know how many non-missing obs there are
+            output[offset_output + k] = aweights? all_xcount[startw]: endw;
+        }
+        else if ( statcode[k] == -14 ) { // freq
+            output[offset_output + k] = nj;
+        }
+        else if ( statcode[k] == -7  ) { // percent
+            // Percent outputs the % of all non-missing values of
+            // that variable in that group relative to the number
+            // of non-missing values of that variable in the entire
+            // data. This latter count is stored in nmfreq; we divide
+            // by this when writing to Stata.
+            output[offset_output + k] = 100 * (endw / nmfreq[st_info->pos_targets[k]]);
+        }
+        else if ( statcode[k] == -10 ) { // first
+            output[offset_output + k] = firstmiss[st_info->pos_targets[k]];
+        }
+        else if ( statcode[k] == -11 ) { // firstnm
+            // First non-missing is the first entry in the inputs buffer;
+            // this is only missing if all are missing.
+            output[offset_output + k] = firstnm[st_info->pos_targets[k]];
+        }
+        else if (statcode[k] == -12 ) { // last
+            output[offset_output + k] = lastmiss[st_info->pos_targets[k]];
+        }
+        else if ( statcode[k] == -13 ) { // lastnm
+            // Last non-missing is the last entry in the inputs buffer;
+            // this is only missing is all are missing.
+            output[offset_output + k] = lastnm[st_info->pos_targets[k]];
+        }
+        else if ( statcode[k] == -18 ) { // nunique
+            if ( (rc = gf_array_nunique_range (
+                    output + offset_output + k,
+                    all_buffer + start,
+                    nj,
+                    (endwraw == SV_missval),
+                    nuniq_h1,
+                    nuniq_xcopy,
+                    nuniq_set
+                )
+            ) ) return (rc);
+        }
+        else if ( endwraw == SV_missval ) { // all missing values
+            // If everything is missing, write a missing value, Except
+            // for sums, which go to 0 for some reason (this is the
+            // behavior of collapse), and min/max (which pick out the
+            // min/max missing value).
+            if ( (statcode[k] == -1) & (st_info->keepmiss == 0) ) { // sum
+                output[offset_output + k] = 0;
+            }
+            else if ( statcode[k] == -4 ) { // max
+                // min/max handle missings b/c they only do comparisons
+                output[offset_output + k] = gf_array_dmax_range (all_buffer + start, 0, nj);
+            }
+            else if ( statcode[k] == -5 ) { // min
+                // min/max handle missings b/c they only do comparisons
+                output[offset_output + k] = gf_array_dmin_range (all_buffer + start, 0, nj);
+            }
+            else {
+                output[offset_output + k] = SV_missval;
+            }
+        }
+        else {
+            // Otherwise compute the requested summary stat
+            output[offset_output + k] = gf_switch_fun_code_w (
+                statcode[k],
+                all_buffer + start,
+                nj,
+                weights + offset_weight,
+                all_xwsum[startw],
+                all_wsum[startw],
+                all_xcount[startw],
+                aweights,
+                p_buffer
+            );
+        }
+    }
 
     return (rc);
 }
@@ -0,0 +1,143 @@
+#include "gtools_accum.h"
+
+/**
+ * @brief Whether every requested stat can be computed in one pass
+ *
+ * Quantiles (including the median), iqr, and nunique need all the
+ * observations in the group at once; everything else can be accumulated.
+ * Approximate quantiles (codes below -1000) and approx_nunique (-19) are
+ * accumulated in sketches.
+ *
+ * @param statcode Internal summary stat codes (see gf_code_fun)
+ * @param kstats Number of stats
+ * @return 1 if all stats can be accumulated, 0 otherwise
+ */
+GT_bool gf_accum_streamable (ST_double *statcode, GT_size kstats)
+{
+    GT_size k;
+    for (k = 0; k < kstats; k++) {
+        if ( statcode[k] > 0 )     return (0); // quantiles
+        if ( statcode[k] == -9 )   return (0); // iqr
+        if ( statcode[k] == -18 )  return (0); // nunique
+    }
+    return (1);
+}
+
+/**
+ * @brief Add one observation to the running summary stats
+ *
+ * Values are compared and added in the order they are read, so sums,
+ * min/max, and first/last match what we would get from the buffered
+ * group. The sd uses Welford's update instead of two passes.
+ *
+ * @param accum Running summary stats for the group and source variable
+ * @param z Value of the observation
+ * @param firstobs Whether this is the first observation in the group
+ * @param lastobs Whether this is the last observation in the group
+ * @return Updates @accum
+ */
+void gf_accum_update (
+    struct GtoolsAccum *accum,
+    ST_double z,
+    GT_bool firstobs,
+    GT_bool lastobs)
+{
+    ST_double delta;
+
+    if ( SF_is_missing(z) ) {
+        if ( accum->nmiss++ == 0 ) {
+            accum->firstmiss = accum->mmin = accum->mmax = z;
+        }
+        else {
+            if ( accum->mmin > z ) accum->mmin = z;
+            if ( accum->mmax < z ) accum->mmax = z;
+        }
+        accum->lastmiss = z;
+        if ( firstobs ) accum->firstobs_miss = 1;
+        if ( lastobs  ) accum->lastobs_miss  = 1;
+    }
+    else {
+        if ( accum->nonmiss++ == 0 ) {
+            accum->firstnm = accum->min = accum->max = z;
+        }
+        else {
+            if ( accum->min > z ) accum->min = z;
+            if ( accum->max < z ) accum->max = z;
+        }
+        accum->lastnm = z;
+        accum->sum   += z;
+
+        delta        = z - accum->mean;
+        accum->mean += delta / accum->nonmiss;
+        accum->m2   += delta * (z - accum->mean);
+
+        if ( (z != ((ST_double) 0)) && (z != ((ST_double) 1)) ) accum->nonbinary = 1;
+        if ( z < 0 ) accum->negative = 1;
+    }
+}
+
+/**
+ * @brief Summary stat from the running stats
+ *
+ * Follows the buffered computation in sf_egen_bulk: if all values are
+ * missing sum is 0 (unless keepmiss), min/max pick out the min/max
+ * missing value, and everything else is missing.
+ *
+ * @param accum Running summary stats for the group and source variable
+ * @param fcode Internal summary stat code (see gf_code_fun)
+ * @param nj Number of observations in the group
+ * @param nmfreq Number of non-missing observations of the source overall
+ * @param keepmiss Whether the sum of all missing values is missing
+ * @return Summary stat @fcode
+ */
+ST_double gf_accum_stat (
+    struct GtoolsAccum *accum,
+    ST_double fcode,
+    GT_size nj,
+    GT_size nmfreq,
+    GT_bool keepmiss)
+{
+    GT_size n = accum->nonmiss;
+    ST_double sd, p, rmean;
+
+    ST_double firstnm = n? accum->firstnm: accum->firstmiss;
+    ST_double lastnm  = n? accum->lastnm:  accum->lastmiss;
+
+    if ( fcode == -6  ) return (n);                                           // count
+    if ( fcode == -14 ) return (nj);                                          // freq
+    if ( fcode == -7  ) return (100 * ((ST_double) n / nmfreq));              // percent
+    if ( fcode == -10 ) return (accum->firstobs_miss? accum->firstmiss: firstnm); // first
+    if ( fcode == -11 ) return (firstnm);                                     // firstnm
+    if ( fcode == -12 ) return (accum->lastobs_miss? accum->lastmiss: lastnm);    // last
+    if ( fcode == -13 ) return (lastnm);                                      // lastnm
+
+    if ( n == 0 ) {
+        if ( (fcode == -1) & (keepmiss == 0) ) return (0);
+        if ( fcode == -4 ) return (accum->mmax);
+        if ( fcode == -5 ) return (accum->mmin);
+        return (SV_missval);
+    }
+
+    if ( fcode == -1 ) return (accum->sum);      // sum
+    if ( fcode == -2 ) return (accum->sum / n);  // mean
+    if ( fcode == -4 ) return (accum->max);      // max
+    if ( fcode == -5 ) return (accum->min);      // min
+
+    sd = sqrt(accum->m2 / (n - 1));
+    if ( fcode == -3  ) return (n < 2? SV_missval: sd);  // sd
+    if ( fcode == -15 ) return (sd / sqrt(n));           // semean
+
+    if ( fcode == -16 ) { // sebinomial
+        if ( accum->nonbinary ) return (SV_missval);
+        p = accum->sum / n;
+        return (sqrt(p * (1 - p) / n));
+    }
+
+    if ( fcode == -17 ) { // sepoisson
+        if ( accum->negative ) return (SV_missval);
+        rmean = (GT_int) (accum->sum + 0.5);
+        return (sqrt(rmean) / n);
+    }
+
+    return (SV_missval);
+}
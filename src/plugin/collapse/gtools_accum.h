@@ -0,0 +1,48 @@
+#ifndef GTOOLS_ACCUM
+#define GTOOLS_ACCUM
+
+/*
+ * Running summary stats for one source variable in one group. Updated
+ * once per observation, in the order observations are read from Stata,
+ * so the stats that do not need the whole group (everything but
+ * quantiles, iqr, and nunique) can be computed without first buffering
+ * the group's observations.
+ */
+struct GtoolsAccum {
+    GT_size   nonmiss;   // non-missing observations
+    GT_size   nmiss;     // missing observations
+    ST_double sum;       // sum of non-missing values
+    ST_double mean;      // running mean (Welford; only used for sd)
+    ST_double m2;        // running sum of squared deviations (Welford)
+    ST_double min;       // min and max of non-missing values
+    ST_double max;
+    ST_double mmin;      // min and max of missing values
+    ST_double mmax;
+    ST_double firstnm;   // first and last non-missing values read
+    ST_double lastnm;
+    ST_double firstmiss; // first and last missing values read
+    ST_double lastmiss;
+    GT_bool   firstobs_miss;
+    GT_bool   lastobs_miss;
+    GT_bool   nonbinary; // some value other than 0 or 1 (sebinomial)
+    GT_bool   negative;  // some negative value (sepoisson)
+};
+
+GT_bool gf_accum_streamable (ST_double *statcode, GT_size kstats);
+
+void gf_accum_update (
+    struct GtoolsAccum *accum,
+    ST_double z,
+    GT_bool firstobs,
+    GT_bool lastobs
+);
+
+ST_double gf_accum_stat (
+    struct GtoolsAccum *accum,
+    ST_double fcode,
+    GT_size nj,
+    GT_size nmfreq,
+    GT_bool keepmiss
+);
+
+#endif
@@ -0,0 +1,298 @@
+#include "gtools_iomodel.h"
+
+static char* gf_io_model_path (char *fname);
+
+/**
+ * @brief Query available memory (MiB)
+ *
+ * MemAvailable from /proc/meminfo where there is one (Linux; this
+ * includes memory the system can reclaim from the page cache), and the
+ * number of free pages otherwise.
+ *
+ * @return Available memory in MiB; -1 if unknown
+ */
+ST_double gf_query_free_memory (void)
+{
+    char line[256];
+    unsigned long long kib;
+    FILE *fhandle = fopen("/proc/meminfo", "r");
+    if ( fhandle != NULL ) {
+        while ( fgets(line, sizeof(line), fhandle) != NULL ) {
+            if ( sscanf(line, "MemAvailable: %llu kB", &kib) == 1 ) {
+                fclose (fhandle);
+                return ((ST_double) kib / 1024);
+            }
+        }
+        fclose (fhandle);
+    }
+
+#if defined(_SC_AVPHYS_PAGES) && defined(_SC_PAGESIZE)
+    long pages = sysconf(_SC_AVPHYS_PAGES);
+    long psize = sysconf(_SC_PAGESIZE);
+    if ( (pages > 0) && (psize > 0) )
+        return ((ST_double) pages * psize / 1024 / 1024);
+#endif
+
+    return (-1);
+}
+
+/**
+ * @brief Fit the disk round trip model to timings
+ *
+ * Least squares fit of seconds = latency + MiB * spm. If the fit gives
+ * a negative latency the line is forced through the origin, and if it
+ * gives a non-positive slope (e.g. all timings were dominated by noise)
+ * the slowest observed rate is used with no latency.
+ *
+ * @param mib Size of each timing, in MiB
+ * @param seconds Seconds to write and read back @mib
+ * @param npoints Number of timings
+ * @param model Output; sets latency and spm
+ * @return 0 on success; 198 if the timings are not valid
+ */
+ST_retcode gf_io_fit (
+    ST_double *mib,
+    ST_double *seconds,
+    GT_size npoints,
+    struct GtoolsIOModel *model)
+{
+    GT_size i;
+    ST_double mx, my, sxx, sxy, x2, xy, rate;
+
+    if ( npoints < 1 ) return (198);
+
+    mx = my = 0;
+    for (i = 0; i < npoints; i++) {
+        if ( !(mib[i] > 0) || !(seconds[i] >= 0) ) return (198);
+        mx += mib[i];
+        my += seconds[i];
+    }
+    mx /= npoints;
+    my /= npoints;
+
+    sxx = sxy = x2 = xy = 0;
+    for (i = 0; i < npoints; i++) {
+        sxx += (mib[i] - mx) * (mib[i] - mx);
+        sxy += (mib[i] - mx) * (seconds[i] - my);
+        x2  += mib[i] * mib[i];
+        xy  += mib[i] * seconds[i];
+    }
+
+    if ( sxx > 0 ) {
+        model->spm     = sxy / sxx;
+        model->latency = my - model->spm * mx;
+    }
+    else {
+        model->spm     = my / mx;
+        model->latency = 0;
+    }
+
+    if ( model->latency < 0 ) {
+        model->spm     = xy / x2;
+        model->latency = 0;
+    }
+
+    if ( !(model->spm > 0) ) {
+        model->spm     = 0;
+        model->latency = 0;
+        for (i = 0; i < npoints; i++) {
+            rate = seconds[i] / mib[i];
+            if ( rate > model->spm ) model->spm = rate;
+        }
+    }
+
+    return (0);
+}
+
+/**
+ * @brief Calibrate the disk round trip model
+ *
+ * Writes spill files of 64KiB, 1MiB, and 8MiB to @fname and reads them
+ * back (same code path as the actual spill), keeping the faster of two
+ * wall-clock timings for each size, and fits the model to them.
+ *
+ * @param fname Spill file to use for the calibration
+ * @param model Output; calibrated model
+ * @return 0 on success; error code if the spill file could not be used
+ */
+ST_retcode gf_io_calibrate (char *fname, struct GtoolsIOModel *model)
+{
+    ST_retcode rc = 0;
+    GT_size s, r, j, nrows;
+    GT_size sizes[GTOOLS_IO_SIZES] = {64 * 1024, 1024 * 1024, 8 * 1024 * 1024};
+    ST_double mib[GTOOLS_IO_SIZES], seconds[GTOOLS_IO_SIZES], start, elapsed;
+
+    GT_size maxrows = sizes[GTOOLS_IO_SIZES - 1] / sizeof(ST_double);
+    ST_double *A = malloc(maxrows * sizeof(ST_double));
+    ST_double *B = malloc(maxrows * sizeof(ST_double));
+    if ( (A == NULL) || (B == NULL) ) {
+        rc = sf_oom_error("gf_io_calibrate", "A");
+        goto exit;
+    }
+
+    for (j = 0; j < maxrows; j++)
+        A[j] = (ST_double) j;
+
+    for (s = 0; s < GTOOLS_IO_SIZES; s++) {
+        nrows      = sizes[s] / sizeof(ST_double);
+        mib[s]     = (ST_double) sizes[s] / 1024 / 1024;
+        seconds[s] = -1;
+        for (r = 0; r < 2; r++) {
+            start = gf_wall_time();
+            if ( (rc = gf_write_collapsed (fname, A, 0, 1, nrows)) ) goto exit;
+            if ( (rc = gf_read_collapsed  (fname, B, 1, nrows)) ) goto exit;
+            elapsed = gf_wall_time() - start;
+            if ( (seconds[s] < 0) || (elapsed < seconds[s]) ) seconds[s] = elapsed;
+        }
+    }
+
+    rc = gf_io_fit (mib, seconds, GTOOLS_IO_SIZES, model);
+    model->stamp = (int64_t) time(NULL);
+
+exit:
+    free (A);
+    free (B);
+    return (rc);
+}
+
+/**
+ * @brief Saved calibration for the directory of @fname, if current
+ *
+ * @param fname Spill file; the calibration is saved in the same directory
+ * @param model Output; saved model
+ * @return 1 if there is a saved calibration under GTOOLS_IO_EXPIRY seconds old
+ */
+GT_bool gf_io_model_load (char *fname, struct GtoolsIOModel *model)
+{
+    GT_bool found = 0;
+    int64_t now   = (int64_t) time(NULL);
+    char *path    = gf_io_model_path(fname);
+    if ( path == NULL ) return (0);
+
+    FILE *fhandle = fopen(path, "rb");
+    if ( fhandle != NULL ) {
+        found = (fread(model, sizeof *model, 1, fhandle) == 1)
+             && (memcmp(model->magic, GTOOLS_IO_MAGIC, sizeof(model->magic)) == 0)
+             && (model->stamp <= now)
+             && (now - model->stamp < GTOOLS_IO_EXPIRY)
+             && (model->latency >= 0)
+             && (model->spm > 0);
+        fclose (fhandle);
+    }
+
+    free (path);
+    return (found);
+}
+
+/**
+ * @brief Save calibration to the directory of @fname
+ *
+ * Failing to save the calibration is not an error; it will simply be
+ * measured again next time.
+ *
+ * @param fname Spill file; the calibration is saved in the same directory
+ * @param model Calibrated model
+ */
+void gf_io_model_save (char *fname, struct GtoolsIOModel *model)
+{
+    char *path = gf_io_model_path(fname);
+    if ( path == NULL ) return;
+
+    memcpy (model->magic, GTOOLS_IO_MAGIC, sizeof(model->magic));
+    FILE *fhandle = fopen(path, "wb");
+    if ( fhandle != NULL ) {
+        if ( fwrite(model, sizeof *model, 1, fhandle) != 1 ) {
+            fclose (fhandle);
+            remove (path);
+        }
+        else {
+            fclose (fhandle);
+        }
+    }
+
+    free (path);
+}
+
+/**
+ * @brief Decide whether to collapse extra targets via disk
+ *
+ * @param model Disk round trip model
+ * @param inputs Size of the data and time to add the targets in memory
+ * @param decision Output; model estimates and whether to use disk
+ */
+void gf_io_decide (
+    struct GtoolsIOModel *model,
+    struct GtoolsIOInputs *inputs,
+    struct GtoolsIODecision *decision)
+{
+    ST_double mib_row = (ST_double) inputs->kextra * sizeof(ST_double) / 1024 / 1024;
+
+    decision->mib_full      = inputs->N * mib_row;
+    decision->mib_collapsed = inputs->J * mib_row;
+    decision->time_io       = model->latency + decision->mib_collapsed * model->spm;
+    decision->time_cstata   = inputs->N > 0? inputs->st_time * inputs->J / inputs->N: 0;
+    decision->time_disk     = decision->time_io + decision->time_cstata;
+    decision->time_mem      = inputs->st_time;
+
+    decision->used_io = (decision->time_disk < decision->time_mem);
+    if ( (inputs->mib_mem >= 0) && (decision->mib_full > inputs->mib_mem) )
+        decision->used_io = 1;
+
+    if ( (inputs->mib_disk >= 0) && (decision->mib_collapsed >= inputs->mib_disk) )
+        decision->used_io = 0;
+}
+
+/**
+ * @brief Append @src to @dest, keeping only characters safe in a file name
+ */
+static void gf_io_model_append (char *dest, const char *src, size_t len)
+{
+    char c;
+    size_t i = strlen(dest);
+    if ( src == NULL ) return;
+    for (; *src && (i + 1 < len); src++, i++) {
+        c = *src;
+        dest[i] = ((c >= 'a') && (c <= 'z'))
+               || ((c >= 'A') && (c <= 'Z'))
+               || ((c >= '0') && (c <= '9'))
+               || (c == '-')? c: '_';
+    }
+    dest[i] = '\0';
+}
+
+/**
+ * @brief File with the saved calibration for the directory of @fname
+ *
+ * Stata's temporary directory is often shared (e.g. /tmp), so the file
+ * name includes the user and host; otherwise users and machines sharing
+ * the directory would read (and overwrite) each other's calibration.
+ */
+static char* gf_io_model_path (char *fname)
+{
+    char *filepath, *filename, *path;
+    char owner[GTOOLS_IO_OWNER] = {0}, host[GTOOLS_IO_OWNER] = {0};
+    const char *user;
+
+#if defined(_WIN64) || defined(_WIN32)
+    user = getenv("USERNAME");
+    gf_io_model_append (host, getenv("COMPUTERNAME"), sizeof host);
+#else
+    user = getenv("USER");
+    if ( user == NULL ) user = getenv("LOGNAME");
+    if ( gethostname(host, sizeof host - 1) ) host[0] = '\0';
+#endif
+
+    gf_io_model_append (owner, "_", sizeof owner);
+    gf_io_model_append (owner, user, sizeof owner);
+    gf_io_model_append (owner, "_", sizeof owner);
+    gf_io_model_append (owner, host, sizeof owner);
+
+    gf_split_path_file (&filepath, &filename, fname);
+
+    path = calloc(strlen(filepath) + strlen(GTOOLS_IO_CACHE) + strlen(owner) + 1, sizeof(char));
+    if ( path != NULL ) sprintf (path, "%s%s%s", filepath, GTOOLS_IO_CACHE, owner);
+
+    free (filepath);
+    free (filename);
+    return (path);
+}
@@ -0,0 +1,82 @@
+#ifndef GTOOLS_IOMODEL
+#define GTOOLS_IOMODEL
+
+/*
+ * Disk vs memory cost model (gcollapse switch)
+ * --------------------------------------------
+ *
+ * When there are many extra targets, gcollapse can either add them to
+ * the full data before collapsing (memory) or write them to a spill file
+ * and read them back once the data has been collapsed (disk). The disk
+ * round trip is modeled as
+ *
+ *     seconds = latency + MiB * spm
+ *
+ * where latency and spm (seconds per MiB written and read back) are
+ * fitted by least squares to wall-clock timings of spill files of
+ * several sizes. The calibration is saved next to the spill file (i.e.
+ * in Stata's temporary directory), in a file named for the user and
+ * host, and reused for GTOOLS_IO_EXPIRY seconds. The timings can also be
+ * given directly (debug_io_timings()), in which case nothing is measured
+ * or saved.
+ *
+ * Disk wins if writing and reading the J x kextra collapsed targets plus
+ * adding them to the collapsed data takes less time than adding them to
+ * the full data (st_time, measured by gcollapse). Disk is never used if
+ * the spill file would not fit in the free disk space, and always used
+ * if adding the targets to the full data would not fit in free memory.
+ */
+
+#define GTOOLS_IO_MAGIC  "GTIOMOD1"
+#define GTOOLS_IO_CACHE  ".gtools_io_model"
+#define GTOOLS_IO_OWNER  256
+#define GTOOLS_IO_EXPIRY (24 * 60 * 60)
+#define GTOOLS_IO_SIZES  3
+#define GTOOLS_IO_MAXPTS 64
+
+struct GtoolsIOModel {
+    char      magic[8];
+    int64_t   stamp;   // time of the calibration
+    ST_double latency; // seconds per round trip
+    ST_double spm;     // seconds per MiB written and read back
+};
+
+struct GtoolsIOInputs {
+    GT_size   N;
+    GT_size   J;
+    GT_size   kextra;
+    ST_double st_time;  // seconds to add kextra targets to the full data
+    ST_double mib_disk; // free disk space (< 0 if unknown)
+    ST_double mib_mem;  // free memory (< 0 if unknown)
+};
+
+struct GtoolsIODecision {
+    ST_double mib_full;      // kextra targets in the full data
+    ST_double mib_collapsed; // kextra targets in the collapsed data
+    ST_double time_io;       // write and read back the spill file
+    ST_double time_cstata;   // add kextra targets to the collapsed data
+    ST_double time_disk;     // time_io + time_cstata
+    ST_double time_mem;      // st_time
+    GT_bool   used_io;
+};
+
+ST_double gf_query_free_memory (void);
+
+ST_retcode gf_io_fit (
+    ST_double *mib,
+    ST_double *seconds,
+    GT_size npoints,
+    struct GtoolsIOModel *model
+);
+
+ST_retcode gf_io_calibrate  (char *fname, struct GtoolsIOModel *model);
+GT_bool    gf_io_model_load (char *fname, struct GtoolsIOModel *model);
+void       gf_io_model_save (char *fname, struct GtoolsIOModel *model);
+
+void gf_io_decide (
+    struct GtoolsIOModel *model,
+    struct GtoolsIOInputs *inputs,
+    struct GtoolsIODecision *decision
+);
+
+#endif
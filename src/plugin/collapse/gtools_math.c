@@ -6,6 +6,7 @@
 
 #include "gtools_math.h"
 #include "qselect.c"
+#include "gtools_simd.c"
 
 /**
  * @brief Standard deviation entries in range of array
@@ -16,12 +17,14 @@
  * @return Standard deviation of the elements of @v from @start to @end
  */
 ST_double gf_array_dsd_range (const ST_double v[], const GT_size start, const GT_size end) {
-    GT_size i;
-    ST_double vvar  = 0;
-    ST_double vmean = gf_array_dmean_range(v, start, end);
-    for (i = start; i < end; i++)
-        vvar += SQUARE(v[i] - vmean);
-    return (sqrt(vvar / (end - start - 1)));
+    ST_double s1, s2, vvar;
+    GT_size n = end - start;
+
+    // One pass, shifting by the first entry for accuracy (see gtools_simd.h)
+    gf_simd.dsumsq (v + start, n, v[start], &s1, &s2);
+    vvar = s2 - s1 * s1 / n;
+    if ( vvar < 0 ) vvar = 0;
+    return (sqrt(vvar / (n - 1)));
 }
 
 /**
@@ -46,11 +49,7 @@ ST_double gf_array_dmean_range (const ST_double v[], const GT_size start, const
  */
 ST_double gf_array_dsum_range (const ST_double v[], const GT_size start, const GT_size end)
 {
-    GT_size i;
-    ST_double vsum = 0;
-    for (i = start; i < end; i++)
-        vsum += v[i];
-    return (vsum);
+    return (gf_simd.dsum (v + start, end - start));
 }
 
 /**
@@ -63,12 +62,7 @@ ST_double gf_array_dsum_range (const ST_double v[], const GT_size start, const G
  */
 ST_double gf_array_dmin_range (const ST_double v[], const GT_size start, const GT_size end)
 {
-    GT_size i;
-    ST_double min = v[start];
-    for (i = start + 1; i < end; ++i) {
-        if (min > v[i]) min = v[i];
-    }
-    return (min);
+    return (gf_simd.dmin (v + start, end - start));
 }
 
 /**
@@ -81,55 +75,55 @@ ST_double gf_array_dmin_range (const ST_double v[], const GT_size start, const G
  */
 ST_double gf_array_dmax_range (const ST_double v[], const GT_size start, const GT_size end)
 {
-    GT_size i;
-    ST_double max = v[start];
-    for (i = start + 1; i < end; ++i) {
-        if (max < v[i]) max = v[i];
-    }
-    return (max);
+    return (gf_simd.dmax (v + start, end - start));
 }
 
 /**
- * @brief Quantile of enries in range of array
+ * @brief Order statistics that make up a quantile
  *
- * This computes the (quantile)th quantile using qsort. When
- * computing multiple quantiles, the data will already be sorted for the
- * next iteration, so it's faster than sorting every time, but it it
- * still a VERY inefficient implementation.
+ * The (quantile)th quantile of N entries is either one order statistic
+ * or the average of two adjacent ones (when quantile * N / 100 is an
+ * integer). Ranks start at 0, so rank 0 is the min and rank N - 1 is
+ * the max.
  *
- * @param v vector of doubles containing the current group's variables
- * @param start summaryze starting at the @start-th entry
- * @param end summaryze until the (@end - 1)-th entry
- * @return Quantile of the elements of @v from @start to @end
+ * @param N Number of entries
+ * @param quantile Quantile to compute
+ * @param r1 First order statistic
+ * @param r2 Second order statistic (same as @r1 if only one is needed)
+ * @return Number of distinct order statistics needed (1 or 2)
  */
-ST_double gf_array_dquantile_range (
-    ST_double v[],
-    const GT_size start,
-    const GT_size end,
-    const ST_double quantile)
+GT_size gf_quantile_ranks (
+    const GT_size N,
+    const ST_double quantile,
+    GT_size *r1,
+    GT_size *r2)
 {
-    ST_double q, qdbl, qfoo, Ndbl;
+    ST_double qdbl, qfoo, Ndbl;
     GT_size   Ndiv, qth;
-    GT_bool   rfoo, Nmod;
-    GT_size   N  = (end - start);
+    GT_bool   rfoo, Nmod, dmax;
 
     // Special cases
     // -------------
 
     if ( N == 1 ) {
         // If only 1 entry, can't take quantile
-        return (v[start]);
+        *r1 = *r2 = 0;
+        return (1);
     }
     else if ( N == 2 ) {
         // If 2 entries, only 3 options
         if ( quantile > 50 ) {
-            return (MAX(v[start], v[end - 1]));
+            *r1 = *r2 = 1;
+            return (1);
         }
         else if ( quantile < 50 ) {
-            return (MIN(v[start], v[end - 1]));
+            *r1 = *r2 = 0;
+            return (1);
         }
         else {
-            return ( (v[start] + v[end - 1]) / 2 );
+            *r1 = 1;
+            *r2 = 0;
+            return (2);
         }
     }
 
@@ -153,39 +147,137 @@ ST_double gf_array_dquantile_range (
 
     // 0th quantile is not a thing, so we can just take the min
     if ( qth == 0 ) {
-        return (gf_array_dmin_range(v, start, end));
+        *r1 = *r2 = 0;
+        return (1);
     }
 
-    // Full selection algorithm
-    // ------------------------
+    dmax = (qth == (N - 1)) | (qfoo == (N - 1));
+    if ( rfoo ) {
+        *r1 = dmax? N - 1: MIN((GT_size) qfoo, N - 1);
+        *r2 = (GT_size) qfoo - 1;
+        return (2);
+    }
+    else {
+        *r1 = *r2 = dmax? N - 1: MIN(qth, N - 1);
+        return (1);
+    }
+}
 
-    GT_size left = start, right = end;
-    GT_bool dmax = (qth == (N - 1)) | (qfoo == (N - 1));
+/**
+ * @brief Order statistic of entries in range of array
+ *
+ * The min and max are a single pass over the data; anything else
+ * uses quickselect (which partially sorts @v).
+ *
+ * @param v vector of doubles containing the current group's variables
+ * @param start summaryze starting at the @start-th entry
+ * @param end summaryze until the (@end - 1)-th entry
+ * @param rank Order statistic to select (0 is the min)
+ * @return @rank-th smallest element of @v from @start to @end
+ */
+ST_double gf_array_dorder_range (
+    ST_double v[],
+    const GT_size start,
+    const GT_size end,
+    const GT_size rank)
+{
+    if ( rank == 0 ) return (gf_array_dmin_range(v, start, end));
+    if ( rank == (end - start - 1) ) return (gf_array_dmax_range(v, start, end));
+    return (gf_qselect_range(v, start, end, rank));
+}
 
-    if ( rfoo ) {
-        if ( dmax ) {
-            q = (
-                gf_array_dmax_range(v, left, right) +
-                gf_qselect_range (v, left, right, qfoo - 1)
-            ) / 2;
-        }
-        else {
-            q = (
-                gf_qselect_range (v, left, right, qfoo) +
-                gf_qselect_range (v, left, right, qfoo - 1)
-            ) / 2;
-        }
+/**
+ * @brief Quantile of enries in range of array
+ *
+ * This computes the (quantile)th quantile using quickselect. To compute
+ * several quantiles of the same range use gf_array_dquantiles_range,
+ * which selects all of them at once.
+ *
+ * @param v vector of doubles containing the current group's variables
+ * @param start summaryze starting at the @start-th entry
+ * @param end summaryze until the (@end - 1)-th entry
+ * @return Quantile of the elements of @v from @start to @end
+ */
+ST_double gf_array_dquantile_range (
+    ST_double v[],
+    const GT_size start,
+    const GT_size end,
+    const ST_double quantile)
+{
+    GT_size r1, r2;
+    if ( gf_quantile_ranks(end - start, quantile, &r1, &r2) == 1 ) {
+        return (gf_array_dorder_range(v, start, end, r1));
     }
     else {
-        if ( dmax ) {
-            q = gf_array_dmax_range(v, left, right);
-        }
-        else{
-            q = gf_qselect_range (v, left, right, qth);
+        return ((
+            gf_array_dorder_range(v, start, end, r1) +
+            gf_array_dorder_range(v, start, end, r2)
+        ) / 2);
+    }
+}
+
+/**
+ * @brief Several quantiles of enries in range of array
+ *
+ * Collects the order statistics needed for every quantile and selects
+ * them all with one call to gf_qselect_multi, which only partitions the
+ * sub-ranges that contain them, instead of running a separate selection
+ * over the whole range for each quantile. The min and max are taken in
+ * a single pass instead. @v is partially sorted in place.
+ *
+ * @param v vector of doubles containing the current group's variables
+ * @param start summaryze starting at the @start-th entry
+ * @param end summaryze until the (@end - 1)-th entry
+ * @param quantiles Quantiles to compute
+ * @param nq Number of quantiles
+ * @param output Output; output[i] is the quantiles[i]th quantile
+ * @param ranks Buffer of size 4 * @nq
+ * @param values Buffer of size 2 * @nq
+ * @return Stores quantiles in @output
+ */
+void gf_array_dquantiles_range (
+    ST_double v[],
+    const GT_size start,
+    const GT_size end,
+    const ST_double *quantiles,
+    const GT_size nq,
+    ST_double *output,
+    GT_size *ranks,
+    ST_double *values)
+{
+    GT_size i, j, l, r, nsel, lo, hi;
+    GT_size N = end - start;
+    GT_size *sel = ranks + 2 * nq;
+
+    // Sorted, unique positions of the order statistics we need
+    nsel = 0;
+    for (i = 0; i < nq; i++) {
+        gf_quantile_ranks(N, quantiles[i], ranks + 2 * i, ranks + 2 * i + 1);
+        for (l = 0; l < 2; l++) {
+            r = start + ranks[2 * i + l];
+            for (j = 0; (j < nsel) && (sel[j] < r); j++);
+            if ( (j < nsel) && (sel[j] == r) ) continue;
+            memmove(sel + j + 1, sel + j, (nsel - j) * sizeof *sel);
+            sel[j] = r;
+            nsel++;
         }
     }
 
-    return (q);
+    lo = 0;
+    hi = nsel;
+    if ( sel[0] == start ) {
+        values[lo++] = gf_array_dmin_range(v, start, end);
+    }
+    if ( (hi > lo) && (sel[hi - 1] == (end - 1)) ) {
+        values[--hi] = gf_array_dmax_range(v, start, end);
+    }
+    gf_qselect_multi (v, start, end, sel + lo, hi - lo, values + lo);
+
+    for (i = 0; i < nq; i++) {
+        for (j = 0; sel[j] != start + ranks[2 * i]; j++);
+        for (l = 0; sel[l] != start + ranks[2 * i + 1]; l++);
+        output[i] = (j == l)? values[j]: (values[j] + values[l]) / 2;
+    }
 }
 
 /**
@@ -237,12 +329,11 @@ ST_double gf_array_dsemean_range (const ST_double v[], const GT_size start, cons
  */
 ST_double gf_array_dsebinom_range (const ST_double v[], const GT_size start, const GT_size end)
 {
-    GT_size i;
-    ST_double p;
-    for (i = start; i < end; i++) {
-        if ( (v[i] != ((ST_double) 0)) && (v[i] != ((ST_double) 1)) ) return (SV_missval);
-    }
-    p = gf_array_dmean_range(v, start, end);
+    ST_double p, vsum;
+
+    // Check every entry is 0 or 1 while summing
+    if ( !gf_simd.dsum_binary (v + start, end - start, &vsum) ) return (SV_missval);
+    p = vsum / (end - start);
     return (sqrt(p * (1 - p) / (end - start)));
 }
 
@@ -256,15 +347,11 @@ ST_double gf_array_dsebinom_range (const ST_double v[], const GT_size start, con
  */
 ST_double gf_array_dsepois_range (const ST_double v[], const GT_size start, const GT_size end)
 {
-    GT_size i;
-    // GT_size vsum = 0;
-    for (i = start; i < end; i++) {
-        if ( v[i] < 0 ) return (SV_missval);
-        // vsum += (GT_size) round(v[i]);
-    }
+    ST_double vsum;
 
-    // ST_double rmean = (GT_int) gf_array_dsum_range(v, start, end);
-    ST_double rmean = (GT_int) (gf_array_dsum_range(v, start, end) + 0.5);
+    // Check no entry is negative while summing
+    if ( !gf_simd.dsum_nonneg (v + start, end - start, &vsum) ) return (SV_missval);
+    ST_double rmean = (GT_int) (vsum + 0.5);
     return (sqrt(rmean) / (end - start));
 }
 
@@ -12,6 +12,31 @@ ST_double gf_array_dquantile_range (
     const ST_double quantile
 );
 
+GT_size gf_quantile_ranks (
+    const GT_size N,
+    const ST_double quantile,
+    GT_size *r1,
+    GT_size *r2
+);
+
+ST_double gf_array_dorder_range (
+    ST_double v[],
+    const GT_size start,
+    const GT_size end,
+    const GT_size rank
+);
+
+void gf_array_dquantiles_range (
+    ST_double v[],
+    const GT_size start,
+    const GT_size end,
+    const ST_double *quantiles,
+    const GT_size nq,
+    ST_double *output,
+    GT_size *ranks,
+    ST_double *values
+);
+
 ST_double gf_array_dsum_range      (const ST_double v[], const GT_size start, const GT_size end);
 ST_double gf_array_dmean_range     (const ST_double v[], const GT_size start, const GT_size end);
 ST_double gf_array_dsd_range       (const ST_double v[], const GT_size start, const GT_size end);
@@ -1,40 +1,113 @@
-ST_retcode gf_array_nunique_range (
-    ST_double *output,
-    void *x,
-    const GT_size N,
-    const GT_bool hmethod,
-    uint64_t *h1,
-    uint64_t *h2,
-    uint64_t *h3,
-    uint64_t *ix,
-    uint64_t *xcopy
-);
-
-ST_retcode gf_counting_sort_noix (
-    uint64_t *hash, GT_size N,
-    uint64_t range,
-    uint64_t *xcopy
-);
+#include "gtools_nunique.h"
+
+/**
+ * @brief Allocate a hash set for groups of up to @nmax values
+ *
+ * @param set Hash set; keys and stamp are NULL if we ran out of memory
+ * @param nmax Size of the largest group
+ */
+void gf_hashset_alloc (struct GtoolsHashSet *set, GT_size nmax)
+{
+    GT_size capacity = 16;
+    while ( capacity < 2 * nmax ) capacity <<= 1;
+    set->capacity = capacity;
+    set->current  = 0;
+    set->keys     = calloc(capacity, sizeof *set->keys);
+    set->stamp    = calloc(capacity, sizeof *set->stamp);
+}
+
+void gf_hashset_free (struct GtoolsHashSet *set)
+{
+    free (set->keys);
+    free (set->stamp);
+    set->keys  = NULL;
+    set->stamp = NULL;
+}
+
+/**
+ * @brief Number of distinct values in an array using a hash set
+ *
+ * @param set Hash set with room for at least @N values
+ * @param v Array of values
+ * @param N Number of values
+ * @return Number of distinct values; 0 and -0 are the same value
+ */
+GT_size gf_hashset_count (struct GtoolsHashSet *set, ST_double *v, GT_size N)
+{
+    GT_size i, s, mask, size = 16, nunique = 0;
+    uint64_t h, key;
+    ST_double z;
+
+    while ( size < 2 * N ) size <<= 1;
+    mask = size - 1;
 
+    // Start a new group; after 2^32 - 1 groups the stamps wrap around
+    // and have to be cleared once.
+    if ( ++set->current == 0 ) {
+        memset(set->stamp, 0, set->capacity * sizeof *set->stamp);
+        set->current = 1;
+    }
+
+    for (i = 0; i < N; i++) {
+        z = v[i];
+        if ( z == 0 ) z = 0;
+        memcpy(&key, &z, sizeof key);
+
+        h  = key;
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ULL;
+        h ^= h >> 33;
+
+        s = h & mask;
+        while ( set->stamp[s] == set->current ) {
+            if ( set->keys[s] == key ) break;
+            s = (s + 1) & mask;
+        }
+
+        if ( set->stamp[s] != set->current ) {
+            set->stamp[s] = set->current;
+            set->keys[s]  = key;
+            nunique++;
+        }
+    }
+
+    return (nunique);
+}
+
+/**
+ * @brief Number of distinct values in an array
+ *
+ * Sorted arrays are counted with a linear scan and integers with a small
+ * range with a counting sort; everything else uses the hash set (see
+ * gtools_nunique.h).
+ *
+ * @param output Where to store the count
+ * @param x Array of values
+ * @param N Number of values
+ * @param hmethod Skip the check for integers (e.g. if all are missing)
+ * @param h1 Scratch space for the counting sort, with room for @N values
+ * @param xcopy Scratch space for the counting sort, with room for @N values
+ * @param set Hash set with room for at least @N values
+ * @return Stores the number of distinct values in @output
+ */
 ST_retcode gf_array_nunique_range (
     ST_double *output,
     void *x,
     const GT_size N,
     const GT_bool hmethod,
     uint64_t *h1,
-    uint64_t *h2,
-    uint64_t *h3,
-    uint64_t *ix,
-    uint64_t *xcopy)
+    uint64_t *xcopy,
+    struct GtoolsHashSet *set)
 {
-    spookyhash_context context;
     ST_double *v = (ST_double *) x;
 
     GT_size nunique = 1;
     GT_size ctol    = pow(2, 24);
 
-    GT_bool biject, anymiss, allmiss, rsort;
-    GT_size i, j, range, npos;
+    GT_bool biject, anymiss, allmiss;
+    GT_size i, range, npos;
     ST_double min = 0, max = 0;
 
     ST_double z;
@@ -73,100 +146,41 @@ ST_retcode gf_array_nunique_range (
             }
             else {
                 // All missing should be handled in the call (i.e. all
-                // missing forces spooky hash)
+                // missing forces the hash set)
                 anymiss = 1;
             }
         }
     }
 
     if ( sorted ) {
-        rsort = 3;
-    }
-    else {
-        if ( biject ) {
-            range = ((GT_int) max - (GT_int) min + anymiss + 1);
-            rsort = range < ctol? 0: 1;
-            for (i = 0; i < N; i++) {
-                if ( (z = v[i]) == SV_missval ) z = max + 1;
-                h1[i] = ((GT_int) z - min);
-            }
-        }
-        else {
-            rsort = 2;
-            for (i = 0; i < N; i++) {
-                // spookyhash_128(v + i, sizeof(ST_double), h1 + i, h2 + i);
-                spookyhash_context_init(&context, 0, 1);
-                spookyhash_update(&context, v + i, sizeof(ST_double));
-                spookyhash_final(&context, h1 + i, h2 + i);
-            }
-        }
-
-        if ( rsort ) {
-            // This has to be indexed because of h2
-            for (i = 0; i < N; i++)
-                ix[i] = i;
-
-            if ( (rc = gf_radix_sort16 (h1, ix, N)) ) return (rc);
-
-            for (i = 0; i < N; i++)
-                h3[i] = h2[ix[i]];
-
-        }
-        else {
-            if ( (rc = gf_counting_sort_noix (h1, N, range, xcopy)) ) return(rc);
-        }
-        sorted = 1;
-    }
-
-    if ( (rsort == 0) || (rsort == 1) ) {
         npos = 0;
         for (i = 1; i < N; i++) {
-            if ( h1[npos] == h1[i] ) continue;
+            if ( v[npos] == v[i] ) continue;
             npos = i;
             nunique++;
         }
     }
-    else if ( rsort == 2 ) {
-        // Unique count using h1, h3, ix
-        npos = 0;
-        for (i = 1; i < N; i++) {
-            if ( h1[npos] == h1[i] ) continue;
-
-            if ( i > npos + 1 ) {
-                for (j = npos + 1; j < i; j++) {
-                    if ( h3[npos] != h3[j] ) break;
-                }
+    else if ( biject && ((max - min) < ctol) && ((max - min) < 4 * N) ) {
+        // The count table is no larger than a few times the group, so
+        // the counting sort is cheaper than hashing.
+        range = ((GT_int) max - (GT_int) min + anymiss + 1);
+        for (i = 0; i < N; i++) {
+            if ( (z = v[i]) == SV_missval ) z = max + 1;
+            h1[i] = ((GT_int) z - min);
+        }
 
-                if ( j < i ) {
-                    if ( (rc = gf_radix_sort16 (h3, ix, i - npos)) ) return (rc);
-                    for (j = npos + 1; j < i; j++) {
-                        if ( h3[npos] == h3[j] ) {
-                            if ( v[ix[npos]] != v[ix[j]] ) return (17999);
-                            continue;
-                        }
-                        npos = j;
-                        nunique++;
-                    }
-                }
-                else {
-                    for (j = npos + 1; j < i; j++) {
-                        if ( v[ix[npos]] != v[ix[j]] ) return (17999);
-                    }
-                }
-            }
+        if ( (rc = gf_counting_sort_noix (h1, N, range, xcopy)) ) return(rc);
 
-            npos = i;
-            nunique++;
-        }
-    }
-    else if ( rsort == 3 ) {
         npos = 0;
         for (i = 1; i < N; i++) {
-            if ( v[npos] == v[i] ) continue;
+            if ( h1[npos] == h1[i] ) continue;
             npos = i;
             nunique++;
         }
     }
+    else {
+        nunique = gf_hashset_count (set, v, N);
+    }
 
     *output = ((ST_double) nunique);
 
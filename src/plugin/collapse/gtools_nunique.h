@@ -0,0 +1,47 @@
+#ifndef GTOOLS_NUNIQUE
+#define GTOOLS_NUNIQUE
+
+/*
+ * Exact per-group nunique
+ * -----------------------
+ *
+ * Sorted groups are counted with a linear scan, and integer groups with
+ * a small range (no more than a few times the group size) with a
+ * counting sort. Everything else goes into an open-addressing hash set
+ * with linear probing: each value's bits are mixed into a 64-bit hash,
+ * which picks the first slot, and a slot matches only if it holds the
+ * same value. The set is allocated once for the largest group and only
+ * the first 2^ceil(log2(2 nj)) slots are used for a group of nj, so the
+ * load factor stays at or below 1/2. Slots are marked with the number of
+ * the group that filled them, so clearing the set between groups is a
+ * counter increment instead of a pass over the slots.
+ */
+
+struct GtoolsHashSet {
+    uint64_t *keys;     // value bits
+    uint32_t *stamp;    // slot is filled if stamp == current
+    GT_size  capacity;  // number of slots (a power of 2)
+    uint32_t current;
+};
+
+void gf_hashset_alloc (struct GtoolsHashSet *set, GT_size nmax);
+void gf_hashset_free  (struct GtoolsHashSet *set);
+GT_size gf_hashset_count (struct GtoolsHashSet *set, ST_double *v, GT_size N);
+
+ST_retcode gf_array_nunique_range (
+    ST_double *output,
+    void *x,
+    const GT_size N,
+    const GT_bool hmethod,
+    uint64_t *h1,
+    uint64_t *xcopy,
+    struct GtoolsHashSet *set
+);
+
+ST_retcode gf_counting_sort_noix (
+    uint64_t *hash, GT_size N,
+    uint64_t range,
+    uint64_t *xcopy
+);
+
+#endif
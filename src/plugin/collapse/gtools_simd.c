@@ -0,0 +1,482 @@
+#include "gtools_simd.h"
+
+#if GTOOLS_SIMD
+#include <immintrin.h>
+#endif
+
+/*********************************************************************
+ *                          Scalar kernels                           *
+ *********************************************************************/
+
+ST_double gf_simd_dsum_scalar (const ST_double *v, GT_size n)
+{
+    GT_size i;
+    ST_double vsum = 0;
+    for (i = 0; i < n; i++)
+        vsum += v[i];
+    return (vsum);
+}
+
+ST_double gf_simd_dmin_scalar (const ST_double *v, GT_size n)
+{
+    GT_size i;
+    ST_double min = v[0];
+    for (i = 1; i < n; i++) {
+        if (min > v[i]) min = v[i];
+    }
+    return (min);
+}
+
+ST_double gf_simd_dmax_scalar (const ST_double *v, GT_size n)
+{
+    GT_size i;
+    ST_double max = v[0];
+    for (i = 1; i < n; i++) {
+        if (max < v[i]) max = v[i];
+    }
+    return (max);
+}
+
+void gf_simd_dsumsq_scalar (
+    const ST_double *v,
+    GT_size n,
+    ST_double shift,
+    ST_double *s1,
+    ST_double *s2)
+{
+    GT_size i;
+    ST_double d, d1 = 0, d2 = 0;
+    for (i = 0; i < n; i++) {
+        d   = v[i] - shift;
+        d1 += d;
+        d2 += d * d;
+    }
+    *s1 = d1;
+    *s2 = d2;
+}
+
+GT_bool gf_simd_dsum_binary_scalar (const ST_double *v, GT_size n, ST_double *sum)
+{
+    GT_size i;
+    ST_double vsum = 0;
+    for (i = 0; i < n; i++) {
+        if ( (v[i] != ((ST_double) 0)) && (v[i] != ((ST_double) 1)) ) return (0);
+        vsum += v[i];
+    }
+    *sum = vsum;
+    return (1);
+}
+
+GT_bool gf_simd_dsum_nonneg_scalar (const ST_double *v, GT_size n, ST_double *sum)
+{
+    GT_size i;
+    ST_double vsum = 0;
+    for (i = 0; i < n; i++) {
+        if ( v[i] < 0 ) return (0);
+        vsum += v[i];
+    }
+    *sum = vsum;
+    return (1);
+}
+
+struct GtoolsSimd gf_simd = {
+    "scalar",
+    gf_simd_dsum_scalar,
+    gf_simd_dmin_scalar,
+    gf_simd_dmax_scalar,
+    gf_simd_dsumsq_scalar,
+    gf_simd_dsum_binary_scalar,
+    gf_simd_dsum_nonneg_scalar
+};
+
+#if GTOOLS_SIMD
+
+/*********************************************************************
+ *                           AVX2 kernels                            *
+ *********************************************************************/
+
+__attribute__((target("avx2")))
+static ST_double gf_simd_hsum_avx2 (__m256d x)
+{
+    ST_double t[4];
+    _mm256_storeu_pd (t, x);
+    return ((t[0] + t[1]) + (t[2] + t[3]));
+}
+
+__attribute__((target("avx2")))
+static ST_double gf_simd_dsum_avx2 (const ST_double *v, GT_size n)
+{
+    GT_size i = 0;
+    ST_double vsum;
+    __m256d a0 = _mm256_setzero_pd();
+    __m256d a1 = _mm256_setzero_pd();
+    __m256d a2 = _mm256_setzero_pd();
+    __m256d a3 = _mm256_setzero_pd();
+
+    for (; i + 16 <= n; i += 16) {
+        a0 = _mm256_add_pd(a0, _mm256_loadu_pd(v + i));
+        a1 = _mm256_add_pd(a1, _mm256_loadu_pd(v + i + 4));
+        a2 = _mm256_add_pd(a2, _mm256_loadu_pd(v + i + 8));
+        a3 = _mm256_add_pd(a3, _mm256_loadu_pd(v + i + 12));
+    }
+    for (; i + 4 <= n; i += 4)
+        a0 = _mm256_add_pd(a0, _mm256_loadu_pd(v + i));
+
+    vsum = gf_simd_hsum_avx2(_mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3)));
+    for (; i < n; i++)
+        vsum += v[i];
+
+    return (vsum);
+}
+
+__attribute__((target("avx2")))
+static ST_double gf_simd_dmin_avx2 (const ST_double *v, GT_size n)
+{
+    GT_size i;
+    ST_double t[4], min;
+    if ( n < 8 ) return (gf_simd_dmin_scalar(v, n));
+
+    __m256d m = _mm256_loadu_pd(v);
+    for (i = 4; i + 4 <= n; i += 4)
+        m = _mm256_min_pd(m, _mm256_loadu_pd(v + i));
+
+    _mm256_storeu_pd (t, m);
+    min = t[0];
+    if (min > t[1]) min = t[1];
+    if (min > t[2]) min = t[2];
+    if (min > t[3]) min = t[3];
+    for (; i < n; i++) {
+        if (min > v[i]) min = v[i];
+    }
+
+    return (min);
+}
+
+__attribute__((target("avx2")))
+static ST_double gf_simd_dmax_avx2 (const ST_double *v, GT_size n)
+{
+    GT_size i;
+    ST_double t[4], max;
+    if ( n < 8 ) return (gf_simd_dmax_scalar(v, n));
+
+    __m256d m = _mm256_loadu_pd(v);
+    for (i = 4; i + 4 <= n; i += 4)
+        m = _mm256_max_pd(m, _mm256_loadu_pd(v + i));
+
+    _mm256_storeu_pd (t, m);
+    max = t[0];
+    if (max < t[1]) max = t[1];
+    if (max < t[2]) max = t[2];
+    if (max < t[3]) max = t[3];
+    for (; i < n; i++) {
+        if (max < v[i]) max = v[i];
+    }
+
+    return (max);
+}
+
+__attribute__((target("avx2")))
+static void gf_simd_dsumsq_avx2 (
+    const ST_double *v,
+    GT_size n,
+    ST_double shift,
+    ST_double *s1,
+    ST_double *s2)
+{
+    GT_size i = 0;
+    ST_double d, d1, d2;
+    __m256d x0, x1;
+    __m256d sh = _mm256_set1_pd(shift);
+    __m256d a0 = _mm256_setzero_pd();
+    __m256d a1 = _mm256_setzero_pd();
+    __m256d b0 = _mm256_setzero_pd();
+    __m256d b1 = _mm256_setzero_pd();
+
+    for (; i + 8 <= n; i += 8) {
+        x0 = _mm256_sub_pd(_mm256_loadu_pd(v + i),     sh);
+        x1 = _mm256_sub_pd(_mm256_loadu_pd(v + i + 4), sh);
+        a0 = _mm256_add_pd(a0, x0);
+        a1 = _mm256_add_pd(a1, x1);
+        b0 = _mm256_add_pd(b0, _mm256_mul_pd(x0, x0));
+        b1 = _mm256_add_pd(b1, _mm256_mul_pd(x1, x1));
+    }
+
+    d1 = gf_simd_hsum_avx2(_mm256_add_pd(a0, a1));
+    d2 = gf_simd_hsum_avx2(_mm256_add_pd(b0, b1));
+    for (; i < n; i++) {
+        d   = v[i] - shift;
+        d1 += d;
+        d2 += d * d;
+    }
+
+    *s1 = d1;
+    *s2 = d2;
+}
+
+__attribute__((target("avx2")))
+static GT_bool gf_simd_dsum_binary_avx2 (const ST_double *v, GT_size n, ST_double *sum)
+{
+    GT_size i = 0;
+    ST_double vsum;
+    __m256d x, ok;
+    __m256d zero = _mm256_setzero_pd();
+    __m256d one  = _mm256_set1_pd(1);
+    __m256d a0   = _mm256_setzero_pd();
+
+    for (; i + 4 <= n; i += 4) {
+        x  = _mm256_loadu_pd(v + i);
+        ok = _mm256_or_pd(_mm256_cmp_pd(x, zero, _CMP_EQ_OQ), _mm256_cmp_pd(x, one, _CMP_EQ_OQ));
+        if ( _mm256_movemask_pd(ok) != 0xF ) return (0);
+        a0 = _mm256_add_pd(a0, x);
+    }
+
+    vsum = gf_simd_hsum_avx2(a0);
+    for (; i < n; i++) {
+        if ( (v[i] != ((ST_double) 0)) && (v[i] != ((ST_double) 1)) ) return (0);
+        vsum += v[i];
+    }
+
+    *sum = vsum;
+    return (1);
+}
+
+__attribute__((target("avx2")))
+static GT_bool gf_simd_dsum_nonneg_avx2 (const ST_double *v, GT_size n, ST_double *sum)
+{
+    GT_size i = 0;
+    ST_double vsum;
+    __m256d x;
+    __m256d zero = _mm256_setzero_pd();
+    __m256d a0   = _mm256_setzero_pd();
+
+    for (; i + 4 <= n; i += 4) {
+        x = _mm256_loadu_pd(v + i);
+        if ( _mm256_movemask_pd(_mm256_cmp_pd(x, zero, _CMP_LT_OQ)) ) return (0);
+        a0 = _mm256_add_pd(a0, x);
+    }
+
+    vsum = gf_simd_hsum_avx2(a0);
+    for (; i < n; i++) {
+        if ( v[i] < 0 ) return (0);
+        vsum += v[i];
+    }
+
+    *sum = vsum;
+    return (1);
+}
+
+/*********************************************************************
+ *                          AVX-512 kernels                          *
+ *********************************************************************/
+
+__attribute__((target("avx512f")))
+static ST_double gf_simd_hsum_avx512 (__m512d x)
+{
+    ST_double t[8];
+    _mm512_storeu_pd (t, x);
+    return (((t[0] + t[1]) + (t[2] + t[3])) + ((t[4] + t[5]) + (t[6] + t[7])));
+}
+
+__attribute__((target("avx512f")))
+static ST_double gf_simd_dsum_avx512 (const ST_double *v, GT_size n)
+{
+    GT_size i = 0;
+    ST_double vsum;
+    __m512d a0 = _mm512_setzero_pd();
+    __m512d a1 = _mm512_setzero_pd();
+    __m512d a2 = _mm512_setzero_pd();
+    __m512d a3 = _mm512_setzero_pd();
+
+    for (; i + 32 <= n; i += 32) {
+        a0 = _mm512_add_pd(a0, _mm512_loadu_pd(v + i));
+        a1 = _mm512_add_pd(a1, _mm512_loadu_pd(v + i + 8));
+        a2 = _mm512_add_pd(a2, _mm512_loadu_pd(v + i + 16));
+        a3 = _mm512_add_pd(a3, _mm512_loadu_pd(v + i + 24));
+    }
+    for (; i + 8 <= n; i += 8)
+        a0 = _mm512_add_pd(a0, _mm512_loadu_pd(v + i));
+
+    vsum = gf_simd_hsum_avx512(_mm512_add_pd(_mm512_add_pd(a0, a1), _mm512_add_pd(a2, a3)));
+    for (; i < n; i++)
+        vsum += v[i];
+
+    return (vsum);
+}
+
+__attribute__((target("avx512f")))
+static ST_double gf_simd_dmin_avx512 (const ST_double *v, GT_size n)
+{
+    GT_size i, l;
+    ST_double t[8], min;
+    if ( n < 16 ) return (gf_simd_dmin_scalar(v, n));
+
+    __m512d m = _mm512_loadu_pd(v);
+    for (i = 8; i + 8 <= n; i += 8)
+        m = _mm512_min_pd(m, _mm512_loadu_pd(v + i));
+
+    _mm512_storeu_pd (t, m);
+    min = t[0];
+    for (l = 1; l < 8; l++) {
+        if (min > t[l]) min = t[l];
+    }
+    for (; i < n; i++) {
+        if (min > v[i]) min = v[i];
+    }
+
+    return (min);
+}
+
+__attribute__((target("avx512f")))
+static ST_double gf_simd_dmax_avx512 (const ST_double *v, GT_size n)
+{
+    GT_size i, l;
+    ST_double t[8], max;
+    if ( n < 16 ) return (gf_simd_dmax_scalar(v, n));
+
+    __m512d m = _mm512_loadu_pd(v);
+    for (i = 8; i + 8 <= n; i += 8)
+        m = _mm512_max_pd(m, _mm512_loadu_pd(v + i));
+
+    _mm512_storeu_pd (t, m);
+    max = t[0];
+    for (l = 1; l < 8; l++) {
+        if (max < t[l]) max = t[l];
+    }
+    for (; i < n; i++) {
+        if (max < v[i]) max = v[i];
+    }
+
+    return (max);
+}
+
+__attribute__((target("avx512f")))
+static void gf_simd_dsumsq_avx512 (
+    const ST_double *v,
+    GT_size n,
+    ST_double shift,
+    ST_double *s1,
+    ST_double *s2)
+{
+    GT_size i = 0;
+    ST_double d, d1, d2;
+    __m512d x0, x1;
+    __m512d sh = _mm512_set1_pd(shift);
+    __m512d a0 = _mm512_setzero_pd();
+    __m512d a1 = _mm512_setzero_pd();
+    __m512d b0 = _mm512_setzero_pd();
+    __m512d b1 = _mm512_setzero_pd();
+
+    for (; i + 16 <= n; i += 16) {
+        x0 = _mm512_sub_pd(_mm512_loadu_pd(v + i),     sh);
+        x1 = _mm512_sub_pd(_mm512_loadu_pd(v + i + 8), sh);
+        a0 = _mm512_add_pd(a0, x0);
+        a1 = _mm512_add_pd(a1, x1);
+        b0 = _mm512_add_pd(b0, _mm512_mul_pd(x0, x0));
+        b1 = _mm512_add_pd(b1, _mm512_mul_pd(x1, x1));
+    }
+
+    d1 = gf_simd_hsum_avx512(_mm512_add_pd(a0, a1));
+    d2 = gf_simd_hsum_avx512(_mm512_add_pd(b0, b1));
+    for (; i < n; i++) {
+        d   = v[i] - shift;
+        d1 += d;
+        d2 += d * d;
+    }
+
+    *s1 = d1;
+    *s2 = d2;
+}
+
+__attribute__((target("avx512f")))
+static GT_bool gf_simd_dsum_binary_avx512 (const ST_double *v, GT_size n, ST_double *sum)
+{
+    GT_size i = 0;
+    ST_double vsum;
+    __m512d x;
+    __mmask8 ok;
+    __m512d zero = _mm512_setzero_pd();
+    __m512d one  = _mm512_set1_pd(1);
+    __m512d a0   = _mm512_setzero_pd();
+
+    for (; i + 8 <= n; i += 8) {
+        x  = _mm512_loadu_pd(v + i);
+        ok = _mm512_cmp_pd_mask(x, zero, _CMP_EQ_OQ) | _mm512_cmp_pd_mask(x, one, _CMP_EQ_OQ);
+        if ( ok != 0xFF ) return (0);
+        a0 = _mm512_add_pd(a0, x);
+    }
+
+    vsum = gf_simd_hsum_avx512(a0);
+    for (; i < n; i++) {
+        if ( (v[i] != ((ST_double) 0)) && (v[i] != ((ST_double) 1)) ) return (0);
+        vsum += v[i];
+    }
+
+    *sum = vsum;
+    return (1);
+}
+
+__attribute__((target("avx512f")))
+static GT_bool gf_simd_dsum_nonneg_avx512 (const ST_double *v, GT_size n, ST_double *sum)
+{
+    GT_size i = 0;
+    ST_double vsum;
+    __m512d x;
+    __m512d zero = _mm512_setzero_pd();
+    __m512d a0   = _mm512_setzero_pd();
+
+    for (; i + 8 <= n; i += 8) {
+        x = _mm512_loadu_pd(v + i);
+        if ( _mm512_cmp_pd_mask(x, zero, _CMP_LT_OQ) ) return (0);
+        a0 = _mm512_add_pd(a0, x);
+    }
+
+    vsum = gf_simd_hsum_avx512(a0);
+    for (; i < n; i++) {
+        if ( v[i] < 0 ) return (0);
+        vsum += v[i];
+    }
+
+    *sum = vsum;
+    return (1);
+}
+
+/**
+ * @brief Pick the kernels when the plugin is loaded
+ */
+__attribute__((constructor))
+static void gf_simd_load (void)
+{
+    gf_simd_init();
+}
+
+#endif
+
+/**
+ * @brief Use the widest kernels the CPU supports
+ *
+ * @return Sets gf_simd to the AVX-512, AVX2, or scalar kernels
+ */
+void gf_simd_init (void)
+{
+#if GTOOLS_SIMD
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports("avx512f") ) {
+        gf_simd.name        = "avx512";
+        gf_simd.dsum        = gf_simd_dsum_avx512;
+        gf_simd.dmin        = gf_simd_dmin_avx512;
+        gf_simd.dmax        = gf_simd_dmax_avx512;
+        gf_simd.dsumsq      = gf_simd_dsumsq_avx512;
+        gf_simd.dsum_binary = gf_simd_dsum_binary_avx512;
+        gf_simd.dsum_nonneg = gf_simd_dsum_nonneg_avx512;
+    }
+    else if ( __builtin_cpu_supports("avx2") ) {
+        gf_simd.name        = "avx2";
+        gf_simd.dsum        = gf_simd_dsum_avx2;
+        gf_simd.dmin        = gf_simd_dmin_avx2;
+        gf_simd.dmax        = gf_simd_dmax_avx2;
+        gf_simd.dsumsq      = gf_simd_dsumsq_avx2;
+        gf_simd.dsum_binary = gf_simd_dsum_binary_avx2;
+        gf_simd.dsum_nonneg = gf_simd_dsum_nonneg_avx2;
+    }
+#endif
+}
@@ -0,0 +1,69 @@
+#ifndef GTOOLS_SIMD_KERNELS
+#define GTOOLS_SIMD_KERNELS
+
+/*
+ * SIMD kernels for the per-group reductions
+ * -----------------------------------------
+ *
+ * gf_array_dsum_range, dmin_range, dmax_range, dsd_range, dsebinom_range
+ * and dsepois_range call the kernels in gf_simd. These default to plain
+ * C loops; if the plugin was compiled with GCC or clang on x86, the CPU
+ * is queried when the plugin is loaded and the AVX-512 or AVX2 kernels
+ * are used instead, if available. Compile with -DGTOOLS_SIMD=0 to always
+ * use the C loops.
+ *
+ * Tolerance
+ * ---------
+ *
+ * min and max are exact. Sums are computed with several partial sums
+ * (one per SIMD lane, and several vectors of lanes) that are added up
+ * at the end, so they may differ from the sequential sum in the last
+ * few bits. The absolute difference is bounded by n * DBL_EPSILON *
+ * sum(|v|), where n is the number of entries; sums of integers (e.g.
+ * the sum in sebinomial) are exact so long as they are below 2^53.
+ * sepoisson rounds the sum to the nearest integer, so with non-integer
+ * data a sum that lands within the tolerance of a half-integer can
+ * round to the adjacent integer.
+ *
+ * The sd takes one pass: we accumulate d = v - v[0] and d^2 and take
+ * (sum(d^2) - sum(d)^2 / n) / (n - 1). Both sums are off by at most
+ * about n * DBL_EPSILON * sum(d^2), and sum(d^2) = (n - 1) sd^2 +
+ * n (mean - v[0])^2, so with r = (mean - v[0]) / sd the relative error
+ * of the sd is at most about
+ *
+ *     3 * n * DBL_EPSILON * (1 + r^2)
+ *
+ * Shifting by the first value keeps r small unless v[0] is far out in
+ * the tails relative to the spread of the data. The bench harness
+ * checks the sd against the two-pass sd with 4 in place of 3, which
+ * also covers the rounding error of the two-pass sd.
+ */
+
+#ifndef GTOOLS_SIMD
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GTOOLS_SIMD 1
+#else
+#define GTOOLS_SIMD 0
+#endif
+#endif
+
+struct GtoolsSimd {
+    const char *name;
+    ST_double (*dsum)        (const ST_double *v, GT_size n);
+    ST_double (*dmin)        (const ST_double *v, GT_size n);
+    ST_double (*dmax)        (const ST_double *v, GT_size n);
+    void      (*dsumsq)      (const ST_double *v, GT_size n, ST_double shift, ST_double *s1, ST_double *s2);
+    GT_bool   (*dsum_binary) (const ST_double *v, GT_size n, ST_double *sum);
+    GT_bool   (*dsum_nonneg) (const ST_double *v, GT_size n, ST_double *sum);
+};
+
+void gf_simd_init (void);
+
+ST_double gf_simd_dsum_scalar        (const ST_double *v, GT_size n);
+ST_double gf_simd_dmin_scalar        (const ST_double *v, GT_size n);
+ST_double gf_simd_dmax_scalar        (const ST_double *v, GT_size n);
+void      gf_simd_dsumsq_scalar      (const ST_double *v, GT_size n, ST_double shift, ST_double *s1, ST_double *s2);
+GT_bool   gf_simd_dsum_binary_scalar (const ST_double *v, GT_size n, ST_double *sum);
+GT_bool   gf_simd_dsum_nonneg_scalar (const ST_double *v, GT_size n, ST_double *sum);
+
+#endif
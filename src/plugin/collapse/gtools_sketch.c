@@ -0,0 +1,384 @@
+#include "gtools_sketch.h"
+
+/**
+ * @brief Sketch size for a given rank error
+ *
+ * @param eps Rank error, as a fraction of the number of observations
+ * @return k such that the rank error is below @eps with probability 99%
+ */
+uint32_t gf_sketch_k (ST_double eps)
+{
+    ST_double k;
+    if ( !(eps > 0) ) return (GTOOLS_SKETCH_KMAX);
+    k = ceil(pow(2.296 / eps, 1 / 0.9723));
+    if ( k < GTOOLS_SKETCH_KMIN ) return (GTOOLS_SKETCH_KMIN);
+    if ( k > GTOOLS_SKETCH_KMAX ) return (GTOOLS_SKETCH_KMAX);
+    return ((uint32_t) k);
+}
+
+/**
+ * @brief Whether any of the requested stats is an approximate quantile
+ *
+ * @param statcode Internal summary stat codes (see gf_code_fun)
+ * @param kstats Number of stats
+ * @return 1 if some stat is approx_p#, 0 otherwise
+ */
+GT_bool gf_sketch_any (ST_double *statcode, GT_size kstats)
+{
+    GT_size k;
+    for (k = 0; k < kstats; k++) {
+        if ( statcode[k] < GTOOLS_SKETCH_CODE ) return (1);
+    }
+    return (0);
+}
+
+/**
+ * @brief Exact stat code for an approximate stat code
+ *
+ * approx_p# is encoded as -1000 - # and approx_nunique as -19. When all
+ * of the group's observations are in memory anyway we compute the exact
+ * stat instead, which trivially satisfies the error bound.
+ *
+ * @param fcode Internal summary stat code
+ * @return p# if @fcode is approx_p#; nunique if @fcode is approx_nunique;
+ *         @fcode otherwise
+ */
+ST_double gf_sketch_exact (ST_double fcode)
+{
+    if ( fcode == GTOOLS_HLL_CODE ) return (-18);
+    return (fcode < GTOOLS_SKETCH_CODE? -(fcode - GTOOLS_SKETCH_CODE): fcode);
+}
+
+static inline uint32_t gf_sketch_capacity (uint32_t k, uint32_t H, uint32_t h)
+{
+    return ((uint32_t) ceil(k * pow(2.0 / 3.0, H - 1 - h)) + 1);
+}
+
+static uint32_t gf_sketch_maxsize (uint32_t k, uint32_t H)
+{
+    uint32_t h, maxsize = 0;
+    for (h = 0; h < H; h++)
+        maxsize += gf_sketch_capacity(k, H, h);
+    return (maxsize);
+}
+
+/**
+ * @brief Upper bound on the number of values held by one sketch
+ *
+ * @param k Sketch size (see gf_sketch_k)
+ * @return Number of values
+ */
+GT_size gf_sketch_items (uint32_t k)
+{
+    return (gf_sketch_maxsize(k, GTOOLS_SKETCH_LEVELS));
+}
+
+void gf_sketch_init (struct GtoolsSketch *sketch, uint32_t k)
+{
+    memset(sketch, 0, sizeof *sketch);
+    sketch->k       = k;
+    sketch->H       = 1;
+    sketch->maxsize = gf_sketch_maxsize(k, 1);
+}
+
+void gf_sketch_free (struct GtoolsSketch *sketch)
+{
+    free (sketch->items);
+    sketch->items = NULL;
+    sketch->size  = sketch->alloc = 0;
+}
+
+static int gf_sketch_compare (const void *a, const void *b)
+{
+    ST_double x = *(const ST_double *) a;
+    ST_double y = *(const ST_double *) b;
+    return ((x > y) - (x < y));
+}
+
+/**
+ * @brief Pseudo-random coin flip for a compaction
+ *
+ * splitmix64 of the number of observations and the level; deterministic,
+ * so the same data always give the same sketch.
+ */
+static inline GT_size gf_sketch_coin (GT_size n, uint32_t h)
+{
+    uint64_t z = n * 0x9E3779B97F4A7C15ULL + h + 1;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z = z ^ (z >> 31);
+    return (z >> 63);
+}
+
+/**
+ * @brief Compact level @h of the sketch into level h + 1
+ *
+ * Level h + 1 immediately precedes level h in memory, so the promoted
+ * items are written in place at the start of level h (i.e. appended to
+ * level h + 1), followed by the leftover item if there was an odd number,
+ * and the lower levels are shifted down.
+ */
+static void gf_sketch_compact (struct GtoolsSketch *sketch, uint32_t h)
+{
+    uint32_t i, l, start, count, keep, half, offset;
+    ST_double *items = sketch->items, kept;
+
+    start = 0;
+    for (l = sketch->H - 1; l > h; l--)
+        start += sketch->len[l];
+
+    count = sketch->len[h];
+    qsort (items + start, count, sizeof *items, gf_sketch_compare);
+
+    keep   = count & 1;
+    half   = count / 2;
+    offset = start + keep + gf_sketch_coin(sketch->n, h);
+    kept   = items[start];
+
+    for (i = 0; i < half; i++)
+        items[start + i] = items[offset + 2 * i];
+
+    if ( keep ) items[start + half] = kept;
+
+    memmove(
+        items + start + half + keep,
+        items + start + count,
+        (sketch->size - start - count) * sizeof *items
+    );
+
+    sketch->len[h + 1] += half;
+    sketch->len[h]      = keep;
+    sketch->size       -= count - half - keep;
+}
+
+/**
+ * @brief Add a non-missing value to the sketch
+ *
+ * @param sketch Sketch for the group and source variable
+ * @param z Value to add
+ * @return 0 on success; error code if we ran out of memory
+ */
+ST_retcode gf_sketch_update (struct GtoolsSketch *sketch, ST_double z)
+{
+    uint32_t h, alloc;
+    ST_double *items;
+
+    if ( sketch->size == sketch->alloc ) {
+        alloc = GTOOLS_PWMIN(2 * sketch->alloc, sketch->maxsize);
+        alloc = GTOOLS_PWMAX(alloc, GTOOLS_PWMAX(sketch->size + 1, 8));
+        items = realloc(sketch->items, alloc * sizeof *items);
+        if ( items == NULL ) return (sf_oom_error("gf_sketch_update", "sketch->items"));
+        sketch->items = items;
+        sketch->alloc = alloc;
+    }
+
+    sketch->items[sketch->size++] = z;
+    sketch->len[0]++;
+    sketch->n++;
+
+    // Compact the lowest level that is over capacity, adding a level on
+    // top if that is the top level. Each compaction drops at least one
+    // item; the top level is only ever full if we are out of levels.
+    while ( sketch->size >= sketch->maxsize ) {
+        for (h = 0; h < sketch->H; h++) {
+            if ( sketch->len[h] >= gf_sketch_capacity(sketch->k, sketch->H, h) ) break;
+        }
+
+        if ( h >= sketch->H - 1 ) {
+            if ( sketch->H == GTOOLS_SKETCH_LEVELS ) break;
+            h = sketch->H - 1;
+            sketch->H++;
+            sketch->maxsize = gf_sketch_maxsize(sketch->k, sketch->H);
+        }
+
+        gf_sketch_compact (sketch, h);
+    }
+
+    return (0);
+}
+
+/**
+ * @brief Approximate quantile from the sketch
+ *
+ * Sorts each level and walks all of them in order (a k-way merge with
+ * level h counting as 2^h observations) until the cumulative weight
+ * reaches ceil(n * quantile / 100). If nothing has been compacted yet the
+ * sketch has every value and we return the exact quantile instead.
+ *
+ * @param sketch Sketch for the group and source variable
+ * @param quantile Quantile to compute, in (0, 100)
+ * @return Approximate quantile; missing if the sketch is empty
+ */
+ST_double gf_sketch_quantile (struct GtoolsSketch *sketch, ST_double quantile)
+{
+    uint32_t h, hmin, start;
+    uint32_t pos[GTOOLS_SKETCH_LEVELS], end[GTOOLS_SKETCH_LEVELS];
+    ST_double *items = sketch->items, last;
+    GT_size rank, cumulative;
+
+    if ( sketch->n == 0 ) return (SV_missval);
+    if ( sketch->size == sketch->n ) {
+        return (gf_array_dquantile_range(items, 0, sketch->size, quantile));
+    }
+
+    start = 0;
+    for (h = sketch->H; h > 0; h--) {
+        pos[h - 1] = start;
+        end[h - 1] = start + sketch->len[h - 1];
+        qsort (items + start, sketch->len[h - 1], sizeof *items, gf_sketch_compare);
+        start = end[h - 1];
+    }
+
+    // Levels hold n observations in total (each compaction keeps the
+    // total weight), so we always reach the rank unless quantile >= 100.
+    rank = ceil(sketch->n * quantile / 100);
+    if ( rank < 1 ) rank = 1;
+
+    last = SV_missval;
+    cumulative = 0;
+    while ( 1 ) {
+        hmin = sketch->H;
+        for (h = 0; h < sketch->H; h++) {
+            if ( pos[h] == end[h] ) continue;
+            if ( (hmin == sketch->H) || (items[pos[h]] < items[pos[hmin]]) ) hmin = h;
+        }
+        if ( hmin == sketch->H ) break;
+
+        last = items[pos[hmin]++];
+        cumulative += ((GT_size) 1) << hmin;
+        if ( cumulative >= rank ) break;
+    }
+
+    return (last);
+}
+
+/*********************************************************************
+ *                           HyperLogLog                             *
+ *********************************************************************/
+
+/**
+ * @brief HyperLogLog precision for a given relative error
+ *
+ * @param eps Relative standard error of the count
+ * @return p such that 1.04 / sqrt(2^p) is at most @eps
+ */
+uint32_t gf_hll_precision (ST_double eps)
+{
+    ST_double p;
+    if ( !(eps > 0) ) return (GTOOLS_HLL_PMAX);
+    p = ceil(log2((1.04 / eps) * (1.04 / eps)));
+    if ( p < GTOOLS_HLL_PMIN ) return (GTOOLS_HLL_PMIN);
+    if ( p > GTOOLS_HLL_PMAX ) return (GTOOLS_HLL_PMAX);
+    return ((uint32_t) p);
+}
+
+/**
+ * @brief Whether any of the requested stats is approx_nunique
+ *
+ * @param statcode Internal summary stat codes (see gf_code_fun)
+ * @param kstats Number of stats
+ * @return 1 if some stat is approx_nunique, 0 otherwise
+ */
+GT_bool gf_hll_any (ST_double *statcode, GT_size kstats)
+{
+    GT_size k;
+    for (k = 0; k < kstats; k++) {
+        if ( statcode[k] == GTOOLS_HLL_CODE ) return (1);
+    }
+    return (0);
+}
+
+/**
+ * @brief Add a value to a HyperLogLog sketch
+ *
+ * The value's bits are mixed with the murmur3 finalizer, which is a
+ * bijection on 64 bits, so distinct values never collide before the
+ * registers are picked. 0 and -0 are the same value.
+ *
+ * @param registers 2^@p registers of the sketch
+ * @param p Precision
+ * @param z Value to add (may be missing)
+ */
+void gf_hll_update (uint8_t *registers, uint32_t p, ST_double z)
+{
+    uint64_t h, w;
+    uint8_t rho;
+
+    if ( z == 0 ) z = 0;
+    memcpy(&h, &z, sizeof h);
+
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+
+    // Leading zeros of the 64 - p bits after the index, plus one; this is
+    // 64 - p + 1 if they are all zero.
+    w   = h << p;
+    rho = 1;
+    while ( (rho <= 64 - p) && !(w & 0x8000000000000000ULL) ) {
+        w <<= 1;
+        rho++;
+    }
+
+    if ( registers[h >> (64 - p)] < rho ) registers[h >> (64 - p)] = rho;
+}
+
+static ST_double gf_hll_sigma (ST_double x)
+{
+    ST_double y = 1, z = x, zprev;
+    if ( x == 1 ) return (SV_missval);
+    do {
+        x     *= x;
+        zprev  = z;
+        z     += x * y;
+        y     += y;
+    } while ( z != zprev );
+    return (z);
+}
+
+static ST_double gf_hll_tau (ST_double x)
+{
+    ST_double y = 1, z = 1 - x, zprev;
+    if ( (x == 0) || (x == 1) ) return (0);
+    do {
+        x      = sqrt(x);
+        zprev  = z;
+        y     *= 0.5;
+        z     -= (1 - x) * (1 - x) * y;
+    } while ( z != zprev );
+    return (z / 3);
+}
+
+/**
+ * @brief Estimated number of distinct values in a HyperLogLog sketch
+ *
+ * Ertl's improved estimator, computed from the histogram of the register
+ * values; see gtools_sketch.h.
+ *
+ * @param registers 2^@p registers of the sketch
+ * @param p Precision
+ * @return Estimated count, rounded to the nearest integer
+ */
+ST_double gf_hll_count (uint8_t *registers, uint32_t p)
+{
+    GT_size i, m = ((GT_size) 1) << p;
+    GT_size q = 64 - p;
+    GT_size counts[66] = {0};
+    ST_double z;
+    int l;
+
+    for (i = 0; i < m; i++)
+        counts[registers[i]]++;
+
+    if ( counts[0] == m ) return (0);
+
+    z = m * gf_hll_tau(1 - (ST_double) counts[q + 1] / m);
+    for (l = q; l >= 1; l--) {
+        z = 0.5 * (z + counts[l]);
+    }
+    z += m * gf_hll_sigma((ST_double) counts[0] / m);
+
+    return (round(m * m / (2 * log(2) * z)));
+}
@@ -0,0 +1,99 @@
+#ifndef GTOOLS_SKETCH
+#define GTOOLS_SKETCH
+
+/*
+ * Approximate quantiles (approx_p#, approx_median)
+ * ------------------------------------------------
+ *
+ * Each group and source variable gets a KLL sketch (Karnin, Lang, and
+ * Liberty, 2016), which is updated once per observation as the source is
+ * read, so the stat is computed in one pass with memory proportional to
+ * J x sketch size instead of N.
+ *
+ * The sketch is a stack of compactors. Level h holds items that each
+ * stand in for 2^h observations. New values go into level 0; when the
+ * sketch is full, the lowest level over its capacity is sorted and every
+ * other item (starting at the first or second, at random) is promoted to
+ * the level above, and the rest are dropped. Level h can hold about
+ * k (2/3)^(H - 1 - h) items, where H is the number of levels, so the
+ * sketch never holds more than about 3k items. A quantile is the
+ * smallest item whose cumulative weight (sorting every item and counting
+ * each as 2^h observations) reaches the requested rank.
+ *
+ * Error bound
+ * -----------
+ *
+ * With k = (2.296 / eps)^(1 / 0.9723), the rank of the value returned for
+ * quantile p is within eps * n of p * n with probability 99%, where n is
+ * the number of non-missing observations in the group (this is the
+ * calibration of the Apache DataSketches KLL sketch, which uses the same
+ * compaction schedule). For example, the default eps = 0.01 gives k = 269
+ * and at most about 830 doubles per sketch. The coin flips are
+ * pseudo-random but seeded by the number of observations and the level,
+ * so results are reproducible. Until the first compaction the sketch
+ * holds every value, and the quantile is exact (same as p#).
+ *
+ * Approximate distinct counts (approx_nunique)
+ * --------------------------------------------
+ *
+ * Each group and source variable gets a HyperLogLog sketch (Flajolet et
+ * al., 2007): m = 2^p one-byte registers. Each value is hashed to 64
+ * bits; the top p bits pick a register, which keeps the maximum number
+ * of leading zeros (plus one) seen in the remaining bits. Missing values
+ * are counted as values, same as nunique.
+ *
+ * The count is estimated from the histogram of register values with
+ * Ertl's improved estimator (2017), which is unbiased from a handful of
+ * distinct values up to 2^64 without the empirical bias-correction
+ * tables of HLL++. The relative standard error is 1.04 / sqrt(m); p is
+ * the smallest precision that brings this within approxeps(), so the
+ * default eps = 0.01 gives p = 14 and 16KiB per sketch.
+ *
+ * Exact fallback
+ * --------------
+ *
+ * Sketches are only used when every stat can be accumulated as the data
+ * are read (see gf_accum_streamable) and the sketches take less memory
+ * than buffering the sources. Otherwise (e.g. p# or nunique is also
+ * requested, there are weights, or the groups are small) the data are
+ * buffered anyway and gf_sketch_exact maps each approximate stat to its
+ * exact counterpart, so the result is exact. Verbose runs say so.
+ */
+
+#define GTOOLS_SKETCH_CODE   -1000
+#define GTOOLS_SKETCH_LEVELS 32
+#define GTOOLS_SKETCH_KMIN   8
+#define GTOOLS_SKETCH_KMAX   65536
+
+#define GTOOLS_HLL_CODE -19
+#define GTOOLS_HLL_PMIN 4
+#define GTOOLS_HLL_PMAX 18
+
+struct GtoolsSketch {
+    ST_double *items;  // levels stored top-down; level 0 is last
+    GT_size   n;       // observations added
+    uint32_t  size;    // items held
+    uint32_t  alloc;   // items allocated
+    uint32_t  maxsize; // sum of the level capacities
+    uint32_t  k;       // capacity of the top level
+    uint32_t  H;       // number of levels
+    uint32_t  len[GTOOLS_SKETCH_LEVELS];
+};
+
+uint32_t  gf_sketch_k (ST_double eps);
+GT_bool   gf_sketch_any (ST_double *statcode, GT_size kstats);
+ST_double gf_sketch_exact (ST_double fcode);
+GT_size   gf_sketch_items (uint32_t k);
+
+void gf_sketch_init (struct GtoolsSketch *sketch, uint32_t k);
+void gf_sketch_free (struct GtoolsSketch *sketch);
+
+ST_retcode gf_sketch_update (struct GtoolsSketch *sketch, ST_double z);
+ST_double  gf_sketch_quantile (struct GtoolsSketch *sketch, ST_double quantile);
+
+uint32_t  gf_hll_precision (ST_double eps);
+GT_bool   gf_hll_any (ST_double *statcode, GT_size kstats);
+void      gf_hll_update (uint8_t *registers, uint32_t p, ST_double z);
+ST_double gf_hll_count (uint8_t *registers, uint32_t p);
+
+#endif
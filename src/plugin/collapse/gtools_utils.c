@@ -1,45 +1,7 @@
 #include "gtools_utils.h"
 
 /**
- * @brief Benchmark I/O
- *
- * @return Time to read/write 1MiB to disk
- */
-ST_double gf_benchmark (char *fname)
-{
-    GT_size k, j;
-    GT_size KiB  = 1024;
-    GT_size k1   = 2;
-    GT_size k2   = 4;
-    GT_size kw   = k2 - k1;
-    GT_size J    = 64 * KiB;
-    srand (time(NULL));
-
-    ST_double *A = malloc(J * k2 * sizeof(ST_double));
-    ST_double *B = malloc(J * kw * sizeof(ST_double));
-    for (j = 0; j < J; j++) {
-        for (k = 0; k < k2; k++)
-            A[k2 * j + k] = (ST_double) rand() / RAND_MAX;
-    }
-
-    clock_t timer = clock(); ST_double iops;
-    gf_write_collapsed (fname, A, k1, k2, J);
-    gf_read_collapsed (fname, B, kw, J);
-    iops = (ST_double) (clock() - timer) / CLOCKS_PER_SEC;
-
-    for (j = 0; j < 20; j++) {
-        for (k = 0; k < kw; k++)
-            if ( A[k2 * j + k1 + k] != B[kw * j + k] ) return(-1);
-    }
-
-    free (A);
-    free (B);
-
-    return (iops);
-}
-
-/**
- * @brief Write collapsed summary stats to binary file
+ * @brief Write collapsed summary stats to a spill file
  *
  * Saves the collapsed data to file. The collapsed data is
  * in a manualy indexed vector using row-major order. So for
@@ -47,7 +9,10 @@ ST_double gf_benchmark (char *fname)
  *
  *     [(0, 0) (0, 1) ... (0, k) (1, 0) ... (J, 0) ... (J, k)]
  *
- * And we save 0 to @J from @kstart to @kend in each row.
+ * And we save 0 to @J from @kstart to @kend in each row. Rows are
+ * packed into chunks of about GTOOLS_SPILL_CHUNK bytes (or written as
+ * is if they are contiguous) so there is one write per chunk, not per
+ * row. The header is written last, once the checksum is known.
  *
  * @param collapsed_file File where to save collapsed stats
  * @param collapsed_data Vector of doubles with collapsed stats
@@ -56,24 +21,173 @@ ST_double gf_benchmark (char *fname)
  * @param J Number of rows.
  * @return Writes @collapsed_data to disk.
  */
-void gf_write_collapsed(
+ST_retcode gf_write_collapsed(
     char *collapsed_file,
     ST_double *collapsed_data,
     GT_size kstart,
     GT_size kend,
     GT_size J)
 {
-    GT_size j;
-    GT_size knum = kend - kstart;
-    FILE *collapsed_handle = fopen(collapsed_file, "wb");
-    for (j = 0; j < J; j++) {
-        fwrite (collapsed_data + j * kend + kstart, sizeof(collapsed_data), knum, collapsed_handle);
+    GT_size i, j, rows, chunk;
+    GT_size knum     = kend - kstart;
+    size_t  rowbytes = knum * sizeof(ST_double);
+    ST_double *buffer = NULL, *rowptr;
+    struct GtoolsSpillHeader header;
+    spookyhash_context context;
+
+    memset (&header, '\0', sizeof(header));
+    memcpy (header.magic, GTOOLS_SPILL_MAGIC, sizeof(header.magic));
+    header.J     = J;
+    header.k     = knum;
+    header.type  = GTOOLS_SPILL_DOUBLE;
+    header.width = sizeof(ST_double);
+
+    FILE *fhandle = fopen(collapsed_file, "wb");
+    if ( fhandle == NULL ) {
+        sf_errprintf ("Unable to open spill file %s for writing.\n", collapsed_file);
+        return (603);
     }
-    fclose(collapsed_handle);
+
+    // Placeholder until the checksum is known
+    if ( fwrite(&header, sizeof(header), 1, fhandle) != 1 ) goto error;
+
+    spookyhash_context_init (&context, 0, 1);
+    if ( (J > 0) && (knum > 0) ) {
+        chunk = GTOOLS_SPILL_CHUNK / rowbytes;
+        if ( chunk < 1 ) chunk = 1;
+        if ( chunk > J ) chunk = J;
+
+        if ( knum < kend ) {
+            buffer = malloc(chunk * rowbytes);
+            if ( buffer == NULL ) {
+                fclose (fhandle);
+                remove (collapsed_file);
+                return (sf_oom_error("gf_write_collapsed", "buffer"));
+            }
+        }
+
+        for (j = 0; j < J; j += rows) {
+            rows = ((J - j) < chunk)? J - j: chunk;
+            if ( buffer == NULL ) {
+                rowptr = collapsed_data + j * kend;
+            }
+            else {
+                for (i = 0; i < rows; i++) {
+                    memcpy (buffer + i * knum,
+                            collapsed_data + (j + i) * kend + kstart,
+                            rowbytes);
+                }
+                rowptr = buffer;
+            }
+
+            spookyhash_update (&context, rowptr, rows * rowbytes);
+            if ( fwrite(rowptr, rowbytes, rows, fhandle) != rows ) goto error;
+        }
+    }
+    spookyhash_final (&context, &(header.check1), &(header.check2));
+
+    if ( fseek(fhandle, 0, SEEK_SET) ) goto error;
+    if ( fwrite(&header, sizeof(header), 1, fhandle) != 1 ) goto error;
+
+    free (buffer);
+    if ( fclose(fhandle) ) {
+        sf_errprintf ("Unable to write spill file %s (is the disk full?).\n", collapsed_file);
+        remove (collapsed_file);
+        return (692);
+    }
+
+    return (0);
+
+error:
+    sf_errprintf ("Unable to write spill file %s (is the disk full?).\n", collapsed_file);
+    fclose (fhandle);
+    remove (collapsed_file);
+    free (buffer);
+    return (692);
 }
 
 /**
- * @brief Read collapsed summary stats from binary file
+ * @brief Map a spill file and check it is intact
+ *
+ * Checks the header and the size of the file, and that the checksum of
+ * the data matches the one in the header. On success, @spill->data
+ * points to the J by k entries in the mapped file (row-major order).
+ *
+ * @param collapsed_file Spill file written by gf_write_collapsed
+ * @param spill Output; view of the spill file; release it with
+ *              gf_spill_close (also on error)
+ * @return 0 on success; Stata error code otherwise
+ */
+ST_retcode gf_spill_open (char *collapsed_file, struct GtoolsSpill *spill)
+{
+    ST_retcode rc = 0;
+    struct GtoolsSpillHeader header;
+    spookyhash_context context;
+    uint64_t check1, check2;
+    size_t payload;
+
+    memset (spill, '\0', sizeof *spill);
+    if ( (spill->map = gf_file_map(collapsed_file, &(spill->bytes))) == NULL ) {
+        sf_errprintf ("Unable to read spill file %s.\n", collapsed_file);
+        return (603);
+    }
+
+    if ( spill->bytes < sizeof(header) ) {
+        rc = 612; goto error;
+    }
+    memcpy (&header, spill->map, sizeof(header));
+
+    if ( memcmp(header.magic, GTOOLS_SPILL_MAGIC, sizeof(header.magic))
+         || (header.type  != GTOOLS_SPILL_DOUBLE)
+         || (header.width != sizeof(ST_double)) ) {
+        rc = 610; goto error;
+    }
+
+    payload = spill->bytes - sizeof(header);
+    if ( (header.k > 0) && (header.J != payload / sizeof(ST_double) / header.k) ) {
+        rc = 612; goto error;
+    }
+    if ( header.J * header.k * sizeof(ST_double) != payload ) {
+        rc = 612; goto error;
+    }
+
+    spookyhash_context_init (&context, 0, 1);
+    spookyhash_update (&context, spill->map + sizeof(header), payload);
+    spookyhash_final (&context, &check1, &check2);
+    if ( (check1 != header.check1) || (check2 != header.check2) ) {
+        rc = 639; goto error;
+    }
+
+    spill->data = (ST_double *) (spill->map + sizeof(header));
+    spill->J    = header.J;
+    spill->k    = header.k;
+    return (0);
+
+error:
+    if ( rc == 612 ) {
+        sf_errprintf ("Spill file %s is truncated.\n", collapsed_file);
+    }
+    else if ( rc == 610 ) {
+        sf_errprintf ("%s is not a gtools spill file.\n", collapsed_file);
+    }
+    else {
+        sf_errprintf ("Spill file %s is corrupted (checksums do not match).\n", collapsed_file);
+    }
+    return (rc);
+}
+
+/**
+ * @brief Release a spill file mapped with gf_spill_open
+ */
+void gf_spill_close (struct GtoolsSpill *spill)
+{
+    if ( spill->map != NULL ) gf_file_unmap (spill->map, spill->bytes);
+    spill->map  = NULL;
+    spill->data = NULL;
+}
+
+/**
+ * @brief Read collapsed summary stats from a spill file
  *
  * Reads collapsed data from file. The collapsed data is
  * in a manualy indexed vector using row-major order. So for
@@ -89,16 +203,26 @@ void gf_write_collapsed(
  * @param J Number of rows.
  * @return Reads @collapsed_data from disk.
  */
-void gf_read_collapsed(
+ST_retcode gf_read_collapsed(
     char *collapsed_file,
     ST_double *collapsed_data,
     GT_size knum,
     GT_size J)
 {
-    FILE *collapsed_handle = fopen(collapsed_file, "rb");
-    GT_size ret = fread (collapsed_data, sizeof(collapsed_data), knum * J, collapsed_handle);
-    if ( ret == 0 ) printf(" "); // So it doesn't nag about ret unused...
-    fclose(collapsed_handle);
+    ST_retcode rc = 0;
+    struct GtoolsSpill spill;
+
+    if ( (rc = gf_spill_open (collapsed_file, &spill)) ) goto exit;
+    if ( (spill.J != J) || (spill.k != knum) ) {
+        sf_errprintf ("Spill file %s does not have the expected dimensions.\n", collapsed_file);
+        rc = 610; goto exit;
+    }
+
+    memcpy (collapsed_data, spill.data, J * knum * sizeof(ST_double));
+
+exit:
+    gf_spill_close (&spill);
+    return (rc);
 }
 
 /**
@@ -129,16 +253,13 @@ void gf_split_path_file(char** p, char** f, char *pf) {
 ST_double gf_query_free_space (char *fname)
 {
     struct statvfs finfo;
-    char *filepath = malloc((strlen(fname) + 1) * sizeof(char));
-    char *filename = malloc((strlen(fname) + 1) * sizeof(char));
-    memset (filepath, '\0', (strlen(fname) + 1) * sizeof(char));
-    memset (filename, '\0', (strlen(fname) + 1) * sizeof(char));
+    char *filepath, *filename;
 
     // char rpath [PATH_MAX+1];
     // char *rc = realpath (fname, rpath);
     // gf_split_path_file (&filepath, &filename, rpath);
     gf_split_path_file (&filepath, &filename, fname);
-    statvfs (filepath, &finfo);
+    statvfs ((filepath[0] == '\0')? ".": filepath, &finfo);
     ST_double mib_free = ((ST_double) finfo.f_bsize * finfo.f_bfree) / 1024 / 1024;
 
     free (filepath);
@@ -1,11 +1,48 @@
 #ifndef GTOOLS_UTILS
 #define GTOOLS_UTILS
 
-ST_double gf_benchmark (char *fname);
 ST_double gf_query_free_space (char *fname);
 void gf_split_path_file(char** p, char** f, char *pf);
 
-void gf_write_collapsed(
+/*
+ * Collapse spill files
+ * --------------------
+ *
+ * With forceio (or when sf_switch_io decides writing to disk is faster)
+ * the targets that do not fit in the collapsed data are written to a
+ * spill file and read back after Stata has dropped the full data.
+ *
+ * Layout: header, then J rows of k doubles in row-major order. The
+ * header records J, k, the type and width of the entries, and a 128-bit
+ * spooky hash of the data, so a truncated or stale file is caught
+ * instead of being read as data. The file is written in large chunks and
+ * read back by mapping it (see gf_file_map), so the entries are stored in
+ * Stata straight from the mapped file.
+ */
+
+#define GTOOLS_SPILL_MAGIC  "GTSPILL1"
+#define GTOOLS_SPILL_DOUBLE 1
+#define GTOOLS_SPILL_CHUNK  (4 * 1024 * 1024)
+
+struct GtoolsSpillHeader {
+    char     magic[8];
+    uint64_t J;
+    uint64_t k;
+    uint64_t type;
+    uint64_t width;
+    uint64_t check1;
+    uint64_t check2;
+};
+
+struct GtoolsSpill {
+    char      *map;
+    size_t    bytes;
+    ST_double *data;
+    GT_size   J;
+    GT_size   k;
+};
+
+ST_retcode gf_write_collapsed(
     char *collapsed_file,
     ST_double *collapsed_data,
     GT_size kstart,
@@ -13,11 +50,14 @@ void gf_write_collapsed(
     GT_size J
 );
 
-void gf_read_collapsed(
+ST_retcode gf_read_collapsed(
     char *collapsed_file,
     ST_double *collapsed_data,
     GT_size knum,
     GT_size J
 );
 
+ST_retcode gf_spill_open  (char *collapsed_file, struct GtoolsSpill *spill);
+void       gf_spill_close (struct GtoolsSpill *spill);
+
 #endif
@@ -1,4 +1,17 @@
-// Adapted from: http://stackoverflow.com/questions/42077009
+// Introselect: quickselect with a median-of-three (ninther for larger
+// ranges) pivot and a three-way partition, so ties are handled in one
+// step. If partitions keep coming out lopsided (e.g. adversarial or
+// sorted data with an unlucky pivot) we switch to the median of medians
+// as the pivot, which bounds the worst case to linear time. There is no
+// recursion: the range is narrowed in a loop, and the median of medians
+// is selected by pushing the current range onto a small explicit stack
+// (each level is 1/5 the size of the one below, so the stack stays
+// shallow).
+//
+// On return, x[start + k] holds the kth smallest entry of the range,
+// every entry before it is <= and every entry after it is >=. Successive
+// selections can exploit this by starting at the previous k (see the
+// gf_quantiles_*_qselect family).
 
 #define SWAP(a, b)       \
 do {                     \
@@ -7,194 +20,279 @@ do {                     \
     (b) = _a;            \
 } while(0)
 
+#define GTOOLS_QSELECT_SMALL  16
+#define GTOOLS_QSELECT_NINTHER 128
+#define GTOOLS_QSELECT_BAD     4
+#define GTOOLS_QSELECT_DEPTH   32
+
 ST_double gf_qselect_range (ST_double *x, GT_size start, GT_size end, GT_size k);
-void gf_qselect_range_partition (
+
+void gf_qselect_multi (
     ST_double *x,
     GT_size start,
     GT_size end,
-    GT_size *less_size,
-    GT_size *equal_size
+    GT_size *pos,
+    GT_size npos,
+    ST_double *values
 );
 
-ST_double gf_qselect_range(ST_double *x, GT_size start, GT_size end, GT_size k)
+static inline ST_double gf_qselect_median3 (ST_double a, ST_double b, ST_double c)
 {
-    if ( (end - start) == 1 ) {
-        return (x[start]);
-    }
-
-    GT_size less_size;
-    GT_size equal_size;
-
-    gf_qselect_range_partition (x, start, end, &less_size, &equal_size);
+    if ( a > b ) SWAP(a, b);
+    if ( b > c ) b = c;
+    return (a > b? a: b);
+}
 
-    if ( k < less_size ) {
-        // k lies in the less-than-pivot partition
-        end = start + less_size;
-    }
-    else if ( k < less_size + equal_size ) {
-        // k lies in the equals-to-pivot partition
-        return x[end - 1];
-    }
-    else {
-        // k lies in the greater-than-pivot partition
-        start += less_size;
-        end   -= equal_size;
-        k     -= less_size + equal_size;
+static inline void gf_qselect_insertion (ST_double *x, GT_size start, GT_size end)
+{
+    GT_size i, j;
+    ST_double z;
+    for (i = start + 1; i < end; i++) {
+        z = x[i];
+        for (j = i; (j > start) && (x[j - 1] > z); j--)
+            x[j] = x[j - 1];
+        x[j] = z;
     }
+}
 
-    return (gf_qselect_range(x, start, end, k));
+/**
+ * @brief Move the medians of groups of 5 to the front of a range
+ *
+ * @param x Array
+ * @param start First entry of the range
+ * @param end One past the last entry of the range
+ * @return Number of medians, which are stored starting at x[start]
+ */
+static GT_size gf_qselect_medians5 (ST_double *x, GT_size start, GT_size end)
+{
+    GT_size i, m, lo, hi;
+    for (i = start, m = 0; i < end; i += 5, m++) {
+        lo = i;
+        hi = (end - i) < 5? end: i + 5;
+        gf_qselect_insertion (x, lo, hi);
+        SWAP(x[start + m], x[lo + (hi - lo - 1) / 2]);
+    }
+    return (m);
 }
 
-void gf_qselect_range_partition(
+/**
+ * @brief Three-way partition of a range around a value
+ *
+ * @param x Array
+ * @param start First entry of the range
+ * @param end One past the last entry of the range
+ * @param pivot Value to partition around
+ * @param lt Output; x[start, lt) < pivot
+ * @param gt Output; x[lt, gt) == pivot and x[gt, end) > pivot
+ */
+static inline void gf_qselect_partition (
     ST_double *x,
     GT_size start,
     GT_size end,
-    GT_size *less_size,
-    GT_size *equal_size)
+    ST_double pivot,
+    GT_size *lt,
+    GT_size *gt)
 {
+    GT_size i, l, g;
+    ST_double z;
 
-    // Modified median-of-three and pivot selection.
-    GT_size nj     = end - start;
-    GT_size first  = start;
-    GT_size middle = start + floor(nj / 2);
-    GT_size last   = end - 1 ;
-
-    if ( x[first] > x[last]) {
-        SWAP(x[first], x[last]);
-    }
-    if ( x[first] > x[middle] ) {
-        SWAP(x[first], x[middle]);
-    }
-    if ( x[last] > x[middle] ) {
-        SWAP(x[last], x[middle]);
-    }
-    const ST_double pivot_value = x[last];
-
-    // Element swapping
-    GT_size greater_idx = 0;
-    GT_size equal_idx   = nj - 1;
-    GT_size i = 0;
-    while ( i < equal_idx ) {
-        const ST_double elem_value = x[start + i];
-
-        if ( elem_value < pivot_value ) {
-            SWAP(x[start + greater_idx], x[start + i]);
-            greater_idx++;
+    l = i = start;
+    g = end;
+    while ( i < g ) {
+        z = x[i];
+        if ( z < pivot ) {
+            SWAP(x[l], x[i]);
+            l++;
             i++;
         }
-        else if ( elem_value == pivot_value ) {
-            equal_idx--;
-            SWAP(x[start + i], x[start + equal_idx]);
+        else if ( z > pivot ) {
+            g--;
+            SWAP(x[i], x[g]);
         }
-        else { // elem_value > pivot_value
+        else {
             i++;
         }
     }
 
-    *less_size  = greater_idx;
-    *equal_size = nj - equal_idx;
+    *lt = l;
+    *gt = g;
 }
 
-/*********************************************************************
- *                            Alternative                            *
- *********************************************************************/
+/**
+ * @brief Select the kth smallest entry in a range of an array
+ *
+ * @param x Array to select from; it is partially sorted in place
+ * @param start Select from the @start-th entry
+ * @param end Select until the (@end - 1)-th entry
+ * @param k Order statistic to select, relative to @start (0 is the min)
+ * @return kth smallest entry of @x from @start to @end
+ */
+ST_double gf_qselect_range (ST_double *x, GT_size start, GT_size end, GT_size k)
+{
+    struct { GT_size lo, hi, target; } stack[GTOOLS_QSELECT_DEPTH];
+    GT_size depth = 0;
 
-// Here we group the equal partition in the middle and the greater partition
-// at the end. I think this is slower for a few arbitrary quantiles but
-// the main use of this function is to compute several reasonably spaced
-// successive quantiles. In that case there are large speed gains if we make
-// sure the array is partially ordered because to compute the next quantile we
-// can start at 'k'!
+    GT_size lo     = start;
+    GT_size hi     = end;
+    GT_size target = start + k;
+    GT_size bad    = 0;
 
-ST_double gf_qselect_xtile (ST_double *x, GT_size start, GT_size end, GT_size k);
-void gf_qselect_xtile_partition (
-    ST_double *x,
-    GT_size start,
-    GT_size end,
-    GT_size *less_size,
-    GT_size *greater_size
-);
+    GT_size n, m, lt, gt, step;
+    GT_bool done;
+    ST_double pivot;
 
-ST_double gf_qselect_xtile(ST_double *x, GT_size start, GT_size end, GT_size k)
-{
-    if ( (end - start) == 1 ) {
-        return (x[start]);
-    }
+    while ( 1 ) {
+        n = hi - lo;
 
-    GT_size less_size;
-    GT_size greater_size;
+        if ( n <= GTOOLS_QSELECT_SMALL ) {
+            gf_qselect_insertion (x, lo, hi);
+            pivot = x[target];
+            done  = 1;
+        }
+        else if ( (bad >= GTOOLS_QSELECT_BAD) && (depth < GTOOLS_QSELECT_DEPTH) ) {
+            // Too many lopsided partitions; select the median of the
+            // medians of groups of 5 and use it as the pivot.
+            m = gf_qselect_medians5 (x, lo, hi);
+            stack[depth].lo     = lo;
+            stack[depth].hi     = hi;
+            stack[depth].target = target;
+            depth++;
+            hi     = lo + m;
+            target = lo + (m - 1) / 2;
+            bad    = 0;
+            continue;
+        }
+        else {
+            if ( n < GTOOLS_QSELECT_NINTHER ) {
+                pivot = gf_qselect_median3 (x[lo], x[lo + n / 2], x[hi - 1]);
+            }
+            else {
+                step  = n / 8;
+                pivot = gf_qselect_median3 (
+                    gf_qselect_median3 (x[lo],            x[lo + step],     x[lo + 2 * step]),
+                    gf_qselect_median3 (x[lo + 3 * step], x[lo + 4 * step], x[lo + 5 * step]),
+                    gf_qselect_median3 (x[lo + 6 * step], x[lo + 7 * step], x[hi - 1])
+                );
+            }
 
-    gf_qselect_xtile_partition (x, start, end, &less_size, &greater_size);
+            gf_qselect_partition (x, lo, hi, pivot, &lt, &gt);
+            if ( target < lt ) {
+                hi = lt;
+            }
+            else if ( target >= gt ) {
+                lo = gt;
+            }
+            done = (target >= lt) && (target < gt);
+            if ( (hi - lo) > (3 * n / 4) ) bad++;
+        }
 
-    if ( k < less_size ) {
-        // k lies in the less-than-pivot partition
-        end = start + less_size;
-    }
-    else if ( k < greater_size ) {
-        // k lies in the equals-to-pivot partition
-        return x[start + less_size];
-    }
-    else {
-        // k lies in the greater-than-pivot partition
-        start += greater_size;
-        k     -= greater_size;
-    }
+        // Once a median of medians is found, go back to the range it came
+        // from and partition it around the median. The median is at least
+        // as large and as small as 3/10 of the range, so this always makes
+        // progress; it can also land on the target of that range.
+        while ( done ) {
+            if ( depth == 0 ) return (pivot);
+
+            depth--;
+            lo     = stack[depth].lo;
+            hi     = stack[depth].hi;
+            target = stack[depth].target;
+            bad    = 0;
 
-    return (gf_qselect_xtile(x, start, end, k));
+            gf_qselect_partition (x, lo, hi, pivot, &lt, &gt);
+            if ( target < lt ) {
+                hi = lt;
+            }
+            else if ( target >= gt ) {
+                lo = gt;
+            }
+            done = (target >= lt) && (target < gt);
+        }
+    }
 }
 
-void gf_qselect_xtile_partition(
+/*********************************************************************
+ *                         Multiple selection                        *
+ *********************************************************************/
+
+/**
+ * @brief Select several order statistics from a range of an array
+ *
+ * Selects the middle requested position with gf_qselect_range, which
+ * leaves smaller entries before it and larger entries after it, and
+ * then does the same for the positions on either side, but only within
+ * the corresponding sub-range. Each level of this halves the number of
+ * positions, so this takes O(N log npos) even in the worst case. Pending
+ * sub-ranges are kept on an explicit stack; we always continue with the
+ * one with fewer positions, so the stack holds at most log2(npos).
+ *
+ * @param x Array to select from; it is partially sorted in place
+ * @param start Select from the @start-th entry
+ * @param end Select until the (@end - 1)-th entry
+ * @param pos Sorted positions in @x, between @start and @end, of the
+ *            order statistics to select (i.e. start + rank)
+ * @param npos Number of positions
+ * @param values Output; values[i] is the entry that would be at pos[i]
+ *               if x were sorted from @start to @end
+ */
+void gf_qselect_multi (
     ST_double *x,
     GT_size start,
     GT_size end,
-    GT_size *less_size,
-    GT_size *greater_size)
+    GT_size *pos,
+    GT_size npos,
+    ST_double *values)
 {
+    struct { GT_size lo, hi, first, count; } stack[64];
+    GT_size depth = 0;
 
-    // Modified median-of-three and pivot selection.
-    ST_double elem_value;
-    GT_size nj     = end - start;
-    GT_size first  = start;
-    GT_size middle = start + floor(nj / 2);
-    GT_size last   = end - 1 ;
-
-    if ( x[first] > x[last]) {
-        SWAP(x[first], x[last]);
-    }
-    if ( x[first] > x[middle] ) {
-        SWAP(x[first], x[middle]);
-    }
-    if ( x[middle] > x[last] ) {
-        SWAP(x[last], x[middle]);
-    }
-    ST_double pivot_value = x[middle];
+    GT_size lo    = start;
+    GT_size hi    = end;
+    GT_size first = 0;
+    GT_size count = npos;
+    GT_size i, mid;
 
+    while ( 1 ) {
+        if ( count == 0 ) {
+            if ( depth == 0 ) return;
+            depth--;
+            lo    = stack[depth].lo;
+            hi    = stack[depth].hi;
+            first = stack[depth].first;
+            count = stack[depth].count;
+            continue;
+        }
 
-    // Wait, maybe this proves performance with many dups, but does it
-    // deteriorate performance with few dups? Ah! think the offset of being
-    // able to pass qstart as the starting point will negate that loss.
+        if ( (hi - lo) <= GTOOLS_QSELECT_SMALL ) {
+            gf_qselect_insertion (x, lo, hi);
+            for (i = first; i < first + count; i++)
+                values[i] = x[pos[i]];
+            count = 0;
+            continue;
+        }
 
-    // Element swapping
-    GT_size greater_idx = 0;
-    GT_size less_idx    = nj;
-    GT_size i = 0;
-    while ( i < less_idx ) {
-        elem_value = x[start + i];
+        mid = first + count / 2;
+        values[mid] = gf_qselect_range (x, lo, hi, pos[mid] - lo);
 
-        if ( elem_value < pivot_value ) {
-            SWAP(x[start + greater_idx], x[start + i]);
-            greater_idx++;
-            i++;
+        // Positions [first, mid) are in [lo, pos[mid]) and positions
+        // (mid, first + count) are in (pos[mid], hi)
+        if ( (mid - first) > (first + count - mid - 1) ) {
+            stack[depth].lo    = lo;
+            stack[depth].hi    = pos[mid];
+            stack[depth].first = first;
+            stack[depth].count = mid - first;
+            lo     = pos[mid] + 1;
+            count  = first + count - mid - 1;
+            first  = mid + 1;
         }
-        else if ( elem_value > pivot_value ) {
-            --less_idx;
-            SWAP(x[start + i], x[start + less_idx]);
-        }
-        else { // elem_value == pivot_value
-            i++;
+        else {
+            stack[depth].lo    = pos[mid] + 1;
+            stack[depth].hi    = hi;
+            stack[depth].first = mid + 1;
+            stack[depth].count = first + count - mid - 1;
+            hi     = pos[mid];
+            count  = mid - first;
         }
+        depth++;
     }
-
-    *less_size    = greater_idx;
-    *greater_size = less_idx;
 }
@@ -93,6 +93,7 @@ ST_retcode sf_encode (struct StataInfo *st_info, int level)
                 }
             }
 
+            gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_STATS);
             if ( st_info->benchmark > 2 )
                 sf_running_timer (&stimer, "\t\tPlugin step 5.1: Generated encoding in Stata order");
 
@@ -103,6 +104,7 @@ ST_retcode sf_encode (struct StataInfo *st_info, int level)
                 }
             }
 
+            gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_WRITE);
             if ( st_info->benchmark > 2 )
                 sf_running_timer (&stimer, "\t\tPlugin step 5.2: Copied back encoding to Stata");
         }
@@ -116,6 +118,7 @@ ST_retcode sf_encode (struct StataInfo *st_info, int level)
                 }
             }
 
+            gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_STATS);
             if ( st_info->benchmark > 2 )
                 sf_running_timer (&stimer, "\t\tPlugin step 5.1: Generated encoding in Stata order");
 
@@ -124,6 +127,7 @@ ST_retcode sf_encode (struct StataInfo *st_info, int level)
                 if ( (rc = SF_vstore(group_targets[0], i + st_info->in1, *eptr)) ) return (rc);
             }
 
+            gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_WRITE);
             if ( st_info->benchmark > 2 )
                 sf_running_timer (&stimer, "\t\tPlugin step 5.2: Copied back encoding to Stata");
         }
@@ -171,6 +175,7 @@ ST_retcode sf_encode (struct StataInfo *st_info, int level)
         }
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_WRITE);
     if ( st_info->benchmark > 1 )
         sf_running_timer (&timer, "\tPlugin step 5: Copied back encoding to Stata");
 
@@ -0,0 +1,164 @@
+#include "gtools_arena.h"
+
+#define GTOOLS_ARENA_HEADER \
+    ((sizeof(struct GtoolsArenaChunk) + GTOOLS_ARENA_ALIGN - 1) & ~((size_t) GTOOLS_ARENA_ALIGN - 1))
+
+void gf_arena_init (struct GtoolsArena *arena)
+{
+    memset(arena, 0, sizeof *arena);
+}
+
+static struct GtoolsArenaChunk *gf_arena_map (
+    struct GtoolsArena *arena,
+    size_t mapped,
+    GT_bool dedicated)
+{
+    struct GtoolsArenaChunk *chunk;
+
+#if GTOOLS_MMAP
+    void *ptr = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( ptr == MAP_FAILED ) return (NULL);
+#if GTOOLS_ARENA_THP && defined(MADV_HUGEPAGE)
+    if ( mapped >= GTOOLS_ARENA_HUGE ) madvise(ptr, mapped, MADV_HUGEPAGE);
+#endif
+    chunk = (struct GtoolsArenaChunk *) ptr;
+#else
+    chunk = calloc(1, mapped);
+    if ( chunk == NULL ) return (NULL);
+#endif
+
+    chunk->prev   = NULL;
+    chunk->next   = arena->chunks;
+    chunk->mapped = mapped;
+    chunk->used   = GTOOLS_ARENA_HEADER;
+    chunk->dedicated = dedicated;
+    if ( arena->chunks != NULL ) arena->chunks->prev = chunk;
+    arena->chunks = chunk;
+
+    arena->mapped += mapped;
+    if ( arena->peak_mapped < arena->mapped ) arena->peak_mapped = arena->mapped;
+
+    return (chunk);
+}
+
+static void gf_arena_unmap (struct GtoolsArena *arena, struct GtoolsArenaChunk *chunk)
+{
+    if ( chunk->prev != NULL ) chunk->prev->next = chunk->next;
+    else arena->chunks = chunk->next;
+    if ( chunk->next != NULL ) chunk->next->prev = chunk->prev;
+
+    arena->mapped -= chunk->mapped;
+
+#if GTOOLS_MMAP
+    munmap((void *) chunk, chunk->mapped);
+#else
+    free (chunk);
+#endif
+}
+
+/**
+ * @brief Allocate zeroed memory from the arena
+ *
+ * @param arena Arena for the plugin call
+ * @param nmemb Number of elements
+ * @param size Size of each element
+ * @return Pointer aligned to GTOOLS_ARENA_ALIGN; NULL if out of memory.
+ *         Zero-size requests get a valid pointer.
+ */
+void *gf_arena_calloc (struct GtoolsArena *arena, size_t nmemb, size_t size)
+{
+    struct GtoolsArenaChunk *chunk;
+    size_t bytes, aligned;
+
+    if ( (size > 0) && (nmemb > SIZE_MAX / size) ) return (NULL);
+    bytes   = GTOOLS_PWMAX(nmemb * size, 1);
+    aligned = (bytes + GTOOLS_ARENA_ALIGN - 1) & ~((size_t) GTOOLS_ARENA_ALIGN - 1);
+    if ( aligned < bytes ) return (NULL);
+
+    if ( aligned >= GTOOLS_ARENA_SMALL ) {
+        if ( aligned > SIZE_MAX - GTOOLS_ARENA_HEADER ) return (NULL);
+        chunk = gf_arena_map(arena, GTOOLS_ARENA_HEADER + aligned, 1);
+        if ( chunk == NULL ) return (NULL);
+        chunk->used += aligned;
+    }
+    else {
+        chunk = arena->block;
+        if ( (chunk == NULL) || (chunk->used + aligned > chunk->mapped) ) {
+            chunk = arena->block = gf_arena_map(arena, GTOOLS_ARENA_BLOCK, 0);
+            if ( chunk == NULL ) return (NULL);
+        }
+        chunk->used += aligned;
+    }
+
+    arena->nalloc++;
+    arena->bytes += aligned;
+    arena->total += aligned;
+    if ( arena->peak < arena->bytes ) arena->peak = arena->bytes;
+
+    return ((char *) chunk + chunk->used - aligned);
+}
+
+/**
+ * @brief Move an allocation to a larger one
+ *
+ * @param arena Arena for the plugin call
+ * @param ptr Pointer from gf_arena_calloc
+ * @param used Bytes of @ptr to keep
+ * @param bytes Size of the new allocation
+ * @return Pointer to @bytes zeroed bytes starting with the first @used
+ *         bytes of @ptr, which is freed; NULL (and @ptr is kept) if out
+ *         of memory.
+ */
+void *gf_arena_grow (struct GtoolsArena *arena, void *ptr, size_t used, size_t bytes)
+{
+    void *grown = gf_arena_calloc(arena, bytes, 1);
+    if ( grown == NULL ) return (NULL);
+    memcpy (grown, ptr, used);
+    gf_arena_free (arena, ptr);
+    return (grown);
+}
+
+/**
+ * @brief Return an allocation to the system before the call ends
+ *
+ * Only allocations of at least GTOOLS_ARENA_SMALL bytes are returned;
+ * smaller ones are released with the rest of the arena.
+ *
+ * @param arena Arena for the plugin call
+ * @param ptr Pointer from gf_arena_calloc (or NULL)
+ */
+void gf_arena_free (struct GtoolsArena *arena, void *ptr)
+{
+    struct GtoolsArenaChunk *chunk;
+    if ( ptr == NULL ) return;
+    for (chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+        if ( chunk->dedicated && ((char *) chunk + GTOOLS_ARENA_HEADER == (char *) ptr) ) {
+            arena->bytes -= chunk->used - GTOOLS_ARENA_HEADER;
+            gf_arena_unmap (arena, chunk);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Release everything allocated from the arena
+ */
+void gf_arena_release (struct GtoolsArena *arena)
+{
+    while ( arena->chunks != NULL )
+        gf_arena_unmap (arena, arena->chunks);
+    arena->block = NULL;
+    arena->bytes = 0;
+}
+
+/**
+ * @brief Print the peak memory use of the plugin call
+ */
+void gf_arena_report (struct GtoolsArena *arena)
+{
+    sf_printf ("Plugin memory: peak %.1f MiB allocated (%.1f MiB mapped) in "
+               GT_size_cfmt" allocations\n",
+               arena->peak        / 1048576.0,
+               arena->peak_mapped / 1048576.0,
+               arena->nalloc);
+}
@@ -0,0 +1,63 @@
+#ifndef GTOOLS_ARENA
+#define GTOOLS_ARENA
+
+/*
+ * Per-call arena
+ * --------------
+ *
+ * Everything that hangs off StataInfo (and most buffers in the setup
+ * steps) is allocated from an arena that lives for one plugin call and
+ * is released all at once when stata_call exits, so there is no need to
+ * track which members were allocated before an error.
+ *
+ * Allocations under GTOOLS_ARENA_SMALL bytes are carved out of shared
+ * blocks of GTOOLS_ARENA_BLOCK bytes; larger ones get a chunk of their
+ * own, which gf_arena_free returns to the system right away (so freeing
+ * e.g. the by variables once the group index is built still lowers
+ * peak memory). Freeing a small allocation is a no-op. All memory comes
+ * back zeroed. On POSIX systems chunks are mapped with mmap, and chunks
+ * of at least 2MiB are marked for transparent huge pages where the
+ * system supports it (compile with -DGTOOLS_ARENA_THP=0 to disable);
+ * on Windows they come from calloc.
+ *
+ * The arena keeps track of the bytes requested and the peak, which is
+ * printed with verbose or benchmark. It is not thread-safe: allocate
+ * from the main thread only (worker scratch space uses malloc).
+ */
+
+#define GTOOLS_ARENA_SMALL (64 * 1024)
+#define GTOOLS_ARENA_BLOCK (1024 * 1024)
+#define GTOOLS_ARENA_ALIGN 64
+#define GTOOLS_ARENA_HUGE  (2 * 1024 * 1024)
+
+#ifndef GTOOLS_ARENA_THP
+#define GTOOLS_ARENA_THP 1
+#endif
+
+struct GtoolsArenaChunk {
+    struct GtoolsArenaChunk *prev;
+    struct GtoolsArenaChunk *next;
+    size_t mapped;    // bytes mapped, including the header
+    size_t used;      // bytes handed out
+    GT_bool dedicated; // holds a single allocation
+};
+
+struct GtoolsArena {
+    struct GtoolsArenaChunk *chunks;  // dedicated chunks and blocks
+    struct GtoolsArenaChunk *block;   // block small allocations come from
+    size_t  bytes;    // bytes currently allocated
+    size_t  peak;     // largest value of bytes
+    size_t  total;    // bytes allocated over the call (frees not subtracted)
+    size_t  mapped;   // bytes currently mapped (including headers and slack)
+    size_t  peak_mapped;
+    GT_size nalloc;   // number of allocations
+};
+
+void  gf_arena_init    (struct GtoolsArena *arena);
+void *gf_arena_calloc  (struct GtoolsArena *arena, size_t nmemb, size_t size);
+void *gf_arena_grow    (struct GtoolsArena *arena, void *ptr, size_t used, size_t bytes);
+void  gf_arena_free    (struct GtoolsArena *arena, void *ptr);
+void  gf_arena_release (struct GtoolsArena *arena);
+void  gf_arena_report  (struct GtoolsArena *arena);
+
+#endif
@@ -0,0 +1,68 @@
+#include "gtools_file.h"
+
+/**
+ * @brief Read-only view of a file (mmap if available; read it otherwise)
+ *
+ * @param fname File to read
+ * @param bytes Size of the file
+ * @return Pointer to the file's contents; NULL if it cannot be read
+ */
+char* gf_file_map (char *fname, size_t *bytes)
+{
+    char *map;
+
+#if GTOOLS_MMAP
+    struct stat sb;
+    int fd = open(fname, O_RDONLY);
+    if ( fd < 0 ) return (NULL);
+
+    if ( fstat(fd, &sb) || (sb.st_size <= 0) ) {
+        close (fd);
+        return (NULL);
+    }
+
+    *bytes = sb.st_size;
+    map = mmap(NULL, *bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+
+    return (map == MAP_FAILED? NULL: map);
+#else
+    long fsize;
+    FILE *fhandle = fopen(fname, "rb");
+    if ( fhandle == NULL ) return (NULL);
+
+    fseek (fhandle, 0, SEEK_END);
+    fsize = ftell(fhandle);
+    fseek (fhandle, 0, SEEK_SET);
+
+    if ( fsize <= 0 ) {
+        fclose (fhandle);
+        return (NULL);
+    }
+
+    *bytes = fsize;
+    map = malloc(*bytes);
+    if ( (map != NULL) && (fread(map, 1, *bytes, fhandle) != *bytes) ) {
+        free (map);
+        map = NULL;
+    }
+    fclose (fhandle);
+
+    return (map);
+#endif
+}
+
+/**
+ * @brief Release a view from gf_file_map
+ *
+ * @param map Pointer returned by gf_file_map
+ * @param bytes Size of the file
+ */
+void gf_file_unmap (char *map, size_t bytes)
+{
+#if GTOOLS_MMAP
+    munmap (map, bytes);
+#else
+    free (map);
+#endif
+}
@@ -0,0 +1,14 @@
+#ifndef GTOOLS_FILE
+#define GTOOLS_FILE
+
+/*
+ * Read-only views of files written by the plugin (the group index cache
+ * and collapse spill files). On POSIX systems the file is mapped with
+ * mmap, so the contents are only paged in as they are used; on Windows
+ * the whole file is read into memory.
+ */
+
+char* gf_file_map   (char *fname, size_t *bytes);
+void  gf_file_unmap (char *map, size_t bytes);
+
+#endif
@@ -0,0 +1,136 @@
+#include "gtools_telemetry.h"
+
+/**
+ * @brief Wall-clock time in seconds
+ *
+ * clock() measures CPU time on POSIX systems (summed over threads), which
+ * leaves out time spent waiting on the disk and overstates multithreaded
+ * steps; on Windows it is already wall-clock time.
+ *
+ * @return Seconds since an arbitrary point
+ */
+ST_double gf_wall_time (void)
+{
+#if defined(_WIN64) || defined(_WIN32)
+    return ((ST_double) clock() / CLOCKS_PER_SEC);
+#else
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ((ST_double) ts.tv_sec + (ST_double) ts.tv_nsec / 1e9);
+#endif
+}
+
+/**
+ * @brief Peak resident set size of the process (MiB)
+ *
+ * Note this is for the entire process, i.e. Stata, and not just the
+ * plugin call.
+ *
+ * @return Peak RSS in MiB; -1 if unknown
+ */
+ST_double gf_query_peak_rss (void)
+{
+#if GTOOLS_PEAK_RSS
+    struct rusage usage;
+    if ( getrusage(RUSAGE_SELF, &usage) ) return (-1);
+#if defined(__APPLE__)
+    return ((ST_double) usage.ru_maxrss / 1024 / 1024);
+#else
+    return ((ST_double) usage.ru_maxrss / 1024);
+#endif
+#else
+    return (-1);
+#endif
+}
+
+void gf_telemetry_init (struct GtoolsTelemetry *tm, struct GtoolsArena *arena)
+{
+    memset (tm, '\0', sizeof *tm);
+    tm->arena     = arena;
+    tm->lap_wall  = gf_wall_time();
+    tm->lap_cpu   = clock();
+    tm->lap_alloc = arena->total;
+}
+
+/**
+ * @brief Charge everything since the last lap to @stage
+ *
+ * @param tm Telemetry for the plugin call
+ * @param stage One of GTOOLS_STAGE_*
+ */
+void gf_telemetry_lap (struct GtoolsTelemetry *tm, GT_size stage)
+{
+    ST_double now_wall = gf_wall_time();
+    clock_t   now_cpu  = clock();
+    ST_double rss      = gf_query_peak_rss();
+
+    tm->wall[stage]  += now_wall - tm->lap_wall;
+    tm->cpu[stage]   += (ST_double) (now_cpu - tm->lap_cpu) / CLOCKS_PER_SEC;
+    tm->alloc[stage] += (ST_double) (tm->arena->total - tm->lap_alloc) / 1024 / 1024;
+    tm->rss[stage]    = (rss < 0)? -1: GTOOLS_PWMAX(tm->rss[stage], rss);
+
+    tm->lap_wall  = now_wall;
+    tm->lap_cpu   = now_cpu;
+    tm->lap_alloc = tm->arena->total;
+}
+
+/**
+ * @brief Add telemetry to __gtools_timings and save the strategy
+ *
+ * Does nothing if the matrix does not exist (e.g. the plugin was called
+ * without _gtools_internal.ado). Timings and allocations are added to
+ * what is already in the matrix; peak RSS is the max.
+ *
+ * @param tm Telemetry for the plugin call
+ * @return 0 on success; Stata error code otherwise
+ */
+ST_retcode sf_telemetry_save (struct GtoolsTelemetry *tm)
+{
+    ST_retcode rc = 0;
+    GT_size s;
+    ST_double z;
+    char strategy[128], *strpos = strategy;
+
+    if ( (SF_row(GTOOLS_TELEMETRY_MATRIX) != GTOOLS_STAGES)
+         || (SF_col(GTOOLS_TELEMETRY_MATRIX) != GTOOLS_TELEMETRY_COLS) ) {
+        return (0);
+    }
+
+    for (s = 0; s < GTOOLS_STAGES; s++) {
+        if ( (rc = SF_mat_el(GTOOLS_TELEMETRY_MATRIX, s + 1, 1, &z)) ) return (rc);
+        if ( (rc = SF_mat_store(GTOOLS_TELEMETRY_MATRIX, s + 1, 1, z + tm->wall[s])) ) return (rc);
+
+        if ( (rc = SF_mat_el(GTOOLS_TELEMETRY_MATRIX, s + 1, 2, &z)) ) return (rc);
+        if ( (rc = SF_mat_store(GTOOLS_TELEMETRY_MATRIX, s + 1, 2, z + tm->cpu[s])) ) return (rc);
+
+        if ( (rc = SF_mat_el(GTOOLS_TELEMETRY_MATRIX, s + 1, 3, &z)) ) return (rc);
+        if ( (rc = SF_mat_store(GTOOLS_TELEMETRY_MATRIX, s + 1, 3, z + tm->alloc[s])) ) return (rc);
+
+        if ( (rc = SF_mat_el(GTOOLS_TELEMETRY_MATRIX, s + 1, 4, &z)) ) return (rc);
+        if ( tm->rss[s] < 0 ) {
+            z = SV_missval;
+        }
+        else if ( SF_is_missing(z) || (z < tm->rss[s]) ) {
+            z = tm->rss[s];
+        }
+        if ( (rc = SF_mat_store(GTOOLS_TELEMETRY_MATRIX, s + 1, 4, z)) ) return (rc);
+    }
+
+    strategy[0] = '\0';
+    if ( tm->index != NULL )
+        strpos += sprintf(strpos, " index=%s", tm->index);
+    if ( tm->hash != NULL )
+        strpos += sprintf(strpos, " hash=%s", tm->hash);
+    if ( tm->panel != NULL )
+        strpos += sprintf(strpos, " panel=%s", tm->panel);
+    if ( tm->sort != NULL )
+        strpos += sprintf(strpos, " sort=%s", tm->sort);
+    if ( tm->quantiles != NULL )
+        strpos += sprintf(strpos, " quantiles=%s", tm->quantiles);
+
+    if ( strpos > strategy ) {
+        if ( (rc = SF_macro_save(GTOOLS_TELEMETRY_LOCAL, strategy + 1)) ) return (rc);
+    }
+
+    return (rc);
+}
@@ -0,0 +1,66 @@
+#ifndef GTOOLS_TELEMETRY
+#define GTOOLS_TELEMETRY
+
+/*
+ * Per-stage telemetry
+ * -------------------
+ *
+ * Every plugin call keeps a running lap: gf_telemetry_lap charges the
+ * wall time, CPU time (all threads), and arena bytes allocated since the
+ * previous lap to a stage, and records the peak resident set size of the
+ * process so far. Stages are charged where the benchmark timers are
+ * printed, but regardless of benchmark(); whatever is not charged to a
+ * stage (parsing, cleanup) goes to GTOOLS_STAGE_OTHER when the call ends,
+ * so the stages add up to the plugin runtime.
+ *
+ * The plugin also records the strategy it chose for the group index, the
+ * row hash, the panel setup, the hash sort, and quantiles.
+ *
+ * If the ado file created __gtools_timings (GTOOLS_STAGES x
+ * GTOOLS_TELEMETRY_COLS) the telemetry is added to it, so multiple plugin
+ * calls for one command accumulate, and the strategy is saved to the
+ * local r_strategy. The ado file returns them as r(gtools_timings) and
+ * r(gtools_strategy) and optionally logs them (GTOOLS_TIMINGS_LOG).
+ */
+
+#define GTOOLS_STAGE_READ    0  // read data from Stata
+#define GTOOLS_STAGE_BIJECT  1  // sort check and bijection limits
+#define GTOOLS_STAGE_HASH    2  // bijection or 128-bit hash
+#define GTOOLS_STAGE_SORT    3  // sort the hash or the groups
+#define GTOOLS_STAGE_PANEL   4  // panel setup and group index
+#define GTOOLS_STAGE_CHECK   5  // hash collision check
+#define GTOOLS_STAGE_STATS   6  // summary stats, quantiles, encoding
+#define GTOOLS_STAGE_WRITE   7  // write results back to Stata or disk
+#define GTOOLS_STAGE_OTHER   8
+#define GTOOLS_STAGES        9
+
+#define GTOOLS_TELEMETRY_COLS   4  // wall, cpu, MiB allocated, peak RSS MiB
+#define GTOOLS_TELEMETRY_MATRIX "__gtools_timings"
+#define GTOOLS_TELEMETRY_LOCAL  "_r_strategy"
+
+struct GtoolsTelemetry {
+    ST_double wall[GTOOLS_STAGES];
+    ST_double cpu[GTOOLS_STAGES];
+    ST_double alloc[GTOOLS_STAGES];  // MiB
+    ST_double rss[GTOOLS_STAGES];    // MiB; < 0 if unknown
+    ST_double lap_wall;
+    clock_t   lap_cpu;
+    size_t    lap_alloc;
+    struct GtoolsArena *arena;
+    // Strategy; NULL if not used in this call
+    const char *index;     // sorted, bijection, prefix, hash, cache
+    const char *hash;      // spooky, column, fast64
+    const char *panel;     // hashtable, sort
+    const char *sort;      // counting, radix
+    const char *quantiles; // qsort, qselect, sketch
+};
+
+ST_double gf_wall_time      (void);
+ST_double gf_query_peak_rss (void);
+
+void gf_telemetry_init (struct GtoolsTelemetry *tm, struct GtoolsArena *arena);
+void gf_telemetry_lap  (struct GtoolsTelemetry *tm, GT_size stage);
+
+ST_retcode sf_telemetry_save (struct GtoolsTelemetry *tm);
+
+#endif
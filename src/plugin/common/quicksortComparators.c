@@ -27,23 +27,32 @@ int MultiCompareNum2Invert (const void *a, const void *b, void *thunk)
  *                       Mixed Character Array                       *
  *********************************************************************/
 
+// Each variable takes an 8-byte slot in the row: numbers are stored in
+// place and strings as a reference into the string arena (see
+// GTOOLS_STRREF). The thunk is the variable's position in the row and
+// the arena; position comes first so numeric comparators can read it
+// as a GT_size.
+
+struct MultiCompareMC {
+    GT_size position;
+    char    *strx;
+};
+
 int AltCompareChar (const void *a, const void *b, void *thunk);
 int AltCompareChar (const void *a, const void *b, void *thunk)
 {
-    GT_size kstart = *(GT_size *)thunk;
-    char *aa = (char *)(a + kstart);
-    char *bb = (char *)(b + kstart);
-// printf("\tcmp(%s, %s) = %d\n", aa, bb, BaseCompareChar(aa, bb));
+    struct MultiCompareMC *mc = (struct MultiCompareMC *) thunk;
+    char *aa = GTOOLS_STRREF_STR(mc->strx, a + mc->position);
+    char *bb = GTOOLS_STRREF_STR(mc->strx, b + mc->position);
     return BaseCompareChar(aa, bb);
 }
 
 int AltCompareCharInvert (const void *a, const void *b, void *thunk);
 int AltCompareCharInvert (const void *a, const void *b, void *thunk)
 {
-    GT_size kstart = *(GT_size *)thunk;
-    char *aa = (char *)(a + kstart);
-    char *bb = (char *)(b + kstart);
-// printf("cmp(%s, %s) = %d\n", bb, aa, BaseCompareChar(bb, aa));
+    struct MultiCompareMC *mc = (struct MultiCompareMC *) thunk;
+    char *aa = GTOOLS_STRREF_STR(mc->strx, a + mc->position);
+    char *bb = GTOOLS_STRREF_STR(mc->strx, b + mc->position);
     return BaseCompareChar(bb, aa);
 }
 
@@ -87,7 +87,8 @@ void MultiQuicksortMC (
     GT_size elsize,
     GT_size *ltypes,
     GT_size *invert,
-    GT_size *positions
+    GT_size *positions,
+    char *strx
 );
 
 void MultiQuicksortMC (
@@ -98,11 +99,13 @@ void MultiQuicksortMC (
     GT_size elsize,
     GT_size *ltypes,
     GT_size *invert,
-    GT_size *positions)
+    GT_size *positions,
+    char *strx)
 {
     GT_size j;
     GT_bool ischar;
     void *i, *end;
+    struct MultiCompareMC thunk = { positions[kstart], strx };
 
     quicksort_bsd (
         start,
@@ -111,7 +114,7 @@ void MultiQuicksortMC (
         ( (ischar = (ltypes[kstart] > 0)) )?
         (invert[kstart]? AltCompareCharInvert: AltCompareChar):
         (invert[kstart]? AltCompareNumInvert: AltCompareNum),
-        &(positions[kstart])
+        &thunk
     );
 
     if ( kstart >= kend )
@@ -125,13 +128,13 @@ loop:
     if ( invert[kstart] ) {
         if ( ischar ) {
             for (i = start + elsize; i < end; i += elsize) {
-                if ( AltCompareCharInvert(i - elsize, i, &(positions[kstart])) ) break;
+                if ( AltCompareCharInvert(i - elsize, i, &thunk) ) break;
                 j++;
             }
         }
         else {
             for (i = start + elsize; i < end; i += elsize) {
-                if ( AltCompareNumInvert(i - elsize, i, &(positions[kstart])) ) break;
+                if ( AltCompareNumInvert(i - elsize, i, &thunk) ) break;
                 j++;
             }
         }
@@ -139,13 +142,13 @@ loop:
     else {
         if ( ischar ) {
             for (i = start + elsize; i < end; i += elsize) {
-                if ( AltCompareChar(i - elsize, i, &(positions[kstart])) ) break;
+                if ( AltCompareChar(i - elsize, i, &thunk) ) break;
                 j++;
             }
         }
         else {
             for (i = start + elsize; i < end; i += elsize) {
-                if ( AltCompareNum(i - elsize, i, &(positions[kstart])) ) break;
+                if ( AltCompareNum(i - elsize, i, &thunk) ) break;
                 j++;
             }
         }
@@ -160,7 +163,8 @@ loop:
             elsize,
             ltypes,
             invert,
-            positions
+            positions,
+            strx
         );
     }
 
@@ -253,7 +257,8 @@ int MultiSortCheckMC (
     GT_size elsize,
     GT_size *ltypes,
     GT_size *invert,
-    GT_size *positions
+    GT_size *positions,
+    char *strx
 );
 
 int MultiSortCheckMC (
@@ -264,11 +269,13 @@ int MultiSortCheckMC (
     GT_size elsize,
     GT_size *ltypes,
     GT_size *invert,
-    GT_size *positions)
+    GT_size *positions,
+    char *strx)
 {
     GT_size j;
     GT_bool ischar;
     void *i, *end;
+    struct MultiCompareMC thunk = { positions[kstart], strx };
 
     if ( gf_is_sorted (
         start,
@@ -277,7 +284,7 @@ int MultiSortCheckMC (
         ( (ischar = (ltypes[kstart] > 0)) )?
         (invert[kstart]? AltCompareCharInvert: AltCompareChar):
         (invert[kstart]? AltCompareNumInvert: AltCompareNum),
-        &(positions[kstart])
+        &thunk
     ) == 0 ) return (0);
 
     if ( kstart >= kend )
@@ -291,13 +298,13 @@ loop:
     if ( invert[kstart] ) {
         if ( ischar ) {
             for (i = start + elsize; i < end; i += elsize) {
-                if ( AltCompareCharInvert(i - elsize, i, &(positions[kstart])) ) break;
+                if ( AltCompareCharInvert(i - elsize, i, &thunk) ) break;
                 j++;
             }
         }
         else {
             for (i = start + elsize; i < end; i += elsize) {
-                if ( AltCompareNumInvert(i - elsize, i, &(positions[kstart])) ) break;
+                if ( AltCompareNumInvert(i - elsize, i, &thunk) ) break;
                 j++;
             }
         }
@@ -305,13 +312,13 @@ loop:
     else {
         if ( ischar ) {
             for (i = start + elsize; i < end; i += elsize) {
-                if ( AltCompareChar(i - elsize, i, &(positions[kstart])) ) break;
+                if ( AltCompareChar(i - elsize, i, &thunk) ) break;
                 j++;
             }
         }
         else {
             for (i = start + elsize; i < end; i += elsize) {
-                if ( AltCompareNum(i - elsize, i, &(positions[kstart])) ) break;
+                if ( AltCompareNum(i - elsize, i, &thunk) ) break;
                 j++;
             }
         }
@@ -326,7 +333,8 @@ loop:
             elsize,
             ltypes,
             invert,
-            positions
+            positions,
+            strx
         ) == 0) return (0);
     }
 
@@ -430,7 +438,8 @@ int MultiIsIDCheckMC (
     GT_size elsize,
     GT_size *ltypes,
     GT_size *invert,
-    GT_size *positions
+    GT_size *positions,
+    char *strx
 );
 
 int MultiIsIDCheckMC (
@@ -441,13 +450,15 @@ int MultiIsIDCheckMC (
     GT_size elsize,
     GT_size *ltypes,
     GT_size *invert,
-    GT_size *positions)
+    GT_size *positions,
+    char *strx)
 {
     int rc;
     GT_size j;
     GT_bool checkok = 0;
     GT_bool ischar;
     void *i, *end;
+    struct MultiCompareMC thunk = { positions[kstart], strx };
 
     // Check if range is sorted.  If it is not in weakly ascending order, it
     // is not sorted.
@@ -460,7 +471,7 @@ int MultiIsIDCheckMC (
         ( (ischar = (ltypes[kstart] > 0)) )?
         (invert[kstart]? AltCompareCharInvert: AltCompareChar):
         (invert[kstart]? AltCompareNumInvert: AltCompareNum),
-        &(positions[kstart])
+        &thunk
     )) < 0 ) return (rc);
 
     // If it is sorted in strictly ascending order, then it is sorted.
@@ -497,13 +508,13 @@ loop:
     if ( invert[kstart] ) {
         if ( ischar ) {
             for (i = start + elsize; i < end; i += elsize) {
-                if ( AltCompareCharInvert(i - elsize, i, &(positions[kstart])) ) break;
+                if ( AltCompareCharInvert(i - elsize, i, &thunk) ) break;
                 j++;
             }
         }
         else {
             for (i = start + elsize; i < end; i += elsize) {
-                if ( AltCompareNumInvert(i - elsize, i, &(positions[kstart])) ) break;
+                if ( AltCompareNumInvert(i - elsize, i, &thunk) ) break;
                 j++;
             }
         }
@@ -511,13 +522,13 @@ loop:
     else {
         if ( ischar ) {
             for (i = start + elsize; i < end; i += elsize) {
-                if ( AltCompareChar(i - elsize, i, &(positions[kstart])) ) break;
+                if ( AltCompareChar(i - elsize, i, &thunk) ) break;
                 j++;
             }
         }
         else {
             for (i = start + elsize; i < end; i += elsize) {
-                if ( AltCompareNum(i - elsize, i, &(positions[kstart])) ) break;
+                if ( AltCompareNum(i - elsize, i, &thunk) ) break;
                 j++;
             }
         }
@@ -542,7 +553,8 @@ loop:
             elsize,
             ltypes,
             invert,
-            positions
+            positions,
+            strx
         )) <= 0) return (rc);
 
         // Note that in the recursive call we exit if the return code is <= 0,
@@ -726,6 +738,7 @@ GT_size MultiSortPanelSetupMC (
     GT_size *ltypes,
     GT_size *invert,
     GT_size *positions,
+    char *strx,
     GT_size *info_max,
     GT_size info_start
 );
@@ -739,12 +752,14 @@ GT_size MultiSortPanelSetupMC (
     GT_size *ltypes,
     GT_size *invert,
     GT_size *positions,
+    char *strx,
     GT_size *info_max,
     GT_size info_start)
 {
     GT_bool ischar = (ltypes[kstart] > 0);
     GT_size j, *info, nj, J = 0;
     void *i, *end;
+    struct MultiCompareMC thunk = { positions[kstart], strx };
 
     end = start + N * elsize;
     if ( kstart >= kend ) {
@@ -756,7 +771,7 @@ GT_size MultiSortPanelSetupMC (
         if ( invert[kstart] ) {
             if ( ischar ) {
                 for (i = start + elsize; i < end; i += elsize) {
-                    if ( AltCompareCharInvert(i - elsize, i, &(positions[kstart])) ) {
+                    if ( AltCompareCharInvert(i - elsize, i, &thunk) ) {
                         *info = j;
                         info++; J++;
                     }
@@ -765,7 +780,7 @@ GT_size MultiSortPanelSetupMC (
             }
             else {
                 for (i = start + elsize; i < end; i += elsize) {
-                    if ( AltCompareNumInvert(i - elsize, i, &(positions[kstart])) ) {
+                    if ( AltCompareNumInvert(i - elsize, i, &thunk) ) {
                         *info = j;
                         info++; J++;
                     }
@@ -776,7 +791,7 @@ GT_size MultiSortPanelSetupMC (
         else {
             if ( ischar ) {
                 for (i = start + elsize; i < end; i += elsize) {
-                    if ( AltCompareChar(i - elsize, i, &(positions[kstart])) ) {
+                    if ( AltCompareChar(i - elsize, i, &thunk) ) {
                         *info = j;
                         info++; J++;
                     }
@@ -785,7 +800,7 @@ GT_size MultiSortPanelSetupMC (
             }
             else {
                 for (i = start + elsize; i < end; i += elsize) {
-                    if ( AltCompareNum(i - elsize, i, &(positions[kstart])) ) {
+                    if ( AltCompareNum(i - elsize, i, &thunk) ) {
                         *info = j;
                         info++; J++;
                     }
@@ -805,13 +820,13 @@ loop:
     if ( invert[kstart] ) {
         if ( ischar ) {
             for (i = start + elsize; i < end; i += elsize) {
-                if ( AltCompareCharInvert(i - elsize, i, &(positions[kstart])) ) break;
+                if ( AltCompareCharInvert(i - elsize, i, &thunk) ) break;
                 j++;
             }
         }
         else {
             for (i = start + elsize; i < end; i += elsize) {
-                if ( AltCompareNumInvert(i - elsize, i, &(positions[kstart])) ) break;
+                if ( AltCompareNumInvert(i - elsize, i, &thunk) ) break;
                 j++;
             }
         }
@@ -819,13 +834,13 @@ loop:
     else {
         if ( ischar ) {
             for (i = start + elsize; i < end; i += elsize) {
-                if ( AltCompareChar(i - elsize, i, &(positions[kstart])) ) break;
+                if ( AltCompareChar(i - elsize, i, &thunk) ) break;
                 j++;
             }
         }
         else {
             for (i = start + elsize; i < end; i += elsize) {
-                if ( AltCompareNum(i - elsize, i, &(positions[kstart])) ) break;
+                if ( AltCompareNum(i - elsize, i, &thunk) ) break;
                 j++;
             }
         }
@@ -842,6 +857,7 @@ loop:
             ltypes,
             invert,
             positions,
+            strx,
             info,
             info_start
         );
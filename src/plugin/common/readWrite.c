@@ -10,6 +10,30 @@ ST_retcode gf_bijection_limits (
 );
 
 
+/**
+ * @brief Read in the by variables one variable at a time
+ *
+ * Select the observations in the if/in range first, then walk each by
+ * variable down the selected observations into the row buffer (the
+ * Stata data is stored by variable, so this reads it in the order it is
+ * laid out). In the same pass we flag rows with missing values (to be
+ * dropped unless the user asked to keep missing values) and note each
+ * numeric variable's min and max and whether every value is an integer
+ * or system missing. gf_bijection_limits uses the latter to pick the
+ * bijection or the hash without a second pass (string variables are
+ * first encoded as integers; see gf_strdict_encode).
+ *
+ * The limits are taken over the if/in selection, including rows later
+ * dropped because another by variable is missing. That can only widen
+ * the range (or make us hash when we could have bijected), which is
+ * always safe.
+ *
+ * @param st_info Meta structure with all the variables and data
+ * @param level Level of the plugin call
+ * @param index Array where to store the Stata observation of each row
+ * @return Stores the by variables in st_numx (all numeric) or st_charx
+ *         and st_strx (see GTOOLS_STRREF)
+ */
 ST_retcode sf_read_byvars (
     struct StataInfo *st_info,
     int level,
@@ -18,237 +42,219 @@ ST_retcode sf_read_byvars (
     ST_retcode rc = 0;
     ST_double z;
 
-    GT_size i, k, sel, obs;
+    GT_size i, k, r, obs, nsel, len, strcap, strmax, strgrow;
+    GT_size strused    = 0;
+    GT_size strlen_max = 0;
     GT_size rowbytes   = st_info->rowbytes;
     GT_size N          = st_info->N;
     GT_size in1        = st_info->in1;
     GT_size kvars      = st_info->kvars_by;
     GT_size kstr       = st_info->kvars_by_str;
     GT_size *positions = st_info->positions;
+    GT_bool dropmiss   = (st_info->missing == 0);
+    GT_bool anydrop    = 0;
+    GT_bool intonly    = 1;
+
+    uint64_t  ref;
+    char      *strx;
+    char      *strbuf      = NULL;
+    GT_bool   *drop        = NULL;
+    ST_double *double_mins = NULL;
+    ST_double *double_maxs = NULL;
+    GT_bool   *any_missing = NULL;
+    GT_bool   *all_missing = NULL;
+
+    // Select observations in range
+    // ----------------------------
+
+    nsel = 0;
+    if ( st_info->any_if ) {
+        for (i = 0; i < N; i++) {
+            if ( SF_ifobs(i + in1) ) {
+                index[nsel++] = i;
+            }
+        }
+    }
+    else {
+        for (i = 0; i < N; i++)
+            index[i] = i;
+        nsel = N;
+    }
 
-    // index = calloc(N, sizeof(index));
-    // if ( index == NULL ) return (sf_oom_error("sf_read_byvars", "index"));
-    // GTOOLS_GC_ALLOCATED("index")
+    // The string arena starts at GTOOLS_STRX_INIT bytes per string and
+    // grows as needed, but never past the declared width of the strings.
 
+    strcap = strmax = 1;
     if ( kstr > 0 ) {
-        st_info->st_numx  = malloc(sizeof(ST_double));
-        st_info->st_charx = calloc(N, rowbytes);
+        for (k = 0; k < kvars; k++) {
+            if ( st_info->byvars_lens[k] > 0 ) {
+                strmax += nsel * (st_info->byvars_lens[k] + 1);
+                if ( strlen_max < st_info->byvars_lens[k] )
+                    strlen_max = st_info->byvars_lens[k];
+            }
+        }
+        strcap = GTOOLS_PWMIN(strmax, nsel * kstr * GTOOLS_STRX_INIT + 1);
+
+        st_info->st_numx  = gf_arena_calloc(st_info->arena, 1, sizeof(ST_double));
+        st_info->st_charx = gf_arena_calloc(st_info->arena, nsel > 0? nsel: 1, rowbytes);
+        st_info->st_strx  = gf_arena_calloc(st_info->arena, strcap, sizeof(char));
 
         if ( st_info->st_numx  == NULL ) return (sf_oom_error("sf_read_byvars", "st_info->st_numx"));
         if ( st_info->st_charx == NULL ) return (sf_oom_error("sf_read_byvars", "st_info->st_charx"));
+        if ( st_info->st_strx  == NULL ) return (sf_oom_error("sf_read_byvars", "st_info->st_strx"));
+    }
+    else {
+        st_info->st_numx  = gf_arena_calloc(st_info->arena, (nsel > 0? nsel: 1) * kvars, sizeof *st_info->st_numx);
+        st_info->st_charx = gf_arena_calloc(st_info->arena, 1, sizeof(char));
+        st_info->st_strx  = gf_arena_calloc(st_info->arena, 1, sizeof(char));
 
-        GTOOLS_GC_ALLOCATED("st_info->st_numx")
-        GTOOLS_GC_ALLOCATED("st_info->st_charx")
+        if ( st_info->st_numx  == NULL ) return (sf_oom_error("sf_read_byvars", "st_info->st_numx"));
+        if ( st_info->st_charx == NULL ) return (sf_oom_error("sf_read_byvars", "st_info->st_charx"));
+        if ( st_info->st_strx  == NULL ) return (sf_oom_error("sf_read_byvars", "st_info->st_strx"));
+    }
 
-        st_info->free = 3;
+    GTOOLS_GC_ALLOCATED("st_info->st_numx")
+    GTOOLS_GC_ALLOCATED("st_info->st_charx")
+    GTOOLS_GC_ALLOCATED("st_info->st_strx")
+
+    strbuf      = malloc(strlen_max + 1);
+
+    drop        = calloc(nsel > 0? nsel: 1, sizeof *drop);
+    double_mins = calloc(kvars, sizeof *double_mins);
+    double_maxs = calloc(kvars, sizeof *double_maxs);
+    any_missing = calloc(kvars, sizeof *any_missing);
+    all_missing = calloc(kvars, sizeof *all_missing);
+
+    if ( strbuf      == NULL ) { rc = sf_oom_error("sf_read_byvars", "strbuf");      goto exit; }
+    if ( drop        == NULL ) { rc = sf_oom_error("sf_read_byvars", "drop");        goto exit; }
+    if ( double_mins == NULL ) { rc = sf_oom_error("sf_read_byvars", "double_mins"); goto exit; }
+    if ( double_maxs == NULL ) { rc = sf_oom_error("sf_read_byvars", "double_maxs"); goto exit; }
+    if ( any_missing == NULL ) { rc = sf_oom_error("sf_read_byvars", "any_missing"); goto exit; }
+    if ( all_missing == NULL ) { rc = sf_oom_error("sf_read_byvars", "all_missing"); goto exit; }
+
+    // Loop through all the by variables
+    // ---------------------------------
+
+    for (k = 0; k < kvars; k++) {
+        all_missing[k] = 1;
+        if ( st_info->byvars_lens[k] > 0 ) {
+            for (r = 0; r < nsel; r++) {
+                if ( (rc = SF_sdata(k + 1, index[r] + in1, strbuf)) )
+                    goto exit;
 
-        // In this case, you need to clean all the chunks
-        for (i = 0; i < N; i++)
-            memset (st_info->st_charx + i * rowbytes, '\0', rowbytes);
+                len = strlen(strbuf);
+                if ( dropmiss & (len == 0) ) {
+                    drop[r] = anydrop = 1;
+                }
 
-        // Loop through all the by variables
-        obs = 0;
-        if ( st_info->any_if || (st_info->missing == 0) ) {
-            if ( st_info->any_if & (st_info->missing == 0) ) {
-                for (i = 0; i < N; i++) {
-                    if ( SF_ifobs(i + in1) ) {
-                        for (k = 0; k < kvars; k++) {
-                            sel = obs * rowbytes + positions[k];
-                            if ( st_info->byvars_lens[k] > 0 ) {
-                                if ( (rc = SF_sdata(k + 1, i + in1, st_info->st_charx + sel)) )
-                                    goto exit;
-
-                                if ( strcmp(st_info->st_charx + sel, "") == 0 ) {
-                                    if ( st_info->nomiss ) {
-                                        rc = 459;
-                                        goto exit;
-                                    }
-                                    memset (st_info->st_charx + obs * rowbytes, '\0', rowbytes);
-                                    goto next_inner1;
-                                }
-                            }
-                            else {
-                                if ( (rc = SF_vdata(k + 1, i + in1, &z)) )
-                                    goto exit;
-
-                                if ( SF_is_missing(z) ) {
-                                    if ( st_info->nomiss ) {
-                                        rc = 459;
-                                        goto exit;
-                                    }
-                                    memset (st_info->st_charx + obs * rowbytes, '\0', rowbytes);
-                                    goto next_inner1;
-                                }
-                                memcpy (st_info->st_charx + sel, &z, sizeof(ST_double));
-                            }
-                        }
-                        index[obs] = i;
-                        ++obs;
-next_inner1: continue;
+                if ( strused + len + 1 > strcap ) {
+                    strgrow = GTOOLS_PWMIN(GTOOLS_PWMAX(2 * strcap, strused + len + 1), strmax);
+                    strx    = gf_arena_grow(st_info->arena, st_info->st_strx, strused, strgrow);
+                    if ( strx == NULL ) {
+                        rc = sf_oom_error("sf_read_byvars", "st_info->st_strx");
+                        goto exit;
                     }
+                    st_info->st_strx = strx;
+                    strcap = strgrow;
                 }
+
+                memcpy (st_info->st_strx + strused, strbuf, len + 1);
+                ref = GTOOLS_STRREF(strused, len);
+                memcpy (st_info->st_charx + r * rowbytes + positions[k], &ref, sizeof(ref));
+                strused += len + 1;
             }
-            else if ( st_info->any_if & (st_info->missing == 1) ) {
-                for (i = 0; i < N; i++) {
-                    if ( SF_ifobs(i + in1) ) {
-                        for (k = 0; k < kvars; k++) {
-                            sel = obs * rowbytes + positions[k];
-                            if ( st_info->byvars_lens[k] > 0 ) {
-                                if ( (rc = SF_sdata(k + 1, i + in1, st_info->st_charx + sel)) )
-                                    goto exit;
-                            }
-                            else {
-                                if ( (rc = SF_vdata(k + 1, i + in1, &z)) )
-                                    goto exit;
-                                memcpy (st_info->st_charx + sel, &z, sizeof(ST_double));
-                            }
-                        }
-                        index[obs] = i;
-                        ++obs;
-                    }
+        }
+        else {
+            for (r = 0; r < nsel; r++) {
+                if ( (rc = SF_vdata(k + 1, index[r] + in1, &z)) )
+                    goto exit;
+
+                if ( kstr > 0 ) {
+                    memcpy (st_info->st_charx + r * rowbytes + positions[k], &z, sizeof(ST_double));
                 }
-            }
-            else if ( (st_info->any_if == 0) & (st_info->missing == 0) ) {
-                for (i = 0; i < N; i++) {
-                    for (k = 0; k < kvars; k++) {
-                        sel = obs * rowbytes + positions[k];
-                        if ( st_info->byvars_lens[k] > 0 ) {
-                            if ( (rc = SF_sdata(k + 1, i + in1, st_info->st_charx + sel)) )
-                                goto exit;
-
-                            if ( strcmp(st_info->st_charx + sel, "") == 0 ) {
-                                if ( st_info->nomiss ) {
-                                    rc = 459;
-                                    goto exit;
-                                }
-                                memset (st_info->st_charx + obs * rowbytes, '\0', rowbytes);
-                                goto next_inner2;
-                            }
-                        }
-                        else {
-                            if ( (rc = SF_vdata(k + 1, i + in1, &z)) )
-                                goto exit;
-
-                            if ( SF_is_missing(z) ) {
-                                if ( st_info->nomiss ) {
-                                    rc = 459;
-                                    goto exit;
-                                }
-                                memset (st_info->st_charx + obs * rowbytes, '\0', rowbytes);
-                                goto next_inner2;
-                            }
-                            memcpy (st_info->st_charx + sel, &z, sizeof(ST_double));
-                        }
+                else {
+                    st_info->st_numx[r * kvars + k] = z;
+                }
+
+                if ( SF_is_missing(z) ) {
+                    if ( dropmiss ) {
+                        drop[r] = anydrop = 1;
+                    }
+                    else {
+                        any_missing[k] = 1;
+                        if ( z > SV_missval ) intonly = 0;
                     }
-                    index[obs] = i;
-                    ++obs;
-next_inner2: continue;
                 }
-            }
-            N = st_info->N = obs;
-        }
-        else {
-            for (i = 0; i < N; i++) {
-                index[i] = i;
-                for (k = 0; k < kvars; k++) {
-                    sel = i * rowbytes + positions[k];
-                    if ( st_info->byvars_lens[k] > 0 ) {
-                        if ( (rc = SF_sdata(k + 1, i + in1, st_info->st_charx + sel)) )
-                            goto exit;
+                else if ( intonly ) {
+                    if ( ceil(z) != z ) {
+                        intonly = 0;
+                    }
+                    else if ( all_missing[k] ) {
+                        all_missing[k] = 0;
+                        double_mins[k] = z;
+                        double_maxs[k] = z;
                     }
                     else {
-                        if ( (rc = SF_vdata(k + 1, i + in1, &z)) ) goto exit;
-                        memcpy (st_info->st_charx + sel, &z, sizeof(ST_double));
+                        if ( z < double_mins[k] ) double_mins[k] = z;
+                        if ( z > double_maxs[k] ) double_maxs[k] = z;
                     }
                 }
             }
         }
     }
-    else {
-        st_info->st_numx  = calloc(N * kvars, sizeof(st_info->st_numx));
-        st_info->st_charx = malloc(sizeof(char));
-
-        if ( st_info->st_numx  == NULL ) return (sf_oom_error("sf_hash_byvars", "st_info->st_numx"));
-        if ( st_info->st_charx == NULL ) return (sf_oom_error("sf_hash_byvars", "st_info->st_charx"));
 
-        GTOOLS_GC_ALLOCATED("st_info->st_numx")
-        GTOOLS_GC_ALLOCATED("st_info->st_charx")
+    // Drop rows with missing values
+    // -----------------------------
 
-        st_info->free = 3;
+    if ( anydrop ) {
+        if ( st_info->nomiss ) {
+            rc = 459;
+            goto exit;
+        }
 
-        // Loop through all the by variables
         obs = 0;
-        if ( st_info->any_if || (st_info->missing == 0) ) {
-            if ( st_info->any_if & (st_info->missing == 0) ) {
-                for (i = 0; i < N; i++) {
-                    if ( SF_ifobs(i + in1) ) {
-                        for (k = 0; k < kvars; k++) {
-                            sel = obs * kvars + k;
-                            if ( (rc = SF_vdata(k + 1, i + in1, st_info->st_numx + sel)) )
-                                goto exit;
-
-                            if ( SF_is_missing(st_info->st_numx[sel]) ) {
-                                if ( st_info->nomiss ) {
-                                    rc = 459;
-                                    goto exit;
-                                }
-                                goto next_inner3;
-                            }
-                        }
-                        index[obs] = i;
-                        ++obs;
-next_inner3: continue;
-                    }
+        for (r = 0; r < nsel; r++) {
+            if ( drop[r] ) continue;
+            if ( obs < r ) {
+                if ( kstr > 0 ) {
+                    memcpy (st_info->st_charx + obs * rowbytes,
+                            st_info->st_charx + r * rowbytes,
+                            rowbytes);
                 }
-            }
-            else if ( st_info->any_if & (st_info->missing == 1) ) {
-                for (i = 0; i < N; i++) {
-                    if ( SF_ifobs(i + in1) ) {
-                        for (k = 0; k < kvars; k++) {
-                            sel = obs * kvars + k;
-                            if ( (rc = SF_vdata(k + 1, i + in1, st_info->st_numx + sel)) )
-                                goto exit;
-                        }
-                        index[obs] = i;
-                        ++obs;
-                    }
-                }
-            }
-            else if ( (st_info->any_if == 0) & (st_info->missing == 0) ) {
-                for (i = 0; i < N; i++) {
-                    for (k = 0; k < kvars; k++) {
-                        sel = obs * kvars + k;
-                        if ( (rc = SF_vdata(k + 1, i + in1, st_info->st_numx + sel)) )
-                            goto exit;
-
-                        if ( SF_is_missing(st_info->st_numx[sel]) ) {
-                            if ( st_info->nomiss ) {
-                                rc = 459;
-                                goto exit;
-                            }
-                            goto next_inner4;
-                        }
-                    }
-                    index[obs] = i;
-                    ++obs;
-next_inner4: continue;
+                else {
+                    memcpy (st_info->st_numx + obs * kvars,
+                            st_info->st_numx + r * kvars,
+                            kvars * sizeof(ST_double));
                 }
+                index[obs] = index[r];
             }
-            N = st_info->N = obs;
+            ++obs;
         }
-        else {
-            for (i = 0; i < N; i++) {
-                index[i] = i;
-                for (k = 0; k < kvars; k++) {
-                    sel = i * kvars + k;
-                    if ( (rc = SF_vdata(k + 1, i + in1, st_info->st_numx + sel)) )
-                        goto exit;
-                }
-            }
+        nsel = obs;
+    }
+
+    st_info->N = nsel;
+    st_info->strxbytes = strused;
+
+    // Bijection limits (missing values go right after the max)
+    // ---------------------------------------------------------
+
+    st_info->byvars_intonly = intonly;
+    if ( intonly ) {
+        for (k = 0; k < kvars; k++) {
+            st_info->byvars_mins[k] = (GT_int) (double_mins[k]);
+            st_info->byvars_maxs[k] = (GT_int) (double_maxs[k]) + any_missing[k];
         }
     }
 
 exit:
+    free (strbuf);
+    free (drop);
+    free (double_mins);
+    free (double_maxs);
+    free (any_missing);
+    free (all_missing);
+
     return (rc);
 }
 
@@ -262,27 +268,10 @@ ST_retcode gf_bijection_limits (
 {
 
     ST_retcode rc = 0;
-    ST_double z;
-    GT_size i, k, worst, range;
-    GT_size N     = st_info->N;
+    GT_size k, worst, range;
     GT_size kvars = st_info->kvars_by;
     GT_size kint  = st_info->kvars_by_int;
 
-    ST_double *double_mins = calloc(kvars, sizeof *double_mins);
-    ST_double *double_maxs = calloc(kvars, sizeof *double_maxs);
-    GT_bool   *any_missing = calloc(kvars, sizeof *any_missing);
-    GT_bool   *all_missing = calloc(kvars, sizeof *all_missing);
-
-    if ( double_mins == NULL ) return (sf_oom_error("gf_bijection_limits", "double_mins"));
-    if ( double_maxs == NULL ) return (sf_oom_error("gf_bijection_limits", "double_maxs"));
-    if ( any_missing == NULL ) return (sf_oom_error("gf_bijection_limits", "any_missing"));
-    if ( all_missing == NULL ) return (sf_oom_error("gf_bijection_limits", "all_missing"));
-
-    GTOOLS_GC_ALLOCATED("double_mins")
-    GTOOLS_GC_ALLOCATED("double_maxs")
-    GTOOLS_GC_ALLOCATED("any_missing")
-    GTOOLS_GC_ALLOCATED("all_missing")
-
     // If only integers, check worst case of the bijection would not
     // overflow. Given K by variables, by_1 to by_K, where by_k belongs to the
     // set B_k, the general problem we face is devising a function f such that
@@ -293,87 +282,27 @@ ST_retcode gf_bijection_limits (
     //     2. The kth variable: z[i, k] = f(k)(x[i, k]) = i * range(z[, k - 1]) + (x[i, k - 1] - min(x[, 2]))
     //
     // If we have too many by variables, it is possible our integers will
-    // overflow. We check whether this may happen below.
+    // overflow. We check whether this may happen below. Whether all the
+    // values are integers (and the min and max of each variable) was
+    // determined as the variables were read in; see sf_read_byvars.
 
-    if ( kint == kvars ) {
-        if ( st_info->verbose )
+    if ( st_info->verbose ) {
+        if ( kint == kvars ) {
             sf_printf("Bijection OK with all integers (i.e. no extended miss val)? ");
-
-        st_info->biject = 1;
-        for (k = 0; k < kvars; k++) {
-            double_maxs[k] = double_mins[k] = 0;
-            any_missing[k] = 0;
-            all_missing[k] = 1;
         }
-
-        for (i = 0; i < N; i++) {
-            for (k = 0; k < kvars; k++) {
-                z = *(st_info->st_numx + (i * kvars + k));
-                if ( z > SV_missval ) {
-                    st_info->biject = 0;
-                    if ( st_info->verbose ) sf_printf("No; using hash.\n");
-                    goto exit;
-                }
-                else {
-                    if ( SF_is_missing(z) ) {
-                        any_missing[k] = 1;
-                    }
-                    else if ( all_missing[k] ) {
-                        all_missing[k] = 0;
-                        double_mins[k] = z;
-                        double_maxs[k] = z;
-                    }
-                    else {
-                        if ( z < double_mins[k] ) double_mins[k]  = z;
-                        if ( z > double_maxs[k] ) double_maxs[k]  = z;
-                    }
-                }
-            }
-        }
-    }
-    else {
-        if ( st_info->verbose )
+        else {
             sf_printf("Bijection OK with all numbers (i.e. no doubles)? ");
-
-        st_info->biject = 1;
-        for (k = 0; k < kvars; k++) {
-            double_maxs[k] = double_mins[k] = 0;
-            any_missing[k] = 0;
-            all_missing[k] = 1;
         }
+    }
 
-        for (i = 0; i < N; i++) {
-            for (k = 0; k < kvars; k++) {
-                z = *(st_info->st_numx + (i * kvars + k));
-                if ( (ceil(z) != z) || (z > SV_missval) ) {
-                    st_info->biject = 0;
-                    if ( st_info->verbose ) sf_printf("No; using hash.\n");
-                    goto exit;
-                }
-                else {
-                    if ( SF_is_missing(z) ) {
-                        any_missing[k] = 1;
-                    }
-                    else if ( all_missing[k] ) {
-                        all_missing[k] = 0;
-                        double_mins[k] = z;
-                        double_maxs[k] = z;
-                    }
-                    else {
-                        if ( z < double_mins[k] ) double_mins[k]  = z;
-                        if ( z > double_maxs[k] ) double_maxs[k]  = z;
-                    }
-                }
-            }
-        }
+    st_info->biject = st_info->byvars_intonly;
+    if ( st_info->biject == 0 ) {
+        if ( st_info->verbose ) sf_printf("No; using hash.\n");
+        goto exit;
     }
 
     // Check whether bijection might overflow.
     if ( st_info->biject ) {
-        for (k = 0; k < kvars; k++) {
-            st_info->byvars_mins[k] = (GT_int) (double_mins[k]);
-            st_info->byvars_maxs[k] = (GT_int) (double_maxs[k]) + any_missing[k];
-        }
         worst = st_info->byvars_maxs[0] - st_info->byvars_mins[0] + 1;
         range = 1;
         for (k = 0; k < (kvars - 1); k++) {
@@ -408,16 +337,5 @@ ST_retcode gf_bijection_limits (
     }
 
 exit:
-
-    free (any_missing);
-    free (all_missing);
-    free (double_mins);
-    free (double_maxs);
-
-    GTOOLS_GC_FREED("any_missing")
-    GTOOLS_GC_FREED("all_missing")
-    GTOOLS_GC_FREED("double_mins")
-    GTOOLS_GC_FREED("double_maxs")
-
     return (rc);
 }
@@ -23,10 +23,9 @@ ST_retcode sf_contract (struct StataInfo *st_info, int level)
      *                     Step 2: Sort group counts                     *
      *********************************************************************/
 
-    st_info->output = calloc(cvars * st_info->J,  sizeof *st_info->output);
+    st_info->output = gf_arena_calloc(st_info->arena, cvars * st_info->J,  sizeof *st_info->output);
     if ( st_info->output == NULL ) sf_oom_error("sf_contract", "st_info->output");
     GTOOLS_GC_ALLOCATED("st_info->output")
-    st_info->free = 9;
 
     k = 0;
     l = st_info->ix[0];
@@ -63,6 +62,7 @@ ST_retcode sf_contract (struct StataInfo *st_info, int level)
         }
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_STATS);
     if ( st_info->benchmark > 1 )
         sf_running_timer (&timer, "\tPlugin step 5: Generated output array");
 
@@ -92,10 +92,9 @@ ST_retcode sf_contract_w (struct StataInfo *st_info, int level)
      *                     Step 2: Sort group counts                     *
      *********************************************************************/
 
-    st_info->output = calloc(cvars * st_info->J,  sizeof *st_info->output);
+    st_info->output = gf_arena_calloc(st_info->arena, cvars * st_info->J,  sizeof *st_info->output);
     if ( st_info->output == NULL ) sf_oom_error("sf_contract", "st_info->output");
     GTOOLS_GC_ALLOCATED("st_info->output")
-    st_info->free = 9;
 
     if ( st_info->wcode ) {
         for (j = 0; j < st_info->J; j++) {
@@ -111,6 +110,7 @@ ST_retcode sf_contract_w (struct StataInfo *st_info, int level)
         }
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_READ);
     if ( st_info->benchmark > 1 )
         sf_running_timer (&timer, "\tPlugin step 5.1: Read in frequency weights");
 
@@ -146,6 +146,7 @@ ST_retcode sf_contract_w (struct StataInfo *st_info, int level)
         }
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_STATS);
     if ( st_info->benchmark > 1 )
         sf_running_timer (&timer, "\tPlugin step 5.2: Generated output array");
 
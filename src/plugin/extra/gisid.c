@@ -154,8 +154,8 @@ ST_retcode gf_check_isid_collision (struct StataInfo *st_info, GT_size obs1, GT_
             sel = obs1 * st_info->rowbytes + st_info->positions[k];
             if ( st_info->byvars_lens[k] > 0 ) {
                 memcpy (st_strbase + strpos,
-                        st_info->st_charx + sel,
-                        strlen(st_info->st_charx + sel));
+                        GTOOLS_STRREF_STR(st_info->st_strx, st_info->st_charx + sel),
+                        strlen(GTOOLS_STRREF_STR(st_info->st_strx, st_info->st_charx + sel)));
                 strpos = strlen(st_strbase);
             }
             else {
@@ -177,8 +177,8 @@ ST_retcode gf_check_isid_collision (struct StataInfo *st_info, GT_size obs1, GT_
             if ( st_info->byvars_lens[k] > 0 ) {
                 // Concatenate string and compare result
                 memcpy (st_strcomp + strpos,
-                        st_info->st_charx + sel,
-                        strlen(st_info->st_charx + sel));
+                        GTOOLS_STRREF_STR(st_info->st_strx, st_info->st_charx + sel),
+                        strlen(GTOOLS_STRREF_STR(st_info->st_strx, st_info->st_charx + sel)));
                 strpos = strlen(st_strcomp);
             }
             else {
@@ -101,7 +101,7 @@ ST_retcode sf_levelsof (struct StataInfo *st_info, int level)
                     if ( k > 0 ) strpos += sprintf(strpos, "%s", colsep);
                     sel = j * rowbytes + st_info->positions[k];
                     if ( st_info->byvars_lens[k] > 0 ) {
-                        strpos += sprintf(strpos, sprintfmt, st_info->st_by_charx + sel);
+                        strpos += sprintf(strpos, sprintfmt, GTOOLS_STRREF_STR(st_info->st_by_strx, st_info->st_by_charx + sel));
                     }
                     else {
                         z = *((ST_double *) (st_info->st_by_charx + sel));
@@ -143,7 +143,7 @@ ST_retcode sf_levelsof (struct StataInfo *st_info, int level)
                 if ( j > 0 ) strpos += sprintf(strpos, "%s", sep);
                 sel = j * rowbytes;
                 if ( st_info->byvars_lens[0] > 0 ) {
-                    strpos += sprintf(strpos, sprintfmt, st_info->st_by_charx + sel);
+                    strpos += sprintf(strpos, sprintfmt, GTOOLS_STRREF_STR(st_info->st_by_strx, st_info->st_by_charx + sel));
                 }
                 else {
                     z = *((ST_double *) (st_info->st_by_charx + sel));
@@ -174,6 +174,7 @@ ST_retcode sf_levelsof (struct StataInfo *st_info, int level)
     }
 
     if ( (rc = SF_macro_save("_vals", macrobuffer)) ) goto exit;
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_WRITE);
     if ( st_info->benchmark > 1 )
         sf_running_timer (&timer, "\tPlugin step 5: Wrote levels to Stata macro");
 
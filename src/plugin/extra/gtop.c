@@ -144,7 +144,7 @@ ST_retcode sf_top (struct StataInfo *st_info, int level)
                 for (k = 0; k < kvars; k++) {
                     sel = topix[j] * rowbytes + st_info->positions[k];
                     if ( st_info->byvars_lens[k] > 0 ) {
-                        if ( strcmp(st_info->st_by_charx + sel, "") == 0 ) {
+                        if ( strcmp(GTOOLS_STRREF_STR(st_info->st_by_strx, st_info->st_by_charx + sel), "") == 0 ) {
                             rowmiss++;
                             if ( st_info->top_groupmiss )
                                 goto countmiss_char;
@@ -206,7 +206,7 @@ countmiss_char:
                 if ( k > 0 ) strpos += sprintf(strpos, "%s", colsep);
                 sel = topix[l] * rowbytes + st_info->positions[k];
                 if ( st_info->byvars_lens[k] > 0 ) {
-                    strpos += sprintf(strpos, sprintfmt, st_info->st_by_charx + sel);
+                    strpos += sprintf(strpos, sprintfmt, GTOOLS_STRREF_STR(st_info->st_by_strx, st_info->st_by_charx + sel));
                 }
                 else {
                     z = *((ST_double *) (st_info->st_by_charx + sel));
@@ -294,6 +294,7 @@ countmiss_dbl:
     }
 
     if ( (rc = SF_macro_save("_vals", macrobuffer)) ) goto exit;
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_WRITE);
     if ( st_info->benchmark > 1 )
         sf_running_timer (&timer, "\tPlugin step 5: Wrote top levels to Stata macro");
 
@@ -85,6 +85,7 @@ error:
         }
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_WRITE);
     if ( st_info->benchmark > 1 )
         sf_running_timer (&timer, "\tPlugin step 5: Wrote back _sortindex");
 
@@ -24,25 +24,29 @@
 #include "spookyhash/src/spookyhash_api.h"
 
 #include "common/sf_wrappers.c"
+#include "common/gtools_arena.c"
+#include "common/gtools_telemetry.c"
+#include "common/gtools_file.c"
 #include "common/fixes.c"
 #include "common/quicksortMultiLevel.c"
 #include "common/readWrite.c"
 
 #if GMULTI
-#    define GTOOLS_THREADS 4
 #    include <pthread.h>
-#    include <assert.h>
-#    include "parallel/hash/gtools_hash.c"
-#else
-#    include "hash/gtools_hash.c"
 #endif
 
+#include "parallel/gtools_threads.c"
+#include "hash/gtools_hash.c"
+
 #include "common/encode.c"
 
 #include "collapse/gtools_math.c"
 #include "collapse/gtools_math_w.c"
 #include "collapse/gtools_nunique.c"
+#include "collapse/gtools_accum.c"
+#include "collapse/gtools_sketch.c"
 #include "collapse/gtools_utils.c"
+#include "collapse/gtools_iomodel.c"
 #include "collapse/gegen_w.c"
 #include "collapse/gegen.c"
 
@@ -56,6 +60,7 @@
 #include "quantiles/gquantiles_utils.c"
 #include "quantiles/gquantiles.c"
 
+#ifndef GTOOLS_BENCH
 int main()
 {
     return(0);
@@ -65,6 +70,7 @@ int WinMain()
 {
     return(0);
 }
+#endif
 
 STDLL stata_call(int argc, char *argv[])
 {
@@ -80,9 +86,15 @@ STDLL stata_call(int argc, char *argv[])
     GTOOLS_CHAR(todo,   16);
     strcpy (todo, argv[0]);
 
-    int free_level = 0;
-    struct StataInfo *st_info = malloc(sizeof(*st_info));
-    st_info->free = 0;
+    struct GtoolsArena arena;
+    struct GtoolsTelemetry telemetry;
+    struct StataInfo *st_info = calloc(1, sizeof(*st_info));
+    if ( st_info == NULL ) return (sf_oom_error("stata_call", "st_info"));
+
+    gf_arena_init (&arena);
+    gf_telemetry_init (&telemetry, &arena);
+    st_info->arena     = &arena;
+    st_info->telemetry = &telemetry;
     GTOOLS_GC_INIT
 
     if ( strcmp(todo, "check") == 0 ) {
@@ -166,8 +178,6 @@ STDLL stata_call(int argc, char *argv[])
 
             if ( (rc = SF_scal_save ("__gtools_used_io",  (ST_double) 0.0)) ) goto exit;
             if ( (rc = SF_scal_save ("__gtools_ixfinish", (ST_double) 0.0)) ) goto exit;
-
-            free_level = 11;
             // goto exit;
         }
         else if ( strcmp(tostat, "read") == 0 ) {
@@ -243,7 +253,10 @@ STDLL stata_call(int argc, char *argv[])
 exit:
     if ( rc == 17013 ) rc = 0;
 
-    sf_free (st_info, free_level);
+    gf_telemetry_lap (&telemetry, GTOOLS_STAGE_OTHER);
+    if ( rc == 0 ) rc = sf_telemetry_save (&telemetry);
+    if ( st_info->verbose || st_info->benchmark ) gf_arena_report (&arena);
+    gf_arena_release (&arena);
     GTOOLS_GC_END(0)
 
     free (st_info);
@@ -308,6 +321,9 @@ ST_retcode sf_parse_info (struct StataInfo *st_info, int level)
             xtile_cutifin,
             xtile_cutby,
             hash_method,
+            threads,
+            verify,
+            cache,
             wcode,
             wpos,
             nunique,
@@ -338,7 +354,7 @@ ST_retcode sf_parse_info (struct StataInfo *st_info, int level)
      *                       Parse missing values                        *
      *********************************************************************/
 
-    st_info->missval = calloc(27, sizeof st_info->missval);
+    st_info->missval = gf_arena_calloc(st_info->arena, 27, sizeof st_info->missval);
     if ( st_info->missval == NULL ) return (sf_oom_error("sf_parse_info", "st_info->missval"));
     GTOOLS_GC_ALLOCATED("st_info->missval")
 
@@ -392,6 +408,9 @@ ST_retcode sf_parse_info (struct StataInfo *st_info, int level)
     if ( (rc = sf_scalar_size("__gtools_invertix",       &invertix)       )) goto exit;
     if ( (rc = sf_scalar_size("__gtools_skipcheck",      &skipcheck)      )) goto exit;
     if ( (rc = sf_scalar_size("__gtools_hash_method",    &hash_method)    )) goto exit;
+    if ( (rc = sf_scalar_size("__gtools_threads",        &threads)        )) goto exit;
+    if ( (rc = sf_scalar_size("__gtools_verify",         &verify)         )) goto exit;
+    if ( (rc = sf_scalar_size("__gtools_cache",          &cache)          )) goto exit;
     if ( (rc = sf_scalar_size("__gtools_weight_code",    &wcode)          )) goto exit;
     if ( (rc = sf_scalar_size("__gtools_weight_pos",     &wpos)           )) goto exit;
     if ( (rc = sf_scalar_size("__gtools_nunique",        &nunique)        )) goto exit;
@@ -455,6 +474,9 @@ ST_retcode sf_parse_info (struct StataInfo *st_info, int level)
     if ( (rc = SF_scal_use("__gtools_top_ntop",  &(st_info->top_ntop)  )) ) return (rc);
     if ( (rc = SF_scal_use("__gtools_top_pct",   &(st_info->top_pct)   )) ) return (rc);
 
+    // Rank error for approximate quantiles
+    if ( (rc = SF_scal_use("__gtools_approx_eps", &(st_info->approx_eps) )) ) return (rc);
+
     // Parse number of variables
     if ( (rc = sf_scalar_size("__gtools_kvars",     &kvars_by)     )) goto exit;
     if ( (rc = sf_scalar_size("__gtools_kvars_int", &kvars_by_int) )) goto exit;
@@ -462,18 +484,18 @@ ST_retcode sf_parse_info (struct StataInfo *st_info, int level)
     if ( (rc = sf_scalar_size("__gtools_kvars_str", &kvars_by_str) )) goto exit;
 
     // Parse variable lengths, positions, and sort order
-    st_info->byvars_lens     = calloc(kvars_by,     sizeof st_info->byvars_lens);
-    st_info->invert          = calloc(kvars_by,     sizeof st_info->invert);
-    st_info->pos_num_byvars  = calloc(kvars_by_num, sizeof st_info->pos_num_byvars);
-    st_info->pos_str_byvars  = calloc(kvars_by_str, sizeof st_info->pos_str_byvars);
-    st_info->group_targets   = calloc(3,            sizeof st_info->group_targets);
-    st_info->group_init      = calloc(3,            sizeof st_info->group_init);
-
-    st_info->pos_targets     = calloc((kvars_targets > 1)? kvars_targets   : 1, sizeof st_info->pos_targets);
-    st_info->statcode        = calloc((kvars_stats   > 1)? kvars_stats     : 1, sizeof st_info->statcode);
-    st_info->xtile_quantiles = calloc((xtile_nq2     > 0)? xtile_nq2       : 1, sizeof st_info->xtile_quantiles);
-    st_info->xtile_cutoffs   = calloc((xtile_ncuts   > 0)? xtile_ncuts + 1 : 1, sizeof st_info->xtile_cutoffs);
-    st_info->contract_which  = calloc(4, sizeof st_info->contract_which);
+    st_info->byvars_lens     = gf_arena_calloc(st_info->arena, kvars_by,     sizeof st_info->byvars_lens);
+    st_info->invert          = gf_arena_calloc(st_info->arena, kvars_by,     sizeof st_info->invert);
+    st_info->pos_num_byvars  = gf_arena_calloc(st_info->arena, kvars_by_num, sizeof st_info->pos_num_byvars);
+    st_info->pos_str_byvars  = gf_arena_calloc(st_info->arena, kvars_by_str, sizeof st_info->pos_str_byvars);
+    st_info->group_targets   = gf_arena_calloc(st_info->arena, 3,            sizeof st_info->group_targets);
+    st_info->group_init      = gf_arena_calloc(st_info->arena, 3,            sizeof st_info->group_init);
+
+    st_info->pos_targets     = gf_arena_calloc(st_info->arena, (kvars_targets > 1)? kvars_targets   : 1, sizeof st_info->pos_targets);
+    st_info->statcode        = gf_arena_calloc(st_info->arena, (kvars_stats   > 1)? kvars_stats     : 1, sizeof st_info->statcode);
+    st_info->xtile_quantiles = gf_arena_calloc(st_info->arena, (xtile_nq2     > 0)? xtile_nq2       : 1, sizeof st_info->xtile_quantiles);
+    st_info->xtile_cutoffs   = gf_arena_calloc(st_info->arena, (xtile_ncuts   > 0)? xtile_ncuts + 1 : 1, sizeof st_info->xtile_cutoffs);
+    st_info->contract_which  = gf_arena_calloc(st_info->arena, 4, sizeof st_info->contract_which);
 
     if ( st_info->byvars_lens     == NULL ) return (sf_oom_error("sf_parse_info", "st_info->byvars_lens"));
     if ( st_info->invert          == NULL ) return (sf_oom_error("sf_parse_info", "st_info->invert"));
@@ -546,6 +568,8 @@ ST_retcode sf_parse_info (struct StataInfo *st_info, int level)
     st_info->invertix       = invertix;
     st_info->skipcheck      = skipcheck;
     st_info->hash_method    = hash_method;
+    st_info->threads        = threads;
+    st_info->verify         = verify;
     st_info->wcode          = wcode;
     st_info->wpos           = wpos;
     st_info->nunique        = nunique;
@@ -608,10 +632,37 @@ ST_retcode sf_parse_info (struct StataInfo *st_info, int level)
     st_info->kvars_stats    = kvars_stats;
 
     /*********************************************************************
-     *                              Cleanup                              *
+     *                    Group index cache file name                    *
      *********************************************************************/
 
-    st_info->free = 1;
+    // __gtools_cache is the length of the cache file name (0 if the
+    // group index should not be cached; see gtools_cache.h)
+
+    st_info->cache     = cache;
+    st_info->cache_hit = 0;
+    if ( cache > 0 ) {
+        st_info->cache_file = gf_arena_calloc(st_info->arena, cache + 1, sizeof(char));
+        if ( st_info->cache_file == NULL ) return (sf_oom_error("sf_parse_info", "st_info->cache_file"));
+        GTOOLS_GC_ALLOCATED("st_info->cache_file")
+        if ( (rc = SF_macro_use("_cachefile", st_info->cache_file, (cache + 1) * sizeof(char))) ) goto exit;
+    }
+    else {
+        st_info->cache_file = NULL;
+    }
+
+    /*********************************************************************
+     *                    Start the shared thread pool                   *
+     *********************************************************************/
+
+    // Every parallel stage runs on this one pool. The workers are kept
+    // alive across plugin calls and only restarted when the number of
+    // threads changes (a no-op in the single-thread plugin).
+    if ( (rc = gf_pool_init (threads)) ) goto exit;
+    st_info->threads = gf_pool_threads();
+
+    /*********************************************************************
+     *                              Cleanup                              *
+     *********************************************************************/
 
 exit:
 
@@ -633,6 +684,7 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
 
     GT_size *info, *index, *ix;
     GT_bool checksorted;
+    GT_bool prefix = 0;
     GT_size i,
             j,
             k,
@@ -640,7 +692,8 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
             ilen,
             rowbytes,
             nj_min,
-            nj_max;
+            nj_max,
+            collisions;
 
     GT_size in1   = st_info->in1;
     GT_size N     = st_info->N;
@@ -651,9 +704,9 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
     // Parse positions in char array
     // -----------------------------
 
-    st_info->positions   = calloc(kvars + 1, sizeof(st_info->positions));
-    st_info->byvars_mins = calloc(kvars,     sizeof(st_info->byvars_mins));
-    st_info->byvars_maxs = calloc(kvars,     sizeof(st_info->byvars_maxs));
+    st_info->positions   = gf_arena_calloc(st_info->arena, kvars + 1, sizeof(st_info->positions));
+    st_info->byvars_mins = gf_arena_calloc(st_info->arena, kvars,     sizeof(st_info->byvars_mins));
+    st_info->byvars_maxs = gf_arena_calloc(st_info->arena, kvars,     sizeof(st_info->byvars_maxs));
 
     if ( st_info->positions   == NULL ) return (sf_oom_error("sf_hash_byvars", "positions"));
     if ( st_info->byvars_mins == NULL ) return (sf_oom_error("sf_hash_byvars", "byvars_mins"));
@@ -663,19 +716,16 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
     GTOOLS_GC_ALLOCATED("st_info->byvars_mins")
     GTOOLS_GC_ALLOCATED("st_info->byvars_maxs")
 
-    st_info->free = 2;
+    // Every variable takes 8 bytes in the row (strings are references
+    // into st_strx); keybytes is the longest a row's key can be with the
+    // strings spelled out (see gf_strx_key).
 
-    st_info->positions[0] = rowbytes = 0;
+    st_info->positions[0] = rowbytes = st_info->keybytes = 0;
     for (k = 1; k < kvars + 1; k++) {
         ilen = st_info->byvars_lens[k - 1] * sizeof(char);
-        if ( ilen > 0 ) {
-            st_info->positions[k] = st_info->positions[k - 1] + (ilen + sizeof(char));
-            rowbytes += (ilen + sizeof(char));
-        }
-        else {
-            st_info->positions[k] = st_info->positions[k - 1] + sizeof(ST_double);
-            rowbytes += sizeof(ST_double);
-        }
+        st_info->positions[k] = st_info->positions[k - 1] + sizeof(ST_double);
+        rowbytes += sizeof(ST_double);
+        st_info->keybytes += (ilen > 0)? (ilen + sizeof(char)): sizeof(ST_double);
     }
     st_info->rowbytes = rowbytes;
 
@@ -684,11 +734,11 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
      *********************************************************************/
 
     if ( st_info->kvars_by == 0 ) {
-        st_info->st_numx  = malloc(sizeof(ST_double));
-        st_info->st_charx = malloc(sizeof(char));
+        st_info->st_numx  = gf_arena_calloc(st_info->arena, 1, sizeof(ST_double));
+        st_info->st_charx = gf_arena_calloc(st_info->arena, 1, sizeof(char));
 
-        st_info->index = calloc(st_info->N, sizeof(st_info->index));
-        st_info->info  = calloc(2, sizeof(st_info->info));
+        st_info->index = gf_arena_calloc(st_info->arena, st_info->N, sizeof(st_info->index));
+        st_info->info  = gf_arena_calloc(st_info->arena, 2, sizeof(st_info->info));
 
         if ( st_info->index == NULL ) sf_oom_error("sf_hash_byvars", "st_info->index");
 
@@ -712,7 +762,7 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
                     return (17001);
                 }
 
-                st_info->ix = calloc(N, sizeof(st_info->ix));
+                st_info->ix = gf_arena_calloc(st_info->arena, N, sizeof(st_info->ix));
                 if ( st_info->ix == NULL ) return (sf_oom_error("sf_hash_byvars", "st_info->ix"));
                 GTOOLS_GC_ALLOCATED("st_info->ix")
 
@@ -732,11 +782,11 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
 
         st_info->info[0]   = 0;
         st_info->info[1]   = st_info->N;
-        st_info->free      = 5;
         st_info->biject    = 1;
         st_info->J         = 1;
         st_info->countonly = 1;
         st_info->seecount  = 0;
+        st_info->cache     = 0;
         st_info->byvars_mins[0] = 0;
         st_info->byvars_maxs[0] = 0;
         st_info->nj_min = st_info->N;
@@ -746,7 +796,7 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
         return (rc);
     }
 
-    index = calloc(N, sizeof(index));
+    index = gf_arena_calloc(st_info->arena, N, sizeof(index));
     if ( index == NULL ) return (sf_oom_error("sf_read_byvars", "index"));
     GTOOLS_GC_ALLOCATED("index")
 
@@ -765,7 +815,7 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
             goto exit;
         }
 
-        ix = calloc(st_info->N, sizeof(ix));
+        ix = gf_arena_calloc(st_info->arena, st_info->N, sizeof(ix));
         if ( ix == NULL ) return (sf_oom_error("sf_hash_byvars", "ix"));
         GTOOLS_GC_ALLOCATED("ix")
 
@@ -776,11 +826,61 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
         ix = index;
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_READ);
     if ( st_info->benchmark > 1 )
         sf_running_timer (&timer, "\tPlugin step 1: Read in by variables");
 
     stimer = clock();
 
+    /*********************************************************************
+     *                    Group index cache (optional)                   *
+     *********************************************************************/
+
+    // If the by variables and the selected observations are the same as
+    // the last time the group index was cached, load it and skip the
+    // hash, sort, panel setup and collision check.
+
+    if ( (st_info->cache > 0) & (level != 0) ) {
+        st_info->cache = 0;
+    }
+    else if ( st_info->cache > 0 ) {
+        if ( (rc = sf_cache_load (st_info, index)) ) goto exit;
+        if ( st_info->cache_hit ) {
+            if ( st_info->N < Nread ) {
+                gf_arena_free (st_info->arena, ix);
+                GTOOLS_GC_FREED("ix")
+            }
+
+            if ( st_info->verbose || (st_info->countonly & st_info->seecount) ) {
+                if ( st_info->nj_min == st_info->nj_max )
+                    sf_printf ("N = "
+                               GT_size_cfmt"; "
+                               GT_size_cfmt" balanced groups of size "
+                               GT_size_cfmt"\n",
+                               st_info->N, st_info->J, st_info->nj_min);
+                else
+                    sf_printf ("N = "
+                               GT_size_cfmt"; "
+                               GT_size_cfmt" unbalanced groups of sizes "
+                               GT_size_cfmt" to "
+                               GT_size_cfmt"\n",
+                               st_info->N, st_info->J, st_info->nj_min, st_info->nj_max);
+            }
+
+            if ( (rc = sf_set_rinfo (st_info, level)) ) goto exit;
+
+            st_info->telemetry->index = "cache";
+            gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_PANEL);
+            if ( st_info->benchmark > 1 )
+                sf_running_timer (&timer, "\tPlugin step 2-3: Loaded group index from cache");
+
+            goto exit;
+        }
+
+        if ( st_info->benchmark > 2 )
+            sf_running_timer (&stimer, "\t\tPlugin step 1.1: Checked group index cache");
+    }
+
     /*********************************************************************
      *                  Check whether is id (isid only)                  *
      *********************************************************************/
@@ -794,7 +894,8 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
                                          st_info->rowbytes,
                                          st_info->byvars_lens,
                                          st_info->invert,
-                                         st_info->positions)) >= 0 ) {
+                                         st_info->positions,
+                                         st_info->st_strx)) >= 0 ) {
 
                 // rc == 0 means the result from a comparison was 0, that is,
                 // two elements within a group were the same. This means that
@@ -873,7 +974,8 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
                 st_info->rowbytes,
                 st_info->byvars_lens,
                 st_info->invert,
-                st_info->positions
+                st_info->positions,
+                st_info->st_strx
             );
         }
         else {
@@ -898,9 +1000,10 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
         goto exit;
     }
 
-    checksorted = checksorted & (st_info->hash_method == 0);
+    checksorted = checksorted & (st_info->hash_method == GTOOLS_HASH_DEFAULT);
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_BIJECT);
     if ( checksorted & st_info->sorted ) {
-        GT_size *info_largest = calloc(st_info->N + 1, sizeof *info_largest);
+        GT_size *info_largest = gf_arena_calloc(st_info->arena, st_info->N + 1, sizeof *info_largest);
         if ( info_largest == NULL ) return (sf_oom_error("sf_hash_byvars", "info_largest"));
 
         if ( st_info->kvars_by_str > 0 ) {
@@ -913,6 +1016,7 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
                 st_info->byvars_lens,
                 st_info->invert,
                 st_info->positions,
+                st_info->st_strx,
                 info_largest,
                 0
             );
@@ -932,15 +1036,15 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
 
         info_largest[st_info->J] = st_info->N;
 
-        st_info->info = calloc(st_info->J + 1, sizeof st_info->info);
+        st_info->info = gf_arena_calloc(st_info->arena, st_info->J + 1, sizeof st_info->info);
         if ( st_info->info == NULL ) return (sf_oom_error("sf_hash_byvars", "st_info->info"));
         GTOOLS_GC_ALLOCATED("st_info->info")
-        st_info->free = 4;
 
         for (i = 0; i < st_info->J + 1; i++)
             st_info->info[i] = info_largest[i];
 
-        free(info_largest);
+        gf_arena_free (st_info->arena, info_largest);
+        gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_PANEL);
     }
 
     /*********************************************************************
@@ -950,15 +1054,49 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
     if ( checksorted & st_info->sorted ) {
         st_info->biject = 1;
     }
-    else if ( (kstr > 0) | (st_info->hash_method == 2) ) {
+    else if ( st_info->hash_method >= GTOOLS_HASH_SPOOKY ) {
         st_info->biject = 0;
     }
     else {
+        if ( (kstr > 0) & st_info->byvars_intonly ) {
+            if ( (rc = gf_strdict_encode (st_info, !(st_info->unsorted | st_info->countonly))) ) goto exit;
+            if ( st_info->benchmark > 2 )
+                sf_running_timer (&stimer, "\t\tPlugin step 2.0: Encoded string by variables");
+        }
         if ( (rc = gf_bijection_limits (st_info, level)) ) goto exit;
         if ( st_info->benchmark > 2 )
             sf_running_timer (&stimer, "\t\tPlugin step 2.1: Determined hashing strategy");
     }
 
+    // If the data is sorted by some of the by variables (but not all)
+    // and we would otherwise hash, sort each run of the sorted prefix
+    // by the remaining by variables instead. The groups come out in
+    // order, as with a bijection.
+
+    if ( checksorted & !st_info->sorted & !st_info->biject & (st_info->kvars_by > 1) ) {
+        if ( (i = gf_sorted_prefix (st_info)) > 0 ) {
+            if ( (rc = gf_panelsetup_prefix (st_info, ix, i, &prefix)) ) goto exit;
+            st_info->biject = prefix;
+        }
+        if ( st_info->benchmark > 2 )
+            sf_running_timer (&stimer, "\t\tPlugin step 2.2: Checked for a sorted prefix");
+    }
+
+    if ( checksorted & st_info->sorted ) {
+        st_info->telemetry->index = "sorted";
+    }
+    else if ( prefix ) {
+        st_info->telemetry->index = "prefix";
+    }
+    else {
+        st_info->telemetry->index = st_info->biject? "bijection": "hash";
+    }
+    gf_telemetry_lap (st_info->telemetry, prefix? GTOOLS_STAGE_SORT: GTOOLS_STAGE_BIJECT);
+
+    // String codes are only needed to biject (see gf_hash)
+    if ( (st_info->biject == 0) | (checksorted & st_info->sorted) | prefix )
+        gf_strdict_free (st_info);
+
     /*********************************************************************
      *                       Panel setup and info                        *
      *********************************************************************/
@@ -969,20 +1107,20 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
     uint64_t *ghash1;
     uint64_t *ghash2;
 
-    if ( checksorted & st_info->sorted ) {
-        ghash1 = malloc(sizeof(uint64_t));
-        ghash2 = malloc(sizeof(uint64_t));
+    if ( (checksorted & st_info->sorted) | prefix ) {
+        ghash1 = gf_arena_calloc(st_info->arena, 1, sizeof(uint64_t));
+        ghash2 = gf_arena_calloc(st_info->arena, 1, sizeof(uint64_t));
     }
     else if ( st_info->biject ) {
-        ghash1 = calloc(N, sizeof *ghash1);
-        ghash2 = malloc(sizeof(uint64_t));
+        ghash1 = gf_arena_calloc(st_info->arena, N, sizeof *ghash1);
+        ghash2 = gf_arena_calloc(st_info->arena, 1, sizeof(uint64_t));
 
         if ( ghash1 == NULL ) sf_oom_error("sf_hash_byvars", "ghash1");
         if ( ghash2 == NULL ) sf_oom_error("sf_hash_byvars", "ghash2");
     }
     else {
-        ghash1 = calloc(N, sizeof *ghash1);
-        ghash2 = calloc(N, sizeof *ghash2);
+        ghash1 = gf_arena_calloc(st_info->arena, N, sizeof *ghash1);
+        ghash2 = gf_arena_calloc(st_info->arena, N, sizeof *ghash2);
 
         if ( ghash1 == NULL ) sf_oom_error("sf_hash_byvars", "ghash1");
         if ( ghash2 == NULL ) sf_oom_error("sf_hash_byvars", "ghash2");
@@ -991,10 +1129,22 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
     GTOOLS_GC_ALLOCATED("ghash1")
     GTOOLS_GC_ALLOCATED("ghash2")
 
-    if ( checksorted & st_info->sorted ) {
+    // Unless the data is already sorted or we need the sorted hash to
+    // check for an id (isid), group rows via a hash table instead of
+    // sorting the hash (gf_panelsetup decides whether it pays off).
+
+    st_info->hashtable = (level != 2) & (st_info->sorted == 0);
+
+    // isid only compares the first two rows with the same hash, so it
+    // needs the 128-bit hash
+    if ( (level == 2) & (st_info->hash_method == GTOOLS_HASH_FAST64) )
+        st_info->hash_method = GTOOLS_HASH_COLUMN;
+
+    if ( (checksorted & st_info->sorted) | prefix ) {
     }
     else {
         if ( (rc = gf_hash (ghash1, ghash2, st_info, ix, stimer)) ) goto error;
+        gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_HASH);
         if ( st_info->benchmark > 1 )
             sf_running_timer (&timer, "\tPlugin step 2: Hashed by variables");
 
@@ -1007,6 +1157,7 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
     if ( level == 2 ) {
 
         rc_isid = gf_isid (ghash1, ghash2, st_info, ix, !(st_info->biject));
+        gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_CHECK);
 
         if ( st_info->benchmark > 1 )
             sf_running_timer (&timer, "\tPlugin step 3: Checked if group is id");
@@ -1026,7 +1177,7 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
         // Otherwise, set up panel normally
         // --------------------------------
 
-        if ( checksorted & st_info->sorted ) {
+        if ( (checksorted & st_info->sorted) | prefix ) {
         }
         else {
             if ( (rc = gf_panelsetup (ghash1,
@@ -1034,13 +1185,43 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
                                       st_info,
                                       ix,
                                       !(st_info->biject))) ) goto error;
+
+            // The 64-bit hash is only kept if every row has the same by
+            // variables as the first row in its group; otherwise hash
+            // again with spooky (sf_check_hash then checks as usual).
+            if ( !st_info->biject & (st_info->hash_method == GTOOLS_HASH_FAST64) ) {
+                if ( (rc = gf_check_collisions (st_info, ix, 0, &collisions)) ) goto error;
+                gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_CHECK);
+                if ( st_info->benchmark > 2 )
+                    sf_running_timer (&stimer, "\t\tPlugin step 3.0: Checked 64-bit hash for collisions");
+
+                if ( collisions > 0 ) {
+                    if ( st_info->verbose )
+                        sf_printf("Found 64-bit hash collisions; will hash again with spooky.\n");
+
+                    // spooky seeds the hash of each row with its h1
+                    gf_arena_free (st_info->arena, st_info->info);
+                    memset (ghash1, 0, N * sizeof *ghash1);
+                    for (i = 0; i < N; i++)
+                        ix[i] = i;
+
+                    st_info->hash_method = GTOOLS_HASH_SPOOKY;
+                    st_info->hashtable   = (st_info->sorted == 0);
+                    if ( (rc = gf_hash (ghash1, ghash2, st_info, ix, stimer)) ) goto error;
+                    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_HASH);
+                    if ( (rc = gf_panelsetup (ghash1,
+                                              ghash2,
+                                              st_info,
+                                              ix,
+                                              1)) ) goto error;
+                }
+            }
+            st_info->telemetry->panel = st_info->hashtable? "hashtable": "sort";
         }
 
         if ( st_info->benchmark > 2 )
             sf_running_timer (&stimer, "\t\tPlugin step 3.1: Created group index");
 
-        st_info->free = 4;
-
         info   = st_info->info;
         nj_min = info[1] - info[0];
         nj_max = info[1] - info[0];
@@ -1075,8 +1256,8 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
 
         if ( st_info->N < Nread ) {
 
-            st_info->index = calloc(st_info->N, sizeof(st_info->index));
-            st_info->ix    = calloc(st_info->N, sizeof(st_info->ix));
+            st_info->index = gf_arena_calloc(st_info->arena, st_info->N, sizeof(st_info->index));
+            st_info->ix    = gf_arena_calloc(st_info->arena, st_info->N, sizeof(st_info->ix));
 
             if ( st_info->index == NULL ) sf_oom_error("sf_hash_byvars", "st_info->index");
             if ( st_info->ix    == NULL ) sf_oom_error("sf_hash_byvars", "st_info->index");
@@ -1087,11 +1268,11 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
             for (i = 0; i < st_info->N; i++)
                 st_info->index[i] = index[st_info->ix[i] = ix[i]];
 
-            free (ix);
+            gf_arena_free (st_info->arena, ix);
             GTOOLS_GC_FREED("ix")
         }
         else {
-            st_info->index = calloc(st_info->N, sizeof(st_info->index));
+            st_info->index = gf_arena_calloc(st_info->arena, st_info->N, sizeof(st_info->index));
             if ( st_info->index == NULL ) sf_oom_error("sf_hash_byvars", "st_info->index");
             GTOOLS_GC_ALLOCATED("st_info->index")
 
@@ -1104,8 +1285,7 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
         if ( st_info->benchmark > 2 )
             sf_running_timer (&stimer, "\t\tPlugin step 3.2: Normalized group index and Stata index");
 
-        st_info->free = 5;
-
+        gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_PANEL);
         if ( st_info->benchmark > 1 )
             sf_running_timer (&timer, "\tPlugin step 3: Set up panel");
 
@@ -1113,8 +1293,8 @@ ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level)
     }
 
 error:
-    free (ghash1);
-    free (ghash2);
+    gf_arena_free (st_info->arena, ghash1);
+    gf_arena_free (st_info->arena, ghash2);
 
     GTOOLS_GC_FREED("ghash1")
     GTOOLS_GC_FREED("ghash2")
@@ -1125,7 +1305,7 @@ error:
 
 exit:
 
-    free (index);
+    gf_arena_free (st_info->arena, index);
     GTOOLS_GC_FREED("index")
 
     return (rc);
@@ -1164,51 +1344,102 @@ exit:
 ST_retcode sf_switch_io (struct StataInfo *st_info, int level, char* fname)
 {
     ST_retcode rc = 0;
-    GT_size i, j;
+    GT_size i, j, ntimings;
     clock_t timer = clock();
 
-    ST_double st_time;
-    if ( (rc = SF_scal_use ("__gtools_st_time", &st_time)) ) goto exit;
+    struct GtoolsIOModel    model;
+    struct GtoolsIOInputs   inputs;
+    struct GtoolsIODecision decision;
+    ST_double mib[GTOOLS_IO_MAXPTS], seconds[GTOOLS_IO_MAXPTS], z;
+    char *source = "saved calibration";
+    GT_bool used_io;
 
-    ST_double c_rate      = gf_benchmark(fname);
-    ST_double time_vars   = (ST_double) (st_info->kvars_targets - st_info->kvars_sources);
-    ST_double mib_base    = time_vars * 8 / 1024 / 1024;
-    ST_double time_c      = (ST_double) st_info->J * c_rate * mib_base;
-    ST_double time_cstata = (ST_double) st_info->J * st_time / st_info->N;
-    ST_double c_time      = time_c + time_cstata;
+    if ( (rc = SF_scal_use ("__gtools_st_time", &(inputs.st_time))) ) goto exit;
+    if ( (rc = sf_scalar_size ("__gtools_io_ntimings", &ntimings)) ) goto exit;
+
+    inputs.N        = st_info->N;
+    inputs.J        = st_info->J;
+    inputs.kextra   = st_info->kvars_extra;
+    inputs.mib_disk = GTOOLS_QUERY_FREE_SPACE? gf_query_free_space(fname): -1;
+    inputs.mib_mem  = gf_query_free_memory();
+
+    // Synthetic timings (debug_io_timings) are used as given; otherwise
+    // use the saved calibration for the temp directory, if it is recent,
+    // or calibrate now and save it. If the spill file cannot be written
+    // at all, stay in memory.
+
+    memset (&model,    '\0', sizeof(model));
+    memset (&decision, '\0', sizeof(decision));
+    if ( ntimings > 0 ) {
+        if ( ntimings > GTOOLS_IO_MAXPTS ) ntimings = GTOOLS_IO_MAXPTS;
+        for (i = 0; i < ntimings; i++) {
+            if ( (rc = SF_mat_el("__gtools_io_timings", 1, 2 * i + 1, &z)) ) goto exit;
+            mib[i] = z;
+            if ( (rc = SF_mat_el("__gtools_io_timings", 1, 2 * i + 2, &z)) ) goto exit;
+            seconds[i] = z;
+        }
+        if ( (rc = gf_io_fit (mib, seconds, ntimings, &model)) ) {
+            sf_errprintf ("debug_io_timings() must be pairs of MiB > 0 and seconds >= 0\n");
+            goto exit;
+        }
+        source = "debug_io_timings()";
+    }
+    else if ( !gf_io_model_load (fname, &model) ) {
+        if ( gf_io_calibrate (fname, &model) ) {
+            model.latency = 0;
+            model.spm     = -1;
+        }
+        else {
+            gf_io_model_save (fname, &model);
+        }
+        source = "calibrated now";
+    }
 
-    GT_bool used_io;
-    if ( GTOOLS_QUERY_FREE_SPACE ) {
-        ST_double mib_free = gf_query_free_space(fname);
-        ST_double mib_c    = st_info->J * mib_base;
-        used_io            = ( (mib_c < mib_free) & (c_time < st_time) );
+    if ( model.spm < 0 ) {
+        used_io = 0;
+        if ( st_info->verbose )
+            sf_printf("Unable to use the temporary directory; will do operations in memory.\n");
     }
     else {
-        used_io = (c_time < st_time);
+        gf_io_decide (&model, &inputs, &decision);
+        used_io = decision.used_io;
     }
 
-    if ( st_info->verbose ) {
-
-        sf_printf("Will write "GT_size_cfmt" extra targets to disk (full data = %.1f MiB; collapsed data = ",
-                  (GT_size) time_vars, st_info->N * mib_base);
-        sf_printf ((st_info->J * mib_base > 1)? "%.1f": "%.2g", st_info->J * mib_base);
+    if ( st_info->verbose && (model.spm >= 0) ) {
+        sf_printf(used_io?
+                  "Will write "GT_size_cfmt" extra targets to disk (full data = %.1f MiB; collapsed data = ":
+                  "Will add "GT_size_cfmt" extra targets in memory (full data = %.1f MiB; collapsed data = ",
+                  inputs.kextra, decision.mib_full);
+        sf_printf ((decision.mib_collapsed > 1)? "%.1f": "%.2g", decision.mib_collapsed);
         sf_printf(" MiB).\n");
 
+        sf_printf("\tDisk model (%s): %.3g seconds + %.3g seconds per MiB written and read back.\n",
+                  source, model.latency, model.spm);
+
+        if ( inputs.mib_disk >= 0 ) sf_printf("\tFree disk space: %.1f MiB.\n", inputs.mib_disk);
+        if ( inputs.mib_mem  >= 0 ) sf_printf("\tFree memory: %.1f MiB.\n", inputs.mib_mem);
+
         sf_printf("\tAdding targets before collapse estimated to take ");
-        sf_printf ((st_time > 1)? "%.1f": "%.2g", st_time);
+        sf_printf ((decision.time_mem > 1)? "%.1f": "%.2g", decision.time_mem);
         sf_printf(" seconds.\n");
 
         sf_printf("\tAdding targets after collapse estimated to take ");
-        sf_printf ((time_cstata > 1)? "%.1f": "%.2g", time_cstata);
+        sf_printf ((decision.time_cstata > 1)? "%.1f": "%.2g", decision.time_cstata);
         sf_printf(" seconds.\n");
 
         sf_printf("\tWriting/reading targets to/from disk estimated to take ");
-        sf_printf ((time_c > 1)? "%.1f": "%.2g", time_c);
+        sf_printf ((decision.time_io > 1)? "%.1f": "%.2g", decision.time_io);
         sf_printf(" seconds.\n");
 
-        if ( used_io ) {
+        if ( used_io && (decision.time_disk >= decision.time_mem) ) {
+            sf_printf("Targets would not fit in free memory before collapse; will write to disk.\n");
+        }
+        else if ( used_io ) {
             sf_printf("Will write to disk and read back later to save time.\n");
         }
+        else if ( decision.time_disk < decision.time_mem ) {
+            sf_printf("Not enough free disk space; will do operations in memory.\n");
+        }
         else {
             sf_printf("Writing to disk too slow; will do operations in memory.\n");
         }
@@ -1251,9 +1482,9 @@ ST_retcode sf_switch_mem (struct StataInfo *st_info, int level)
     GT_size i, j;
     clock_t timer = clock();
 
-    st_info->index = calloc(st_info->N,     sizeof(st_info->index));
-    st_info->ix    = calloc(st_info->J,     sizeof(st_info->ix));
-    st_info->info  = calloc(st_info->J + 1, sizeof(st_info->info));
+    st_info->index = gf_arena_calloc(st_info->arena, st_info->N,     sizeof(st_info->index));
+    st_info->ix    = gf_arena_calloc(st_info->arena, st_info->J,     sizeof(st_info->ix));
+    st_info->info  = gf_arena_calloc(st_info->arena, st_info->J + 1, sizeof(st_info->info));
 
     if ( st_info->index == NULL ) return(sf_oom_error("sf_switch_mem", "st_info->index"));
     if ( st_info->info  == NULL ) return(sf_oom_error("sf_switch_mem", "st_info->info"));
@@ -1287,79 +1518,3 @@ ST_retcode sf_switch_mem (struct StataInfo *st_info, int level)
 exit:
     return (rc);
 }
-
-/**
- * @brief Clean up st_info
- *
- * @param st_info Pointer to container structure for Stata info
- * @return Frees memory allocated to st_info objects
- */
-void sf_free (struct StataInfo *st_info, int level)
-{
-    if ( st_info->free >= 1 ) {
-        free (st_info->invert);
-        free (st_info->missval);
-        free (st_info->byvars_lens);
-        free (st_info->group_targets);
-        free (st_info->group_init);
-        free (st_info->pos_num_byvars);
-        free (st_info->pos_str_byvars);
-        free (st_info->pos_targets);
-        free (st_info->statcode);
-        free (st_info->contract_which);
-        free (st_info->xtile_quantiles);
-        free (st_info->xtile_cutoffs);
-
-        GTOOLS_GC_FREED("st_info->invert")
-        GTOOLS_GC_FREED("st_info->missval")
-        GTOOLS_GC_FREED("st_info->byvars_lens")
-        GTOOLS_GC_FREED("st_info->group_targets")
-        GTOOLS_GC_FREED("st_info->group_init")
-        GTOOLS_GC_FREED("st_info->pos_num_byvars")
-        GTOOLS_GC_FREED("st_info->pos_str_byvars")
-        GTOOLS_GC_FREED("st_info->pos_targets")
-        GTOOLS_GC_FREED("st_info->statcode")
-        GTOOLS_GC_FREED("st_info->contract_which")
-        GTOOLS_GC_FREED("st_info->xtile_quantiles")
-        GTOOLS_GC_FREED("st_info->xtile_cutoffs")
-    }
-    if ( (st_info->free >= 2) & (level != 11) ) {
-        free (st_info->positions);
-        free (st_info->byvars_mins);
-        free (st_info->byvars_maxs);
-
-        GTOOLS_GC_FREED("st_info->positions")
-        GTOOLS_GC_FREED("st_info->byvars_mins")
-        GTOOLS_GC_FREED("st_info->byvars_maxs")
-    }
-    if ( (st_info->free >= 3) & (st_info->free <= 5) & (level != 11) ) {
-        free (st_info->st_numx);
-        free (st_info->st_charx);
-
-        GTOOLS_GC_FREED("st_info->st_numx")
-        GTOOLS_GC_FREED("st_info->st_charx")
-    }
-    if ( st_info->free >= 4 ) {
-        free (st_info->info);
-        GTOOLS_GC_FREED("st_info->info")
-    }
-    if ( st_info->free >= 5 ) {
-        free (st_info->index);
-        GTOOLS_GC_FREED("st_info->index")
-    }
-    if ( st_info->free >= 7 ) {
-        free (st_info->ix);
-        GTOOLS_GC_FREED("st_info->ix")
-    }
-    if ( (st_info->free >= 6) & (st_info->free <= 7) & (level != 11) ) {
-        free (st_info->st_by_numx);
-        free (st_info->st_by_charx);
-
-        GTOOLS_GC_FREED("st_info->st_by_numx")
-        GTOOLS_GC_FREED("st_info->st_by_charx")
-    }
-    if ( st_info->free >= 9 ) {
-        free (st_info->output);
-        GTOOLS_GC_FREED("st_info->output")
-    }
-}
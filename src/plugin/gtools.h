@@ -51,6 +51,9 @@
 #include <inttypes.h>
 #include <sys/types.h>
 
+#include "common/gtools_arena.h"
+#include "common/gtools_telemetry.h"
+
 // Container structure for Stata-provided info
 struct StataInfo {
     GT_size   start;
@@ -63,7 +66,8 @@ struct StataInfo {
     GT_size   nj_max;
     GT_size   strmax;
     GT_size   rowbytes;
-    GT_size   free;
+    GT_size   keybytes;
+    GT_size   strxbytes;
     GT_size   strbuffer;
     GT_size   sep_len;
     GT_size   colsep_len;
@@ -86,6 +90,8 @@ struct StataInfo {
     GT_size   top_lother;
     GT_size   top_lmiss;
     //
+    ST_double approx_eps;
+    //
     GT_size xtile_xvars;
     GT_size xtile_nq;
     GT_size xtile_nq2;
@@ -108,9 +114,13 @@ struct StataInfo {
     GT_bool xtile_cutby;
     //
     GT_bool   hash_method;
+    GT_bool   verify;
     GT_bool   wcode;
     GT_bool   nunique;
     GT_bool   sorted;
+    GT_bool   hashtable;
+    GT_bool   cache_hit;
+    GT_bool   byvars_intonly;
     GT_bool   cleanstr;
     GT_bool   init_targ;
     GT_bool   any_if;
@@ -130,6 +140,10 @@ struct StataInfo {
     GT_bool   used_io;
     //
     GT_size   wpos;
+    GT_size   threads;
+    GT_size   cache;
+    uint64_t  cache_fp1;
+    uint64_t  cache_fp2;
     GT_size   kvars_group;
     GT_size   kvars_sources;
     GT_size   kvars_targets;
@@ -160,13 +174,19 @@ struct StataInfo {
     GT_size   *ix;
     GT_size   *index;
     GT_size   *info;
+    GT_size   *st_strcode;
     ST_double *output;
     ST_double *st_numx;
     ST_double *st_by_numx;
     char *st_charx;
     char *st_by_charx;
+    char *st_strx;
+    char *st_by_strx;
     //
+    char *cache_file;
     char *gc_info;
+    struct GtoolsArena *arena;
+    struct GtoolsTelemetry *telemetry;
 };
 
 
@@ -198,25 +218,60 @@ struct StataInfo {
 #define GTOOLS_PWMAX(a, b) ( (a) > (b) ? (a) : (b) )
 #define GTOOLS_PWMIN(a, b) ( (a) > (b) ? (b) : (a) )
 
-// Check if you're actually cleaning up after yourself
-#define GTOOLS_GC_INIT                              \
-    st_info->gc_info = malloc(4096 * sizeof(char)); \
-    memset (st_info->gc_info, '\0', 4096 * sizeof(char));
+// Hint that memory will be read soon (no-op if the compiler lacks it)
+#if defined(__GNUC__) || defined(__clang__)
+#define GTOOLS_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define GTOOLS_PREFETCH(addr)
+#endif
+
+// If any by variable is a string, rows of by variables (st_charx,
+// st_by_charx) have an 8-byte slot per variable: numbers are stored in
+// place and strings as a reference to a NUL-terminated string in a
+// packed arena (st_strx, st_by_strx), with its offset and length. Only
+// the actual bytes of each string are stored, not its declared width.
+#define GTOOLS_STRREF(off, len) ( (((uint64_t) (off)) << 16) | ((uint64_t) (len)) )
+#define GTOOLS_STRREF_OFF(ref)  ( (GT_size) ((ref) >> 16) )
+#define GTOOLS_STRREF_LEN(ref)  ( (GT_size) ((ref) & 0xFFFF) )
+#define GTOOLS_STRREF_GET(slot) ( *((uint64_t *) (slot)) )
+#define GTOOLS_STRREF_STR(strx, slot) ( (strx) + GTOOLS_STRREF_OFF(GTOOLS_STRREF_GET(slot)) )
+
+// Initial bytes per string in the arena; it grows as needed (up to the
+// declared width of the strings)
+#define GTOOLS_STRX_INIT 16
+
+// Check if you're actually cleaning up after yourself. Only compiled in
+// with -DGTOOLS_GC_DEBUG; entries that do not fit in the log are dropped.
+#ifdef GTOOLS_GC_DEBUG
+
+#define GTOOLS_GC_SIZE 4096
+
+#define GTOOLS_GC_INIT \
+    st_info->gc_info = calloc(GTOOLS_GC_SIZE, sizeof(char));
 
-#define GTOOLS_GC_ALLOCATED(a)                \
-    strcat (st_info->gc_info, "allocated: "); \
-    strcat (st_info->gc_info, (a));           \
-    strcat (st_info->gc_info, "\n");
+#define GTOOLS_GC_LOG(what, a)                                     \
+    if ( st_info->gc_info != NULL ) {                              \
+        size_t _gc_len = strlen(st_info->gc_info);                 \
+        snprintf (st_info->gc_info + _gc_len, GTOOLS_GC_SIZE - _gc_len, \
+                  "%s: %s\n", (what), (a));                        \
+    }
 
-#define GTOOLS_GC_FREED(f)                \
-    strcat (st_info->gc_info, "freed: "); \
-    strcat (st_info->gc_info, (f));       \
-    strcat (st_info->gc_info, "\n");
+#define GTOOLS_GC_ALLOCATED(a) GTOOLS_GC_LOG("allocated", a)
+#define GTOOLS_GC_FREED(f)     GTOOLS_GC_LOG("freed", f)
 
-#define GTOOLS_GC_END(p)                      \
-    if ( p ) printf ("%s", st_info->gc_info); \
+#define GTOOLS_GC_END(p)                                       \
+    if ( p && (st_info->gc_info != NULL) ) printf ("%s", st_info->gc_info); \
     free (st_info->gc_info);
 
+#else
+
+#define GTOOLS_GC_INIT
+#define GTOOLS_GC_ALLOCATED(a)
+#define GTOOLS_GC_FREED(f)
+#define GTOOLS_GC_END(p)
+
+#endif
+
 // Switch missing values
 #define GTOOLS_SWITCH_MISSING                                                \
          if ( z <= SV_missval )             strpos += sprintf(strpos, ".");  \
@@ -253,6 +308,13 @@ struct StataInfo {
 
 // statvfs is POSIX only; repalce with dummies on windows
 #define GTOOLS_QUERY_FREE_SPACE 0
+
+// mmap is POSIX only; cache and spill files are read with stdio on windows
+// (both are always written with stdio)
+#define GTOOLS_MMAP 0
+
+// getrusage is POSIX only; peak RSS is reported as missing on windows
+#define GTOOLS_PEAK_RSS 0
 struct statvfs {
     int f_bsize;
     int f_bfree;
@@ -277,10 +339,19 @@ char * strndup (const char *s, size_t n)
 #define GTOOLS_QUERY_FREE_SPACE 1
 #include <sys/statvfs.h>
 
+// Use mmap to read the group index cache and spill files
+#define GTOOLS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Use getrusage for the peak RSS in the telemetry
+#define GTOOLS_PEAK_RSS 1
+#include <sys/resource.h>
+
 #endif
 
 // Functions
-void sf_free (struct StataInfo *st_info, int level);
 
 ST_retcode sf_parse_info  (struct StataInfo *st_info, int level);
 ST_retcode sf_hash_byvars (struct StataInfo *st_info, int level);
@@ -0,0 +1,230 @@
+#include "gtools_cache.h"
+
+/**
+ * @brief Fingerprint of the by variables and the observations selected
+ *
+ * 128-bit spooky hash of every setting that affects the group index
+ * (sort order, missing values, hash method, etc.), the observations
+ * read in, and the by variables as read into st_numx or st_charx and
+ * st_strx.
+ *
+ * @param st_info Meta structure with all the variables and data
+ * @param index Stata observation of each row read in
+ * @param fp1 First half of the fingerprint
+ * @param fp2 Second half of the fingerprint
+ * @return Stores fingerprint in @fp1, @fp2
+ */
+void gf_cache_fingerprint (
+    struct StataInfo *st_info,
+    GT_size *index,
+    uint64_t *fp1,
+    uint64_t *fp2)
+{
+    spookyhash_context context;
+
+    GT_size kvars = st_info->kvars_by;
+    GT_size settings[] = {
+        st_info->N,
+        st_info->Nread,
+        st_info->in1,
+        st_info->any_if,
+        st_info->missing,
+        st_info->nomiss,
+        st_info->unsorted,
+        st_info->countonly,
+        st_info->hash_method,
+        st_info->verify,
+        kvars,
+        st_info->rowbytes
+    };
+
+    spookyhash_context_init (&context, 0, 1);
+    spookyhash_update (&context, settings, sizeof(settings));
+    spookyhash_update (&context, st_info->byvars_lens, kvars * sizeof(GT_size));
+    spookyhash_update (&context, st_info->invert, kvars * sizeof(GT_size));
+    spookyhash_update (&context, index, st_info->N * sizeof(GT_size));
+
+    if ( st_info->kvars_by_str > 0 ) {
+        spookyhash_update (&context, st_info->st_charx, st_info->N * st_info->rowbytes);
+        spookyhash_update (&context, st_info->st_strx, st_info->strxbytes);
+    }
+    else {
+        spookyhash_update (&context, st_info->st_numx, st_info->N * kvars * sizeof(ST_double));
+    }
+
+    spookyhash_final (&context, fp1, fp2);
+}
+
+/**
+ * @brief Load the group index from the cache, if it is current
+ *
+ * Fingerprint the by variables just read in and look for a cache file
+ * with the same fingerprint. If there is one, set up index, ix, info and
+ * J as sf_hash_byvars would have. Any problem reading the cache simply
+ * means there is no cache hit.
+ *
+ * @param st_info Meta structure with all the variables and data
+ * @param index Stata observation of each row read in
+ * @return Sets st_info->cache_hit and, if 1, the group index
+ */
+ST_retcode sf_cache_load (struct StataInfo *st_info, GT_size *index)
+{
+    size_t bytes, expected;
+    struct GtoolsCacheHeader header;
+    char *map, *pos;
+
+    st_info->cache_hit = 0;
+    gf_cache_fingerprint (st_info, index, &(st_info->cache_fp1), &(st_info->cache_fp2));
+
+    if ( (map = gf_file_map (st_info->cache_file, &bytes)) == NULL ) {
+        if ( st_info->verbose ) sf_printf("(no group index cache found)\n");
+        return (0);
+    }
+
+    if ( bytes < sizeof(header) ) goto miss;
+    memcpy (&header, map, sizeof(header));
+
+    if ( memcmp(header.magic, GTOOLS_CACHE_MAGIC, sizeof(header.magic)) ) goto miss;
+    if ( header.fp1 != st_info->cache_fp1 ) goto miss;
+    if ( header.fp2 != st_info->cache_fp2 ) goto miss;
+    if ( header.N   != st_info->N         ) goto miss;
+
+    expected = sizeof(header)
+             + header.N * sizeof(GT_size) * (header.ixcopy? 2: 1)
+             + (header.J + 1) * sizeof(GT_size);
+
+    if ( bytes != expected ) goto miss;
+
+    st_info->index = gf_arena_calloc(st_info->arena, st_info->N, sizeof(st_info->index));
+    st_info->info  = gf_arena_calloc(st_info->arena, header.J + 1, sizeof(st_info->info));
+
+    if ( st_info->index == NULL ) return (sf_oom_error("sf_cache_load", "st_info->index"));
+    if ( st_info->info  == NULL ) return (sf_oom_error("sf_cache_load", "st_info->info"));
+
+    GTOOLS_GC_ALLOCATED("st_info->index")
+    GTOOLS_GC_ALLOCATED("st_info->info")
+
+    pos = map + sizeof(header);
+    memcpy (st_info->index, pos, st_info->N * sizeof(GT_size));
+    pos += st_info->N * sizeof(GT_size);
+
+    if ( header.ixcopy ) {
+        st_info->ix = gf_arena_calloc(st_info->arena, st_info->N, sizeof(st_info->ix));
+        if ( st_info->ix == NULL ) return (sf_oom_error("sf_cache_load", "st_info->ix"));
+        GTOOLS_GC_ALLOCATED("st_info->ix")
+
+        memcpy (st_info->ix, pos, st_info->N * sizeof(GT_size));
+        pos += st_info->N * sizeof(GT_size);
+    }
+    else {
+        st_info->ix = st_info->index;
+    }
+
+    memcpy (st_info->info, pos, (header.J + 1) * sizeof(GT_size));
+
+    st_info->J      = header.J;
+    st_info->nj_min = header.nj_min;
+    st_info->nj_max = header.nj_max;
+    st_info->biject = header.biject;
+    st_info->sorted = header.sorted;
+    st_info->cache_hit = 1;
+
+    if ( st_info->verbose )
+        sf_printf("Loaded group index from cache ("GT_size_cfmt" groups)\n", st_info->J);
+
+    gf_file_unmap (map, bytes);
+    return (0);
+
+miss:
+    if ( st_info->verbose )
+        sf_printf("(group index cache out of date; will rebuild)\n");
+    gf_file_unmap (map, bytes);
+    return (0);
+}
+
+/**
+ * @brief Write @bytes of @data to @fhandle in chunks
+ *
+ * @return 0 if every chunk was written in full
+ */
+static GT_bool gf_cache_write (FILE *fhandle, void *data, size_t bytes)
+{
+    size_t chunk;
+    char *pos = (char *) data;
+    while ( bytes > 0 ) {
+        chunk = bytes < GTOOLS_CACHE_CHUNK? bytes: GTOOLS_CACHE_CHUNK;
+        if ( fwrite(pos, 1, chunk, fhandle) != chunk ) return (1);
+        pos   += chunk;
+        bytes -= chunk;
+    }
+    return (0);
+}
+
+/**
+ * @brief Save the group index to the cache
+ *
+ * Called from sf_check_hash once the group index has been verified (and
+ * before ix is replaced by the group order). The file is written to a
+ * temporary name and then renamed, so a failed write never leaves a
+ * partial cache behind. It is written with stdio rather than through a
+ * mapping, so a full disk is a failed (checked) write instead of a bus
+ * error. Failing to write the cache is not an error.
+ *
+ * @param st_info Meta structure with all the variables and data
+ * @return Writes cache file st_info->cache_file
+ */
+ST_retcode sf_cache_save (struct StataInfo *st_info)
+{
+    struct GtoolsCacheHeader header;
+    size_t flength;
+    FILE *fhandle;
+
+    memset (&header, '\0', sizeof(header));
+    memcpy (header.magic, GTOOLS_CACHE_MAGIC, sizeof(header.magic));
+    header.fp1    = st_info->cache_fp1;
+    header.fp2    = st_info->cache_fp2;
+    header.N      = st_info->N;
+    header.J      = st_info->J;
+    header.nj_min = st_info->nj_min;
+    header.nj_max = st_info->nj_max;
+    header.biject = st_info->biject;
+    header.sorted = st_info->sorted;
+    header.ixcopy = (st_info->ix != st_info->index);
+
+    flength = strlen(st_info->cache_file) + 5;
+    GTOOLS_CHAR (tmpname, flength);
+    sprintf (tmpname, "%s.tmp", st_info->cache_file);
+
+    if ( (fhandle = fopen(tmpname, "wb")) == NULL ) goto error;
+
+    if ( gf_cache_write(fhandle, &header, sizeof(header))
+      || gf_cache_write(fhandle, st_info->index, header.N * sizeof(GT_size))
+      || (header.ixcopy && gf_cache_write(fhandle, st_info->ix, header.N * sizeof(GT_size)))
+      || gf_cache_write(fhandle, st_info->info, (header.J + 1) * sizeof(GT_size)) ) {
+        fclose (fhandle);
+        goto error;
+    }
+
+    if ( fclose(fhandle) ) goto error;
+
+#if !GTOOLS_MMAP
+    // rename does not replace an existing file on windows
+    remove (st_info->cache_file);
+#endif
+
+    if ( rename(tmpname, st_info->cache_file) ) goto error;
+
+    if ( st_info->verbose )
+        sf_printf("Saved group index to cache\n");
+
+    free (tmpname);
+    return (0);
+
+error:
+    if ( st_info->verbose )
+        sf_printf("(unable to save group index cache to %s)\n", st_info->cache_file);
+
+    remove (tmpname);
+    free (tmpname);
+    return (0);
+}
@@ -0,0 +1,46 @@
+#ifndef GTOOLS_CACHE
+#define GTOOLS_CACHE
+
+/*
+ * Group index cache
+ * -----------------
+ *
+ * With option cache (or $GTOOLS_CACHE) the group index built by
+ * sf_hash_byvars (index, ix, info, J and how the groups were found) is
+ * saved to a temporary file after sf_check_hash has verified it. The file
+ * name is derived from the by variables and the if/in condition; the file
+ * is reused only if a fingerprint of the settings, the selected
+ * observations and the by variables themselves matches, in which case the
+ * hash, sort, panel setup, and collision check are all skipped.
+ *
+ * Layout: header, index (N), ix (N; only if distinct from index), info
+ * (J + 1).
+ */
+
+#define GTOOLS_CACHE_MAGIC "GTCACHE1"
+#define GTOOLS_CACHE_CHUNK (4 * 1024 * 1024)
+
+struct GtoolsCacheHeader {
+    char     magic[8];
+    uint64_t fp1;
+    uint64_t fp2;
+    uint64_t N;
+    uint64_t J;
+    uint64_t nj_min;
+    uint64_t nj_max;
+    uint64_t biject;
+    uint64_t sorted;
+    uint64_t ixcopy;
+};
+
+void gf_cache_fingerprint (
+    struct StataInfo *st_info,
+    GT_size *index,
+    uint64_t *fp1,
+    uint64_t *fp2
+);
+
+ST_retcode sf_cache_load (struct StataInfo *st_info, GT_size *index);
+ST_retcode sf_cache_save (struct StataInfo *st_info);
+
+#endif
@@ -1,5 +1,9 @@
 #include "gtools_hash.h"
 #include "gtools_sort.c"
+#include "gtools_hashtable.c"
+#include "gtools_strdict.c"
+#include "gtools_cache.c"
+#include "gtools_prefix.c"
 
 ST_retcode gf_hash (
     uint64_t *h1,
@@ -13,19 +17,19 @@ ST_retcode gf_hash (
 
     GT_size i;
     uint64_t *h3;
+    struct GtoolsHashEngine *engine;
 
-    GT_bool sorted   = st_info->sorted;
-    GT_size N        = st_info->N;
-    GT_size rowbytes = st_info->rowbytes;
-    GT_size kvars    = st_info->kvars_by;
-    GT_size kstr     = st_info->kvars_by_str;
+    GT_bool sorted = st_info->sorted;
+    GT_size N      = st_info->N;
 
     // Hash the variables or biject
     // ----------------------------
 
     if ( st_info->biject ) {
         if ( (rc = gf_biject_varlist (h1, st_info)) ) goto exit;
+        gf_strdict_free (st_info);
 
+        gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_HASH);
         if ( st_info->benchmark > 2 )
             sf_running_timer (&stimer, "\t\tPlugin step 2.3: Bijected integers to natural numbers");
 
@@ -36,15 +40,17 @@ ST_retcode gf_hash (
         //     }
         // }
 
-        // Sort hash with index
-        // --------------------
+        // Sort hash with index (unless we will use a hash table)
+        // ------------------------------------------------------
 
-        if ( !sorted ) {
+        if ( !sorted & !st_info->hashtable ) {
             if ( (rc = gf_sort_hash (h1,
                                      ix,
                                      st_info->N,
-                                     st_info->verbose)) ) goto exit;
+                                     st_info->verbose,
+                                     st_info->telemetry)) ) goto exit;
 
+            gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_SORT);
             if ( st_info->benchmark > 2 )
                 sf_running_timer (&stimer, "\t\tPlugin step 2.4: Sorted integer-only hash");
         }
@@ -54,55 +60,74 @@ ST_retcode gf_hash (
     }
     else {
 
-        h3 = calloc(N, sizeof *h3);
-        if ( h3 == NULL ) sf_oom_error("sf_hash_byvars", "h3");
-        GTOOLS_GC_ALLOCATED("h3")
+        // The 64-bit engine leaves the second part of the hash at 0
+        engine = gf_hash_engine (st_info);
+        st_info->telemetry->hash = engine->name;
 
-        if ( kstr > 0 ) {
-            // sorted = MultiSortCheckMC (st_info->st_charx,
-            //                            st_info->N,
-            //                            0,
-            //                            st_info->kvars_by - 1,
-            //                            st_info->rowbytes,
-            //                            st_info->byvars_lens,
-            //                            st_info->invert,
-            //                            st_info->positions);
-
-            for (i = 0; i < N; i++) {
-                spookyhash_128(st_info->st_charx + (i * rowbytes),
-                               rowbytes, h1 + i, h3 + i);
-            }
+        h3 = NULL;
+        if ( engine->bits128 ) {
+            h3 = calloc(N, sizeof *h3);
+            if ( h3 == NULL ) return (sf_oom_error("sf_hash_byvars", "h3"));
+            GTOOLS_GC_ALLOCATED("h3")
         }
-        else {
-            // sorted = MultiSortCheckDbl(st_info->st_numx,
-            //                            st_info->N,
-            //                            0,
-            //                            st_info->kvars_by - 1,
-            //                            st_info->kvars_by * sizeof(ST_double),
-            //                            st_info->invert);
-
-            for (i = 0; i < N; i++) {
-                spookyhash_128(st_info->st_numx + i * kvars,
-                               sizeof(ST_double) * kvars, h1 + i, h3 + i);
+
+        // Each task hashes a contiguous block of rows; the blocks are
+        // spread over the shared thread pool (serial in the single-thread
+        // plugin, where there is only one task).
+        GT_size ntasks = gf_pool_ntasks(N);
+        struct hInfo *hinfo = calloc(ntasks, sizeof *hinfo);
+        if ( hinfo == NULL ) return (sf_oom_error("sf_hash_byvars", "hinfo"));
+
+        // With several by variables and any strings, each spooky task
+        // spells out a row's key in its own buffer before hashing it.
+        for (i = 0; i < ntasks; i++) {
+            hinfo[i].h1      = h1;
+            hinfo[i].h3      = h3;
+            hinfo[i].st_info = st_info;
+            hinfo[i].key     = NULL;
+            gf_pool_split (N, ntasks, i, &(hinfo[i].start), &(hinfo[i].end));
+            if ( (engine->phash == gf_phash) & (st_info->kvars_by_str > 0) & (st_info->kvars_by > 1) ) {
+                if ( (hinfo[i].key = malloc(st_info->keybytes)) == NULL ) rc = 1702;
             }
         }
 
+        if ( rc == 0 ) gf_pool_run (engine->phash, hinfo, sizeof *hinfo, ntasks);
+
+        for (i = 0; i < ntasks; i++)
+            free (hinfo[i].key);
+        free (hinfo);
+
+        if ( rc ) {
+            free (h3);
+            return (sf_oom_error("sf_hash_byvars", "hinfo[i].key"));
+        }
+
+        gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_HASH);
         if ( st_info->benchmark > 2 )
-            sf_running_timer (&stimer, "\t\tPlugin step 2.3: Hashed variables (128-bit)");
+            sf_running_timer (&stimer, engine->bits128?
+                              "\t\tPlugin step 2.3: Hashed variables (128-bit)":
+                              "\t\tPlugin step 2.3: Hashed variables (64-bit)");
 
-        // Sort hash with index
-        // --------------------
+        // Sort hash with index (unless we will use a hash table)
+        // ------------------------------------------------------
 
-        if ( !sorted ) {
+        if ( !sorted & !st_info->hashtable ) {
             if ( (rc = gf_sort_hash (h1,
                                      ix,
                                      st_info->N,
-                                     st_info->verbose)) ) goto exit;
+                                     st_info->verbose,
+                                     st_info->telemetry)) ) goto exit;
 
-            for (i = 0; i < st_info->N; i++) {
-                h2[i] = h3[ix[i]];
+            if ( h3 != NULL ) {
+                for (i = 0; i < st_info->N; i++) {
+                    h2[i] = h3[ix[i]];
+                }
+            }
+            else {
+                memset (h2, 0, N * sizeof *h2);
             }
 
+            gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_SORT);
             if ( st_info->benchmark > 2 )
                 sf_running_timer (&stimer, "\t\tPlugin step 2.4: Sorted integer-only hash");
         }
@@ -110,22 +135,281 @@ ST_retcode gf_hash (
             // if ( st_info->verbose )
             //     sf_printf("(already sorted)\n");
 
-            for (i = 0; i < st_info->N; i++) {
-                h2[i] = h3[i];
+            if ( h3 != NULL ) {
+                for (i = 0; i < st_info->N; i++) {
+                    h2[i] = h3[i];
+                }
+            }
+            else {
+                memset (h2, 0, N * sizeof *h2);
             }
         }
 
         // Copy back second part of the hash in correct order
         // --------------------------------------------------
 
-        free (h3);
-        GTOOLS_GC_FREED("h3")
+        if ( h3 != NULL ) {
+            free (h3);
+            GTOOLS_GC_FREED("h3")
+        }
     }
 
 exit:
     return (rc);
 }
 
+/**
+ * @brief Hash a block of rows (one pool task)
+ *
+ * Only the actual bytes of strings are hashed: a single string is hashed
+ * in place in the string arena; otherwise the row's key is spelled out
+ * in the task's buffer first (see gf_strx_key).
+ *
+ * @param argument hInfo with output arrays and the [start, end) rows to hash
+ * @return Stores 128-bit hash of rows start to end - 1 in @h1 and @h3
+ */
+void* gf_phash (void *argument)
+{
+    struct hInfo *hinfo = ((struct hInfo *) argument);
+    struct StataInfo *st_info = hinfo->st_info;
+
+    GT_size i;
+    uint64_t ref;
+    GT_size rowbytes = st_info->rowbytes;
+    GT_size kvars    = st_info->kvars_by;
+
+    if ( (st_info->kvars_by_str > 0) & (kvars == 1) ) {
+        for (i = hinfo->start; i < hinfo->end; i++) {
+            ref = GTOOLS_STRREF_GET(st_info->st_charx + i * rowbytes);
+            spookyhash_128(st_info->st_strx + GTOOLS_STRREF_OFF(ref),
+                           GTOOLS_STRREF_LEN(ref), hinfo->h1 + i, hinfo->h3 + i);
+        }
+    }
+    else if ( st_info->kvars_by_str > 0 ) {
+        for (i = hinfo->start; i < hinfo->end; i++) {
+            spookyhash_128(hinfo->key,
+                           gf_strx_key(st_info, st_info->st_charx + i * rowbytes, hinfo->key),
+                           hinfo->h1 + i, hinfo->h3 + i);
+        }
+    }
+    else {
+        for (i = hinfo->start; i < hinfo->end; i++) {
+            spookyhash_128(st_info->st_numx + i * kvars,
+                           sizeof(ST_double) * kvars, hinfo->h1 + i, hinfo->h3 + i);
+        }
+    }
+
+    return (NULL);
+}
+
+
+static struct GtoolsHashEngine GtoolsHashEngines[] = {
+    {"spooky", gf_phash,        1},
+    {"column", gf_phash_column, 1},
+    {"fast64", gf_phash_column, 0},
+};
+
+/**
+ * @brief Row-hash engine for __gtools_hash_method
+ *
+ * @param st_info Stata structure with meta info and data
+ * @return engine; spooky unless column or fast64 were requested
+ */
+struct GtoolsHashEngine *gf_hash_engine (struct StataInfo *st_info)
+{
+    if ( st_info->hash_method == GTOOLS_HASH_COLUMN ) return (GtoolsHashEngines + 1);
+    if ( st_info->hash_method == GTOOLS_HASH_FAST64 ) return (GtoolsHashEngines + 2);
+    return (GtoolsHashEngines);
+}
+
+/**
+ * @brief Mixers of the two lanes of the column engines
+ *
+ * Both are bijections of 64-bit integers: the finalizers of MurmurHash3
+ * and of SplitMix64.
+ */
+static inline uint64_t gf_hash_mix1 (uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return (x);
+}
+
+static inline uint64_t gf_hash_mix2 (uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return (x);
+}
+
+/**
+ * @brief Hash a block of rows column by column (one pool task)
+ *
+ * The rows are hashed GTOOLS_HASH_BLOCK at a time. Each lane starts at
+ * its seed and each by variable, in order, is folded in as h = mix(h ^ x),
+ * where x is the bits of a number or the spooky hash of a string (each
+ * lane takes one half of spookyhash_128). Since the mixers are
+ * bijections, two rows can only have the same hash if they differ in at
+ * least two variables or their strings collide.
+ *
+ * @param argument hInfo with output arrays and the [start, end) rows to hash
+ * @return Stores the hash of rows start to end - 1 in @h1 and, unless it
+ *         is NULL, @h3
+ */
+void* gf_phash_column (void *argument)
+{
+    struct hInfo *hinfo = ((struct hInfo *) argument);
+    struct StataInfo *st_info = hinfo->st_info;
+
+    GT_size i, k, start, end;
+    uint64_t x, y, ref;
+    char *pos;
+
+    uint64_t *h1     = hinfo->h1;
+    uint64_t *h3     = hinfo->h3;
+    GT_size rowbytes = st_info->rowbytes;
+    GT_size kvars    = st_info->kvars_by;
+    GT_size kstr     = st_info->kvars_by_str;
+
+    for (start = hinfo->start; start < hinfo->end; start = end) {
+        end = GTOOLS_PWMIN(start + GTOOLS_HASH_BLOCK, hinfo->end);
+
+        for (i = start; i < end; i++)
+            h1[i] = GTOOLS_HASH_SEED1;
+
+        if ( h3 != NULL ) {
+            for (i = start; i < end; i++)
+                h3[i] = GTOOLS_HASH_SEED2;
+        }
+
+        for (k = 0; k < kvars; k++) {
+            if ( kstr == 0 ) {
+                if ( h3 != NULL ) {
+                    for (i = start; i < end; i++) {
+                        memcpy (&x, st_info->st_numx + i * kvars + k, sizeof(x));
+                        h1[i] = gf_hash_mix1(h1[i] ^ x);
+                        h3[i] = gf_hash_mix2(h3[i] ^ x);
+                    }
+                }
+                else {
+                    for (i = start; i < end; i++) {
+                        memcpy (&x, st_info->st_numx + i * kvars + k, sizeof(x));
+                        h1[i] = gf_hash_mix1(h1[i] ^ x);
+                    }
+                }
+            }
+            else if ( st_info->byvars_lens[k] > 0 ) {
+                pos = st_info->st_charx + st_info->positions[k];
+                for (i = start; i < end; i++) {
+                    ref = GTOOLS_STRREF_GET(pos + i * rowbytes);
+                    if ( h3 != NULL ) {
+                        x = y = 0;
+                        spookyhash_128(st_info->st_strx + GTOOLS_STRREF_OFF(ref),
+                                       GTOOLS_STRREF_LEN(ref), &x, &y);
+                        h1[i] = gf_hash_mix1(h1[i] ^ x);
+                        h3[i] = gf_hash_mix2(h3[i] ^ y);
+                    }
+                    else {
+                        x = spookyhash_64(st_info->st_strx + GTOOLS_STRREF_OFF(ref),
+                                          GTOOLS_STRREF_LEN(ref), 0);
+                        h1[i] = gf_hash_mix1(h1[i] ^ x);
+                    }
+                }
+            }
+            else {
+                pos = st_info->st_charx + st_info->positions[k];
+                if ( h3 != NULL ) {
+                    for (i = start; i < end; i++) {
+                        memcpy (&x, pos + i * rowbytes, sizeof(x));
+                        h1[i] = gf_hash_mix1(h1[i] ^ x);
+                        h3[i] = gf_hash_mix2(h3[i] ^ x);
+                    }
+                }
+                else {
+                    for (i = start; i < end; i++) {
+                        memcpy (&x, pos + i * rowbytes, sizeof(x));
+                        h1[i] = gf_hash_mix1(h1[i] ^ x);
+                    }
+                }
+            }
+        }
+    }
+
+    return (NULL);
+}
+
+
+/**
+ * @brief Spell out the by variables of a row with strings
+ *
+ * Numbers take 8 bytes and strings their length plus the NUL, so two
+ * rows have the same key if and only if they have the same values.
+ *
+ * @param st_info Meta structure with all the variables and data
+ * @param row Row of st_charx
+ * @param key Where to write the key (at least st_info->keybytes)
+ * @return Length of the key
+ */
+GT_size gf_strx_key (struct StataInfo *st_info, char *row, char *key)
+{
+    GT_size k, len;
+    uint64_t ref;
+    char *pos = key;
+
+    for (k = 0; k < st_info->kvars_by; k++, row += sizeof(ST_double)) {
+        if ( st_info->byvars_lens[k] > 0 ) {
+            ref = GTOOLS_STRREF_GET(row);
+            len = GTOOLS_STRREF_LEN(ref) + 1;
+            memcpy (pos, st_info->st_strx + GTOOLS_STRREF_OFF(ref), len);
+            pos += len;
+        }
+        else {
+            memcpy (pos, row, sizeof(ST_double));
+            pos += sizeof(ST_double);
+        }
+    }
+
+    return (pos - key);
+}
+
+/**
+ * @brief Compare two rows of by variables with strings
+ *
+ * @param a Row of st_charx
+ * @param b Row of st_charx
+ * @param kvars Number of by variables
+ * @param ltypes Length of each string variable; 0 for numbers
+ * @param strx String arena the rows point into
+ * @return 0 if the rows have the same values; 1 otherwise
+ */
+GT_bool gf_strx_differ (char *a, char *b, GT_size kvars, GT_size *ltypes, char *strx)
+{
+    GT_size k;
+    uint64_t refa, refb;
+
+    for (k = 0; k < kvars; k++, a += sizeof(ST_double), b += sizeof(ST_double)) {
+        if ( ltypes[k] > 0 ) {
+            refa = GTOOLS_STRREF_GET(a);
+            refb = GTOOLS_STRREF_GET(b);
+            if ( refa == refb ) continue;
+            if ( GTOOLS_STRREF_LEN(refa) != GTOOLS_STRREF_LEN(refb) ) return (1);
+            if ( memcmp(strx + GTOOLS_STRREF_OFF(refa),
+                        strx + GTOOLS_STRREF_OFF(refb),
+                        GTOOLS_STRREF_LEN(refa)) ) return (1);
+        }
+        else if ( memcmp(a, b, sizeof(ST_double)) ) {
+            return (1);
+        }
+    }
+
+    return (0);
+}
 
 /**
  * @brief Use the grouping variables as a hassh
@@ -162,6 +446,9 @@ exit:
  *     ...
  *     ith-smallest # of vark -> vmap(k - 1) + i * range of vmap(k - 1)
  *
+ * String variables enter as their codes 1 to D (see gf_strdict_encode)
+ * and numbers are read from their slot in st_charx.
+ *
  * @param h1 Where to store the map to the whole nubmers
  * @param st_info Meta structure with all the variables and data
  * @return Store map to whole numbers in @h1
@@ -170,13 +457,16 @@ exit:
 ST_retcode gf_biject_varlist (uint64_t *h1, struct StataInfo *st_info)
 {
     ST_double z;
-    GT_size i, k, l;
+    GT_size i, k, l, s;
 
     GT_size N        = st_info->N;
     GT_size kvars    = st_info->kvars_by;
+    GT_size kstr     = st_info->kvars_by_str;
     GT_size offset   = 1;
     GT_size *offsets = calloc(kvars, sizeof *offsets);
-    if ( offsets == NULL ) sf_oom_error ("gf_biject_varlist", "offsets");
+    GT_size *strcol  = calloc(kvars, sizeof *strcol);
+    if ( offsets == NULL ) return (sf_oom_error ("gf_biject_varlist", "offsets"));
+    if ( strcol  == NULL ) return (sf_oom_error ("gf_biject_varlist", "strcol"));
 
     offsets[0] = 0;
     for (k = 0; k < kvars - 1; k++) {
@@ -193,6 +483,42 @@ ST_retcode gf_biject_varlist (uint64_t *h1, struct StataInfo *st_info)
     // not correct; it only works here because whenever there are extended
     // missing values, I use the spooky hash.
 
+    if ( kstr > 0 ) {
+        for (k = s = 0; k < kvars; k++) {
+            if ( st_info->byvars_lens[k] > 0 ) strcol[k] = s++;
+        }
+
+        for (i = 0; i < N; i++) {
+            for (k = 0; k < kvars; k++) {
+                l = kvars - (k + 1);
+                if ( st_info->byvars_lens[l] > 0 ) {
+                    z = st_info->st_strcode[i * kstr + strcol[l]];
+                }
+                else {
+                    z = *((ST_double *) (st_info->st_charx + i * st_info->rowbytes + st_info->positions[l]));
+                    if ( z == SV_missval ) z = st_info->byvars_maxs[l];
+                }
+
+                if ( k == 0 ) {
+                    if ( st_info->invert[l] ) {
+                        h1[i] = (st_info->byvars_maxs[l] - z + 1);
+                    }
+                    else {
+                        h1[i] = (z - st_info->byvars_mins[l] + 1);
+                    }
+                }
+                else if ( st_info->invert[l] ) {
+                    h1[i] += (st_info->byvars_maxs[l] - (GT_int) z) * offsets[k];
+                }
+                else {
+                    h1[i] += ((GT_int) z - st_info->byvars_mins[l]) * offsets[k];
+                }
+            }
+        }
+
+        goto exit;
+    }
+
     for (i = 0; i < N; i++) {
         l = kvars - (0 + 1);
         z = *(st_info->st_numx + i * kvars + l);
@@ -218,7 +544,9 @@ ST_retcode gf_biject_varlist (uint64_t *h1, struct StataInfo *st_info)
         // sf_printf ("\tObs %9d = "GT_size_cfmt"\n", i, h1[i]);
     }
 
+exit:
     free (offsets);
+    free (strcol);
     return (0);
 }
 
@@ -226,7 +554,9 @@ ST_retcode gf_biject_varlist (uint64_t *h1, struct StataInfo *st_info)
  * @brief Set up variables for panel using 128-bit hashes
  *
  * Using sorted 128-bit hashes, generate info array with start and
- * ending positions of each group in the sorted hash.
+ * ending positions of each group in the sorted hash. If gf_hash left
+ * the hash unsorted (st_info->hashtable) we group the rows with a hash
+ * table instead; see gf_panelsetup_hashtable.
  *
  * @param h1 Array of 64-bit integers containing first half of 128-bit hashes
  * @param h2 Array of 64-bit integers containing second half of 128-bit hashes
@@ -241,9 +571,17 @@ ST_retcode gf_panelsetup (
     GT_size *ix,
     const GT_bool hash_level)
 {
+    ST_retcode rc = 0;
+
+    // Group with a hash table if gf_hash left the hash unsorted; if the
+    // table gives up it sorts the hash and we carry on as usual.
+    if ( st_info->hashtable ) {
+        if ( (rc = gf_panelsetup_hashtable (h1, h2, st_info, ix, hash_level)) ) return (rc);
+        if ( st_info->hashtable ) return (0);
+    }
+
     if (hash_level == 0) return (gf_panelsetup_bijection (h1, st_info));
 
-    ST_retcode rc = 0;
     GT_size collision64 = 0;
     st_info->J = 1;
     GT_size i   = 0;
@@ -258,7 +596,7 @@ ST_retcode gf_panelsetup (
     GT_size   *ix_l;
     uint64_t *h2_l;
 
-    GT_size *info_largest = calloc(st_info->N + 1, sizeof *info_largest);
+    GT_size *info_largest = gf_arena_calloc(st_info->arena, st_info->N + 1, sizeof *info_largest);
     if ( info_largest == NULL ) return (sf_oom_error("gf_panelsetup", "info_largest"));
 
     info_largest[l++] = 0;
@@ -315,7 +653,7 @@ ST_retcode gf_panelsetup (
     info_largest[l] = st_info->N;
 
     st_info->J = l;
-    st_info->info = calloc(l + 1, sizeof st_info->info);
+    st_info->info = gf_arena_calloc(st_info->arena, l + 1, sizeof st_info->info);
     if ( st_info->info == NULL ) return (sf_oom_error("gf_panelsetup", "st_info->info"));
     GTOOLS_GC_ALLOCATED("st_info->info")
 
@@ -329,7 +667,7 @@ ST_retcode gf_panelsetup (
                   collision64);
 
 exit:
-    free (info_largest);
+    gf_arena_free (st_info->arena, info_largest);
     return (rc);
 }
 
@@ -371,7 +709,7 @@ ST_retcode gf_panelsetup_bijection (uint64_t *h1, struct StataInfo *st_info)
     GT_size l  = 0;
 
     uint64_t el = h1[i++];
-    GT_size *info_largest = calloc(st_info->N + 1, sizeof *info_largest);
+    GT_size *info_largest = gf_arena_calloc(st_info->arena, st_info->N + 1, sizeof *info_largest);
     if ( info_largest == NULL ) return (sf_oom_error("gf_panelsetup_bijection", "info_largest"));
 
     info_largest[l++] = 0;
@@ -387,14 +725,14 @@ ST_retcode gf_panelsetup_bijection (uint64_t *h1, struct StataInfo *st_info)
     info_largest[l] = st_info->N;
 
     st_info->J = l;
-    st_info->info = calloc(l + 1, sizeof st_info->info);
+    st_info->info = gf_arena_calloc(st_info->arena, l + 1, sizeof st_info->info);
     if ( st_info->info == NULL ) return (sf_oom_error("gf_panelsetup_bijection", "st_info->info"));
     GTOOLS_GC_ALLOCATED("st_info->info")
 
     for (i = 0; i < l + 1; i++)
         st_info->info[i] = info_largest[i];
 
-    free (info_largest);
+    gf_arena_free (st_info->arena, info_largest);
 
     return (0);
 }
@@ -410,7 +748,7 @@ ST_retcode gf_panelsetup_bijection (uint64_t *h1, struct StataInfo *st_info)
  */
 int sf_check_hash (struct StataInfo *st_info, int level)
 {
-    GT_size i, j, k;
+    GT_size j, k;
     GT_size kvars   = st_info->kvars_by;
     GT_size kstr    = st_info->kvars_by_str;
     ST_retcode rc  = 0;
@@ -421,7 +759,7 @@ int sf_check_hash (struct StataInfo *st_info, int level)
     // multisort will be skipped. // 2017-11-21 08:02 EST
 
     st_info->strbuffer = 0;
-    if ( st_info->biject ) {
+    if ( st_info->biject | st_info->cache_hit ) {
         goto bycopy;
     }
 
@@ -430,170 +768,32 @@ int sf_check_hash (struct StataInfo *st_info, int level)
      *********************************************************************/
 
     GT_bool multisort, skipbycopy;
-    GT_size start, end, sel, selx, numpos, strpos, rowbytes;
-    GT_size l_str  = 0;
-    GT_size k_num  = 0;
-    GTOOLS_MAX (st_info->byvars_lens, kvars, kmax, k);
-
-    // Figure out the number of numeric by variables and the combined string
-    // length of string by variables.
-    for (k = 0; k < kvars; k++) {
-        if (st_info->byvars_lens[k] > 0) {
-            l_str += st_info->byvars_lens[k];
-        }
-        else {
-            k_num += 1;
-        }
-    }
-    l_str = l_str > 0? (l_str + 1): 1;
-
-    // Will compare string in st_strbase to st_strcomp and number as are being
-    // read to numbers in st_numbase and st_nummiss
-    ST_double z;
-
-    GT_size klen = kmax > 0? (kmax + 1): 1;
-    char *s  = malloc(klen * sizeof(char)); memset (s, '\0', klen);
-    char *st_strbase = malloc(l_str * sizeof(char)); memset (st_strbase, '\0', l_str);
-    char *st_strcomp = malloc(l_str * sizeof(char)); memset (st_strcomp, '\0', l_str);
-
-    if ( st_strbase == NULL ) return(sf_oom_error("sf_check_hash_index", "st_strbase"));
-    if ( st_strcomp == NULL ) return(sf_oom_error("sf_check_hash_index", "st_strcomp"));
-
-    ST_double *st_numbase = calloc(k_num > 0? k_num: 1, sizeof *st_numbase);
-    GT_bool   *st_nummiss = calloc(k_num > 0? k_num: 1, sizeof *st_nummiss);
+    GT_size sel, selx, rowbytes, collisions_count, strpos;
+    uint64_t ref;
 
-    if ( st_numbase == NULL ) return(sf_oom_error("sf_check_hash_index", "st_numbase"));
-    if ( st_nummiss == NULL ) return(sf_oom_error("sf_check_hash_index", "st_nummiss"));
+    if ( st_info->verify == 0 ) {
+        if ( st_info->verbose )
+            sf_printf("Skipped check for hash collisions (verify off)\n");
+        goto bycopy;
+    }
 
-    GT_size collisions_count = 0;
-    GT_size collisions_row   = 0;
+    // fast64 already compared every row to its group (see sf_hash_byvars)
+    if ( st_info->hash_method == GTOOLS_HASH_FAST64 ) {
+        if ( st_info->verbose )
+            sf_printf("Skipped check for hash collisions (checked with the 64-bit hash)\n");
+        goto bycopy;
+    }
 
     /*********************************************************************
-     *             Allocate memory to final collapsed array              *
+     *                     Check for hash collisions                     *
      *********************************************************************/
 
-    if ( kstr > 0 ) {
-        for (j = 0; j < st_info->J; j++) {
-            memset (st_strbase, '\0', l_str);
-            start  = i = st_info->info[j];
-            end    = st_info->info[j + 1];
-            strpos = 0;
-            numpos = 0;
-
-            // The idea is to compare all group entries to the first group entry
-            // -----------------------------------------------------------------
-
-            for (k = 0; k < kvars; k++) {
-                sel = st_info->ix[i] * st_info->rowbytes + st_info->positions[k];
-                if ( st_info->byvars_lens[k] > 0 ) {
-                    memcpy (st_strbase + strpos,
-                            st_info->st_charx + sel,
-                            strlen(st_info->st_charx + sel));
-                    strpos = strlen(st_strbase);
-                }
-                else {
-                    z = *((ST_double *) (st_info->st_charx + sel));
-                    st_numbase[numpos] = z;
-                    ++numpos;
-                }
-            }
-
-            /***************
-             *  debugging  *
-             ***************
-            printf ("Checking: strings = '");
-            printf (st_strbase);
-            printf ("' and numbers = ");
-            for (k = 0; k < k_num; k++) {
-                if ( st_nummiss[k] ) {
-                    printf ("[missing], ");
-                }
-                else {
-                    printf ("%.5f, ", st_numbase[k]);
-                }
-            }
-            printf ("vs:\n");
-             ***************
-             *  debugging  *
-             ***************/
-
-            // Check 2nd entry of group onward
-            // -------------------------------
-
-            for (i = start + 1; i < end; i++) {
-                memset (st_strcomp, '\0', l_str);
-                collisions_row = 0;
-                numpos = 0;
-                strpos = 0;
-                for (k = 0; k < kvars; k++) {
-                    sel = st_info->ix[i] * st_info->rowbytes + st_info->positions[k];
-                    if ( st_info->byvars_lens[k] > 0 ) {
-                        // Concatenate string and compare result
-                        memcpy (st_strcomp + strpos,
-                                st_info->st_charx + sel,
-                                strlen(st_info->st_charx + sel));
-                        strpos = strlen(st_strcomp);
-                    }
-                    else {
-                        // Compare each number individually
-                        z = *((ST_double *) (st_info->st_charx + sel));
-                        if ( st_numbase[numpos] != z ) ++collisions_row;
-                        ++numpos;
-                    }
-                }
-
-                if ( kmax > 0 ) {
-                    if ( (strlen (st_strbase) != strlen (st_strcomp)) ) {
-                        ++collisions_row;
-                    }
-                    else if ( strncmp(st_strbase, st_strcomp, strlen(st_strcomp)) != 0 ) {
-                        ++collisions_row;
-                        /***************
-                         *  debugging  *
-                         ***************{
-                        printf ("\tstrings = '");
-                        printf (st_strcomp);
-                        printf ("\n");
-                         ***************
-                         *  debugging  *
-                         ***************/
-                    }
-                }
-            }
-
-            if ( collisions_row > 0 ) ++collisions_count;
-        }
-    }
-    else {
-        for (j = 0; j < st_info->J; j++) {
-            start = i = st_info->info[j];
-            end   = st_info->info[j + 1];
-
-            // The idea is to compare all group entries to the first group entry
-            // -----------------------------------------------------------------
-
-            for (k = 0; k < kvars; k++) {
-                sel  = st_info->ix[i] * kvars + k;
-                z    = *(st_info->st_numx + sel);
-                st_numbase[k] = z;
-            }
-
-            // Check 2nd entry of group onward
-            // -------------------------------
-
-            for (i = start + 1; i < end; i++) {
-                collisions_row = 0;
-                for (k = 0; k < kvars; k++) {
-                    sel = st_info->ix[i] * kvars + k;
-                    z   = *(st_info->st_numx + sel);
-                    if ( st_numbase[k] != z ) ++collisions_row;
-                }
-            }
-
-            if ( collisions_row > 0 ) ++collisions_count;
-        }
-    }
+    if ( (rc = gf_check_collisions (st_info,
+                                    st_info->ix,
+                                    st_info->verify == 1,
+                                    &collisions_count)) ) return (rc);
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_CHECK);
     if ( st_info->benchmark > 2 )
         sf_running_timer (&stimer, "\t\tPlugin step 4.1: Checked for hash collisions");
 
@@ -614,19 +814,14 @@ int sf_check_hash (struct StataInfo *st_info, int level)
     }
     else {
         if ( st_info->verbose )
-            sf_printf ("There were no hash collisions: "
+            sf_printf ("There were no hash collisions%s: "
                        GT_size_cfmt" variables, "
                        GT_size_cfmt" obs, "
                        GT_size_cfmt" groups\n",
+                       st_info->verify == 1? " (sampled)": "",
                        st_info->kvars_by, st_info->N, st_info->J);
     }
 
-    free (s);
-    free (st_strbase);
-    free (st_strcomp);
-    free (st_numbase);
-    free (st_nummiss);
-
     /*********************************************************************
      *              Read in copy of variables, if requested              *
      *********************************************************************/
@@ -638,6 +833,10 @@ int sf_check_hash (struct StataInfo *st_info, int level)
 
 bycopy:
 
+    // Save the (verified) group index before ix is replaced below
+    if ( (st_info->cache > 0) & (st_info->cache_hit == 0) & (rc == 0) )
+        sf_cache_save (st_info);
+
     multisort  = (st_info->biject == 0) & (st_info->unsorted == 0) & (st_info->sorted == 0);
     rowbytes   = st_info->rowbytes + sizeof(GT_size);
     skipbycopy = ( (multisort == 0) & (level == 22) ) | st_info->countonly;
@@ -654,30 +853,46 @@ bycopy:
 
     if ( (level > 0) & (skipbycopy == 0) ) {
         if ( kstr > 0 ) {
-            st_info->st_by_numx  = malloc(sizeof(ST_double));
-            st_info->st_by_charx = calloc(st_info->J, rowbytes);
+
+            // The strings of the first row in each group are copied to a
+            // string arena of their own (st_by_strx) so st_strx can be
+            // freed along with the rest of the by variables.
+
+            for (j = 0; j < st_info->J; j++) {
+                sel = st_info->ix[st_info->info[j]] * st_info->rowbytes;
+                for (k = 0; k < kvars; k++, sel += sizeof(ST_double)) {
+                    if ( st_info->byvars_lens[k] > 0 ) {
+                        ref = GTOOLS_STRREF_GET(st_info->st_charx + sel);
+                        st_info->strbuffer += GTOOLS_STRREF_LEN(ref);
+                    }
+                }
+            }
+
+            st_info->st_by_numx  = gf_arena_calloc(st_info->arena, 1, sizeof(ST_double));
+            st_info->st_by_charx = gf_arena_calloc(st_info->arena, st_info->J, rowbytes);
+            st_info->st_by_strx  = gf_arena_calloc(st_info->arena, st_info->strbuffer + st_info->J * kstr + 1, sizeof(char));
 
             if ( st_info->st_by_numx  == NULL ) return (sf_oom_error("sf_read_byvars", "st_info->st_by_numx"));
             if ( st_info->st_by_charx == NULL ) return (sf_oom_error("sf_read_byvars", "st_info->st_by_charx"));
+            if ( st_info->st_by_strx  == NULL ) return (sf_oom_error("sf_read_byvars", "st_info->st_by_strx"));
 
             GTOOLS_GC_ALLOCATED("st_info->st_by_numx")
             GTOOLS_GC_ALLOCATED("st_info->st_by_charx")
+            GTOOLS_GC_ALLOCATED("st_info->st_by_strx")
 
+            strpos = 0;
             for (j = 0; j < st_info->J; j++) {
-                memset (st_info->st_by_charx + j * rowbytes, '\0', rowbytes);
-                sel = j * rowbytes + st_info->positions[kvars];
-                memcpy (st_info->st_by_charx + sel, &j, sizeof(GT_size));
-            }
-
-            for (j = 0; j < st_info->J; j++) {
-                for (k = 0; k < kvars; k++) {
-                    sel  = st_info->ix[st_info->info[j]] * st_info->rowbytes + st_info->positions[k];
-                    selx = j * rowbytes + st_info->positions[k];
+                sel  = st_info->ix[st_info->info[j]] * st_info->rowbytes;
+                selx = j * rowbytes;
+                for (k = 0; k < kvars; k++, sel += sizeof(ST_double), selx += sizeof(ST_double)) {
                     if ( st_info->byvars_lens[k] > 0 ) {
-                        memcpy (st_info->st_by_charx + selx,
-                                st_info->st_charx + sel,
-                                strlen(st_info->st_charx + sel));
-                        st_info->strbuffer += strlen(st_info->st_charx + sel);
+                        ref = GTOOLS_STRREF_GET(st_info->st_charx + sel);
+                        memcpy (st_info->st_by_strx + strpos,
+                                st_info->st_strx + GTOOLS_STRREF_OFF(ref),
+                                GTOOLS_STRREF_LEN(ref) + 1);
+                        ref = GTOOLS_STRREF(strpos, GTOOLS_STRREF_LEN(ref));
+                        memcpy (st_info->st_by_charx + selx, &ref, sizeof(ref));
+                        strpos += GTOOLS_STRREF_LEN(ref) + 1;
                     }
                     else {
                         memcpy (st_info->st_by_charx + selx,
@@ -685,11 +900,12 @@ bycopy:
                                 sizeof(ST_double));
                     }
                 }
+                memcpy (st_info->st_by_charx + selx, &j, sizeof(GT_size));
             }
         }
         else {
-            st_info->st_by_numx  = calloc(st_info->J * (kvars + 1), sizeof(st_info->st_by_numx));
-            st_info->st_by_charx = malloc(sizeof(char));
+            st_info->st_by_numx  = gf_arena_calloc(st_info->arena, st_info->J * (kvars + 1), sizeof(st_info->st_by_numx));
+            st_info->st_by_charx = gf_arena_calloc(st_info->arena, 1, sizeof(char));
 
             if ( st_info->st_by_numx  == NULL ) return (sf_oom_error("sf_read_byvars", "st_info->st_by_numx"));
             if ( st_info->st_by_charx == NULL ) return (sf_oom_error("sf_read_byvars", "st_info->st_by_charx"));
@@ -707,11 +923,10 @@ bycopy:
             }
         }
 
+        gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_PANEL);
         if ( st_info->benchmark > 2 )
             sf_running_timer (&stimer, "\t\tPlugin step 4.2: Keep only one row per group");
 
-        st_info->free = 6;
-
         // Skip if the user specifies the results need not be sorted
         // (unsorted, countonly). Also skip with the bijection, where
         // you get the sorting for free, or if we determined the data
@@ -724,49 +939,49 @@ bycopy:
 
         if ( (level > 1) &  multisort ) {
             if ( kstr > 0 ) {
-                MultiQuicksortMC (st_info->st_by_charx,
-                                  st_info->J,
-                                  0,
-                                  kvars - 1,
-                                  rowbytes,
-                                  st_info->byvars_lens,
-                                  st_info->invert,
-                                  st_info->positions);
+                if ( (rc = gf_radix_sort_mc (st_info->st_by_charx,
+                                             st_info->J,
+                                             0,
+                                             kvars - 1,
+                                             rowbytes,
+                                             st_info->byvars_lens,
+                                             st_info->invert,
+                                             st_info->positions,
+                                             st_info->st_by_strx)) ) return (rc);
             }
             else {
-                MultiQuicksortDbl(st_info->st_by_numx,
-                                  st_info->J,
-                                  0,
-                                  kvars - 1,
-                                  (kvars + 1) * sizeof(ST_double),
-                                  st_info->invert);
+                if ( (rc = gf_radix_sort_dbl (st_info->st_by_numx,
+                                              st_info->J,
+                                              0,
+                                              kvars - 1,
+                                              (kvars + 1) * sizeof(ST_double),
+                                              st_info->invert)) ) return (rc);
             }
 
+            gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_SORT);
             if ( st_info->benchmark > 2 )
                 sf_running_timer (&stimer, "\t\tPlugin step 4.3: Sorted groups in memory");
         }
     }
-    else {
-        st_info->free = 8;
-    }
 
-    free (st_info->st_numx);
-    free (st_info->st_charx);
+    gf_arena_free (st_info->arena, st_info->st_numx);
+    gf_arena_free (st_info->arena, st_info->st_charx);
+    gf_arena_free (st_info->arena, st_info->st_strx);
 
     GTOOLS_GC_FREED("st_info->st_numx")
     GTOOLS_GC_FREED("st_info->st_charx")
+    GTOOLS_GC_FREED("st_info->st_strx")
 
     if ( st_info->N < st_info->Nread ) {
-        free (st_info->ix);
+        gf_arena_free (st_info->arena, st_info->ix);
         GTOOLS_GC_FREED("st_info->ix")
     }
 
-    st_info->ix = calloc(st_info->J, sizeof(st_info->ix));
+    st_info->ix = gf_arena_calloc(st_info->arena, st_info->J, sizeof(st_info->ix));
     if ( st_info->ix == NULL ) sf_oom_error ("sf_check_hash", "st_info->ix");
     GTOOLS_GC_ALLOCATED("st_info->ix")
 
     if ( (level > 0) & (skipbycopy == 0) ) {
-        st_info->free = 7;
         if ( kstr > 0 ) {
             for (j = 0; j < st_info->J; j++) {
                 st_info->ix[j] = *((GT_size *) (st_info->st_by_charx + j * rowbytes + st_info->positions[kvars]));
@@ -785,8 +1000,131 @@ bycopy:
             st_info->ix[j] = j;
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_PANEL);
     if ( st_info->benchmark > 1 )
         sf_running_timer (&timer, "\tPlugin step 4: Created indexed array with sorted by vars");
 
     return (rc);
 }
+
+/**
+ * @brief Compare every row to the first row of its group
+ *
+ * Every row in a group must have the same by variables as the first
+ * row in the group. Numeric rows are compared whole with memcmp;
+ * rows with strings are compared variable by variable, and strings
+ * by their length and actual bytes (see gf_strx_differ). Groups are
+ * checked with gf_pool_steal, with the number of rows compared as the
+ * cost of each group, so a few very large groups do not end up in the
+ * same task. The first collision found stops every worker.
+ *
+ * @param st_info Stata structure with meta info, data, and group info
+ * @param ix Index of the rows in group order
+ * @param sample Only compare GTOOLS_VERIFY_SAMPLE rows per group
+ * @param collisions Set to 1 if a group with collisions was found, 0
+ *        otherwise
+ * @return return code (out of memory)
+ */
+ST_retcode gf_check_collisions (
+    struct StataInfo *st_info,
+    GT_size *ix,
+    GT_bool sample,
+    GT_size *collisions)
+{
+    ST_retcode rc;
+    GT_size j, nj, total, nworkers;
+    GT_size kvars = st_info->kvars_by;
+    GT_size kstr  = st_info->kvars_by_str;
+    struct cInfo cinfo;
+
+    *collisions = 0;
+    if ( st_info->J == 0 ) return (0);
+
+    GT_size *cost = gf_arena_calloc(st_info->arena, st_info->J, sizeof *cost);
+    if ( cost == NULL ) return (sf_oom_error("gf_check_collisions", "cost"));
+
+    total = 0;
+    for (j = 0; j < st_info->J; j++) {
+        nj = st_info->info[j + 1] - st_info->info[j];
+        cost[j] = (sample & (nj > GTOOLS_VERIFY_SAMPLE))? GTOOLS_VERIFY_SAMPLE: nj;
+        total  += cost[j];
+    }
+
+    cinfo.keys     = kstr > 0? st_info->st_charx: (char *) st_info->st_numx;
+    cinfo.keybytes = kstr > 0? st_info->rowbytes: kvars * sizeof(ST_double);
+    cinfo.strx     = kstr > 0? st_info->st_strx: NULL;
+    cinfo.kvars    = kvars;
+    cinfo.ltypes   = st_info->byvars_lens;
+    cinfo.info     = st_info->info;
+    cinfo.ix       = ix;
+    cinfo.sample   = sample;
+
+    nworkers = gf_pool_steal_workers(st_info->J, total);
+    rc = gf_pool_steal (gf_pcheck_hash, &cinfo, cost, st_info->J, nworkers);
+    gf_arena_free (st_info->arena, cost);
+
+    if ( rc == GTOOLS_VERIFY_FOUND ) {
+        *collisions = 1;
+        rc = 0;
+    }
+
+    return (rc);
+}
+
+/**
+ * @brief Whether two keys in a collision check differ
+ *
+ * @param cinfo cInfo with the key layout
+ * @param a Key
+ * @param b Key
+ * @return 0 if @a and @b have the same values; non-zero otherwise
+ */
+int gf_pcheck_differ (struct cInfo *cinfo, char *a, char *b)
+{
+    if ( cinfo->strx == NULL ) return (memcmp(a, b, cinfo->keybytes));
+    return (gf_strx_differ(a, b, cinfo->kvars, cinfo->ltypes, cinfo->strx));
+}
+
+/**
+ * @brief Check one group for hash collisions (gf_pool_steal item)
+ *
+ * Compare the key of each row in group @j to the key of the group's
+ * first row. With @cinfo->sample only GTOOLS_VERIFY_SAMPLE rows spread
+ * evenly over the group (always including the last) are checked.
+ *
+ * @param context cInfo with the keys and group info
+ * @param worker Worker running the item (unused)
+ * @param j Group to check
+ * @return GTOOLS_VERIFY_FOUND if the group has a collision, which
+ *         stops gf_pool_steal; 0 otherwise
+ */
+ST_retcode gf_pcheck_hash (void *context, GT_size worker, GT_size j)
+{
+    struct cInfo *cinfo = ((struct cInfo *) context);
+
+    GT_size i, m, nj;
+    char *base;
+
+    GT_size keybytes = cinfo->keybytes;
+    GT_size *info    = cinfo->info;
+    GT_size *ix      = cinfo->ix;
+
+    base = cinfo->keys + ix[info[j]] * keybytes;
+    nj   = info[j + 1] - info[j];
+
+    if ( cinfo->sample & (nj > GTOOLS_VERIFY_SAMPLE) ) {
+        for (m = 1; m <= GTOOLS_VERIFY_SAMPLE; m++) {
+            i = info[j] + ((nj - 1) * m) / GTOOLS_VERIFY_SAMPLE;
+            if ( gf_pcheck_differ(cinfo, base, cinfo->keys + ix[i] * keybytes) )
+                return (GTOOLS_VERIFY_FOUND);
+        }
+    }
+    else {
+        for (i = info[j] + 1; i < info[j + 1]; i++) {
+            if ( gf_pcheck_differ(cinfo, base, cinfo->keys + ix[i] * keybytes) )
+                return (GTOOLS_VERIFY_FOUND);
+        }
+    }
+
+    return (0);
+}
@@ -3,6 +3,45 @@
 
 #define RADIX_SHIFT 24
 
+/*
+ * Row-hash engines
+ * ----------------
+ *
+ * __gtools_hash_method picks how the by variables are hashed. default
+ * and biject only hash if the by variables cannot be bijected, and then
+ * use spooky: spookyhash_128 over each row's key. spooky, column, and
+ * fast64 always hash (and skip the check for sorted data).
+ *
+ * - column hashes each by variable down a block of rows (numbers by
+ *   their bits; strings with spookyhash_128) and folds it into two
+ *   64-bit lanes with different mixers, one column at a time, so the
+ *   inner loops run over contiguous hashes.
+ * - fast64 is column with only the first lane. The groups are then
+ *   checked exactly, row by row; if any two rows with the same hash
+ *   differ the call falls back on spooky.
+ */
+
+#define GTOOLS_HASH_DEFAULT 0
+#define GTOOLS_HASH_BIJECT  1
+#define GTOOLS_HASH_SPOOKY  2
+#define GTOOLS_HASH_COLUMN  3
+#define GTOOLS_HASH_FAST64  4
+
+// Rows per block with the column engines
+#define GTOOLS_HASH_BLOCK 1024
+
+// Seeds of the two lanes of the column engines
+#define GTOOLS_HASH_SEED1 0x9e3779b97f4a7c15ULL
+#define GTOOLS_HASH_SEED2 0x6a09e667f3bcc909ULL
+
+struct GtoolsHashEngine {
+    const char  *name;
+    GT_pool_fun phash;    // hashes the rows of one hInfo
+    GT_bool     bits128;  // whether phash fills hInfo.h3
+};
+
+struct GtoolsHashEngine *gf_hash_engine (struct StataInfo *st_info);
+
 int gf_hash (
     uint64_t *h1,
     uint64_t *h2,
@@ -11,6 +50,47 @@ int gf_hash (
     clock_t stimer
 );
 
+void* gf_phash (void *argument);
+void* gf_phash_column (void *argument);
+struct hInfo {
+    uint64_t *h1;
+    uint64_t *h3;
+    GT_size start;
+    GT_size end;
+    char *key;
+    struct StataInfo *st_info;
+};
+
+GT_size gf_strx_key    (struct StataInfo *st_info, char *row, char *key);
+GT_bool gf_strx_differ (char *a, char *b, GT_size kvars, GT_size *ltypes, char *strx);
+
+// Rows per group compared with verify(sample)
+#define GTOOLS_VERIFY_SAMPLE 16
+
+// Returned by gf_pcheck_hash to stop the check at the first collision
+#define GTOOLS_VERIFY_FOUND 17000
+
+ST_retcode gf_check_collisions (
+    struct StataInfo *st_info,
+    GT_size *ix,
+    GT_bool sample,
+    GT_size *collisions
+);
+
+ST_retcode gf_pcheck_hash (void *context, GT_size worker, GT_size j);
+struct cInfo {
+    char    *keys;
+    GT_size keybytes;
+    char    *strx;
+    GT_size kvars;
+    GT_size *ltypes;
+    GT_size *info;
+    GT_size *ix;
+    GT_bool sample;
+};
+
+int gf_pcheck_differ (struct cInfo *cinfo, char *a, char *b);
+
 int gf_biject_varlist (uint64_t *h1, struct StataInfo *st_info);
 
 int gf_panelsetup (
@@ -0,0 +1,277 @@
+#include "gtools_hashtable.h"
+
+// Fibonacci hashing: spread the key over the table using the top bits of
+// the product with 2^64 / golden ratio. The spooky hash is already
+// uniform, but bijected integers are not.
+#define GTOOLS_HASHTABLE_SLOT(key, shift) \
+    ((GT_size) (((uint64_t) (key) * 0x9E3779B97F4A7C15ULL) >> (shift)))
+
+/**
+ * @brief Set up panel using a hash table instead of sorting the hash
+ *
+ * Assign each row a dense group ID in one pass over an open-addressing
+ * table keyed on the bijection (@hash_level = 0) or the full 128-bit
+ * hash (@hash_level = 1; no 64-bit collision fallback is needed). Then
+ * count the rows in each group, take the running sum to get the info
+ * array, and scatter the index so each group's rows are contiguous
+ * (the scatter is stable, so rows within a group keep their order).
+ *
+ * Groups come out in order of first appearance. That is fine if the
+ * user did not want sorted output (unsorted, countonly) or if the groups
+ * are sorted after the fact from the by copy (128-bit hash; see
+ * sf_check_hash). With a bijection the groups are expected to be in
+ * sorted order, so we sort the J group keys instead of the N row keys.
+ * For that to pay off J must be small relative to N; if more than N /
+ * GTOOLS_HASHTABLE_RATIO groups turn up we give up and sort the hash
+ * (see gf_hashtable_giveup).
+ *
+ * @param h1 Array of 64-bit integers containing the bijection or first half of 128-bit hashes
+ * @param h2 Array of 64-bit integers containing second half of 128-bit hashes
+ * @param st_info Meta structure with all the variables and data
+ * @param ix Index into the rows of the data; reordered so groups are contiguous
+ * @param hash_level whether we used a bijection (0) or a 128-bit hash (1)
+ * @return info arary with start and end positions of each group
+ */
+ST_retcode gf_panelsetup_hashtable (
+    uint64_t *h1,
+    uint64_t *h2,
+    struct StataInfo *st_info,
+    GT_size *ix,
+    const GT_bool hash_level)
+{
+    ST_retcode rc = 0;
+    GT_size i, j, s, id;
+
+    GT_size N      = st_info->N;
+    GT_bool anyord = st_info->unsorted | st_info->countonly;
+    GT_bool resort = (hash_level == 0) & (anyord == 0);
+    GT_size maxJ   = anyord? N: N / GTOOLS_HASHTABLE_RATIO;
+
+    GT_size *gid    = NULL;
+    GT_size *next   = NULL;
+    GT_size *ixcopy = NULL;
+
+    struct GtoolsHashTable ht;
+    ht.nslots = GTOOLS_HASHTABLE_INIT;
+    ht.shift  = 64 - 10;
+    ht.J      = 0;
+    ht.slots  = calloc(ht.nslots, sizeof *ht.slots);
+    ht.g1     = calloc(ht.nslots / 2, sizeof *ht.g1);
+    ht.g2     = hash_level? calloc(ht.nslots / 2, sizeof *ht.g2): NULL;
+
+    if ( ht.slots == NULL ) {
+        rc = sf_oom_error("gf_panelsetup_hashtable", "ht.slots");
+        goto exit;
+    }
+    if ( ht.g1 == NULL ) {
+        rc = sf_oom_error("gf_panelsetup_hashtable", "ht.g1");
+        goto exit;
+    }
+    if ( hash_level & (ht.g2 == NULL) ) {
+        rc = sf_oom_error("gf_panelsetup_hashtable", "ht.g2");
+        goto exit;
+    }
+
+    gid = calloc(N, sizeof *gid);
+    if ( gid == NULL ) {
+        rc = sf_oom_error("gf_panelsetup_hashtable", "gid");
+        goto exit;
+    }
+
+    // Assign group IDs
+    // ----------------
+
+    // Slots store group ID + 1 so that 0 marks an empty slot. The table
+    // is at most half full, so probing is short and always terminates.
+
+    for (i = 0; i < N; i++) {
+probe:
+        s = GTOOLS_HASHTABLE_SLOT(h1[i], ht.shift);
+        while ( (id = ht.slots[s]) ) {
+            if ( (ht.g1[id - 1] == h1[i]) && ((hash_level == 0) || (ht.g2[id - 1] == h2[i])) )
+                break;
+            s = (s + 1) & (ht.nslots - 1);
+        }
+
+        if ( id == 0 ) {
+            if ( ht.J >= maxJ ) {
+                if ( st_info->verbose )
+                    sf_printf("Hash table found over "GT_size_cfmt" groups; will sort.\n", maxJ);
+                rc = gf_hashtable_giveup (h1, h2, st_info, ix, hash_level);
+                goto exit;
+            }
+
+            if ( 2 * (ht.J + 1) > ht.nslots ) {
+                if ( (rc = gf_hashtable_grow (&ht, hash_level)) ) goto exit;
+                goto probe;
+            }
+
+            ht.g1[ht.J] = h1[i];
+            if ( hash_level ) ht.g2[ht.J] = h2[i];
+            id = ht.slots[s] = ++ht.J;
+        }
+
+        gid[i] = id - 1;
+    }
+
+    st_info->J = ht.J;
+
+    next = calloc(ht.J + 1, sizeof *next);
+    if ( next == NULL ) {
+        rc = sf_oom_error("gf_panelsetup_hashtable", "next");
+        goto exit;
+    }
+
+    // Sort the group keys (bijection only)
+    // ------------------------------------
+
+    // Sort the J distinct keys, carrying each group's first-appearance
+    // ID, then relabel the rows with the rank of their group's key.
+
+    if ( resort ) {
+        for (j = 0; j < ht.J; j++)
+            next[j] = j;
+
+        if ( (rc = gf_sort_hash (ht.g1, next, ht.J, 0, NULL)) ) goto exit;
+
+        for (j = 0; j < ht.J; j++)
+            ht.slots[next[j]] = j;
+
+        for (i = 0; i < N; i++)
+            gid[i] = ht.slots[gid[i]];
+
+        memset (next, '\0', (ht.J + 1) * sizeof *next);
+    }
+
+    // Counting pass over the group IDs
+    // --------------------------------
+
+    st_info->info = gf_arena_calloc(st_info->arena, ht.J + 1, sizeof st_info->info);
+    if ( st_info->info == NULL ) {
+        rc = sf_oom_error("gf_panelsetup_hashtable", "st_info->info");
+        goto exit;
+    }
+    GTOOLS_GC_ALLOCATED("st_info->info")
+
+    for (i = 0; i < N; i++)
+        st_info->info[gid[i] + 1]++;
+
+    for (j = 0; j < ht.J; j++) {
+        st_info->info[j + 1] += st_info->info[j];
+        next[j] = st_info->info[j];
+    }
+
+    ixcopy = calloc(N, sizeof *ixcopy);
+    if ( ixcopy == NULL ) {
+        rc = sf_oom_error("gf_panelsetup_hashtable", "ixcopy");
+        goto exit;
+    }
+
+    for (i = 0; i < N; i++)
+        ixcopy[next[gid[i]]++] = ix[i];
+
+    memcpy (ix, ixcopy, N * sizeof *ix);
+
+    if ( st_info->verbose )
+        sf_printf("Hash table on %s; "GT_size_cfmt" groups\n",
+                  hash_level == 0? "bijection":
+                  st_info->hash_method == GTOOLS_HASH_FAST64? "64-bit hash": "128-bit hash", ht.J);
+
+exit:
+    free (ht.slots);
+    free (ht.g1);
+    free (ht.g2);
+    free (gid);
+    free (next);
+    free (ixcopy);
+
+    return (rc);
+}
+
+/**
+ * @brief Double the number of slots in the hash table
+ *
+ * @param ht Hash table
+ * @param hash_level whether we used a bijection (0) or a 128-bit hash (1)
+ * @return Re-inserts every group into a table twice the size
+ */
+ST_retcode gf_hashtable_grow (struct GtoolsHashTable *ht, const GT_bool hash_level)
+{
+    GT_size j, s;
+    uint64_t *grown;
+
+    // The keys are reallocated through a temporary so that on failure
+    // the caller still holds (and frees) the old buffers.
+
+    free (ht->slots);
+    ht->nslots *= 2;
+    ht->shift  -= 1;
+    ht->slots   = calloc(ht->nslots, sizeof *ht->slots);
+    if ( ht->slots == NULL ) return (sf_oom_error("gf_hashtable_grow", "ht->slots"));
+
+    grown = realloc(ht->g1, ht->nslots / 2 * sizeof *ht->g1);
+    if ( grown == NULL ) return (sf_oom_error("gf_hashtable_grow", "ht->g1"));
+    ht->g1 = grown;
+
+    if ( hash_level ) {
+        grown = realloc(ht->g2, ht->nslots / 2 * sizeof *ht->g2);
+        if ( grown == NULL ) return (sf_oom_error("gf_hashtable_grow", "ht->g2"));
+        ht->g2 = grown;
+    }
+
+    for (j = 0; j < ht->J; j++) {
+        s = GTOOLS_HASHTABLE_SLOT(ht->g1[j], ht->shift);
+        while ( ht->slots[s] )
+            s = (s + 1) & (ht->nslots - 1);
+        ht->slots[s] = j + 1;
+    }
+
+    return (0);
+}
+
+/**
+ * @brief Sort the hash after all (too many groups for the hash table)
+ *
+ * gf_hash leaves the hash in row order when we intend to use the hash
+ * table. This sorts it (and the index) the way gf_hash would have, so
+ * gf_panelsetup can carry on as usual.
+ *
+ * @param h1 Array of 64-bit integers containing the bijection or first half of 128-bit hashes
+ * @param h2 Array of 64-bit integers containing second half of 128-bit hashes
+ * @param st_info Meta structure with all the variables and data
+ * @param ix Index into the rows of the data
+ * @param hash_level whether we used a bijection (0) or a 128-bit hash (1)
+ * @return Sorted @h1 and @ix; @h2 in the same order
+ */
+ST_retcode gf_hashtable_giveup (
+    uint64_t *h1,
+    uint64_t *h2,
+    struct StataInfo *st_info,
+    GT_size *ix,
+    const GT_bool hash_level)
+{
+    ST_retcode rc = 0;
+    GT_size i;
+    uint64_t *h3 = NULL;
+
+    st_info->hashtable = 0;
+
+    if ( hash_level ) {
+        h3 = calloc(st_info->N, sizeof *h3);
+        if ( h3 == NULL ) return (sf_oom_error("gf_hashtable_giveup", "h3"));
+        memcpy (h3, h2, st_info->N * sizeof *h3);
+    }
+
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_PANEL);
+    if ( (rc = gf_sort_hash (h1, ix, st_info->N, st_info->verbose, st_info->telemetry)) ) goto exit;
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_SORT);
+
+    if ( hash_level ) {
+        for (i = 0; i < st_info->N; i++)
+            h2[i] = h3[ix[i]];
+    }
+
+exit:
+    free (h3);
+    return (rc);
+}
@@ -0,0 +1,39 @@
+#ifndef GTOOLS_HASHTABLE
+#define GTOOLS_HASHTABLE
+
+// If the output must come out sorted, only use the hash table while
+// there are at most N / GTOOLS_HASHTABLE_RATIO groups (beyond that
+// sorting the hash is no slower and we fall back on it)
+#define GTOOLS_HASHTABLE_RATIO 16
+
+// Initial number of slots (must be a power of 2)
+#define GTOOLS_HASHTABLE_INIT 1024
+
+struct GtoolsHashTable {
+    GT_size  nslots;
+    GT_size  shift;
+    GT_size  J;
+    GT_size  *slots;
+    uint64_t *g1;
+    uint64_t *g2;
+};
+
+int gf_panelsetup_hashtable (
+    uint64_t *h1,
+    uint64_t *h2,
+    struct StataInfo *st_info,
+    GT_size *ix,
+    const GT_bool hash_level
+);
+
+int gf_hashtable_grow (struct GtoolsHashTable *ht, const GT_bool hash_level);
+
+int gf_hashtable_giveup (
+    uint64_t *h1,
+    uint64_t *h2,
+    struct StataInfo *st_info,
+    GT_size *ix,
+    const GT_bool hash_level
+);
+
+#endif
@@ -0,0 +1,403 @@
+#include "gtools_prefix.h"
+
+/**
+ * @brief Longest prefix of the by variables the data is sorted by
+ *
+ * Only called once we know the data is not sorted by all the by
+ * variables. Typically the data is sorted by the first few keys or not
+ * at all, so we check prefixes from the shortest up and stop at the
+ * first one that is not sorted (the check of an unsorted prefix usually
+ * stops early).
+ *
+ * @param st_info Meta structure with all the variables and data
+ * @return Number of leading by variables the data is sorted by (0 to K - 1)
+ */
+GT_size gf_sorted_prefix (struct StataInfo *st_info)
+{
+    GT_size k, sorted;
+    GT_size kvars = st_info->kvars_by;
+
+    for (k = 1; k < kvars; k++) {
+        if ( st_info->kvars_by_str > 0 ) {
+            sorted = MultiSortCheckMC (
+                st_info->st_charx,
+                st_info->N,
+                0,
+                k - 1,
+                st_info->rowbytes,
+                st_info->byvars_lens,
+                st_info->invert,
+                st_info->positions,
+                st_info->st_strx
+            );
+        }
+        else {
+            sorted = MultiSortCheckDbl (
+                st_info->st_numx,
+                st_info->N,
+                0,
+                k - 1,
+                kvars * sizeof(ST_double),
+                st_info->invert
+            );
+        }
+        if ( !sorted ) break;
+    }
+
+    return (k - 1);
+}
+
+/**
+ * @brief Set up panel from the runs of a sorted key prefix
+ *
+ * Find the runs of rows with the same first @kprefix keys, then sort
+ * the rows of each run by the remaining keys and find the groups within
+ * it (see gf_prefix_sort_rows). Rows within a group keep their order.
+ * The result is the same as sorting the data by every key: @ix is
+ * permuted and st_info->info and st_info->J are set.
+ *
+ * Otherwise the rows would be hashed and grouped with a hash table,
+ * which is linear in N. Sorting short runs is cheaper than that, but
+ * sorting long runs only pays off if there are too many groups for the
+ * table (it then gives up and sorts the hash; see
+ * gf_panelsetup_hashtable), so for long runs we estimate the number of
+ * groups from a sample of runs first.
+ *
+ * @param st_info Meta structure with all the variables and data
+ * @param ix Index to permute (row numbers in increasing order)
+ * @param kprefix Number of leading by variables the data is sorted by
+ * @param used Set to 1 if the panel was set up; 0 if the runs are too
+ *             few or too long for the prefix to help (nothing is changed)
+ * @return Stata return code
+ */
+ST_retcode gf_panelsetup_prefix (
+    struct StataInfo *st_info,
+    GT_size *ix,
+    GT_size kprefix,
+    GT_bool *used)
+{
+    ST_retcode rc = 0;
+    GT_size i, j, k, nruns, Jest;
+    GT_size nworkers = 0;
+    GT_size N     = st_info->N;
+    GT_size kvars = st_info->kvars_by;
+    GT_size kstr  = st_info->kvars_by_str;
+    GT_bool anyord = st_info->unsorted | st_info->countonly;
+
+    struct rInfo rinfo = {0};
+    GT_size *cost = NULL;
+
+    *used = 0;
+
+    GT_size *runs = gf_arena_calloc(st_info->arena, N + 1, sizeof *runs);
+    if ( runs == NULL ) return (sf_oom_error("gf_panelsetup_prefix", "runs"));
+
+    if ( kstr > 0 ) {
+        nruns = MultiSortPanelSetupMC (
+            st_info->st_charx,
+            N,
+            0,
+            kprefix - 1,
+            st_info->rowbytes,
+            st_info->byvars_lens,
+            st_info->invert,
+            st_info->positions,
+            st_info->st_strx,
+            runs,
+            0
+        );
+    }
+    else {
+        nruns = MultiSortPanelSetupDbl (
+            st_info->st_numx,
+            N,
+            0,
+            kprefix - 1,
+            kvars * sizeof(ST_double),
+            st_info->invert,
+            runs,
+            0
+        );
+    }
+    runs[nruns] = N;
+
+    if ( nruns < GTOOLS_PREFIX_MINRUNS ) goto exit;
+
+    // The row number is appended to each row as a last (numeric) key so
+    // that the sort keeps rows in their original order within a group.
+
+    rinfo.invert = gf_arena_calloc(st_info->arena, kvars + 1, sizeof *rinfo.invert);
+    rinfo.ltypes = gf_arena_calloc(st_info->arena, kvars + 1, sizeof *rinfo.ltypes);
+
+    if ( rinfo.invert == NULL ) { rc = sf_oom_error("gf_panelsetup_prefix", "invert"); goto exit; }
+    if ( rinfo.ltypes == NULL ) { rc = sf_oom_error("gf_panelsetup_prefix", "ltypes"); goto exit; }
+
+    for (k = 0; k < kvars; k++) {
+        rinfo.invert[k] = st_info->invert[k];
+        rinfo.ltypes[k] = st_info->byvars_lens[k];
+    }
+
+    nworkers = gf_pool_steal_workers(nruns, N);
+
+    rinfo.scratch   = calloc(nworkers, sizeof *rinfo.scratch);
+    rinfo.scratch_n = calloc(nworkers, sizeof *rinfo.scratch_n);
+    if ( rinfo.scratch   == NULL ) { rc = sf_oom_error("gf_panelsetup_prefix", "scratch");   goto exit; }
+    if ( rinfo.scratch_n == NULL ) { rc = sf_oom_error("gf_panelsetup_prefix", "scratch_n"); goto exit; }
+
+    rinfo.st_info = st_info;
+    rinfo.ix      = ix;
+    rinfo.runs    = runs;
+    rinfo.kprefix = kprefix;
+    rinfo.elsize  = (kstr > 0? st_info->rowbytes: kvars * sizeof(ST_double)) + sizeof(ST_double);
+
+    // Long runs: only worth it if the hash table would give up
+    // --------------------------------------------------------
+
+    if ( (N > nruns * GTOOLS_PREFIX_MAXRUN) & (N > GTOOLS_PREFIX_SAMPLE) ) {
+        if ( anyord | (N > nruns * GTOOLS_PREFIX_SAMPLE) ) goto exit;
+        rc = gf_prefix_estimate_groups (&rinfo, nruns, &Jest);
+        if ( rc == 1702 ) { rc = sf_oom_error("gf_panelsetup_prefix", "scratch"); goto exit; }
+        if ( rc ) goto exit;
+        if ( Jest <= N / GTOOLS_HASHTABLE_RATIO ) goto exit;
+    }
+
+    rinfo.starts = gf_arena_calloc(st_info->arena, N, sizeof *rinfo.starts);
+    cost         = gf_arena_calloc(st_info->arena, nruns, sizeof *cost);
+
+    if ( rinfo.starts == NULL ) { rc = sf_oom_error("gf_panelsetup_prefix", "starts"); goto exit; }
+    if ( cost         == NULL ) { rc = sf_oom_error("gf_panelsetup_prefix", "cost");   goto exit; }
+
+    for (j = 0; j < nruns; j++)
+        cost[j] = runs[j + 1] - runs[j];
+
+    // Workers only fail if they cannot grow their scratch space, and they
+    // return 1702 without printing anything
+    rc = gf_pool_steal (gf_prefix_sort_run, &rinfo, cost, nruns, nworkers);
+    if ( rc == 1702 ) { rc = sf_oom_error("gf_panelsetup_prefix", "scratch"); goto exit; }
+    if ( rc ) goto exit;
+
+    // Group starts to info
+    // --------------------
+
+    st_info->J = 0;
+    for (i = 0; i < N; i++)
+        st_info->J += rinfo.starts[i];
+
+    st_info->info = gf_arena_calloc(st_info->arena, st_info->J + 1, sizeof st_info->info);
+    if ( st_info->info == NULL ) { rc = sf_oom_error("gf_panelsetup_prefix", "st_info->info"); goto exit; }
+    GTOOLS_GC_ALLOCATED("st_info->info")
+
+    for (i = j = 0; i < N; i++) {
+        if ( rinfo.starts[i] ) st_info->info[j++] = i;
+    }
+    st_info->info[st_info->J] = N;
+
+    if ( st_info->verbose )
+        sf_printf("(sorted by the first "GT_size_cfmt" of "GT_size_cfmt" by variables; "
+                  GT_size_cfmt" runs sorted separately)\n",
+                  kprefix, kvars, nruns);
+
+    *used = 1;
+
+exit:
+    if ( rinfo.scratch != NULL ) {
+        for (i = 0; i < nworkers; i++)
+            free (rinfo.scratch[i]);
+    }
+    free (rinfo.scratch);
+    free (rinfo.scratch_n);
+
+    gf_arena_free (st_info->arena, cost);
+    gf_arena_free (st_info->arena, rinfo.starts);
+    gf_arena_free (st_info->arena, rinfo.ltypes);
+    gf_arena_free (st_info->arena, rinfo.invert);
+    gf_arena_free (st_info->arena, runs);
+
+    return (rc);
+}
+
+/**
+ * @brief Estimate the number of groups from a sample of runs
+ *
+ * Sort evenly spaced runs, about GTOOLS_PREFIX_SAMPLE rows in all, by
+ * the remaining keys without saving the result, and scale the number
+ * of groups found by the share of rows sampled.
+ *
+ * @param rinfo Data, index, runs, and scratch space
+ * @param nruns Number of runs; at least N / GTOOLS_PREFIX_SAMPLE
+ * @param Jest Set to the estimated number of groups
+ * @return 0 on success; 1702 if the scratch space could not be grown
+ */
+ST_retcode gf_prefix_estimate_groups (
+    struct rInfo *rinfo,
+    GT_size nruns,
+    GT_size *Jest)
+{
+    ST_retcode rc = 0;
+    GT_size j, ng, nrun;
+    GT_size N      = rinfo->st_info->N;
+    GT_size stride = GTOOLS_PWMAX(N / GTOOLS_PREFIX_SAMPLE, 1);
+    GT_size nrows  = 0;
+    GT_size groups = 0;
+
+    for (j = 0; j < nruns; j += stride) {
+        nrun = rinfo->runs[j + 1] - rinfo->runs[j];
+        if ( (rc = gf_prefix_sort_rows (rinfo, 0, rinfo->runs[j], nrun, 0, &ng)) ) return (rc);
+        nrows  += nrun;
+        groups += ng;
+    }
+
+    *Jest = (GT_size) ((ST_double) groups / nrows * N);
+    return (0);
+}
+
+/**
+ * @brief Sort one run of a sorted prefix by the remaining keys
+ *
+ * Runs are sorted independently on the thread pool; see
+ * gf_prefix_sort_rows.
+ *
+ * @param context rInfo with the data, index, runs, and scratch space
+ * @param worker Worker running the item (owns rinfo->scratch[worker])
+ * @param item Run to sort
+ * @return 0 on success; 1702 if the scratch space could not be grown
+ */
+ST_retcode gf_prefix_sort_run (void *context, GT_size worker, GT_size item)
+{
+    struct rInfo *rinfo = (struct rInfo *) context;
+    GT_size ng;
+    return (gf_prefix_sort_rows (
+        rinfo,
+        worker,
+        rinfo->runs[item],
+        rinfo->runs[item + 1] - rinfo->runs[item],
+        1,
+        &ng
+    ));
+}
+
+/**
+ * @brief Sort rows of a run by the keys after the prefix
+ *
+ * Copy the rows to the worker's scratch space along with their row
+ * number, sort them by the keys after the prefix (and then the row
+ * number), and count the groups. If @apply, also flag where each group
+ * starts and write the sorted row numbers back to the index; otherwise
+ * nothing outside the scratch space is changed.
+ *
+ * @param rinfo Data, index, and scratch space
+ * @param worker Worker sorting the rows (owns rinfo->scratch[worker])
+ * @param start First row of the run
+ * @param nrun Number of rows in the run
+ * @param apply Whether to save the sort to the index and group starts
+ * @param ng Set to the number of groups in the run
+ * @return 0 on success; 1702 if the scratch space could not be grown
+ */
+ST_retcode gf_prefix_sort_rows (
+    struct rInfo *rinfo,
+    GT_size worker,
+    GT_size start,
+    GT_size nrun,
+    GT_bool apply,
+    GT_size *ng)
+{
+    struct StataInfo *st_info = rinfo->st_info;
+
+    GT_size i, *info;
+    ST_double z;
+    char *buffer, *row;
+
+    GT_size kvars    = st_info->kvars_by;
+    GT_size rowbytes = rinfo->elsize - sizeof(ST_double);
+    GT_size *ix      = rinfo->ix + start;
+
+    *ng = 1;
+    if ( apply ) rinfo->starts[start] = 1;
+    if ( nrun == 1 ) return (0);
+
+    if ( nrun > rinfo->scratch_n[worker] ) {
+        free (rinfo->scratch[worker]);
+        rinfo->scratch[worker]   = malloc(nrun * (rinfo->elsize + sizeof(GT_size)));
+        rinfo->scratch_n[worker] = nrun;
+        if ( rinfo->scratch[worker] == NULL ) {
+            rinfo->scratch_n[worker] = 0;
+            return (1702);
+        }
+    }
+
+    info   = (GT_size *) rinfo->scratch[worker];
+    buffer = rinfo->scratch[worker] + nrun * sizeof(GT_size);
+
+    for (i = 0; i < nrun; i++) {
+        row = buffer + i * rinfo->elsize;
+        z   = (ST_double) ix[i];
+        if ( st_info->kvars_by_str > 0 ) {
+            memcpy (row, st_info->st_charx + ix[i] * rowbytes, rowbytes);
+        }
+        else {
+            memcpy (row, st_info->st_numx + ix[i] * kvars, rowbytes);
+        }
+        memcpy (row + rowbytes, &z, sizeof(ST_double));
+    }
+
+    if ( st_info->kvars_by_str > 0 ) {
+        MultiQuicksortMC (
+            buffer,
+            nrun,
+            rinfo->kprefix,
+            kvars,
+            rinfo->elsize,
+            rinfo->ltypes,
+            rinfo->invert,
+            st_info->positions,
+            st_info->st_strx
+        );
+
+        *ng = MultiSortPanelSetupMC (
+            buffer,
+            nrun,
+            rinfo->kprefix,
+            kvars - 1,
+            rinfo->elsize,
+            rinfo->ltypes,
+            rinfo->invert,
+            st_info->positions,
+            st_info->st_strx,
+            info,
+            0
+        );
+    }
+    else {
+        MultiQuicksortDbl (
+            buffer,
+            nrun,
+            rinfo->kprefix,
+            kvars,
+            rinfo->elsize,
+            rinfo->invert
+        );
+
+        *ng = MultiSortPanelSetupDbl (
+            buffer,
+            nrun,
+            rinfo->kprefix,
+            kvars - 1,
+            rinfo->elsize,
+            rinfo->invert,
+            info,
+            0
+        );
+    }
+
+    if ( !apply ) return (0);
+
+    for (i = 0; i < *ng; i++)
+        rinfo->starts[start + info[i]] = 1;
+
+    for (i = 0; i < nrun; i++) {
+        memcpy (&z, buffer + i * rinfo->elsize + rowbytes, sizeof(ST_double));
+        ix[i] = (GT_size) z;
+    }
+
+    return (0);
+}
@@ -0,0 +1,66 @@
+#ifndef GTOOLS_PREFIX
+#define GTOOLS_PREFIX
+
+/*
+ * Sorted key prefix
+ * -----------------
+ *
+ * Data is often sorted by some of the by variables but not all of them
+ * (e.g. sorted by firm and grouped by firm and year). If the data is
+ * sorted by the first k of K keys, each run of rows with the same prefix
+ * is sorted on its own by the remaining K - k keys; the groups then come
+ * out in sorted order without hashing or sorting all N rows, and since
+ * the keys themselves are compared there can be no collisions. Runs are
+ * independent, so they are spread over the thread pool.
+ */
+
+// Only use the prefix if it splits the data into at least this many runs
+#define GTOOLS_PREFIX_MINRUNS 2
+
+// Runs at most this long on average are always sorted; sorting longer
+// runs is slower than grouping with the hash table unless the table
+// gives up, so we first estimate the number of groups from a sample of
+// about GTOOLS_PREFIX_SAMPLE rows (runs longer than that are not sorted).
+#define GTOOLS_PREFIX_MAXRUN 100
+#define GTOOLS_PREFIX_SAMPLE 65536
+
+struct rInfo {
+    struct StataInfo *st_info;
+    GT_size *ix;
+    GT_size *runs;
+    GT_size kprefix;
+    GT_size elsize;
+    GT_size *invert;
+    GT_size *ltypes;
+    GT_bool *starts;
+    char    **scratch;
+    GT_size *scratch_n;
+};
+
+GT_size gf_sorted_prefix (struct StataInfo *st_info);
+
+ST_retcode gf_panelsetup_prefix (
+    struct StataInfo *st_info,
+    GT_size *ix,
+    GT_size kprefix,
+    GT_bool *used
+);
+
+ST_retcode gf_prefix_estimate_groups (
+    struct rInfo *rinfo,
+    GT_size nruns,
+    GT_size *Jest
+);
+
+ST_retcode gf_prefix_sort_run (void *context, GT_size worker, GT_size item);
+
+ST_retcode gf_prefix_sort_rows (
+    struct rInfo *rinfo,
+    GT_size worker,
+    GT_size start,
+    GT_size nrun,
+    GT_bool apply,
+    GT_size *ng
+);
+
+#endif
@@ -16,14 +16,15 @@
  * @param index Stata index of sort
  * @param N number of elements
  * @param verbose Print sorting info to Stata
- * @param hash_level whether we used a bijection (0) or a 128-bit hash (1)
+ * @param tm Telemetry to record the sort used in (NULL to skip)
  * @return stable sorted @hash, with @index sorted as well
  */
 ST_retcode gf_sort_hash (
     uint64_t *hash,
     GT_size *index,
     GT_size N,
-    GT_bool verbose)
+    GT_bool verbose,
+    struct GtoolsTelemetry *tm)
 {
     GT_size i;
     ST_retcode rc = 0;
@@ -36,6 +37,7 @@ ST_retcode gf_sort_hash (
 
     if ( range < ctol ) {
         if ( (rc = gf_counting_sort (hash, index, N, min, max)) ) return(rc);
+        if ( tm != NULL ) tm->sort = "counting";
         if ( verbose ) {
             sf_printf("Counting sort on hash; min = "
                       GT_size_cfmt", max = "
@@ -44,6 +46,7 @@ ST_retcode gf_sort_hash (
     }
     else {
         if ( (rc = gf_radix_sort16 (hash, index, N)) ) return(rc);
+        if ( tm != NULL ) tm->sort = "radix";
         if ( verbose ) {
             sf_printf("Radix sort on hash (16-bits at a time)\n");
         }
@@ -232,6 +235,10 @@ ST_retcode gf_radix_sort16 (
 {
     GT_size size = 65536;
 
+    if ( (gf_pool_threads() > 1) & (N >= 2 * GTOOLS_THREADS_MINCHUNK) ) {
+        return (gf_radix_psort16 (hash, index, N));
+    }
+
     // Allocate space for index and hash copies
     // ----------------------------------------
 
@@ -261,12 +268,10 @@ ST_retcode gf_radix_sort16 (
 	counts->c2 = calloc(size, sizeof(uint32_t));
 	counts->c1 = calloc(size, sizeof(uint32_t));
 
-    for (i = 0; i < size; i++) {
-        counts->c4[0] = 0;
-        counts->c3[0] = 0;
-        counts->c2[0] = 0;
-        counts->c1[0] = 0;
-    }
+    if ( counts->c4 == NULL ) return (sf_oom_error("radixSort", "counts->c4"));
+    if ( counts->c3 == NULL ) return (sf_oom_error("radixSort", "counts->c3"));
+    if ( counts->c2 == NULL ) return (sf_oom_error("radixSort", "counts->c2"));
+    if ( counts->c1 == NULL ) return (sf_oom_error("radixSort", "counts->c1"));
 
 	// Calculate counts
 	// ----------------
@@ -345,6 +350,151 @@ ST_retcode gf_radix_sort16 (
     return (0);
 }
 
+/**
+ * @brief Parallel radix sort with index (16-bit)
+ *
+ * LSD radix sort where each pass is split across the shared thread pool:
+ * every task counts the 16-bit digit over its own contiguous block of
+ * rows, the per-task counts are turned into starting offsets (all of
+ * digit d in task 0, then task 1, and so on, which keeps the sort
+ * stable), and each task then scatters its own block. Passes where every
+ * element has the same digit (e.g. the upper bits of a bijection) are
+ * skipped.
+ *
+ * @param hash hash to sort
+ * @param index Hash sort index
+ * @param N number of elements
+ * @return Radix sort on hash array.
+ */
+ST_retcode gf_radix_psort16 (
+    uint64_t *hash,
+    GT_size *index,
+    GT_size N)
+{
+    ST_retcode rc = 0;
+    GT_size size   = 65536;
+    GT_size ntasks = gf_pool_ntasks(N);
+
+    GT_size d, i, k, pass, offset, total;
+    GT_bool skip;
+
+    uint64_t *hswap;
+    GT_size  *ixswap;
+
+    uint64_t *hcopy  = calloc(N, sizeof *hcopy);
+    GT_size  *ixcopy = calloc(N, sizeof *ixcopy);
+    GT_size  *counts = calloc(ntasks * size, sizeof *counts);
+    struct pInfo *pinfo = calloc(ntasks, sizeof *pinfo);
+
+    if ( hcopy  == NULL ) { rc = sf_oom_error("gf_radix_psort16", "hcopy");  goto exit; }
+    if ( ixcopy == NULL ) { rc = sf_oom_error("gf_radix_psort16", "ixcopy"); goto exit; }
+    if ( counts == NULL ) { rc = sf_oom_error("gf_radix_psort16", "counts"); goto exit; }
+    if ( pinfo  == NULL ) { rc = sf_oom_error("gf_radix_psort16", "pinfo");  goto exit; }
+
+    for (k = 0; k < ntasks; k++) {
+        pinfo[k].hash   = hash;
+        pinfo[k].hcopy  = hcopy;
+        pinfo[k].index  = index;
+        pinfo[k].ixcopy = ixcopy;
+        pinfo[k].counts = counts + k * size;
+        gf_pool_split (N, ntasks, k, &(pinfo[k].start), &(pinfo[k].end));
+    }
+
+    for (pass = 0; pass < 4; pass++) {
+        for (k = 0; k < ntasks; k++)
+            pinfo[k].shift = 16 * pass;
+
+        gf_pool_run (gf_radix_pcounts16, pinfo, sizeof *pinfo, ntasks);
+
+        // Counts to offsets, digit-major then task order
+        skip   = 0;
+        offset = 0;
+        for (d = 0; d < size; d++) {
+            total = 0;
+            for (k = 0; k < ntasks; k++) {
+                i = counts[k * size + d];
+                counts[k * size + d] = offset;
+                offset += i;
+                total  += i;
+            }
+            if ( total == N ) {
+                skip = 1;
+                break;
+            }
+        }
+
+        if ( skip ) continue;
+
+        gf_pool_run (gf_radix_pscatter16, pinfo, sizeof *pinfo, ntasks);
+
+        for (k = 0; k < ntasks; k++) {
+            hswap  = pinfo[k].hash;
+            ixswap = pinfo[k].index;
+            pinfo[k].hash   = pinfo[k].hcopy;
+            pinfo[k].index  = pinfo[k].ixcopy;
+            pinfo[k].hcopy  = hswap;
+            pinfo[k].ixcopy = ixswap;
+        }
+    }
+
+    // Sorted data ends in whichever buffer the last pass wrote to
+    if ( pinfo[0].hash != hash ) {
+        memcpy (hash,  pinfo[0].hash,  N * sizeof *hash);
+        memcpy (index, pinfo[0].index, N * sizeof *index);
+    }
+
+exit:
+    free (pinfo);
+    free (counts);
+    free (ixcopy);
+    free (hcopy);
+
+    return (rc);
+}
+
+/**
+ * @brief Count one 16-bit digit over one block (one pool task)
+ */
+void* gf_radix_pcounts16 (void *argument)
+{
+    struct pInfo *pinfo = ((struct pInfo *) argument);
+
+    GT_size i;
+    GT_size *counts = pinfo->counts;
+    uint64_t *hash  = pinfo->hash;
+    GT_size shift   = pinfo->shift;
+
+    memset (counts, 0, 65536 * sizeof *counts);
+    for (i = pinfo->start; i < pinfo->end; i++)
+        counts[(hash[i] >> shift) & 0xffff]++;
+
+    return (NULL);
+}
+
+/**
+ * @brief Scatter one block by its 16-bit digit (one pool task)
+ */
+void* gf_radix_pscatter16 (void *argument)
+{
+    struct pInfo *pinfo = ((struct pInfo *) argument);
+
+    GT_size i, pos;
+    GT_size *counts  = pinfo->counts;
+    uint64_t *hash   = pinfo->hash;
+    uint64_t *hcopy  = pinfo->hcopy;
+    GT_size  *index  = pinfo->index;
+    GT_size  *ixcopy = pinfo->ixcopy;
+    GT_size shift    = pinfo->shift;
+
+    for (i = pinfo->start; i < pinfo->end; i++) {
+        pos = counts[(hash[i] >> shift) & 0xffff]++;
+        hcopy[pos]  = hash[i];
+        ixcopy[pos] = index[i];
+    }
+
+    return (NULL);
+}
+
 /**
  * @brief Counting sort with index
  *
@@ -430,3 +580,329 @@ ST_retcode gf_counting_sort (
 
     return (0);
 }
+
+/**
+ * @brief Order-preserving 64-bit key of a double
+ *
+ * Flip every bit of negative numbers and only the sign bit of the rest,
+ * so the keys compare as unsigned integers in the same order as the
+ * numbers (missing values, which are encoded as the largest doubles,
+ * come last in the order . .a ... .z). -0 is mapped to 0 since they
+ * compare equal. Descending variables (@invert) take the complement.
+ *
+ * @param z number
+ * @param invert whether the variable is sorted in descending order
+ * @return key
+ */
+static inline uint64_t gf_radix_dbl_key (ST_double z, GT_size invert)
+{
+    uint64_t bits;
+    if ( z == 0 ) z = 0;
+    memcpy (&bits, &z, sizeof(bits));
+    bits = (bits & 0x8000000000000000ULL)? ~bits: (bits | 0x8000000000000000ULL);
+    return (invert? ~bits: bits);
+}
+
+/**
+ * @brief Sort rows of doubles by several columns with radix sorts
+ *
+ * Drop-in replacement for MultiQuicksortDbl: the rows of @start are
+ * sorted by columns @kstart to @kend (descending where @invert). Each
+ * column, last to first, is mapped to order-preserving 64-bit keys (see
+ * gf_radix_dbl_key) and the row index is stably sorted by them with
+ * gf_sort_hash, so after the pass for @kstart the rows are in order by
+ * all the columns. The rows are then permuted once. With few rows the
+ * passes cost more than the comparisons, so this falls back on
+ * MultiQuicksortDbl.
+ *
+ * Since it may use the thread pool, do not call it from a pool task.
+ *
+ * @param start Rows to sort
+ * @param N Number of rows
+ * @param kstart First column to sort by
+ * @param kend Last column to sort by
+ * @param elsize Size of each row, in bytes
+ * @param invert Whether to sort each column in descending order
+ * @return @start sorted in place
+ */
+ST_retcode gf_radix_sort_dbl (
+    void *start,
+    GT_size N,
+    GT_size kstart,
+    GT_size kend,
+    GT_size elsize,
+    GT_size *invert)
+{
+    ST_retcode rc = 0;
+    GT_size i, k;
+    GT_size kcols = elsize / sizeof(ST_double);
+    ST_double *rows = (ST_double *) start;
+
+    if ( N < GTOOLS_RADIX_DBL_MIN ) {
+        MultiQuicksortDbl (start, N, kstart, kend, elsize, invert);
+        return (0);
+    }
+
+    uint64_t *keys = calloc(N, sizeof *keys);
+    GT_size  *ix   = calloc(N, sizeof *ix);
+    char     *copy = NULL;
+
+    if ( keys == NULL ) return (sf_oom_error("gf_radix_sort_dbl", "keys"));
+    if ( ix   == NULL ) return (sf_oom_error("gf_radix_sort_dbl", "ix"));
+
+    for (i = 0; i < N; i++)
+        ix[i] = i;
+
+    for (k = kend + 1; k-- > kstart; ) {
+        for (i = 0; i < N; i++)
+            keys[i] = gf_radix_dbl_key(rows[ix[i] * kcols + k], invert[k]);
+
+        if ( (rc = gf_sort_hash (keys, ix, N, 0, NULL)) ) goto exit;
+    }
+
+    if ( (copy = malloc(N * elsize)) == NULL ) {
+        rc = sf_oom_error("gf_radix_sort_dbl", "copy");
+        goto exit;
+    }
+
+    for (i = 0; i < N; i++)
+        memcpy (copy + i * elsize, (char *) start + ix[i] * elsize, elsize);
+
+    memcpy (start, copy, N * elsize);
+
+exit:
+    free (keys);
+    free (ix);
+    free (copy);
+
+    return (rc);
+}
+
+/**
+ * @brief Byte @depth of the sort key of a row's column
+ *
+ * Strings are their own keys (byte 0 marks the end of the string, so
+ * shorter strings come first as with strcmp); numbers are the 8 bytes,
+ * most significant first, of gf_radix_dbl_key.
+ *
+ * @param row Row
+ * @param ischar Whether the column is a string
+ * @param invert Whether the column is sorted in descending order
+ * @param position Offset of the column in the row
+ * @param strx String arena
+ * @param depth Byte of the key
+ * @return byte
+ */
+static inline GT_size gf_radix_mc_byte (
+    char *row,
+    GT_bool ischar,
+    GT_size invert,
+    GT_size position,
+    char *strx,
+    GT_size depth)
+{
+    if ( ischar ) {
+        return ((unsigned char) GTOOLS_STRREF_STR(strx, row + position)[depth]);
+    }
+    else {
+        return ((gf_radix_dbl_key(*((ST_double *) (row + position)), invert) >> (56 - 8 * depth)) & 0xff);
+    }
+}
+
+/**
+ * @brief Compare two rows from byte @depth of column @k onwards
+ *
+ * Same order as MultiQuicksortMC. Rows sharing the first @depth bytes
+ * of the key of column @k need only be compared from there.
+ */
+static inline int gf_radix_mc_compare (
+    char *a,
+    char *b,
+    GT_size k,
+    GT_size kend,
+    GT_size depth,
+    GT_size *ltypes,
+    GT_size *invert,
+    GT_size *positions,
+    char *strx)
+{
+    int cmp;
+    for (; k <= kend; k++, depth = 0) {
+        if ( ltypes[k] > 0 ) {
+            cmp = BaseCompareChar(GTOOLS_STRREF_STR(strx, a + positions[k]) + depth,
+                                  GTOOLS_STRREF_STR(strx, b + positions[k]) + depth);
+        }
+        else {
+            cmp = BaseCompareNum(*((ST_double *) (a + positions[k])),
+                                 *((ST_double *) (b + positions[k])));
+        }
+        if ( cmp ) return (invert[k]? -cmp: cmp);
+    }
+    return (0);
+}
+
+/**
+ * @brief Sort rows of strings and numbers with an MSD radix sort
+ *
+ * Drop-in replacement for MultiQuicksortMC, which compares whole strings
+ * at every step of the quicksort; with long common prefixes (paths,
+ * URLs, IDs) those comparisons dominate the sort. Instead the row index
+ * is split into 256 buckets by one byte of the key of column @k at a
+ * time, most significant first: strings byte by byte and numbers by
+ * the 8 bytes of their order-preserving key (see gf_radix_dbl_key).
+ * Rows whose key for column @k has ended (the end of the string or the
+ * last byte of the number) move on to column @k + 1.
+ *
+ * Runs left to sort are kept in a stack instead of recursing, since a
+ * long string may take as many passes as it has bytes. A run where all
+ * the rows share the byte is not split, just moved to the next byte (so
+ * a common prefix costs one counting pass per byte). Runs with fewer
+ * than GTOOLS_RADIX_MC_INSERT rows are insertion sorted, comparing the
+ * strings from the current byte only. The rows are permuted once at the
+ * end; with few rows this falls back on MultiQuicksortMC.
+ *
+ * @param start Rows to sort
+ * @param N Number of rows
+ * @param kstart First column to sort by
+ * @param kend Last column to sort by
+ * @param elsize Size of each row, in bytes
+ * @param ltypes Whether each column is a string (> 0)
+ * @param invert Whether to sort each column in descending order
+ * @param positions Offset of each column in the row
+ * @param strx String arena
+ * @return @start sorted in place
+ */
+ST_retcode gf_radix_sort_mc (
+    void *start,
+    GT_size N,
+    GT_size kstart,
+    GT_size kend,
+    GT_size elsize,
+    GT_size *ltypes,
+    GT_size *invert,
+    GT_size *positions,
+    char *strx)
+{
+    ST_retcode rc = 0;
+    GT_size i, j, b, c, n, lo, k, depth, ix1, last, nstack, alloc, offsets[256];
+    GT_bool ischar, keyend;
+    char *rows = (char *) start;
+    struct radixRunMC *grown;
+
+    if ( N < GTOOLS_RADIX_MC_MIN ) {
+        MultiQuicksortMC (start, N, kstart, kend, elsize, ltypes, invert, positions, strx);
+        return (0);
+    }
+
+    GT_size  *ix    = calloc(N, sizeof *ix);
+    GT_size  *tmp   = calloc(N, sizeof *tmp);
+    uint8_t  *bytes = calloc(N, sizeof *bytes);
+    char     *copy  = NULL;
+
+    alloc  = 1024;
+    nstack = 0;
+    struct radixRunMC *stack = calloc(alloc, sizeof *stack);
+
+    if ( ix    == NULL ) return (sf_oom_error("gf_radix_sort_mc", "ix"));
+    if ( tmp   == NULL ) return (sf_oom_error("gf_radix_sort_mc", "tmp"));
+    if ( bytes == NULL ) return (sf_oom_error("gf_radix_sort_mc", "bytes"));
+    if ( stack == NULL ) return (sf_oom_error("gf_radix_sort_mc", "stack"));
+
+    for (i = 0; i < N; i++)
+        ix[i] = i;
+
+    stack[nstack++] = (struct radixRunMC) { 0, N, kstart, 0 };
+    while ( nstack > 0 ) {
+        lo    = stack[--nstack].lo;
+        n     = stack[nstack].n;
+        k     = stack[nstack].k;
+        depth = stack[nstack].depth;
+
+        if ( n < GTOOLS_RADIX_MC_INSERT ) {
+            for (i = lo + 1; i < lo + n; i++) {
+                ix1 = ix[i];
+                for (j = i; j > lo; j--) {
+                    if ( gf_radix_mc_compare(rows + ix[j - 1] * elsize,
+                                             rows + ix1 * elsize,
+                                             k, kend, depth,
+                                             ltypes, invert, positions, strx) <= 0 ) break;
+                    ix[j] = ix[j - 1];
+                }
+                ix[j] = ix1;
+            }
+            continue;
+        }
+
+        ischar = (ltypes[k] > 0);
+        memset (offsets, 0, sizeof offsets);
+        for (i = lo; i < lo + n; i++) {
+            bytes[i] = gf_radix_mc_byte(rows + ix[i] * elsize, ischar, invert[k], positions[k], strx, depth);
+            offsets[bytes[i]]++;
+        }
+
+        keyend = ischar? 0: (depth == 7);
+        if ( offsets[bytes[lo]] == n ) {
+            if ( keyend || (ischar && (bytes[lo] == 0)) ) {
+                if ( k < kend )
+                    stack[nstack++] = (struct radixRunMC) { lo, n, k + 1, 0 };
+            }
+            else {
+                stack[nstack++] = (struct radixRunMC) { lo, n, k, depth + 1 };
+            }
+            continue;
+        }
+
+        if ( nstack + 256 > alloc ) {
+            alloc *= 2;
+            if ( (grown = realloc(stack, alloc * sizeof *stack)) == NULL ) {
+                rc = sf_oom_error("gf_radix_sort_mc", "stack");
+                goto exit;
+            }
+            stack = grown;
+        }
+
+        // String bytes are sorted in reverse for descending variables
+        // (the complement is already part of the numeric key); the end
+        // of the string, byte 0, then comes last.
+        last = lo;
+        for (b = 0; b < 256; b++) {
+            c = (ischar && invert[k])? 255 - b: b;
+            n = offsets[c];
+            offsets[c] = last;
+            if ( n > 1 ) {
+                if ( keyend || (ischar && (c == 0)) ) {
+                    if ( k < kend )
+                        stack[nstack++] = (struct radixRunMC) { last, n, k + 1, 0 };
+                }
+                else {
+                    stack[nstack++] = (struct radixRunMC) { last, n, k, depth + 1 };
+                }
+            }
+            last += n;
+        }
+
+        for (i = lo; i < last; i++)
+            tmp[offsets[bytes[i]]++] = ix[i];
+
+        memcpy (ix + lo, tmp + lo, (last - lo) * sizeof *ix);
+    }
+
+    if ( (copy = malloc(N * elsize)) == NULL ) {
+        rc = sf_oom_error("gf_radix_sort_mc", "copy");
+        goto exit;
+    }
+
+    for (i = 0; i < N; i++)
+        memcpy (copy + i * elsize, rows + ix[i] * elsize, elsize);
+
+    memcpy (start, copy, N * elsize);
+
+exit:
+    free (ix);
+    free (tmp);
+    free (bytes);
+    free (stack);
+    free (copy);
+
+    return (rc);
+}
@@ -22,10 +22,62 @@ struct  radixCounts16 {
     uint32_t *c1;
 };
 
-int gf_sort_hash     (uint64_t *hash, GT_size *index, GT_size N, GT_bool verbose);
+int gf_sort_hash     (uint64_t *hash, GT_size *index, GT_size N, GT_bool verbose, struct GtoolsTelemetry *tm);
 int gf_radix_sort8   (uint64_t *hash, GT_size *index, GT_size N);
 int gf_radix_sort16  (uint64_t *hash, GT_size *index, GT_size N);
 int gf_counting_sort (uint64_t *hash, GT_size *index, GT_size N, uint64_t min, uint64_t max);
 
+int gf_radix_psort16 (uint64_t *hash, GT_size *index, GT_size N);
+
+// Fewer rows than this are sorted with MultiQuicksortDbl
+#define GTOOLS_RADIX_DBL_MIN 4096
+
+int gf_radix_sort_dbl (
+    void *start,
+    GT_size N,
+    GT_size kstart,
+    GT_size kend,
+    GT_size elsize,
+    GT_size *invert
+);
+
+// Fewer rows than this are sorted with MultiQuicksortMC; runs with
+// fewer rows than GTOOLS_RADIX_MC_INSERT are insertion sorted
+#define GTOOLS_RADIX_MC_MIN    4096
+#define GTOOLS_RADIX_MC_INSERT 32
+
+struct radixRunMC {
+    GT_size lo;
+    GT_size n;
+    GT_size k;
+    GT_size depth;
+};
+
+int gf_radix_sort_mc (
+    void *start,
+    GT_size N,
+    GT_size kstart,
+    GT_size kend,
+    GT_size elsize,
+    GT_size *ltypes,
+    GT_size *invert,
+    GT_size *positions,
+    char *strx
+);
+
+struct pInfo {
+    uint64_t *hash;
+    uint64_t *hcopy;
+    GT_size  *index;
+    GT_size  *ixcopy;
+    GT_size  *counts;
+    GT_size  start;
+    GT_size  end;
+    GT_size  shift;
+};
+
+void* gf_radix_pcounts16  (void *argument);
+void* gf_radix_pscatter16 (void *argument);
+
 
 #endif
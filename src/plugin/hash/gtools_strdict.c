@@ -0,0 +1,321 @@
+#include "gtools_strdict.h"
+
+/**
+ * @brief Encode the string by variables as dense integer codes
+ *
+ * Called when picking the bijection or the hash if the numeric by
+ * variables, if any, are all integers (see gf_bijection_limits).
+ * Each string variable is encoded in turn (see gf_strdict_column) into
+ * st_strcode, an N by kstr array, and its bijection limits are set to
+ * 1 and D. If the codes together with the ranges of the numeric
+ * variables could not fit under GTOOLS_BIJECTION_LIMIT we give up as
+ * soon as that is clear and leave byvars_intonly at 0, so the rows are
+ * hashed as usual.
+ *
+ * @param st_info Meta structure with all the variables and data
+ * @param sortcodes Whether codes must follow the sort order of the strings
+ * @return Stores the codes in st_strcode
+ */
+ST_retcode gf_strdict_encode (struct StataInfo *st_info, GT_bool sortcodes)
+{
+    ST_retcode rc = 0;
+    GT_size k, s, D, range;
+    GT_size N     = st_info->N;
+    GT_size kvars = st_info->kvars_by;
+    GT_size kstr  = st_info->kvars_by_str;
+    GT_size room  = GTOOLS_BIJECTION_LIMIT;
+
+    // Room the numeric variables leave for the codes
+    for (k = 0; k < kvars; k++) {
+        if ( st_info->byvars_lens[k] == 0 ) {
+            range = st_info->byvars_maxs[k] - st_info->byvars_mins[k] + 1;
+            room /= range;
+        }
+    }
+
+    if ( room < 1 ) {
+        st_info->byvars_intonly = 0;
+        return (0);
+    }
+
+    st_info->st_strcode = gf_arena_calloc(st_info->arena, (N > 0? N: 1) * kstr, sizeof(st_info->st_strcode));
+    if ( st_info->st_strcode == NULL ) return (sf_oom_error("gf_strdict_encode", "st_info->st_strcode"));
+    GTOOLS_GC_ALLOCATED("st_info->st_strcode")
+
+    for (k = s = 0; k < kvars; k++) {
+        if ( st_info->byvars_lens[k] == 0 ) continue;
+
+        if ( (rc = gf_strdict_column (st_info, k, s, room, sortcodes, &D)) ) goto exit;
+        if ( D > room ) {
+            if ( st_info->verbose )
+                sf_printf("Too many distinct strings for the bijection; will hash.\n");
+            gf_strdict_free (st_info);
+            st_info->byvars_intonly = 0;
+            goto exit;
+        }
+
+        if ( st_info->verbose )
+            sf_printf("Encoded string by variable "GT_size_cfmt" ("
+                      GT_size_cfmt" distinct values)\n", k + 1, D);
+
+        st_info->byvars_mins[k] = 1;
+        st_info->byvars_maxs[k] = GTOOLS_PWMAX(D, 1);
+        room /= GTOOLS_PWMAX(D, 1);
+        s++;
+    }
+
+exit:
+    return (rc);
+}
+
+/**
+ * @brief Encode one string by variable
+ *
+ * Intern the strings of variable @k through an open-addressing table
+ * keyed on a 64-bit hash of each string; entries point back to the first
+ * row with that string, which is compared in full on a hash match (so
+ * there can be no collisions). Rows get codes 1 to D in order of first
+ * appearance. With @sortcodes the D distinct strings are then sorted
+ * (with gf_radix_sort_mc, in the same order as MultiQuicksortMC) and
+ * rows are relabeled with the rank of their string.
+ *
+ * The strings are hashed across the thread pool first (the hashes are
+ * kept in the rows' code slots until they are replaced by the codes),
+ * so the serial pass only probes the table. It prefetches the slot of
+ * the row GTOOLS_STRDICT_AHEAD rows ahead and, halfway there, the string
+ * that slot points to.
+ *
+ * @param st_info Meta structure with all the variables and data
+ * @param k Position of the variable among the by variables
+ * @param s Position of the variable among the string by variables
+ * @param maxD Give up if there are more than this many distinct strings
+ * @param sortcodes Whether codes must follow the sort order of the strings
+ * @param D Number of distinct strings (@maxD + 1 if we gave up)
+ * @return Stores the codes in column @s of st_strcode
+ */
+ST_retcode gf_strdict_column (
+    struct StataInfo *st_info,
+    GT_size k,
+    GT_size s,
+    GT_size maxD,
+    GT_bool sortcodes,
+    GT_size *D)
+{
+    ST_retcode rc = 0;
+    GT_size i, j, id, len, ntasks;
+    uint64_t h, ref;
+    char *str;
+    struct GtoolsStrDictSlot *slot;
+
+    GT_size N          = st_info->N;
+    GT_size kstr       = st_info->kvars_by_str;
+    GT_size rowbytes   = st_info->rowbytes;
+    GT_size *codes     = st_info->st_strcode + s;
+    char    *row       = st_info->st_charx + st_info->positions[k];
+    char    *strx      = st_info->st_strx;
+    GT_size ascending  = 0;
+    GT_size refpos[2]  = {0, sizeof(uint64_t)};
+    GT_size *rank      = NULL;
+    char    *sorted    = NULL;
+    struct dInfo *dinfo;
+
+    struct GtoolsStrDict dict;
+    dict.nslots = GTOOLS_STRDICT_INIT;
+    dict.shift  = 64 - 10;
+    dict.D      = 0;
+    dict.slots  = calloc(dict.nslots, sizeof *dict.slots);
+
+    if ( dict.slots == NULL ) {
+        rc = sf_oom_error("gf_strdict_column", "dict.slots");
+        goto exit;
+    }
+
+    // Hash the strings
+    // ----------------
+
+    ntasks = gf_pool_ntasks(N);
+    dinfo  = calloc(ntasks, sizeof *dinfo);
+    if ( dinfo == NULL ) {
+        rc = sf_oom_error("gf_strdict_column", "dinfo");
+        goto exit;
+    }
+
+    for (i = 0; i < ntasks; i++) {
+        dinfo[i].st_info = st_info;
+        dinfo[i].codes   = codes;
+        dinfo[i].row     = row;
+        gf_pool_split (N, ntasks, i, &(dinfo[i].start), &(dinfo[i].end));
+    }
+
+    gf_pool_run (gf_strdict_phash, dinfo, sizeof *dinfo, ntasks);
+    free (dinfo);
+
+    // Intern the strings
+    // ------------------
+
+    // The table is at most half full, so probing is short and always
+    // terminates; id 0 marks an empty slot.
+
+    for (i = 0; i < N; i++, row += rowbytes) {
+        if ( i + GTOOLS_STRDICT_AHEAD < N ) {
+            GTOOLS_PREFETCH(dict.slots + (codes[(i + GTOOLS_STRDICT_AHEAD) * kstr] >> dict.shift));
+        }
+        if ( i + GTOOLS_STRDICT_AHEAD / 2 < N ) {
+            slot = dict.slots + (codes[(i + GTOOLS_STRDICT_AHEAD / 2) * kstr] >> dict.shift);
+            if ( slot->id ) GTOOLS_PREFETCH(strx + GTOOLS_STRREF_OFF(slot->ref));
+        }
+
+        h   = codes[i * kstr];
+        ref = GTOOLS_STRREF_GET(row);
+        len = GTOOLS_STRREF_LEN(ref);
+        str = strx + GTOOLS_STRREF_OFF(ref);
+probe:
+        slot = dict.slots + (h >> dict.shift);
+        while ( (id = slot->id) ) {
+            if ( (slot->hash == h)
+                    && (GTOOLS_STRREF_LEN(slot->ref) == len)
+                    && (memcmp(strx + GTOOLS_STRREF_OFF(slot->ref), str, len) == 0) )
+                break;
+            slot = dict.slots + ((slot - dict.slots + 1) & (dict.nslots - 1));
+        }
+
+        if ( id == 0 ) {
+            if ( dict.D >= maxD ) {
+                dict.D = maxD + 1;
+                goto exit;
+            }
+
+            if ( 2 * (dict.D + 1) > dict.nslots ) {
+                if ( (rc = gf_strdict_grow (&dict)) ) goto exit;
+                goto probe;
+            }
+
+            slot->hash = h;
+            slot->ref  = ref;
+            id = slot->id = ++dict.D;
+        }
+
+        codes[i * kstr] = id;
+    }
+
+    // Relabel codes in sort order
+    // ---------------------------
+
+    // Sort (reference, code) pairs of the D distinct strings, then map
+    // each code to its rank.
+
+    if ( sortcodes & (dict.D > 1) ) {
+        sorted = calloc(dict.D, 2 * sizeof(uint64_t));
+        rank   = calloc(dict.D, sizeof *rank);
+        if ( sorted == NULL ) {
+            rc = sf_oom_error("gf_strdict_column", "sorted");
+            goto exit;
+        }
+        if ( rank == NULL ) {
+            rc = sf_oom_error("gf_strdict_column", "rank");
+            goto exit;
+        }
+
+        for (j = 0; j < dict.nslots; j++) {
+            if ( (id = dict.slots[j].id) ) {
+                memcpy (sorted + (id - 1) * 2 * sizeof(uint64_t), &(dict.slots[j].ref), sizeof(uint64_t));
+                memcpy (sorted + (id - 1) * 2 * sizeof(uint64_t) + refpos[1], &id, sizeof(GT_size));
+            }
+        }
+
+        if ( (rc = gf_radix_sort_mc (sorted,
+                                     dict.D,
+                                     0,
+                                     0,
+                                     2 * sizeof(uint64_t),
+                                     st_info->byvars_lens + k,
+                                     &ascending,
+                                     refpos,
+                                     strx)) ) goto exit;
+
+        for (j = 0; j < dict.D; j++) {
+            memcpy (&id, sorted + j * 2 * sizeof(uint64_t) + refpos[1], sizeof(GT_size));
+            rank[id - 1] = j + 1;
+        }
+
+        for (i = 0; i < N; i++)
+            codes[i * kstr] = rank[codes[i * kstr] - 1];
+    }
+
+exit:
+    *D = dict.D;
+
+    free (dict.slots);
+    free (sorted);
+    free (rank);
+
+    return (rc);
+}
+
+/**
+ * @brief Hash the strings in a block of rows (one pool task)
+ *
+ * @param argument dInfo with the [start, end) rows to hash
+ * @return Stores the 64-bit hash of each string in its row's code slot
+ */
+void* gf_strdict_phash (void *argument)
+{
+    struct dInfo *dinfo = ((struct dInfo *) argument);
+    struct StataInfo *st_info = dinfo->st_info;
+
+    GT_size i;
+    uint64_t ref;
+    GT_size kstr     = st_info->kvars_by_str;
+    GT_size rowbytes = st_info->rowbytes;
+    char    *row     = dinfo->row + dinfo->start * rowbytes;
+
+    for (i = dinfo->start; i < dinfo->end; i++, row += rowbytes) {
+        ref = GTOOLS_STRREF_GET(row);
+        dinfo->codes[i * kstr] = spookyhash_64(st_info->st_strx + GTOOLS_STRREF_OFF(ref),
+                                               GTOOLS_STRREF_LEN(ref), 0);
+    }
+
+    return (NULL);
+}
+
+/**
+ * @brief Double the number of slots in the string dictionary
+ *
+ * @param dict String dictionary
+ * @return Re-inserts every string into a table twice the size
+ */
+ST_retcode gf_strdict_grow (struct GtoolsStrDict *dict)
+{
+    GT_size j, s;
+    struct GtoolsStrDictSlot *old = dict->slots;
+
+    dict->nslots *= 2;
+    dict->shift  -= 1;
+    dict->slots   = calloc(dict->nslots, sizeof *dict->slots);
+
+    if ( dict->slots == NULL ) {
+        dict->slots = old;
+        return (sf_oom_error("gf_strdict_grow", "dict->slots"));
+    }
+
+    for (j = 0; j < dict->nslots / 2; j++) {
+        if ( old[j].id == 0 ) continue;
+        s = old[j].hash >> dict->shift;
+        while ( dict->slots[s].id )
+            s = (s + 1) & (dict->nslots - 1);
+        dict->slots[s] = old[j];
+    }
+
+    free (old);
+    return (0);
+}
+
+/**
+ * @brief Free the string codes once the bijection no longer needs them
+ */
+void gf_strdict_free (struct StataInfo *st_info)
+{
+    gf_arena_free (st_info->arena, st_info->st_strcode);
+    st_info->st_strcode = NULL;
+    GTOOLS_GC_FREED("st_info->st_strcode")
+}
@@ -0,0 +1,63 @@
+#ifndef GTOOLS_STRDICT
+#define GTOOLS_STRDICT
+
+/*
+ * String dictionary
+ * -----------------
+ *
+ * A string by variable used to rule out the bijection, so any by list
+ * with a string was hashed with the 128-bit hash, checked for
+ * collisions, and its groups sorted by comparing strings. Instead, each
+ * string variable is interned into dense integer codes 1 to D (D is the
+ * number of distinct values) through a hash table on the strings
+ * themselves. The codes follow the sort order of the strings (unless
+ * the output need not be sorted) and stand in for the strings in the
+ * bijection (see gf_biject_varlist), so e.g. by(state year) is grouped
+ * the same way as two integer variables.
+ */
+
+// Initial number of slots (must be a power of 2)
+#define GTOOLS_STRDICT_INIT 1024
+
+// Rows ahead of the current one whose slot (and then string) we prefetch
+#define GTOOLS_STRDICT_AHEAD 16
+
+struct GtoolsStrDictSlot {
+    uint64_t hash;
+    uint64_t ref;
+    GT_size  id;
+};
+
+struct GtoolsStrDict {
+    GT_size nslots;
+    GT_size shift;
+    GT_size D;
+    struct GtoolsStrDictSlot *slots;
+};
+
+struct dInfo {
+    struct StataInfo *st_info;
+    GT_size *codes;
+    char    *row;
+    GT_size start;
+    GT_size end;
+};
+
+ST_retcode gf_strdict_encode (struct StataInfo *st_info, GT_bool sortcodes);
+
+ST_retcode gf_strdict_column (
+    struct StataInfo *st_info,
+    GT_size k,
+    GT_size s,
+    GT_size maxD,
+    GT_bool sortcodes,
+    GT_size *D
+);
+
+void* gf_strdict_phash (void *argument);
+
+ST_retcode gf_strdict_grow (struct GtoolsStrDict *dict);
+
+void gf_strdict_free (struct StataInfo *st_info);
+
+#endif
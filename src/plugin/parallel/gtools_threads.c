@@ -0,0 +1,515 @@
+#include "gtools_threads.h"
+
+static struct GtoolsPool *GtoolsThreadPool = NULL;
+
+#if GMULTI
+static void gf_pool_take (struct GtoolsPool *pool);
+static void* gf_pool_worker (void *argument);
+#endif
+
+static void* gf_pool_steal_worker (void *argument);
+static ST_retcode gf_pool_steal_rc (struct GtoolsSteal *steal, ST_retcode rc);
+static GT_bool gf_pool_steal_pop (
+    struct GtoolsSteal *steal,
+    GT_size worker,
+    GT_size *lo,
+    GT_size *hi
+);
+
+/**
+ * @brief Start the shared worker pool
+ *
+ * Spawns nthreads - 1 workers that sleep until work is submitted via
+ * gf_pool_run. If nthreads is 0 we use the number of online processors.
+ * A pool that is already running with the requested number of threads is
+ * left as is; otherwise it is torn down and started anew.
+ *
+ * @param nthreads Number of threads (including the calling thread)
+ * @return Sets up GtoolsThreadPool
+ */
+ST_retcode gf_pool_init (GT_size nthreads)
+{
+#if GMULTI
+    GT_size i;
+    long nproc;
+
+    if ( nthreads == 0 ) {
+#ifdef _SC_NPROCESSORS_ONLN
+        nproc    = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = nproc > 0? (GT_size) nproc: 4;
+#else
+        nproc    = 4;
+        nthreads = nproc;
+#endif
+    }
+#else
+    nthreads = 1;
+#endif
+
+    if ( nthreads > GTOOLS_THREADS_MAX ) nthreads = GTOOLS_THREADS_MAX;
+
+    if ( GtoolsThreadPool != NULL ) {
+        if ( GtoolsThreadPool->nthreads == nthreads ) return (0);
+        gf_pool_free();
+    }
+
+    struct GtoolsPool *pool = calloc(1, sizeof *pool);
+    if ( pool == NULL ) return (sf_oom_error("gf_pool_init", "pool"));
+
+    pool->nthreads = nthreads;
+    pool->ntasks   = 0;
+    pool->next     = 0;
+    pool->pending  = 0;
+    pool->shutdown = 0;
+    pool->busy     = 0;
+    pool->fun      = NULL;
+    pool->args     = NULL;
+    pool->argsize  = 0;
+
+#if GMULTI
+    pool->workers = calloc(nthreads, sizeof *pool->workers);
+    if ( pool->workers == NULL ) {
+        free (pool);
+        return (sf_oom_error("gf_pool_init", "pool->workers"));
+    }
+
+    pthread_mutex_init (&(pool->lock), NULL);
+    pthread_cond_init  (&(pool->work), NULL);
+    pthread_cond_init  (&(pool->done), NULL);
+
+    for (i = 1; i < nthreads; i++) {
+        if ( pthread_create(pool->workers + i, NULL, gf_pool_worker, pool) ) {
+            // Run with however many workers we were able to start
+            pool->nthreads = i;
+            break;
+        }
+    }
+#endif
+
+    GtoolsThreadPool = pool;
+    return (0);
+}
+
+/**
+ * @brief Stop the shared worker pool and join all workers
+ */
+void gf_pool_free (void)
+{
+    struct GtoolsPool *pool = GtoolsThreadPool;
+    if ( pool == NULL ) return;
+
+#if GMULTI
+    GT_size i;
+
+    pthread_mutex_lock (&(pool->lock));
+    pool->shutdown = 1;
+    pthread_cond_broadcast (&(pool->work));
+    pthread_mutex_unlock (&(pool->lock));
+
+    for (i = 1; i < pool->nthreads; i++)
+        pthread_join (pool->workers[i], NULL);
+
+    pthread_mutex_destroy (&(pool->lock));
+    pthread_cond_destroy  (&(pool->work));
+    pthread_cond_destroy  (&(pool->done));
+    free (pool->workers);
+#endif
+
+    free (pool);
+    GtoolsThreadPool = NULL;
+}
+
+/**
+ * @brief Number of threads available to parallel stages
+ */
+GT_size gf_pool_threads (void)
+{
+    return (GtoolsThreadPool == NULL? 1: GtoolsThreadPool->nthreads);
+}
+
+/**
+ * @brief Number of tasks to split N elements into
+ *
+ * One task per thread, but no task is smaller than
+ * GTOOLS_THREADS_MINCHUNK elements (small inputs run in one task).
+ *
+ * @param N Number of elements
+ * @return Number of tasks, at least 1
+ */
+GT_size gf_pool_ntasks (GT_size N)
+{
+    GT_size ntasks = gf_pool_threads();
+    GT_size nchunk = N / GTOOLS_THREADS_MINCHUNK;
+    if ( ntasks > nchunk ) ntasks = nchunk;
+    return (ntasks < 1? 1: ntasks);
+}
+
+/**
+ * @brief Contiguous range [start, end) for the kth of ntasks chunks of N
+ */
+void gf_pool_split (
+    GT_size N,
+    GT_size ntasks,
+    GT_size k,
+    GT_size *start,
+    GT_size *end)
+{
+    GT_size step = N / ntasks;
+    GT_size rem  = N % ntasks;
+    *start = k * step + (k < rem? k: rem);
+    *end   = *start + step + (k < rem? 1: 0);
+}
+
+/**
+ * @brief Number of workers to use for gf_pool_steal
+ *
+ * One worker per thread, but no more workers than items, and a single
+ * worker if the total cost is below GTOOLS_THREADS_MINCHUNK.
+ *
+ * @param nitems Number of items
+ * @param totalcost Total cost of all the items
+ * @return Number of workers, at least 1
+ */
+GT_size gf_pool_steal_workers (GT_size nitems, GT_size totalcost)
+{
+    GT_size nworkers = gf_pool_threads();
+    if ( totalcost < GTOOLS_THREADS_MINCHUNK ) nworkers = 1;
+    if ( nworkers > nitems ) nworkers = nitems;
+    return (nworkers < 1? 1: nworkers);
+}
+
+/**
+ * @brief Run fun on every item using work stealing
+ *
+ * Items are split into nworkers contiguous ranges of about equal total
+ * cost, one per worker. fun(context, worker, item) is called exactly once
+ * per item; worker is in [0, nworkers), and no two calls with the same
+ * worker run at the same time. Stops early if fun returns an error.
+ *
+ * @param fun Function to run on each item
+ * @param context Passed to fun as is
+ * @param cost Cost of each item (e.g. number of observations)
+ * @param nitems Number of items
+ * @param nworkers Number of workers (see gf_pool_steal_workers)
+ * @return First non-zero return code from fun, if any
+ */
+ST_retcode gf_pool_steal (
+    GT_steal_fun fun,
+    void *context,
+    GT_size *cost,
+    GT_size nitems,
+    GT_size nworkers)
+{
+    GT_size i, w, total, target, running;
+    ST_retcode rc;
+
+    struct GtoolsSteal steal;
+    struct GtoolsStealRange *ranges = calloc(nworkers, sizeof *ranges);
+    struct sInfo *sinfo = calloc(nworkers, sizeof *sinfo);
+
+    if ( (ranges == NULL) || (sinfo == NULL) ) {
+        free (ranges);
+        free (sinfo);
+        return (sf_oom_error("gf_pool_steal", ranges == NULL? "ranges": "sinfo"));
+    }
+
+    total = 0;
+    for (i = 0; i < nitems; i++)
+        total += cost[i];
+
+    // Worker w's range ends once the running cost reaches (w + 1) / nworkers
+    // of the total (and every worker gets at least one item)
+    i = running = 0;
+    for (w = 0; w < nworkers; w++) {
+        ranges[w].lo   = i;
+        ranges[w].left = running;
+        if ( w == nworkers - 1 ) {
+            i       = nitems;
+            running = total;
+        }
+        else {
+            target = (GT_size) ((ST_double) total * (w + 1) / nworkers);
+            do {
+                running += cost[i++];
+            } while ( (running < target) && (nitems - i > nworkers - w - 1) );
+        }
+        ranges[w].hi   = i;
+        ranges[w].left = running - ranges[w].left;
+#if GMULTI
+        pthread_mutex_init (&(ranges[w].lock), NULL);
+#endif
+    }
+
+    steal.fun      = fun;
+    steal.context  = context;
+    steal.cost     = cost;
+    steal.nworkers = nworkers;
+    steal.ranges   = ranges;
+    steal.rc       = 0;
+#if GMULTI
+    pthread_mutex_init (&(steal.lock), NULL);
+#endif
+
+    for (w = 0; w < nworkers; w++) {
+        sinfo[w].steal  = &steal;
+        sinfo[w].worker = w;
+    }
+
+    gf_pool_run (gf_pool_steal_worker, sinfo, sizeof *sinfo, nworkers);
+    rc = steal.rc;
+
+#if GMULTI
+    for (w = 0; w < nworkers; w++)
+        pthread_mutex_destroy (&(ranges[w].lock));
+    pthread_mutex_destroy (&(steal.lock));
+#endif
+
+    free (ranges);
+    free (sinfo);
+
+    return (rc);
+}
+
+static void* gf_pool_steal_worker (void *argument)
+{
+    struct sInfo *sinfo = ((struct sInfo *) argument);
+    struct GtoolsSteal *steal = sinfo->steal;
+    GT_size i, lo, hi;
+    ST_retcode rc;
+
+    while ( (gf_pool_steal_rc(steal, 0) == 0) && gf_pool_steal_pop(steal, sinfo->worker, &lo, &hi) ) {
+        for (i = lo; i < hi; i++) {
+            if ( (rc = steal->fun(steal->context, sinfo->worker, i)) ) {
+                gf_pool_steal_rc(steal, rc);
+                break;
+            }
+        }
+    }
+
+    return (NULL);
+}
+
+/**
+ * @brief Return code of the first item that failed
+ *
+ * @param rc If non-zero and no item has failed yet, record @rc
+ * @return First non-zero return code recorded, or 0
+ */
+static ST_retcode gf_pool_steal_rc (struct GtoolsSteal *steal, ST_retcode rc)
+{
+#if GMULTI
+    pthread_mutex_lock (&(steal->lock));
+#endif
+    if ( steal->rc == 0 ) steal->rc = rc;
+    rc = steal->rc;
+#if GMULTI
+    pthread_mutex_unlock (&(steal->lock));
+#endif
+    return (rc);
+}
+
+/**
+ * @brief Next batch of items [lo, hi) for worker (steals if need be)
+ *
+ * The victim is the range with the most cost left, not the most items,
+ * and the thief takes items from its back until it has about half that
+ * cost (always at least one item). A single expensive item at the front
+ * thus stays with its owner while the cheap items behind it are shared.
+ *
+ * @return 1 if there was a batch, 0 if every range is empty
+ */
+static GT_bool gf_pool_steal_pop (
+    struct GtoolsSteal *steal,
+    GT_size worker,
+    GT_size *lo,
+    GT_size *hi)
+{
+    GT_size v, victim, mid, most, taken, running;
+    GT_bool found;
+    struct GtoolsStealRange *own = steal->ranges + worker, *range;
+
+    while ( 1 ) {
+
+        // Take a batch from the front of our own range
+        // --------------------------------------------
+
+#if GMULTI
+        pthread_mutex_lock (&(own->lock));
+#endif
+        if ( own->lo < own->hi ) {
+            *lo = own->lo;
+            running = 0;
+            do {
+                running += steal->cost[own->lo++];
+            } while ( (running < GTOOLS_STEAL_GRAIN) && (own->lo < own->hi) );
+            *hi = own->lo;
+            own->left -= running;
+#if GMULTI
+            pthread_mutex_unlock (&(own->lock));
+#endif
+            return (1);
+        }
+#if GMULTI
+        pthread_mutex_unlock (&(own->lock));
+#endif
+
+        // Steal half the cost left in the costliest remaining range
+        // ---------------------------------------------------------
+
+        found  = 0;
+        most   = 0;
+        victim = worker;
+        for (v = 0; v < steal->nworkers; v++) {
+            range = steal->ranges + v;
+#if GMULTI
+            pthread_mutex_lock (&(range->lock));
+#endif
+            if ( (range->lo < range->hi) && (!found || (range->left > most)) ) {
+                found  = 1;
+                most   = range->left;
+                victim = v;
+            }
+#if GMULTI
+            pthread_mutex_unlock (&(range->lock));
+#endif
+        }
+
+        if ( !found ) return (0);
+
+        range = steal->ranges + victim;
+#if GMULTI
+        pthread_mutex_lock (&(range->lock));
+#endif
+        if ( range->lo >= range->hi ) {
+#if GMULTI
+            pthread_mutex_unlock (&(range->lock));
+#endif
+            continue;
+        }
+
+        mid   = range->hi;
+        taken = 0;
+        do {
+            taken += steal->cost[--mid];
+        } while ( (mid > range->lo) && (2 * (taken + steal->cost[mid - 1]) <= range->left) );
+
+        *lo = mid;
+        *hi = range->hi;
+        range->hi    = mid;
+        range->left -= taken;
+#if GMULTI
+        pthread_mutex_unlock (&(range->lock));
+        pthread_mutex_lock (&(own->lock));
+#endif
+        own->lo   = *lo;
+        own->hi   = *hi;
+        own->left = taken;
+#if GMULTI
+        pthread_mutex_unlock (&(own->lock));
+#endif
+    }
+}
+
+/**
+ * @brief Run ntasks tasks on the shared pool and wait for them to finish
+ *
+ * Task k calls fun(args + k * argsize). The calling thread takes tasks
+ * as well. If there is no pool, or only one thread or task, everything
+ * runs serially in the calling thread. Nested calls (i.e. from inside a
+ * task) also run serially, so tasks may call functions that use the pool.
+ *
+ * @param fun Function to run
+ * @param args Array of ntasks arguments, each argsize bytes
+ * @param argsize Size of each argument
+ * @param ntasks Number of tasks
+ * @return Runs fun on every argument
+ */
+void gf_pool_run (
+    GT_pool_fun fun,
+    void *args,
+    size_t argsize,
+    GT_size ntasks)
+{
+    GT_size k;
+    struct GtoolsPool *pool = GtoolsThreadPool;
+
+    if ( (pool == NULL) || (pool->nthreads < 2) || (ntasks < 2) ) {
+        for (k = 0; k < ntasks; k++)
+            fun((char *) args + k * argsize);
+        return;
+    }
+
+#if GMULTI
+    pthread_mutex_lock (&(pool->lock));
+    if ( pool->busy ) {
+        pthread_mutex_unlock (&(pool->lock));
+        for (k = 0; k < ntasks; k++)
+            fun((char *) args + k * argsize);
+        return;
+    }
+
+    pool->busy    = 1;
+    pool->fun     = fun;
+    pool->args    = (char *) args;
+    pool->argsize = argsize;
+    pool->ntasks  = ntasks;
+    pool->next    = 0;
+    pool->pending = ntasks;
+    pthread_cond_broadcast (&(pool->work));
+
+    gf_pool_take (pool);
+    while ( pool->pending > 0 )
+        pthread_cond_wait (&(pool->done), &(pool->lock));
+
+    pool->busy   = 0;
+    pool->fun    = NULL;
+    pool->args   = NULL;
+    pool->ntasks = 0;
+    pool->next   = 0;
+    pthread_mutex_unlock (&(pool->lock));
+#endif
+}
+
+#if GMULTI
+
+/**
+ * @brief Run queued tasks until none are left (lock must be held)
+ */
+static void gf_pool_take (struct GtoolsPool *pool)
+{
+    GT_size k;
+    GT_pool_fun fun;
+    char *arg;
+
+    while ( pool->next < pool->ntasks ) {
+        k   = pool->next++;
+        fun = pool->fun;
+        arg = pool->args + k * pool->argsize;
+        pthread_mutex_unlock (&(pool->lock));
+
+        fun(arg);
+
+        pthread_mutex_lock (&(pool->lock));
+        if ( --(pool->pending) == 0 )
+            pthread_cond_broadcast (&(pool->done));
+    }
+}
+
+static void* gf_pool_worker (void *argument)
+{
+    struct GtoolsPool *pool = ((struct GtoolsPool *) argument);
+
+    pthread_mutex_lock (&(pool->lock));
+    while ( 1 ) {
+        while ( !pool->shutdown && (pool->next >= pool->ntasks) )
+            pthread_cond_wait (&(pool->work), &(pool->lock));
+
+        if ( pool->shutdown ) break;
+        gf_pool_take (pool);
+    }
+    pthread_mutex_unlock (&(pool->lock));
+
+    return (NULL);
+}
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef GTOOLS_THREADS
+#define GTOOLS_THREADS
+
+/*
+ * Persistent worker pool
+ * ----------------------
+ *
+ * The pool is started by the first plugin call (in sf_parse_info) and
+ * shared by every parallel stage. Its workers sleep between calls; the
+ * pool is only restarted when a call asks for a different number of
+ * threads. Work is submitted as ntasks independent tasks;
+ * task k receives a pointer to the kth element of an argument array. The
+ * calling thread also takes tasks, so a pool with nthreads threads only
+ * spawns nthreads - 1 workers. In the single-threaded plugin (GMULTI not
+ * defined) tasks simply run serially in the calling thread.
+ */
+
+// Cap on the number of threads we will spawn
+#define GTOOLS_THREADS_MAX 256
+
+// Do not split work into chunks smaller than this many elements
+#define GTOOLS_THREADS_MINCHUNK 65536
+
+typedef void* (*GT_pool_fun) (void *argument);
+
+struct GtoolsPool {
+    GT_size     nthreads;
+    GT_size     ntasks;
+    GT_size     next;
+    GT_size     pending;
+    GT_bool     shutdown;
+    GT_bool     busy;
+    GT_pool_fun fun;
+    char        *args;
+    size_t      argsize;
+#if GMULTI
+    pthread_t       *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t  work;
+    pthread_cond_t  done;
+#endif
+};
+
+/*
+ * Work stealing
+ * -------------
+ *
+ * For items of very uneven cost (e.g. groups of very different sizes)
+ * gf_pool_steal gives each of nworkers workers a contiguous range of
+ * items with roughly the same total cost. Workers take batches of about
+ * GTOOLS_STEAL_GRAIN cost units from the front of their own range; once
+ * it is empty they steal about half the remaining cost of the range with
+ * the most cost left, from its back.
+ * The item function is told which worker is running it, so workers can
+ * keep their own scratch space.
+ */
+
+// Batch size (in cost units) a worker takes from its own range at a time
+#define GTOOLS_STEAL_GRAIN 16384
+
+typedef ST_retcode (*GT_steal_fun) (void *context, GT_size worker, GT_size item);
+
+// lo, hi, and left (the cost of items lo to hi - 1) are only read or
+// written while holding lock
+struct GtoolsStealRange {
+    GT_size lo;
+    GT_size hi;
+    GT_size left;
+#if GMULTI
+    pthread_mutex_t lock;
+#endif
+};
+
+// rc is only read or written while holding lock
+struct GtoolsSteal {
+    GT_steal_fun fun;
+    void         *context;
+    GT_size      *cost;
+    GT_size      nworkers;
+    struct GtoolsStealRange *ranges;
+    ST_retcode   rc;
+#if GMULTI
+    pthread_mutex_t lock;
+#endif
+};
+
+struct sInfo {
+    struct GtoolsSteal *steal;
+    GT_size worker;
+};
+
+ST_retcode gf_pool_init (GT_size nthreads);
+void       gf_pool_free (void);
+GT_size    gf_pool_threads (void);
+GT_size    gf_pool_ntasks (GT_size N);
+
+void gf_pool_run (
+    GT_pool_fun fun,
+    void *args,
+    size_t argsize,
+    GT_size ntasks
+);
+
+GT_size gf_pool_steal_workers (GT_size nitems, GT_size totalcost);
+
+ST_retcode gf_pool_steal (
+    GT_steal_fun fun,
+    void *context,
+    GT_size *cost,
+    GT_size nitems,
+    GT_size nworkers
+);
+
+void gf_pool_split (
+    GT_size N,
+    GT_size ntasks,
+    GT_size k,
+    GT_size *start,
+    GT_size *end
+);
+
+#endif
@@ -20,6 +20,10 @@ ST_retcode sf_xtile (struct StataInfo *st_info, int level)
     GT_bool method = st_info->xtile_method;
     ST_double m1_etime, m2_etime, m_ratio;
 
+    // Method 3 (approx) reads the source into a sketch instead of memory
+    struct GtoolsSketch sketch;
+    gf_sketch_init (&sketch, gf_sketch_k(st_info->approx_eps));
+
     GT_size nq      = st_info->xtile_nq;
     GT_size nq2     = st_info->xtile_nq2;
     GT_size ncuts   = st_info->xtile_ncuts;
@@ -64,7 +68,7 @@ ST_retcode sf_xtile (struct StataInfo *st_info, int level)
      *********************************************************************/
 
     GT_size kx = kgen? 3: 1;
-    GT_size xmem_sources = kx * Nread;
+    GT_size xmem_sources = (method == 3)? 1: kx * Nread;
     GT_size xmem_quant   = nout;
     GT_size xmem_points  = cutvars? (st_info->xtile_cutifin? Nread + 1: SF_nobs() + 1): 1;
     GT_size xmem_quants  = qvars? (st_info->xtile_cutifin? Nread + 1: SF_nobs() + 1): 1;
@@ -192,6 +196,7 @@ ST_retcode sf_xtile (struct StataInfo *st_info, int level)
         }
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_STATS);
     if ( st_info->benchmark > 1 ) {
         if ( (ncuts > 0) || (npoints > 0) ) {
             sf_running_timer (&timer, "\txtile step 1: De-duplicated cutoff list");
@@ -282,13 +287,16 @@ ST_retcode sf_xtile (struct StataInfo *st_info, int level)
             method = 1;
         }
     }
-    else if ( (method != 1) & (method != 2) ) {
+    else if ( (method != 1) & (method != 2) & (method != 3) ) {
         method = 1;
     }
 
     // method = 0; // expected optimal
     // method = 1; // qsort, default
     // method = 2; // qselect
+    // method = 3; // sketch (approx)
+
+    st_info->telemetry->quantiles = (method == 3)? "sketch": ((method == 2)? "qselect": "qsort");
 
     /*********************************************************************
      *                   Read in the source variables                    *
@@ -299,7 +307,27 @@ ST_retcode sf_xtile (struct StataInfo *st_info, int level)
     obs   = 0;
     xptr2 = xsources;
     ixptr = xsources;
-    if ( method == 2 ) {
+    xmin  = xmax = SV_missval;
+    if ( method == 3 ) {
+        // One pass; the xtile or bin counts are computed from a second
+        // pass once we have the quantiles.
+        for (i = 0; i < Nread; i++) {
+            if ( st_info->any_if && !SF_ifobs(i + in1) ) continue;
+            if ( (rc = SF_vdata(start_xsources,
+                                i + in1,
+                                &z)) ) goto error;
+            if ( SF_is_missing(z) ) continue;
+            if ( (rc = gf_sketch_update(&sketch, z)) ) goto error;
+            if ( obs++ == 0 ) {
+                xmin = xmax = z;
+            }
+            else {
+                if ( xmin > z ) xmin = z;
+                if ( xmax < z ) xmax = z;
+            }
+        }
+    }
+    else if ( method == 2 ) {
         xptr2 = kgen? xsources + 1 * Nread: xsources;
         ixptr = kgen? xsources + 2 * Nread: xsources;
         if ( st_info->any_if ) {
@@ -427,6 +455,7 @@ ST_retcode sf_xtile (struct StataInfo *st_info, int level)
         }
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_READ);
     if ( st_info->benchmark > 1 )
         sf_running_timer (&timer, "\txtile step 2: Read in source variable");
 
@@ -437,7 +466,7 @@ ST_retcode sf_xtile (struct StataInfo *st_info, int level)
      *********************************************************************/
 
     GT_size xmem_count  = (pctpct | bincount)? nout: 1;
-    GT_size xmem_output = (kgen & (method != 2))? N: 1;
+    GT_size xmem_output = (kgen & (method == 1))? N: 1;
 
     GT_size   *xcount   = calloc(xmem_count,   sizeof *xcount);
     ST_double *xoutput  = calloc(xmem_output,  sizeof *xoutput);
@@ -456,14 +485,19 @@ ST_retcode sf_xtile (struct StataInfo *st_info, int level)
 
     // Check if already sorted
     i = 0;
-    for (xptr = xsources;
-         xptr < xsources + kx * (N - 1);
-         xptr += kx, i++) {
-        if ( *xptr > *(xptr + kx) ) break;
+    if ( method != 3 ) {
+        for (xptr = xsources;
+             xptr < xsources + kx * (N - 1);
+             xptr += kx, i++) {
+            if ( *xptr > *(xptr + kx) ) break;
+        }
     }
     i++;
 
-    if ( method == 2 ) {
+    if ( method == 3 ) {
+        sorted = 0;
+    }
+    else if ( method == 2 ) {
         if ( i >= N ) {
             sorted = 2;
         }
@@ -550,6 +584,20 @@ ST_retcode sf_xtile (struct StataInfo *st_info, int level)
             }
         }
     }
+    else if ( method == 3 ) {
+        if ( nquants > 0 ) {
+            gf_quantiles_sketch (xquants, &sketch, xquants, nquants, xmax);
+            qptr = xquants;
+        }
+        else if ( nq2 > 0 ) {
+            gf_quantiles_sketch (xquant, &sketch, st_info->xtile_quantiles, nq2, xmax);
+            qptr = xquant;
+        }
+        else if ( nq > 0 ) {
+            gf_quantiles_nq_sketch (xquant, &sketch, nq, xmax);
+            qptr = xquant;
+        }
+    }
     else {
         if ( (method == 2) & (sorted < 2) ) {
             if ( nquants > 0 ) {
@@ -581,7 +629,10 @@ ST_retcode sf_xtile (struct StataInfo *st_info, int level)
         }
     }
 
-    if ( method == 2 ) {
+    if ( method == 3 ) {
+        // min and max were tracked while reading the source
+    }
+    else if ( method == 2 ) {
         xmin = gf_array_dmin_range(xptr2, 0, N);
         xmax = qptr[nout - 1];
     }
@@ -590,8 +641,12 @@ ST_retcode sf_xtile (struct StataInfo *st_info, int level)
         xmax = qptr[nout - 1];
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_STATS);
     if ( st_info->benchmark > 1 ) {
-        if ( method == 2 ) {
+        if ( method == 3 ) {
+            sf_running_timer (&timer, "\txtile step 3: Computed quantiles from sketch");
+        }
+        else if ( method == 2 ) {
             if ( (nq2 > 0) | (nq > 0) | (nquants > 0) ) {
                 sf_running_timer (&timer, "\txtile step 3: Computed quantiles");
             }
@@ -612,7 +667,27 @@ ST_retcode sf_xtile (struct StataInfo *st_info, int level)
      *********************************************************************/
 
     q = 0;
-    if ( kgen ) {
+    if ( method == 3 ) {
+        if ( kgen | pctpct | bincount ) {
+            for (i = 0; i < Nread; i++) {
+                if ( st_info->any_if && !SF_ifobs(i + in1) ) continue;
+                if ( (rc = SF_vdata(start_xsources,
+                                    i + in1,
+                                    &z)) ) goto exit;
+                if ( SF_is_missing(z) ) continue;
+                q = gf_xtile_bin (qptr, nout, z);
+                if ( bincount | pctpct ) xcount[q]++;
+                if ( kgen ) {
+                    if ( (rc = SF_vstore(start_xtile, i + in1, q + 1)) ) goto exit;
+                }
+            }
+
+            gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_STATS);
+            if ( st_info->benchmark > 1 )
+                sf_running_timer (&timer, "\txtile step 4: Binned source variable from quantiles");
+        }
+    }
+    else if ( kgen ) {
         if ( method == 2 ) {
             if ( sorted ) {
                 if ( bincount | pctpct ) {
@@ -647,6 +722,7 @@ ST_retcode sf_xtile (struct StataInfo *st_info, int level)
                 }
             }
 
+            gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_STATS);
             if ( st_info->benchmark > 2 )
                 sf_running_timer (&stimer, "\t\txtile step 4.1: Computed xtile");
 
@@ -663,6 +739,7 @@ ST_retcode sf_xtile (struct StataInfo *st_info, int level)
                 }
             }
 
+            gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_WRITE);
             if ( st_info->benchmark > 2 )
                 sf_running_timer (&stimer, "\t\txtile step 4.2: Copied xtile to Stata sequentially");
 
@@ -687,6 +764,7 @@ ST_retcode sf_xtile (struct StataInfo *st_info, int level)
                 }
             }
 
+            gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_STATS);
             if ( st_info->benchmark > 2 )
                 sf_running_timer (&stimer, "\t\txtile step 4.1: Computed xtile");
 
@@ -699,6 +777,7 @@ ST_retcode sf_xtile (struct StataInfo *st_info, int level)
                     xsources[kx * ((GT_size) *(xptr + kx - 1))] = *(xptr + 1);
                 }
 
+                gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_STATS);
                 if ( st_info->benchmark > 2 )
                     sf_running_timer (&stimer, "\t\txtile step 4.2: Arranged xtile in memory");
             }
@@ -716,6 +795,7 @@ ST_retcode sf_xtile (struct StataInfo *st_info, int level)
                 }
             }
 
+            gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_WRITE);
             if ( st_info->benchmark > 2 )
                 sf_running_timer (&stimer, "\t\txtile step 4.3: Copied xtile to Stata sequentially");
 
@@ -824,6 +904,7 @@ ST_retcode sf_xtile (struct StataInfo *st_info, int level)
     }
     if ( (rc = SF_scal_save ("__gtools_xtile_method", m_ratio)) ) goto exit;
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_WRITE);
     if ( st_info->benchmark > 1 ) {
         if ( kgen ) {
             if ( pctile | (nq2 > 0) ) {
@@ -850,6 +931,7 @@ error:
     free (xquant);
     free (xpoints);
     free (xquants);
+    gf_sketch_free (&sketch);
 
     return (rc);
 }
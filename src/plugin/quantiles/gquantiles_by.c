@@ -284,6 +284,7 @@ ST_retcode sf_xtile_by (struct StataInfo *st_info, int level)
         }
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_STATS);
     if ( st_info->benchmark > 1 ) {
         if ( (ncuts > 0) || (npoints > 0) ) {
             sf_running_timer (&timer, "\txtile step 1: De-duplicated cutoff list");
@@ -302,6 +303,7 @@ ST_retcode sf_xtile_by (struct StataInfo *st_info, int level)
     nout = GTOOLS_PWMAX(nout, (nquants + 1));
 
     // method ignored and everything is sorted! may bring back method later.
+    st_info->telemetry->quantiles = "qsort";
 
     /*********************************************************************
      *                   Read in the source variables                    *
@@ -520,6 +522,7 @@ ST_retcode sf_xtile_by (struct StataInfo *st_info, int level)
         goto error;
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_READ);
     if ( st_info->benchmark > 1 )
         sf_running_timer (&timer, "\txtile step 2: Read in source variable");
 
@@ -795,6 +798,7 @@ ST_retcode sf_xtile_by (struct StataInfo *st_info, int level)
         }
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_SORT);
     if ( st_info->benchmark > 1 )
         sf_running_timer (&stimer, "\txtile step 3: Sorted inputs by group");
 
@@ -894,6 +898,7 @@ ST_retcode sf_xtile_by (struct StataInfo *st_info, int level)
             }
         }
 
+        gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_STATS);
         if ( st_info->benchmark > 2 )
             sf_running_timer (&stimer, "\t\txtile step 4.1: Computed xtile and pctile");
 
@@ -911,6 +916,7 @@ ST_retcode sf_xtile_by (struct StataInfo *st_info, int level)
             }
         }
 
+        gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_WRITE);
         if ( st_info->benchmark > 2 )
             sf_running_timer (&stimer, "\t\txtile step 4.2: Copied xtile to Stata sequentially");
 
@@ -971,6 +977,7 @@ ST_retcode sf_xtile_by (struct StataInfo *st_info, int level)
             }
         }
 
+        gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_STATS);
         if ( st_info->benchmark > 2 )
             sf_running_timer (&stimer, "\t\txtile step 4.1: Computed xtile");
 
@@ -988,6 +995,7 @@ ST_retcode sf_xtile_by (struct StataInfo *st_info, int level)
             }
         }
 
+        gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_WRITE);
         if ( st_info->benchmark > 2 )
             sf_running_timer (&stimer, "\t\txtile step 4.2: Copied xtile to Stata sequentially");
 
@@ -1115,6 +1123,7 @@ ST_retcode sf_xtile_by (struct StataInfo *st_info, int level)
         sf_printf_debug("debug 18: everything should be in Stata\n");
     }
 
+    gf_telemetry_lap (st_info->telemetry, GTOOLS_STAGE_WRITE);
     if ( st_info->benchmark ) {
         if ( kgen ) {
             if ( pctile ) {
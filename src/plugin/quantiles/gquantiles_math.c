@@ -374,19 +374,19 @@ void gf_quantiles_nq_qselect (
             rfoo = (i + 1) % nqdiv;
             if ( rfoo ) {
                 q = ceil((i + 1) * Ndbl / nqdbl) - 1;
-                qout[i] = gf_qselect_xtile (x + qstart, 0, N - qstart, q - qstart);
+                qout[i] = gf_qselect_range (x + qstart, 0, N - qstart, q - qstart);
                 qstart = q;
             }
             else {
                 q   = Ndbl * ((i + 1) / nqdbl) - 1;
-                qlo = gf_qselect_xtile (
+                qlo = gf_qselect_range (
                     x + qstart,
                     0,
                     N - qstart,
                     q - qstart
                 );
                 qstart = q;
-                qhi = gf_qselect_xtile (
+                qhi = gf_qselect_range (
                     x + qstart,
                     0,
                     N - qstart,
@@ -400,14 +400,14 @@ void gf_quantiles_nq_qselect (
         Ndiv = N / nquants;
         for (i = 1; i < nquants; i++) {
             q   = i * Ndiv - 1;
-            qlo = gf_qselect_xtile (
+            qlo = gf_qselect_range (
                 x + qstart,
                 0,
                 N - qstart,
                 q - qstart
             );
             qstart = q;
-            qhi = gf_qselect_xtile (
+            qhi = gf_qselect_range (
                 x + qstart,
                 0,
                 N - qstart,
@@ -458,14 +458,14 @@ void gf_quantiles_qselect (
             rfoo = ((qfoo * 100 / Ndbl) == quants[i]);
             if ( rfoo ) {
                 q   = qfoo - 1;
-                qlo = gf_qselect_xtile (
+                qlo = gf_qselect_range (
                     x + qstart,
                     0,
                     N - qstart,
                     q - qstart
                 );
                 qstart = q;
-                qhi = gf_qselect_xtile (
+                qhi = gf_qselect_range (
                     x + qstart,
                     0,
                     N - qstart,
@@ -475,7 +475,7 @@ void gf_quantiles_qselect (
             }
             else {
                 q = ceil(qdbl) - 1;
-                qout[i] = gf_qselect_xtile (x + qstart, 0, N - qstart, q - qstart);
+                qout[i] = gf_qselect_range (x + qstart, 0, N - qstart, q - qstart);
                 qstart = q;
             }
         }
@@ -488,14 +488,14 @@ void gf_quantiles_qselect (
             rfoo = ((qfoo / Ndiv) == quants[i]);
             if ( rfoo ) {
                 q = qfoo - 1;
-                qlo = gf_qselect_xtile (
+                qlo = gf_qselect_range (
                     x + qstart,
                     0,
                     N - qstart,
                     q - qstart
                 );
                 qstart = q;
-                qhi = gf_qselect_xtile (
+                qhi = gf_qselect_range (
                     x + qstart,
                     0,
                     N - qstart,
@@ -505,7 +505,7 @@ void gf_quantiles_qselect (
             }
             else {
                 q = ceil(qdbl) - 1;
-                qout[i] = gf_qselect_xtile (x + qstart, 0, N - qstart, q - qstart);
+                qout[i] = gf_qselect_range (x + qstart, 0, N - qstart, q - qstart);
                 qstart = q;
             }
         }
@@ -542,14 +542,14 @@ void gf_quantiles_nq_qselect_altdef (
                     if ( rfoo ) {
                         qdiff   = (qdbl - q);
                         q--;    
-                        qlo     = gf_qselect_xtile(x + qstart, 0, N - qstart, q - qstart);
+                        qlo     = gf_qselect_range (x + qstart, 0, N - qstart, q - qstart);
                         qstart  = q;
-                        qhi     = gf_qselect_xtile(x + qstart, 0, N - qstart, 1);
+                        qhi     = gf_qselect_range (x + qstart, 0, N - qstart, 1);
                         qout[i] = (qlo == qhi)? qlo: (1 - qdiff) * qlo + qdiff * qhi;
                     }
                     else {
                         q--;
-                        qout[i] = gf_qselect_xtile(x + qstart, 0, N - qstart, q - qstart);
+                        qout[i] = gf_qselect_range (x + qstart, 0, N - qstart, q - qstart);
                         qstart  = q;
                     }
                 }
@@ -566,7 +566,7 @@ void gf_quantiles_nq_qselect_altdef (
         Ndiv = (N + 1) / nquants;
         for (i = 1; i < nquants; i++) {
             q = i * Ndiv - 1;
-            qout[i - 1] = gf_qselect_xtile(x + qstart, 0, N - qstart, q - qstart);
+            qout[i - 1] = gf_qselect_range (x + qstart, 0, N - qstart, q - qstart);
             qstart = q;
         }
     }
@@ -604,15 +604,15 @@ void gf_quantiles_qselect_altdef (
 
                     if ( rfoo ) {
                         q        = qfoo - 1;
-                        qout[i]  = gf_qselect_xtile(x + qstart, 0, N - qstart, q - qstart);
+                        qout[i]  = gf_qselect_range (x + qstart, 0, N - qstart, q - qstart);
                         qstart   = q;
                     }
                     else {
                         qdiff   = (qdbl - q);
                         q--;
-                        qlo     = gf_qselect_xtile(x + qstart, 0, N - qstart, q - qstart);
+                        qlo     = gf_qselect_range (x + qstart, 0, N - qstart, q - qstart);
                         qstart  = q;
-                        qhi     = gf_qselect_xtile(x + qstart, 0, N - qstart, 1);
+                        qhi     = gf_qselect_range (x + qstart, 0, N - qstart, 1);
                         qout[i] = (qlo == qhi)? qlo: (1 - qdiff) * qlo + qdiff * qhi;
                     }
                 }
@@ -636,15 +636,15 @@ void gf_quantiles_qselect_altdef (
 
                     if ( rfoo ) {
                         q        = qfoo - 1;
-                        qout[i]  = gf_qselect_xtile(x + qstart, 0, N - qstart, q - qstart);
+                        qout[i]  = gf_qselect_range (x + qstart, 0, N - qstart, q - qstart);
                         qstart   = q;
                     }
                     else {
                         qdiff   = (qdbl - q);
                         q--;    
-                        qlo     = gf_qselect_xtile(x + qstart, 0, N - qstart, q - qstart);
+                        qlo     = gf_qselect_range (x + qstart, 0, N - qstart, q - qstart);
                         qstart  = q;
-                        qhi     = gf_qselect_xtile(x + qstart, 0, N - qstart, 1);
+                        qhi     = gf_qselect_range (x + qstart, 0, N - qstart, 1);
                         qout[i] = (qlo == qhi)? qlo: (1 - qdiff) * qlo + qdiff * qhi;
                     }
                 }
@@ -659,3 +659,39 @@ void gf_quantiles_qselect_altdef (
     }
     qout[nquants] = gf_array_dmax_range(x, qstart, N);
 }
+
+/*********************************************************************
+ *                  Approximate quantiles (sketch)                   *
+ *********************************************************************/
+
+// Same output as gf_quantiles_nq and gf_quantiles, but the quantiles are
+// read off a sketch of the source (see gtools_sketch.h), so each is only
+// within the sketch's rank error. The last entry is the max, as above.
+
+void gf_quantiles_nq_sketch (
+    ST_double *qout,
+    struct GtoolsSketch *sketch,
+    GT_size nquants,
+    ST_double xmax)
+{
+    GT_size i;
+    ST_double nqdbl = (ST_double) nquants;
+    for (i = 0; i < (nquants - 1); i++) {
+        qout[i] = gf_sketch_quantile(sketch, 100 * (i + 1) / nqdbl);
+    }
+    qout[nquants - 1] = xmax;
+}
+
+void gf_quantiles_sketch (
+    ST_double *qout,
+    struct GtoolsSketch *sketch,
+    ST_double *quants,
+    GT_size nquants,
+    ST_double xmax)
+{
+    GT_size i;
+    for (i = 0; i < nquants; i++) {
+        qout[i] = gf_sketch_quantile(sketch, quants[i]);
+    }
+    qout[nquants] = xmax;
+}
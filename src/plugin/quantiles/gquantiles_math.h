@@ -70,4 +70,19 @@ GT_size gf_quantiles_gcd (
     GT_size b
 );
 
+void gf_quantiles_nq_sketch (
+    ST_double *qout,
+    struct GtoolsSketch *sketch,
+    GT_size nquants,
+    ST_double xmax
+);
+
+void gf_quantiles_sketch (
+    ST_double *qout,
+    struct GtoolsSketch *sketch,
+    ST_double *quants,
+    GT_size nquants,
+    ST_double xmax
+);
+
 #endif
@@ -67,3 +67,25 @@ GT_size gf_xtile_clean (
         return (lsize);
     }
 }
+
+/**
+ * @brief Bin of a value given sorted cutoffs
+ *
+ * @param cutoffs Sorted cutoffs; the last one is the max of the data
+ * @param ncuts Number of cutoffs
+ * @param z Value to bin
+ * @return First q such that z <= cutoffs[q] (0-indexed)
+ */
+GT_size gf_xtile_bin (
+    ST_double *cutoffs,
+    GT_size ncuts,
+    ST_double z)
+{
+    GT_size lo = 0, hi = ncuts - 1, mid;
+    while ( lo < hi ) {
+        mid = lo + (hi - lo) / 2;
+        if ( z > cutoffs[mid] ) lo = mid + 1;
+        else hi = mid;
+    }
+    return (lo);
+}
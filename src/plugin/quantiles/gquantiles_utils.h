@@ -8,4 +8,10 @@ GT_size gf_xtile_clean (
     GT_bool dedup
 );
 
+GT_size gf_xtile_bin (
+    ST_double *cutoffs,
+    GT_size ncuts,
+    ST_double z
+);
+
 #endif